@@ -29,6 +29,7 @@ if [ "$SPECIFIC_TEST" = "-h" ] || [ "$SPECIFIC_TEST" = "--help" ]; then
     echo "  semantic       - Run semantic equivalence tests"
     echo "  correctness    - Run CPU-specific correctness tests"
     echo "  performance    - Run performance validation tests"
+    echo "  library        - Run library API tests"
     echo
     echo "Without arguments, all available test suites will be run."
     exit 0
@@ -74,7 +75,8 @@ run_suite() {
 
     SUITES_RUN=$((SUITES_RUN + 1))
 
-    if eval "$suite_command"; then
+    # In a subshell, so a suite that changes directory does not move the next one
+    if (eval "$suite_command"); then
         echo -e "${GREEN}✓ $suite_name PASSED${NC}"
     else
         echo -e "${RED}✗ $suite_name FAILED${NC}"
@@ -183,12 +185,18 @@ if should_run_suite "performance"; then
     fi
 fi
 
+# 6. Run library API tests
+if should_run_suite "library"; then
+    SUITE_FOUND=true
+    run_suite "library" "Library API Tests" "tests/lib/run_lib_tests.sh"
+fi
+
 # Check if the requested specific test was found
 if [ -n "$SPECIFIC_TEST" ] && [ "$SUITE_FOUND" = false ]; then
     echo -e "${RED}Error: Unknown test suite '$SPECIFIC_TEST'${NC}"
     echo
     echo "Available test suites:"
-    echo "  regression, idempotence, semantic, correctness, performance"
+    echo "  regression, idempotence, semantic, correctness, performance, library"
     echo
     echo "Use --help for more information"
     exit 1
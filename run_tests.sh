@@ -21,6 +21,17 @@ for testdir in tests/*; do
         45gs02_opt)
             cpu="-cpu 45gs02"
             ;;
+        65816_opt)
+            cpu="-cpu 65816"
+            ;;
+        dma)
+            cpu="-cpu 45gs02 -dma"
+            ;;
+        superopt)
+            # A fresh memo, so the search itself runs
+            superopt_memo=$(mktemp)
+            cpu="-superopt $superopt_memo"
+            ;;
     esac
 
     for testfile in "$testdir"/input/*.asm; do
@@ -31,16 +42,35 @@ for testdir in tests/*; do
         expectedfile="$testdir/expected/$testname.asm"
         mkdir -p "$testdir/output"
 
-        # Handle CPU-specific tests by filename (for validation tests)
+        # Handle CPU-specific tests by filename (for validation tests and
+        # categories that do not pick a CPU)
         test_cpu="$cpu"
-        if [[ "$testname" == *"45gs02"* ]] && [[ -z "$cpu" ]]; then
-            test_cpu="-cpu 45gs02"
-        elif [[ "$testname" == *"65c02"* ]] && [[ -z "$cpu" ]]; then
-            test_cpu="-cpu 65c02"
+        if [[ "$testname" == *"45gs02"* ]] && [[ "$cpu" != *"-cpu "* ]]; then
+            test_cpu="$cpu -cpu 45gs02"
+        elif [[ "$testname" == *"65c02"* ]] && [[ "$cpu" != *"-cpu "* ]]; then
+            test_cpu="$cpu -cpu 65c02"
+        fi
+
+        # Extra peephole rules for this test, if it has a rule file
+        test_rules=""
+        if [ -f "$testdir/input/$testname.rules" ]; then
+            test_rules="-rules $testdir/input/$testname.rules"
+        fi
+
+        # Free zero page bytes for this test, if it has a zp file
+        test_zp=""
+        if [ -f "$testdir/input/$testname.zp" ]; then
+            test_zp="-zp-free $(cat "$testdir/input/$testname.zp")"
+        fi
+
+        # Execution counts for this test, if it has a profile
+        test_profile=""
+        if [ -f "$testdir/input/$testname.profile" ]; then
+            test_profile="-profile $testdir/input/$testname.profile"
         fi
 
         echo "Testing $testname with cpu flag: $test_cpu"
-        ./opt6502 -speed $test_cpu "$testfile" "$outputfile"
+        ./opt6502 -speed $test_cpu $test_rules $test_zp $test_profile "$testfile" "$outputfile"
 
         # Compare files, ignoring trailing whitespace but preserving label syntax (colons)
         # Create temporary files with trailing whitespace stripped
@@ -59,3 +89,6 @@ for testdir in tests/*; do
         fi
     done
 done
+if [ -n "$superopt_memo" ]; then
+    rm -f "$superopt_memo"
+fi
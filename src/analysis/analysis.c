@@ -7,40 +7,58 @@
  */
 
 #include "analysis.h"
+#include "cfg.h"
+#include <string.h>
 
 /**
- * @brief Mark all branch target labels in the AST
+ * @brief Mark branch target labels in the AST
  *
- * Iterates through the AST and marks all label nodes as branch targets.
- * Labels are potential targets for jumps, branches, and subroutine calls,
- * so they must be preserved during optimization.
+ * With a control flow graph, only labels that some operand references
+ * or that may be entered from outside the file are branch targets, so
+ * passes can keep register knowledge across labels nobody jumps to.
+ * Without one (allocation failure) every label is conservatively
+ * treated as a branch target.
  *
  * @param prog Program to analyze
  */
 void mark_branch_targets_ast(Program *prog) {
-    AstNode *node = prog->root;
-    while (node) {
-        if (node->type == NODE_LABEL) {
+    const Cfg *cfg = prog->cfg;
+
+    for (int i = 0; i < prog->count; i++) {
+        AstNode *node = &prog->nodes[i];
+        if (node->type != NODE_LABEL) {
+            node->is_branch_target = false;
+            continue;
+        }
+        if (!cfg) {
             node->is_branch_target = true;
+            continue;
         }
-        node = node->next;
+
+        const CfgLabel *label = node->label && node->label[0]
+            ? cfg_find_label(cfg, node->label, strlen(node->label), i)
+            : NULL;
+        const BasicBlock *block = &cfg->blocks[cfg->block_of[i]];
+        node->is_branch_target = (label && label->refs > 0) ||
+                                 (block->start == i && block->unknown_entry);
     }
 }
 
 /**
  * @brief Analyze call flow and control flow patterns
  *
- * Wrapper function that performs all necessary control flow analysis.
- * Currently calls mark_branch_targets_ast() to identify all labels
- * that can be branched to.
+ * Rebuilds the program's control flow graph (basic blocks, edges and
+ * referenced labels) and derives branch targets from it. Natural loops
+ * are found on demand from the graph (see loops.h).
  *
  * Future enhancements could include:
  * - Dead code detection based on reachability
- * - Loop detection
  * - Subroutine call graph construction
  *
  * @param prog Program to analyze
  */
 void analyze_call_flow_ast(Program *prog) {
+    free_cfg(prog->cfg);
+    prog->cfg = build_cfg(prog);
     mark_branch_targets_ast(prog);
 }
@@ -12,11 +12,12 @@
 #include "../types.h"
 
 /**
- * @brief Mark all branch target labels in the AST
+ * @brief Mark branch target labels in the AST
  *
- * Scans the AST and marks all label nodes that can be jumped or
- * branched to. This information is used by optimizers to preserve
- * labels that are referenced by control flow instructions.
+ * Sets is_branch_target on label nodes that are referenced by some
+ * operand or may be entered from outside the file, using the program's
+ * control flow graph. Falls back to marking every label when no graph
+ * is available. Optimizers must not carry state across these labels.
  *
  * @param prog Program to analyze
  */
@@ -25,9 +26,10 @@ void mark_branch_targets_ast(Program *prog);
 /**
  * @brief Analyze call flow and control flow patterns
  *
- * Performs control flow analysis including branch target identification.
- * This is typically called before optimization passes to ensure that
- * control flow is properly understood.
+ * Builds prog->cfg (basic blocks, successor/predecessor edges and
+ * referenced labels, see cfg.h) and then marks branch targets. This is
+ * typically called before optimization passes to ensure that control
+ * flow is properly understood.
  *
  * @param prog Program to analyze
  */
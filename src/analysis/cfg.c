@@ -0,0 +1,571 @@
+/**
+ * @file cfg.c
+ * @brief Basic block and control flow graph construction
+ *
+ * Builds the graph in four linear sweeps over the node array:
+ * 1. Collect label definitions into a scoped hash table
+ * 2. Scan every operand for label references and resolve direct
+ *    branch/jump/call targets
+ * 3. Mark block leaders and cut the node array into blocks
+ * 4. Add successor edges and gather predecessor lists
+ */
+
+#include "cfg.h"
+#include "../program/program.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Classification of a line for block splitting */
+typedef enum {
+    LINE_NEUTRAL,       /**< Blank, comment-only or label-only line */
+    LINE_CODE,          /**< CPU instruction */
+    LINE_DIRECTIVE      /**< Assembler directive, data or equate */
+} LineKind;
+
+/**
+ * @brief Classify a node for block splitting
+ *
+ * @param node Node to classify
+ * @return Line kind
+ */
+static LineKind line_kind(const AstNode *node) {
+    if (node->op != OP_NONE) return LINE_CODE;
+    if (node->opcode && node->opcode[0]) return LINE_DIRECTIVE;
+    return LINE_NEUTRAL;
+}
+
+/**
+ * @brief Check whether a node defines a label
+ *
+ * @param node Node to check
+ * @return true if the node carries a non-empty label
+ */
+static bool has_label(const AstNode *node) {
+    return node->label && node->label[0];
+}
+
+/**
+ * @brief Hash a label name within a scope (FNV-1a)
+ *
+ * @param name Label text
+ * @param len Length of the label text
+ * @param scope Owning scope
+ * @return Hash value
+ */
+static unsigned int label_hash(const char *name, size_t len, int scope) {
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    h ^= (unsigned int)scope;
+    h *= 16777619u;
+    return h;
+}
+
+/**
+ * @brief Find the table slot for a label name in one scope
+ *
+ * @param cfg Graph owning the table
+ * @param name Label text
+ * @param len Length of the label text
+ * @param scope Scope to search
+ * @return Matching slot, or the empty slot where it would go
+ */
+static CfgLabel* label_slot(const Cfg *cfg, const char *name, size_t len, int scope) {
+    unsigned int mask = (unsigned int)cfg->label_capacity - 1;
+    unsigned int i = label_hash(name, len, scope) & mask;
+
+    while (cfg->labels[i].name) {
+        CfgLabel *label = &cfg->labels[i];
+        if (label->scope == scope && strncmp(label->name, name, len) == 0 &&
+            label->name[len] == '\0') {
+            return label;
+        }
+        i = (i + 1) & mask;
+    }
+    return &cfg->labels[i];
+}
+
+/**
+ * @brief Find the label a symbol refers to from a given position
+ *
+ * Tries the scope of the referencing node first so local labels shadow
+ * nothing but are found before falling back to the global scope.
+ *
+ * @param cfg Graph to search
+ * @param name Symbol text (need not be NUL-terminated)
+ * @param len Length of the symbol
+ * @param from Index of the referencing node
+ * @return Matching label, or NULL if the symbol is not a label
+ */
+const CfgLabel* cfg_find_label(const Cfg *cfg, const char *name, size_t len, int from) {
+    if (len == 0 || cfg->label_capacity == 0) return NULL;
+
+    int scope = cfg->scope_of[from];
+    if (scope >= 0) {
+        CfgLabel *label = label_slot(cfg, name, len, scope);
+        if (label->name) return label;
+    }
+
+    CfgLabel *label = label_slot(cfg, name, len, -1);
+    return label->name ? label : NULL;
+}
+
+/**
+ * @brief Check whether a character can be part of a symbol
+ *
+ * @param c Character to check
+ * @param config Assembler configuration (for the local label prefix)
+ * @return true if c continues a symbol
+ */
+static bool is_symbol_char(char c, const AsmConfig *config) {
+    if (isalnum((unsigned char)c) || c == '_' || c == '.' || c == '@') return true;
+    return config->local_label_prefix && c == config->local_label_prefix[0];
+}
+
+/**
+ * @brief Get the next symbol token in an operand
+ *
+ * Skips numeric literals ($hex, %binary and plain decimal) unless the
+ * assembler supports numeric local labels.
+ */
+const char* next_operand_symbol(const char *text, size_t *pos, const AsmConfig *config, size_t *len) {
+    size_t i = *pos;
+    while (text[i]) {
+        if (!is_symbol_char(text[i], config)) {
+            i++;
+            continue;
+        }
+
+        size_t start = i;
+        while (text[i] && is_symbol_char(text[i], config)) i++;
+
+        bool literal = (start > 0 && (text[start - 1] == '$' || text[start - 1] == '%')) ||
+                       (isdigit((unsigned char)text[start]) && !config->local_labels_numeric);
+        if (literal) continue;
+
+        *pos = i;
+        *len = i - start;
+        return text + start;
+    }
+    *pos = i;
+    return NULL;
+}
+
+/**
+ * @brief Get the branch/jump target text of a control flow operand
+ *
+ * For BBRn/BBSn the target follows the zero page operand.
+ *
+ * @param node Control flow node
+ * @param len Receives the trimmed target length
+ * @return Start of the target text
+ */
+static const char* control_target(const AstNode *node, size_t *len) {
+    const char *text = node->operand;
+    if (node->mode == AM_ZP_RELATIVE) {
+        const char *comma = strrchr(text, ',');
+        if (comma) text = comma + 1;
+    }
+    while (*text && isspace((unsigned char)*text)) text++;
+
+    size_t n = strlen(text);
+    while (n > 0 && isspace((unsigned char)text[n - 1])) n--;
+    *len = n;
+    return text;
+}
+
+/**
+ * @brief Check whether an unresolved target may point into this file
+ *
+ * Targets such as "*+3" or "loop+2" land mid-block. A plain external
+ * symbol or literal address (JMP $FFD2, JMP KERNAL_RESET) just leaves
+ * the graph.
+ *
+ * @param cfg Graph being built
+ * @param prog Program being analyzed
+ * @param node Control flow node
+ * @param index Index of the node
+ * @return true if the target is relative to this file's code
+ */
+static bool target_is_expression(const Cfg *cfg, const Program *prog, const AstNode *node, int index) {
+    size_t target_len;
+    const char *text = control_target(node, &target_len);
+    if (memchr(text, '*', target_len)) return true;
+
+    size_t pos = 0, len = 0;
+    const char *sym;
+    while ((sym = next_operand_symbol(text, &pos, &prog->config, &len)) != NULL) {
+        if (cfg_find_label(cfg, sym, len, index)) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Check whether a label may be entered from code we cannot see
+ *
+ * In a streaming window, code in other windows may also jump to global
+ * labels, or to any label at all when the window was cut inside a scope.
+ *
+ * @param label Label to check
+ * @param scope How much of the source the program holds
+ * @return true if state at the label must be treated as unknown
+ */
+static bool label_is_external_entry(const CfgLabel *label, SourceScope scope) {
+    if (scope == SOURCE_FRAGMENT || (scope == SOURCE_WINDOW && !label->is_local)) return true;
+    return label->called || label->address_taken || label->ambiguous ||
+           (label->refs == 0 && !label->is_local);
+}
+
+/**
+ * @brief Collect label definitions and per-node scopes
+ *
+ * @param cfg Graph being built
+ * @param prog Program to scan
+ * @return false on allocation failure
+ */
+static bool collect_labels(Cfg *cfg, const Program *prog) {
+    int count = 0;
+    for (int i = 0; i < prog->count; i++) {
+        if (has_label(&prog->nodes[i])) count++;
+    }
+
+    int capacity = 16;
+    while (capacity < count * 2) capacity *= 2;
+    cfg->labels = calloc(capacity, sizeof(CfgLabel));
+    if (!cfg->labels) return false;
+    cfg->label_capacity = capacity;
+
+    int scope = -1;
+    for (int i = 0; i < prog->count; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (has_label(node)) {
+            if (!node->is_local_label) scope = i;
+
+            int def_scope = node->is_local_label ? scope : -1;
+            size_t len = strlen(node->label);
+            CfgLabel *label = label_slot(cfg, node->label, len, def_scope);
+            if (label->name) {
+                label->ambiguous = true;
+            } else {
+                label->name = node->label;
+                label->scope = def_scope;
+                label->node = i;
+                label->is_local = node->is_local_label;
+                cfg->label_count++;
+            }
+        }
+        cfg->scope_of[i] = scope;
+    }
+    return true;
+}
+
+/**
+ * @brief Count label references and resolve control flow targets
+ *
+ * @param cfg Graph being built
+ * @param prog Program to scan
+ * @param target_of Receives the target node of each resolved branch,
+ *                  jump or call (-1 otherwise)
+ */
+static void resolve_references(Cfg *cfg, const Program *prog, int *target_of) {
+    for (int i = 0; i < prog->count; i++) {
+        const AstNode *node = &prog->nodes[i];
+        target_of[i] = -1;
+        if (!node->operand || !node->operand[0] || node->mode == AM_ACCUMULATOR) continue;
+
+        int flow = opcode_info(node->op)->flow;
+        bool control = flow == FLOW_BRANCH || flow == FLOW_JUMP || flow == FLOW_CALL;
+        bool direct_mode = node->mode == AM_RELATIVE || node->mode == AM_ZP_RELATIVE ||
+                           node->mode == AM_ABSOLUTE || node->mode == AM_LONG ||
+                           node->mode == AM_ZEROPAGE;
+
+        // Resolve a direct target: the target text is exactly one label
+        CfgLabel *target = NULL;
+        if (control && direct_mode) {
+            size_t target_len;
+            const char *text = control_target(node, &target_len);
+            size_t pos = 0, len = 0;
+            const char *sym = next_operand_symbol(text, &pos, &prog->config, &len);
+            if (sym == text && len == target_len) {
+                target = (CfgLabel *)cfg_find_label(cfg, sym, len, i);
+            }
+            if (target) {
+                target_of[i] = target->node;
+                if (flow == FLOW_CALL) {
+                    target->called = true;
+                } else {
+                    target->direct_target = true;
+                }
+            } else if (flow != FLOW_CALL && target_is_expression(cfg, prog, node, i)) {
+                // Lands somewhere inside this file we cannot pin down
+                cfg->unresolved_targets = true;
+            }
+        }
+
+        // Every other label mention takes the label's address
+        size_t pos = 0, len = 0;
+        const char *sym;
+        while ((sym = next_operand_symbol(node->operand, &pos, &prog->config, &len)) != NULL) {
+            CfgLabel *label = (CfgLabel *)cfg_find_label(cfg, sym, len, i);
+            if (!label) continue;
+            label->refs++;
+            if (label != target) label->address_taken = true;
+        }
+    }
+}
+
+/**
+ * @brief Build the control flow graph of a program
+ *
+ * @param prog Program to analyze
+ * @return New graph, or NULL on allocation failure
+ */
+Cfg* build_cfg(const Program *prog) {
+    int n = prog->count;
+    Cfg *cfg = calloc(1, sizeof(Cfg));
+    if (!cfg) return NULL;
+
+    int alloc = n > 0 ? n : 1;
+    cfg->node_count = n;
+    cfg->block_of = malloc(alloc * sizeof(int));
+    cfg->scope_of = malloc(alloc * sizeof(int));
+    int *target_of = malloc(alloc * sizeof(int));
+    unsigned char *leader = calloc(alloc, 1);   // 1 = leader, 2 = leader after data
+    if (!cfg->block_of || !cfg->scope_of || !target_of || !leader ||
+        !collect_labels(cfg, prog)) {
+        free(target_of);
+        free(leader);
+        free_cfg(cfg);
+        return NULL;
+    }
+
+    resolve_references(cfg, prog, target_of);
+
+    // Mark block leaders
+    LineKind prev_kind = LINE_NEUTRAL;
+    int last_significant = -1;
+    for (int i = 0; i < n; i++) {
+        const AstNode *node = &prog->nodes[i];
+        LineKind kind = line_kind(node);
+
+        if (i == 0) leader[i] = 1;
+
+        if (has_label(node)) {
+            const CfgLabel *label = cfg_find_label(cfg, node->label,
+                                                   strlen(node->label), i);
+            if (label && (label->direct_target || label_is_external_entry(label, prog->source_scope))) {
+                leader[i] |= 1;
+            }
+        }
+
+        // Runs of directives form their own blocks
+        if (kind != LINE_NEUTRAL) {
+            if (prev_kind != LINE_NEUTRAL && kind != prev_kind) {
+                leader[last_significant + 1] |= (kind == LINE_CODE) ? 2 : 1;
+            }
+            prev_kind = kind;
+            last_significant = i;
+        }
+
+        if (kind == LINE_CODE && i + 1 < n) {
+            int flow = opcode_info(node->op)->flow;
+            if (flow == FLOW_BRANCH || flow == FLOW_JUMP ||
+                flow == FLOW_RETURN || flow == FLOW_STOP) {
+                leader[i + 1] |= 1;
+            }
+        }
+    }
+
+    // Cut the node array into blocks
+    int blocks = 0;
+    for (int i = 0; i < n; i++) {
+        if (leader[i]) blocks++;
+    }
+    cfg->blocks = calloc(blocks > 0 ? blocks : 1, sizeof(BasicBlock));
+    if (!cfg->blocks) {
+        free(target_of);
+        free(leader);
+        free_cfg(cfg);
+        return NULL;
+    }
+
+    int b = -1;
+    for (int i = 0; i < n; i++) {
+        if (leader[i]) {
+            b++;
+            BasicBlock *block = &cfg->blocks[b];
+            block->start = i;
+            block->unknown_entry = (i == 0) || (leader[i] & 2) || cfg->unresolved_targets;
+            block->is_data = false;
+            if (has_label(&prog->nodes[i])) {
+                const CfgLabel *label = cfg_find_label(cfg, prog->nodes[i].label,
+                                                       strlen(prog->nodes[i].label), i);
+                if (label && label_is_external_entry(label, prog->source_scope)) {
+                    block->unknown_entry = true;
+                }
+            }
+        }
+        cfg->block_of[i] = b;
+        cfg->blocks[b].end = i + 1;
+    }
+    cfg->block_count = blocks;
+
+    // Blocks with directives but no instructions hold data
+    for (b = 0; b < blocks; b++) {
+        BasicBlock *block = &cfg->blocks[b];
+        bool code = false, directive = false;
+        for (int i = block->start; i < block->end; i++) {
+            LineKind kind = line_kind(&prog->nodes[i]);
+            if (kind == LINE_CODE) code = true;
+            if (kind == LINE_DIRECTIVE) directive = true;
+        }
+        block->is_data = directive && !code;
+    }
+
+    // Successor edges from the last instruction of each block
+    int edges = 0;
+    for (b = 0; b < blocks; b++) {
+        BasicBlock *block = &cfg->blocks[b];
+        bool falls_through = !block->is_data;
+        int target = -1;
+
+        int last = block->end - 1;
+        while (last >= block->start && line_kind(&prog->nodes[last]) == LINE_NEUTRAL) last--;
+
+        if (last >= block->start && !block->is_data) {
+            const AstNode *node = &prog->nodes[last];
+            int flow = opcode_info(node->op)->flow;
+            if (flow == FLOW_BRANCH || flow == FLOW_JUMP) {
+                if (target_of[last] >= 0) {
+                    target = cfg->block_of[target_of[last]];
+                } else {
+                    block->unknown_exit = true;
+                }
+                if (flow == FLOW_JUMP) falls_through = false;
+            } else if (flow == FLOW_RETURN || flow == FLOW_STOP) {
+                falls_through = false;
+            }
+        }
+
+        block->succ_count = 0;
+        if (falls_through && b + 1 < blocks) block->succ[block->succ_count++] = b + 1;
+        if (target >= 0 && (block->succ_count == 0 || block->succ[0] != target)) {
+            block->succ[block->succ_count++] = target;
+        }
+        edges += block->succ_count;
+    }
+
+    // Predecessor lists
+    cfg->preds = malloc((edges > 0 ? edges : 1) * sizeof(int));
+    if (!cfg->preds) {
+        free(target_of);
+        free(leader);
+        free_cfg(cfg);
+        return NULL;
+    }
+    for (b = 0; b < blocks; b++) {
+        for (int s = 0; s < cfg->blocks[b].succ_count; s++) {
+            cfg->blocks[cfg->blocks[b].succ[s]].pred_count++;
+        }
+    }
+    int offset = 0;
+    for (b = 0; b < blocks; b++) {
+        cfg->blocks[b].pred_start = offset;
+        offset += cfg->blocks[b].pred_count;
+        cfg->blocks[b].pred_count = 0;
+    }
+    for (b = 0; b < blocks; b++) {
+        for (int s = 0; s < cfg->blocks[b].succ_count; s++) {
+            BasicBlock *succ = &cfg->blocks[cfg->blocks[b].succ[s]];
+            cfg->preds[succ->pred_start + succ->pred_count++] = b;
+        }
+    }
+
+    free(target_of);
+    free(leader);
+    return cfg;
+}
+
+/**
+ * @brief Print the blocks and edges of a graph for debugging
+ *
+ * One line per block: source line range, flags, successors and
+ * predecessors (block numbers).
+ *
+ * @param cfg Graph to print
+ * @param prog Program the graph was built from
+ */
+void print_cfg(const Cfg *cfg, const Program *prog) {
+    program_log(prog, "\n=== Control Flow Graph: %d blocks, %d labels%s ===\n",
+           cfg->block_count, cfg->label_count,
+           cfg->unresolved_targets ? " (unresolved targets)" : "");
+
+    for (int b = 0; b < cfg->block_count; b++) {
+        const BasicBlock *block = &cfg->blocks[b];
+        const AstNode *first = &prog->nodes[block->start];
+        const AstNode *last = &prog->nodes[block->end - 1];
+
+        program_log(prog, "B%d lines %d-%d%s%s%s%s%s ->", b, first->line_num, last->line_num,
+               first->label && first->label[0] ? " " : "",
+               first->label && first->label[0] ? first->label : "",
+               block->unknown_entry ? " [entry]" : "",
+               block->unknown_exit ? " [exit]" : "",
+               block->is_data ? " [data]" : "");
+        for (int s = 0; s < block->succ_count; s++) {
+            program_log(prog, " B%d", block->succ[s]);
+        }
+        program_log(prog, " <-");
+        for (int p = 0; p < block->pred_count; p++) {
+            program_log(prog, " B%d", cfg->preds[block->pred_start + p]);
+        }
+        program_log(prog, "\n");
+    }
+}
+
+/**
+ * @brief Estimate the loop nesting depth of every block
+ *
+ * Treats every edge to the same or an earlier block as a loop back-edge
+ * and every block between its target and source as part of that loop.
+ * This matches the loops assemblers write (label, body, branch back)
+ * without computing dominators.
+ *
+ * @param cfg Graph to analyze
+ * @return New array of block_count depths, or NULL on allocation failure
+ */
+int* cfg_loop_depths(const Cfg *cfg) {
+    int *depth = calloc(cfg->block_count > 0 ? cfg->block_count : 1, sizeof(int));
+    if (!depth) return NULL;
+
+    for (int b = 0; b < cfg->block_count; b++) {
+        const BasicBlock *block = &cfg->blocks[b];
+        for (int s = 0; s < block->succ_count; s++) {
+            int head = block->succ[s];
+            if (head > b) continue;
+            for (int k = head; k <= b; k++) {
+                depth[k]++;
+            }
+        }
+    }
+    return depth;
+}
+
+/**
+ * @brief Free a control flow graph
+ *
+ * @param cfg Graph to free (NULL-safe)
+ */
+void free_cfg(Cfg *cfg) {
+    if (!cfg) return;
+
+    free(cfg->blocks);
+    free(cfg->block_of);
+    free(cfg->scope_of);
+    free(cfg->preds);
+    free(cfg->labels);
+    free(cfg);
+}
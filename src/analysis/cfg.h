@@ -0,0 +1,139 @@
+/**
+ * @file cfg.h
+ * @brief Basic blocks and control flow graph
+ *
+ * Splits the program's node array into basic blocks and resolves
+ * branch, jump and call operands against the program's labels. The
+ * result tells passes which labels are actually referenced, which
+ * blocks can be entered from places the optimizer cannot see, and how
+ * blocks connect to each other.
+ */
+
+#ifndef CFG_H
+#define CFG_H
+
+#include "../types.h"
+
+#define CFG_MAX_SUCC 2  /**< Fall-through plus one branch target */
+
+/**
+ * @brief One label definition
+ *
+ * Local labels are scoped to the nearest preceding global label, so the
+ * same local name may appear once per scope.
+ */
+typedef struct {
+    const char *name;           /**< Label text (owned by the program arena) */
+    int scope;                  /**< Owning global label index, or -1 for globals */
+    int node;                   /**< Defining node index */
+    int refs;                   /**< Number of operands that mention the label */
+    bool direct_target;         /**< Target of a resolved branch or jump */
+    bool called;                /**< Target of a subroutine call */
+    bool address_taken;         /**< Used as data or in an expression */
+    bool ambiguous;             /**< Defined more than once in its scope */
+    bool is_local;              /**< Local label (see is_local_label()) */
+} CfgLabel;
+
+/**
+ * @brief Straight-line run of nodes with a single entry point
+ */
+typedef struct {
+    int start;                  /**< First node index */
+    int end;                    /**< One past the last node index */
+    int succ[CFG_MAX_SUCC];     /**< Successor block indices */
+    int succ_count;             /**< Number of valid entries in succ */
+    int pred_start;             /**< First entry of this block in Cfg::preds */
+    int pred_count;             /**< Number of predecessors */
+    bool unknown_entry;         /**< May be entered from outside the graph */
+    bool unknown_exit;          /**< Leaves through an unresolved or indirect jump */
+    bool is_data;               /**< Holds only assembler directives or data */
+} BasicBlock;
+
+/**
+ * @brief Control flow graph of a program
+ */
+typedef struct Cfg {
+    BasicBlock *blocks;         /**< Blocks in source order */
+    int block_count;            /**< Number of blocks */
+    int *block_of;              /**< Block index of every node */
+    int *scope_of;              /**< Enclosing global label of every node (-1 if none) */
+    int node_count;             /**< Number of nodes covered by block_of */
+    int *preds;                 /**< Predecessor lists of all blocks, back to back */
+    CfgLabel *labels;           /**< Open-addressing label table */
+    int label_capacity;         /**< Slots in labels (power of two) */
+    int label_count;            /**< Labels defined */
+    bool unresolved_targets;    /**< Some branch target could not be resolved */
+} Cfg;
+
+/**
+ * @brief Build the control flow graph of a program
+ *
+ * A new block starts at node 0, at every label that is referenced or
+ * may be entered externally, after every branch, jump, return or trap,
+ * and around runs of assembler directives. A block is marked
+ * unknown_entry when it is the first block, follows data, starts at a
+ * global label nobody in the file references, starts at a label that is
+ * called, address-taken or ambiguous, or when some branch target could
+ * not be resolved at all. In a streaming window (Program::source_scope)
+ * labels other windows may jump to are entry points as well.
+ *
+ * @param prog Program to analyze
+ * @return New graph, or NULL on allocation failure
+ */
+Cfg* build_cfg(const Program *prog);
+
+/**
+ * @brief Free a control flow graph
+ * @param cfg Graph to free (NULL-safe)
+ */
+void free_cfg(Cfg *cfg);
+
+/**
+ * @brief Print the blocks and edges of a graph for debugging
+ *
+ * @param cfg Graph to print
+ * @param prog Program the graph was built from
+ */
+void print_cfg(const Cfg *cfg, const Program *prog);
+
+/**
+ * @brief Find the label a symbol refers to from a given position
+ *
+ * Local names are looked up in the scope of the global label that
+ * precedes the referencing node.
+ *
+ * @param cfg Graph to search
+ * @param name Symbol text (need not be NUL-terminated)
+ * @param len Length of the symbol
+ * @param from Index of the referencing node
+ * @return Matching label, or NULL if the symbol is not a label
+ */
+const CfgLabel* cfg_find_label(const Cfg *cfg, const char *name, size_t len, int from);
+
+/**
+ * @brief Get the next symbol token in an operand
+ *
+ * Skips numeric literals ($hex, %binary and plain decimal) unless the
+ * assembler supports numeric local labels.
+ *
+ * @param text Operand text
+ * @param pos Scan position (advanced past the token)
+ * @param config Assembler configuration
+ * @param len Receives the token length
+ * @return Start of the token, or NULL when there are no more tokens
+ */
+const char* next_operand_symbol(const char *text, size_t *pos, const AsmConfig *config, size_t *len);
+
+/**
+ * @brief Estimate the loop nesting depth of every block
+ *
+ * Every edge to the same or an earlier block counts as a back-edge, and
+ * the blocks from its target to its source form the loop body.
+ *
+ * @param cfg Graph to analyze
+ * @return New array of cfg->block_count depths (caller frees), or NULL
+ *         on allocation failure
+ */
+int* cfg_loop_depths(const Cfg *cfg);
+
+#endif // CFG_H
@@ -0,0 +1,992 @@
+/**
+ * @file cost.c
+ * @brief Cycle and byte cost model implementation
+ *
+ * The model is computed rather than tabulated: each opcode is sorted into
+ * an access class (read, write, read-modify-write, stack, flow, implied),
+ * its legal addressing modes are checked per CPU, and the class plus the
+ * addressing mode give the cycle count.
+ */
+
+#include "cost.h"
+#include "cfg.h"
+#include "registers.h"
+#include "../program/program.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define M(mode) (1u << (mode))
+
+/* Addressing mode groups shared by many opcodes */
+#define MODES_ALU   (M(AM_IMMEDIATE) | M(AM_ZEROPAGE) | M(AM_ZEROPAGE_X) | M(AM_ABSOLUTE) | \
+                     M(AM_ABSOLUTE_X) | M(AM_ABSOLUTE_Y) | M(AM_INDEXED_INDIRECT) | \
+                     M(AM_INDIRECT_INDEXED))
+#define MODES_LONG  (M(AM_LONG) | M(AM_LONG_X) | M(AM_STACK_RELATIVE) | \
+                     M(AM_STACK_INDIRECT_Y) | M(AM_INDIRECT_LONG) | M(AM_INDIRECT_LONG_Y))
+#define MODES_SHIFT (M(AM_ACCUMULATOR) | M(AM_ZEROPAGE) | M(AM_ZEROPAGE_X) | M(AM_ABSOLUTE) | \
+                     M(AM_ABSOLUTE_X))
+#define MODES_QUAD  (M(AM_ZEROPAGE) | M(AM_ABSOLUTE) | M(AM_ZP_INDIRECT) | M(AM_INDIRECT_Z) | \
+                     M(AM_FLAT_INDIRECT_Z))
+
+/** How an instruction touches memory, which decides its timing */
+typedef enum {
+    ACCESS_IMPLIED,     /**< Registers only */
+    ACCESS_READ,        /**< Reads its operand */
+    ACCESS_WRITE,       /**< Writes its operand */
+    ACCESS_RMW,         /**< Reads and writes its operand */
+    ACCESS_FLOW         /**< Branches, jumps, calls, returns and stack ops */
+} AccessClass;
+
+/**
+ * @brief Check for a 45GS02 32-bit Q register pseudo-op
+ * @param op Opcode
+ * @return true for ADCQ..STQ
+ */
+static bool is_quad(Opcode op) {
+    return op >= OP_ADCQ && op <= OP_STQ;
+}
+
+/**
+ * @brief Classify an opcode by how it accesses memory
+ * @param op Opcode
+ * @return Access class
+ */
+static AccessClass access_class(Opcode op) {
+    switch (op) {
+        case OP_ADC: case OP_AND: case OP_BIT: case OP_CMP: case OP_CPX: case OP_CPY:
+        case OP_CPZ: case OP_EOR: case OP_LDA: case OP_LDX: case OP_LDY: case OP_LDZ:
+        case OP_ORA: case OP_SBC:
+        case OP_ADCQ: case OP_ANDQ: case OP_BITQ: case OP_CMPQ: case OP_EORQ:
+        case OP_LDQ: case OP_ORQ: case OP_SBCQ:
+            return ACCESS_READ;
+
+        case OP_STA: case OP_STX: case OP_STY: case OP_STZ: case OP_STQ:
+            return ACCESS_WRITE;
+
+        case OP_ASL: case OP_LSR: case OP_ROL: case OP_ROR: case OP_INC: case OP_DEC:
+        case OP_TRB: case OP_TSB: case OP_RMB: case OP_SMB: case OP_ASR: case OP_ASW:
+        case OP_ROW: case OP_INW: case OP_DEW:
+        case OP_ASLQ: case OP_ASRQ: case OP_LSRQ: case OP_ROLQ: case OP_RORQ:
+        case OP_INQ: case OP_DEQ:
+            return ACCESS_RMW;
+
+        default: {
+            const OpcodeInfo *info = opcode_info(op);
+            if (info->flow != FLOW_NONE || (info->reads | info->writes) & RF_SP) {
+                return ACCESS_FLOW;
+            }
+            return ACCESS_IMPLIED;
+        }
+    }
+}
+
+/**
+ * @brief Addressing modes an opcode accepts on a CPU
+ *
+ * @param op Opcode
+ * @param cpu Target CPU
+ * @return Bit mask of AddrMode values
+ */
+static unsigned int legal_modes(Opcode op, CpuType cpu) {
+    bool cmos = cpu != CPU_6502;
+    bool w65816 = cpu == CPU_65816;
+    bool gs = cpu == CPU_45GS02;
+    unsigned int extra;
+
+    switch (op) {
+        case OP_ADC: case OP_AND: case OP_CMP: case OP_EOR: case OP_LDA: case OP_ORA:
+        case OP_SBC: case OP_STA:
+            extra = 0;
+            if (cmos) extra |= M(AM_ZP_INDIRECT);
+            if (w65816) extra |= MODES_LONG;
+            if (gs) extra |= M(AM_INDIRECT_Z) | M(AM_FLAT_INDIRECT_Z);
+            if (gs && (op == OP_LDA || op == OP_STA)) extra |= M(AM_STACK_INDIRECT_Y);
+            return (op == OP_STA ? MODES_ALU & ~M(AM_IMMEDIATE) : MODES_ALU) | extra;
+
+        case OP_LDX:
+            return M(AM_IMMEDIATE) | M(AM_ZEROPAGE) | M(AM_ZEROPAGE_Y) | M(AM_ABSOLUTE) |
+                   M(AM_ABSOLUTE_Y);
+        case OP_LDY:
+            return M(AM_IMMEDIATE) | M(AM_ZEROPAGE) | M(AM_ZEROPAGE_X) | M(AM_ABSOLUTE) |
+                   M(AM_ABSOLUTE_X);
+        case OP_LDZ:
+            return M(AM_IMMEDIATE) | M(AM_ABSOLUTE) | M(AM_ABSOLUTE_X);
+        case OP_STX:
+            return M(AM_ZEROPAGE) | M(AM_ZEROPAGE_Y) | M(AM_ABSOLUTE) | (gs ? M(AM_ABSOLUTE_Y) : 0);
+        case OP_STY:
+            return M(AM_ZEROPAGE) | M(AM_ZEROPAGE_X) | M(AM_ABSOLUTE) | (gs ? M(AM_ABSOLUTE_X) : 0);
+        case OP_STZ:
+            return M(AM_ZEROPAGE) | M(AM_ZEROPAGE_X) | M(AM_ABSOLUTE) | M(AM_ABSOLUTE_X);
+        case OP_CPX: case OP_CPY: case OP_CPZ:
+            return M(AM_IMMEDIATE) | M(AM_ZEROPAGE) | M(AM_ABSOLUTE);
+        case OP_BIT:
+            return M(AM_ZEROPAGE) | M(AM_ABSOLUTE) |
+                   (cmos ? M(AM_IMMEDIATE) | M(AM_ZEROPAGE_X) | M(AM_ABSOLUTE_X) : 0);
+
+        case OP_ASL: case OP_LSR: case OP_ROL: case OP_ROR:
+            return MODES_SHIFT;
+        case OP_INC: case OP_DEC:
+            return MODES_SHIFT & ~(cmos ? 0 : M(AM_ACCUMULATOR));
+        case OP_TRB: case OP_TSB:
+            return M(AM_ZEROPAGE) | M(AM_ABSOLUTE);
+        case OP_RMB: case OP_SMB: case OP_INW: case OP_DEW:
+            return M(AM_ZEROPAGE);
+        case OP_ASR:
+            return M(AM_ACCUMULATOR) | M(AM_ZEROPAGE) | M(AM_ZEROPAGE_X);
+        case OP_ASW: case OP_ROW:
+            return M(AM_ABSOLUTE);
+        case OP_BBR: case OP_BBS:
+            return M(AM_ZP_RELATIVE);
+
+        case OP_LDQ: case OP_ADCQ: case OP_ANDQ: case OP_CMPQ: case OP_EORQ: case OP_ORQ:
+        case OP_SBCQ: case OP_STQ:
+            return MODES_QUAD;
+        case OP_BITQ:
+            return M(AM_ZEROPAGE) | M(AM_ABSOLUTE);
+        case OP_ASLQ: case OP_ASRQ: case OP_LSRQ: case OP_ROLQ: case OP_RORQ: case OP_INQ:
+        case OP_DEQ:
+            return MODES_SHIFT;
+
+        case OP_JMP:
+            return M(AM_ABSOLUTE) | M(AM_INDIRECT) | (cmos ? M(AM_ABS_INDEXED_INDIRECT) : 0) |
+                   (w65816 ? M(AM_LONG) | M(AM_INDIRECT_LONG) : 0);
+        case OP_JSR:
+            return M(AM_ABSOLUTE) | (w65816 ? M(AM_ABS_INDEXED_INDIRECT) | M(AM_LONG) : 0) |
+                   (gs ? M(AM_INDIRECT) | M(AM_ABS_INDEXED_INDIRECT) : 0);
+        case OP_JML:
+            return M(AM_ABSOLUTE) | M(AM_LONG) | M(AM_INDIRECT_LONG);
+        case OP_JSL:
+            return M(AM_ABSOLUTE) | M(AM_LONG);
+
+        case OP_BCC: case OP_BCS: case OP_BEQ: case OP_BMI: case OP_BNE: case OP_BPL:
+        case OP_BVC: case OP_BVS: case OP_BRA: case OP_BRL: case OP_BSR:
+            return M(AM_RELATIVE);
+        case OP_PER:
+            return M(AM_RELATIVE) | M(AM_ABSOLUTE);
+        case OP_PEA:
+            return M(AM_ABSOLUTE) | M(AM_IMMEDIATE);
+        case OP_PEI:
+            return M(AM_ZP_INDIRECT);
+        case OP_PHW:
+            return M(AM_IMMEDIATE) | M(AM_ABSOLUTE);
+        case OP_MVN: case OP_MVP:
+            return M(AM_BLOCK_MOVE);
+        case OP_REP: case OP_SEP:
+            return M(AM_IMMEDIATE);
+        case OP_BRK: case OP_COP: case OP_WDM:
+            return M(AM_IMPLIED) | M(AM_IMMEDIATE) | M(AM_ZEROPAGE);
+        case OP_NEG:
+            return M(AM_IMPLIED) | M(AM_ACCUMULATOR);
+
+        default:
+            return M(AM_IMPLIED);
+    }
+}
+
+/**
+ * @brief Encoded size of an addressing mode's operand
+ *
+ * @param op Opcode (for the few whose operand size depends on it)
+ * @param mode Addressing mode
+ * @return Operand bytes, excluding the opcode byte
+ */
+static int operand_bytes(Opcode op, AddrMode mode) {
+    switch (mode) {
+        case AM_IMPLIED: case AM_ACCUMULATOR:
+            return 0;
+        case AM_IMMEDIATE:
+            return op == OP_PHW || op == OP_PEA ? 2 : 1;
+        case AM_RELATIVE:
+            return op == OP_BRL || op == OP_PER || op == OP_BSR ? 2 : 1;
+        case AM_ABSOLUTE: case AM_ABSOLUTE_X: case AM_ABSOLUTE_Y: case AM_INDIRECT:
+        case AM_ABS_INDEXED_INDIRECT: case AM_ZP_RELATIVE: case AM_BLOCK_MOVE:
+            return 2;
+        case AM_LONG: case AM_LONG_X:
+            return 3;
+        case AM_INDIRECT_LONG:
+            return op == OP_JMP || op == OP_JML ? 2 : 1;
+        default:
+            return 1;
+    }
+}
+
+/**
+ * @brief Cycles of a read or write operand access on the NMOS and CMOS cores
+ *
+ * @param mode Addressing mode
+ * @param cost Cost to fill in (cycles and page_penalty)
+ * @param write Instruction writes its operand (no page-cross skip)
+ */
+static void operand_cycles(AddrMode mode, InstrCost *cost, bool write) {
+    switch (mode) {
+        case AM_IMMEDIATE:      cost->cycles = 2; break;
+        case AM_ZEROPAGE:       cost->cycles = 3; break;
+        case AM_ZEROPAGE_X:
+        case AM_ZEROPAGE_Y:     cost->cycles = 4; break;
+        case AM_ABSOLUTE:       cost->cycles = 4; break;
+        case AM_ABSOLUTE_X:
+        case AM_ABSOLUTE_Y:     cost->cycles = write ? 5 : 4; cost->page_penalty = !write; break;
+        case AM_INDEXED_INDIRECT: cost->cycles = 6; break;
+        case AM_INDIRECT_INDEXED: cost->cycles = write ? 6 : 5; cost->page_penalty = !write; break;
+        case AM_ZP_INDIRECT:
+        case AM_INDIRECT_Z:     cost->cycles = 5; break;
+        case AM_LONG:
+        case AM_LONG_X:         cost->cycles = 5; break;
+        case AM_STACK_RELATIVE: cost->cycles = 4; break;
+        case AM_STACK_INDIRECT_Y: cost->cycles = 7; break;
+        case AM_INDIRECT_LONG:
+        case AM_INDIRECT_LONG_Y:
+        case AM_FLAT_INDIRECT_Z: cost->cycles = 6; break;
+        default:                cost->cycles = 2; break;
+    }
+}
+
+/**
+ * @brief Cycles of flow control and stack instructions on the NMOS and
+ * CMOS cores
+ *
+ * @param op Opcode
+ * @param mode Addressing mode
+ * @param cpu Target CPU
+ * @param cost Cost to fill in
+ */
+static void flow_cycles(Opcode op, AddrMode mode, CpuType cpu, InstrCost *cost) {
+    const OpcodeInfo *info = opcode_info(op);
+
+    if (info->flow == FLOW_BRANCH) {
+        cost->cycles = 2;
+        cost->branch_taken = 1;
+        cost->page_penalty = 1;
+        if (op == OP_BBR || op == OP_BBS) cost->cycles = 5;
+        return;
+    }
+
+    switch (op) {
+        case OP_BRA:  cost->cycles = 3; cost->page_penalty = 1; break;
+        case OP_BRL:  cost->cycles = 4; break;
+        case OP_JMP:
+            cost->cycles = mode == AM_ABSOLUTE ? 3 : mode == AM_LONG ? 4 :
+                           mode == AM_INDIRECT ? (cpu == CPU_6502 ? 5 : 6) : 6;
+            break;
+        case OP_JML:  cost->cycles = mode == AM_INDIRECT_LONG ? 6 : 4; break;
+        case OP_JSR:  cost->cycles = mode == AM_ABSOLUTE ? 6 : 8; break;
+        case OP_JSL:  cost->cycles = 8; break;
+        case OP_RTS: case OP_RTI: case OP_RTL: cost->cycles = 6; break;
+        case OP_BRK: case OP_COP: cost->cycles = 7; break;
+        case OP_PHA: case OP_PHP: case OP_PHX: case OP_PHY: case OP_PHB: case OP_PHK:
+            cost->cycles = 3; break;
+        case OP_PLA: case OP_PLP: case OP_PLX: case OP_PLY: case OP_PLB: case OP_PHD:
+            cost->cycles = 4; break;
+        case OP_PLD:  cost->cycles = 5; break;
+        case OP_PEA:  cost->cycles = 5; break;
+        case OP_PEI: case OP_PER: cost->cycles = 6; break;
+        case OP_MVN: case OP_MVP: cost->cycles = 7; break;
+        case OP_STP: case OP_WAI: cost->cycles = 3; break;
+        default:      cost->cycles = 2; break;
+    }
+}
+
+/**
+ * @brief Approximate 45GS02 full-speed cycles
+ *
+ * One cycle per instruction byte, plus pointer fetches for indirect
+ * modes and one cycle per data byte read or written. Quad operations
+ * move four data bytes.
+ *
+ * @param op Opcode
+ * @param mode Addressing mode
+ * @param bytes Encoded size including prefixes
+ * @param cost Cost to fill in
+ */
+static void gs02_cycles(Opcode op, AddrMode mode, int bytes, InstrCost *cost) {
+    const OpcodeInfo *info = opcode_info(op);
+    int data = is_quad(op) ? 4 : (op == OP_INW || op == OP_DEW || op == OP_ASW ||
+                                  op == OP_ROW || op == OP_PHW) ? 2 : 1;
+    int cycles = bytes;
+
+    switch (mode) {
+        case AM_INDEXED_INDIRECT: case AM_INDIRECT_INDEXED: case AM_ZP_INDIRECT:
+        case AM_INDIRECT_Z: case AM_STACK_INDIRECT_Y: case AM_INDIRECT:
+        case AM_ABS_INDEXED_INDIRECT:
+            cycles += 2;
+            break;
+        case AM_FLAT_INDIRECT_Z:
+            cycles += 4;
+            break;
+        default:
+            break;
+    }
+
+    switch (access_class(op)) {
+        case ACCESS_READ:
+        case ACCESS_WRITE:
+            if (mode != AM_IMMEDIATE) cycles += data;
+            break;
+        case ACCESS_RMW:
+            if (mode != AM_ACCUMULATOR) cycles += 2 * data;
+            break;
+        case ACCESS_FLOW:
+            if (info->flow == FLOW_BRANCH) cost->branch_taken = 1;
+            if (info->flow == FLOW_CALL) cycles += 2;
+            if (info->flow == FLOW_RETURN) cycles += 2;
+            if (info->flow == FLOW_NONE) cycles += data;  // Push or pull
+            break;
+        default:
+            break;
+    }
+
+    cost->cycles = (unsigned char)cycles;
+}
+
+/**
+ * @brief Look up the cost of an opcode and addressing mode
+ */
+InstrCost instruction_cost(Opcode op, AddrMode mode, CpuType cpu) {
+    InstrCost cost;
+    memset(&cost, 0, sizeof(cost));
+
+    unsigned int cpus = cpu == CPU_6502 ? CPUM_6502 : cpu == CPU_65C02 ? CPUM_65C02 :
+                        cpu == CPU_65816 ? CPUM_65816 : CPUM_45GS02;
+    if (op == OP_NONE || mode == AM_NONE || !opcode_available(op, cpus)) return cost;
+    if (!(legal_modes(op, cpu) & M(mode))) return cost;
+
+    int bytes = 1 + operand_bytes(op, mode);
+    if (cpu == CPU_45GS02) {
+        if (is_quad(op)) bytes += 2;                  // NEG NEG prefix
+        if (mode == AM_FLAT_INDIRECT_Z) bytes += 1;   // EOM prefix
+    }
+    cost.bytes = (unsigned char)bytes;
+    cost.valid = true;
+
+    if (cpu == CPU_45GS02) {
+        gs02_cycles(op, mode, bytes, &cost);
+        return cost;
+    }
+
+    switch (access_class(op)) {
+        case ACCESS_READ:
+            operand_cycles(mode, &cost, false);
+            break;
+
+        case ACCESS_WRITE:
+            operand_cycles(mode, &cost, true);
+            break;
+
+        case ACCESS_RMW:
+            if (mode == AM_ACCUMULATOR) {
+                cost.cycles = 2;
+            } else if (op == OP_RMB || op == OP_SMB || op == OP_TRB || op == OP_TSB) {
+                cost.cycles = mode == AM_ZEROPAGE ? 5 : 6;
+            } else {
+                operand_cycles(mode, &cost, true);
+                cost.cycles += 2;
+                // 65C02 shifts abs,X skip a cycle unless they cross a page
+                if (mode == AM_ABSOLUTE_X && cpu == CPU_65C02 && op != OP_INC && op != OP_DEC) {
+                    cost.cycles--;
+                    cost.page_penalty = 1;
+                }
+            }
+            break;
+
+        case ACCESS_FLOW:
+            flow_cycles(op, mode, cpu, &cost);
+            break;
+
+        default:
+            cost.cycles = op == OP_XBA || op == OP_REP || op == OP_SEP ? 3 : 2;
+            break;
+    }
+
+    return cost;
+}
+
+/**
+ * @brief Cost of a 65816 instruction running with a 16-bit register
+ */
+InstrCost wide_instruction_cost(Opcode op, AddrMode mode) {
+    InstrCost cost = instruction_cost(op, mode, CPU_65816);
+    if (!cost.valid) return cost;
+
+    if (mode == AM_IMMEDIATE) cost.bytes++;
+    switch (access_class(op)) {
+        case ACCESS_READ:
+        case ACCESS_WRITE:
+            cost.cycles++;
+            break;
+        case ACCESS_RMW:
+            if (mode != AM_ACCUMULATOR) cost.cycles += 2;
+            break;
+        default:
+            break;
+    }
+    return cost;
+}
+
+/**
+ * @brief Cost of a program node on the program's target CPU
+ */
+InstrCost node_cost(const Program *prog, int index) {
+    const AstNode *node = &prog->nodes[index];
+    if (node_is_dead(prog, index) || node->op == OP_NONE) {
+        InstrCost none;
+        memset(&none, 0, sizeof(none));
+        return none;
+    }
+    return instruction_cost(node->op, node->mode, prog->cpu_type);
+}
+
+/**
+ * @brief Add the cost of an instruction form to a running total
+ */
+void cost_add(CostTotal *total, InstrCost cost) {
+    if (!cost.valid) return;
+    total->cycles += cost.cycles;
+    total->bytes += cost.bytes;
+}
+
+/**
+ * @brief Add the cost of a program node to a running total
+ */
+void cost_add_node(CostTotal *total, const Program *prog, int index) {
+    cost_add(total, node_cost(prog, index));
+}
+
+/**
+ * @brief Decide whether a rewrite pays off under the program's mode
+ */
+bool cost_is_better(const Program *prog, CostTotal before, CostTotal after) {
+    return cost_is_better_for(prog->mode, before, after);
+}
+
+/**
+ * @brief Decide whether a rewrite pays off under a given mode
+ */
+bool cost_is_better_for(OptMode mode, CostTotal before, CostTotal after) {
+    if (mode == OPT_SIZE) {
+        if (after.bytes != before.bytes) return after.bytes < before.bytes;
+        return after.cycles < before.cycles;
+    }
+    if (after.cycles != before.cycles) return after.cycles < before.cycles;
+    return after.bytes < before.bytes;
+}
+
+/**
+ * @brief Loop weight of a nesting depth
+ */
+long loop_weight(int depth) {
+    long weight = 1;
+    if (depth > COST_MAX_LOOP_DEPTH) depth = COST_MAX_LOOP_DEPTH;
+    for (int d = 0; d < depth; d++) weight *= COST_LOOP_WEIGHT;
+    return weight;
+}
+
+/**
+ * @brief Index register a counting instruction steps
+ *
+ * @param op Opcode
+ * @param delta Where to store the change (+1 or -1)
+ * @return RF_X or RF_Y, or 0 if op is not DEX/DEY/INX/INY
+ */
+static unsigned int counter_step(Opcode op, int *delta) {
+    switch (op) {
+        case OP_DEX: *delta = -1; return RF_X;
+        case OP_DEY: *delta = -1; return RF_Y;
+        case OP_INX: *delta = 1; return RF_X;
+        case OP_INY: *delta = 1; return RF_Y;
+        default: return 0;
+    }
+}
+
+/**
+ * @brief Value a loop counter enters the loop with
+ *
+ * @param prog Program owning the nodes
+ * @param block Block that enters the loop
+ * @param counter RF_X or RF_Y
+ * @return Value of the last LDX/LDY #imm of the block, or -1 if the
+ *         block writes the counter otherwise last, calls out or does not
+ *         load it
+ */
+static int counter_start(const Program *prog, const BasicBlock *block, unsigned int counter) {
+    for (int i = block->end - 1; i >= block->start; i--) {
+        const AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i) || node->op == OP_NONE) continue;
+        if (opcode_info(node->op)->flow == FLOW_CALL) return -1;
+        if (opcode_writes(node->op, node->mode) & counter) {
+            Opcode load = counter == RF_X ? OP_LDX : OP_LDY;
+            if (node->op != load || node->mode != AM_IMMEDIATE) return -1;
+            return parse_immediate_value(node->operand);
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Trip count of a counted loop block
+ *
+ * The trips are found by stepping the 8-bit counter from its start
+ * value until the branch falls through. On the 65816 the index
+ * registers may be 16 bits wide, so only loops counting down to exactly
+ * zero are counted there.
+ */
+int loop_trip_count(const Program *prog, const Cfg *cfg, int b) {
+    const BasicBlock *block = &cfg->blocks[b];
+    if (block->is_data || block->unknown_entry || block->pred_count != 2) return 0;
+    int entry = -1;
+    bool self = false;
+    for (int p = 0; p < block->pred_count; p++) {
+        int pred = cfg->preds[block->pred_start + p];
+        if (pred == b) self = true; else entry = pred;
+    }
+    if (!self || entry < 0) return 0;
+
+    // Branch and the step right before it, from the end of the block
+    int branch = -1, step = -1;
+    for (int i = block->end - 1; i >= block->start && step < 0; i--) {
+        if (node_is_dead(prog, i) || prog->nodes[i].op == OP_NONE) continue;
+        if (branch < 0) branch = i; else step = i;
+    }
+    if (step < 0) return 0;
+    Opcode br = prog->nodes[branch].op;
+    int delta;
+    unsigned int counter = counter_step(prog->nodes[step].op, &delta);
+    if ((br != OP_BNE && br != OP_BPL) || !counter) return 0;
+
+    // Net change per trip; nothing else may write the counter
+    int change = 0;
+    for (int i = block->start; i < branch; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i) || node->op == OP_NONE) continue;
+        int d;
+        if (counter_step(node->op, &d) == counter) {
+            if (d != delta) return 0;
+            change += d;
+        } else if (opcode_info(node->op)->flow != FLOW_NONE ||
+                   (opcode_writes(node->op, node->mode) & counter)) {
+            return 0;
+        }
+    }
+
+    int value = counter_start(prog, &cfg->blocks[entry], counter);
+    if (value < 0 || value > 0xFF) return 0;
+    if (prog->cpu_type == CPU_65816) {
+        return br == OP_BNE && change < 0 && value > 0 && value % -change == 0 ? value / -change : 0;
+    }
+    for (int trips = 1; trips <= 256; trips++) {
+        value = (value + change) & 0xFF;
+        if (br == OP_BNE ? value == 0 : (value & 0x80) != 0) return trips;
+    }
+    return 0;
+}
+
+/**
+ * @brief Estimate how often every node runs
+ */
+long* estimate_node_runs(const Program *prog, const Cfg *cfg, bool weighted) {
+    long *runs = malloc((prog->count > 0 ? prog->count : 1) * sizeof(long));
+    int *depth = weighted ? cfg_loop_depths(cfg) : NULL;
+    if (!runs || (weighted && !depth)) {
+        free(runs);
+        free(depth);
+        return NULL;
+    }
+
+    for (int i = 0; i < prog->count; i++) runs[i] = 1;
+    for (int b = 0; b < cfg->block_count; b++) {
+        const BasicBlock *block = &cfg->blocks[b];
+        int trips = loop_trip_count(prog, cfg, b);
+        long n = weighted ? loop_weight(depth[b] - (trips > 0 ? 1 : 0)) : 1;
+        if (trips > 0) n *= trips;
+        for (int i = block->start; i < block->end && i < prog->count; i++) runs[i] = n;
+    }
+    free(depth);
+    return runs;
+}
+
+/**
+ * @brief Check whether a node starts a new routine
+ *
+ * @param node Node to check
+ * @return true for global labels that are not equates
+ */
+bool is_routine_start(const AstNode *node) {
+    if (!node->label || !node->label[0] || node->is_local_label) return false;
+    return !(node->op == OP_NONE && node->opcode && strcmp(node->opcode, "=") == 0);
+}
+
+/**
+ * @brief Record the current cost of every node
+ *
+ * @param prog Program to measure
+ * @return New array of prog->count costs, or NULL on allocation failure
+ */
+NodeCost* measure_node_costs(const Program *prog) {
+    NodeCost *costs = malloc((prog->count > 0 ? prog->count : 1) * sizeof(NodeCost));
+    Cfg *own_cfg = prog->cfg ? NULL : build_cfg(prog);
+    const Cfg *cfg = prog->cfg ? prog->cfg : own_cfg;
+    long *runs = cfg ? estimate_node_runs(prog, cfg, false) : NULL;
+    long *weight = cfg ? estimate_node_runs(prog, cfg, true) : NULL;
+    if (!costs || !runs || !weight) {
+        free(costs);
+        costs = NULL;
+    }
+
+    for (int i = 0; costs && i < prog->count; i++) {
+        costs[i].cost = node_cost(prog, i);
+        costs[i].runs = runs[i];
+        costs[i].weight = weight[i];
+    }
+    free(runs);
+    free(weight);
+    free_cfg(own_cfg);
+    return costs;
+}
+
+/**
+ * @brief Measure the live code of a program, routine by routine
+ *
+ * Routine boundaries depend only on labels, which are never rewritten,
+ * so summaries taken before and after optimization line up entry by
+ * entry.
+ */
+CostSummary* measure_program_cost(const Program *prog) {
+    CostSummary *summary = calloc(1, sizeof(CostSummary));
+    if (!summary) return NULL;
+
+    int capacity = 1;
+    for (int i = 0; i < prog->count; i++) {
+        if (is_routine_start(&prog->nodes[i])) capacity++;
+    }
+
+    summary->routines = calloc(capacity, sizeof(RoutineCost));
+    if (!summary->routines) {
+        free(summary);
+        return NULL;
+    }
+
+    // Without a graph (out of memory) every node counts once
+    Cfg *own_cfg = prog->cfg ? NULL : build_cfg(prog);
+    const Cfg *cfg = prog->cfg ? prog->cfg : own_cfg;
+    long *runs = cfg ? estimate_node_runs(prog, cfg, false) : NULL;
+    free_cfg(own_cfg);
+
+    RoutineCost *current = NULL;
+    for (int i = 0; i < prog->count; i++) {
+        if (!current || is_routine_start(&prog->nodes[i])) {
+            current = &summary->routines[summary->count++];
+            current->node = i;
+        }
+        InstrCost cost = node_cost(prog, i);
+        if (!cost.valid) continue;
+        current->cost.cycles += cost.cycles * (runs ? runs[i] : 1);
+        current->cost.bytes += cost.bytes;
+    }
+    free(runs);
+
+    for (int r = 0; r < summary->count; r++) {
+        summary->total.cycles += summary->routines[r].cost.cycles;
+        summary->total.bytes += summary->routines[r].cost.bytes;
+    }
+    return summary;
+}
+
+/**
+ * @brief Free a cost summary
+ */
+void free_cost_summary(CostSummary *summary) {
+    if (!summary) return;
+    free(summary->routines);
+    free(summary);
+}
+
+/**
+ * @brief Parse a numeric address ($hex, %binary or decimal)
+ *
+ * @param text Address text
+ * @return Address, or -1 if the text is not a plain number
+ */
+static long parse_address(const char *text) {
+    if (!text) return -1;
+    while (*text == ' ' || *text == '\t') text++;
+
+    int base = 10;
+    if (*text == '$') {
+        base = 16;
+        text++;
+    } else if (*text == '%') {
+        base = 2;
+        text++;
+    }
+    if (!*text) return -1;
+
+    long value = 0;
+    for (; *text && *text != ' ' && *text != '\t'; text++) {
+        int digit;
+        if (*text >= '0' && *text <= '9') {
+            digit = *text - '0';
+        } else if (*text >= 'a' && *text <= 'f') {
+            digit = *text - 'a' + 10;
+        } else if (*text >= 'A' && *text <= 'F') {
+            digit = *text - 'A' + 10;
+        } else {
+            return -1;
+        }
+        if (digit >= base) return -1;
+        value = value * base + digit;
+        if (value > 0xFFFFFF) return -1;
+    }
+    return value;
+}
+
+/**
+ * @brief Compare a directive name, ignoring its '.' or '!' prefix and case
+ *
+ * @param opcode Directive text
+ * @param name Lowercase directive name without prefix
+ * @return true if the directive is name
+ */
+static bool directive_is(const char *opcode, const char *name) {
+    if (*opcode == '.' || *opcode == '!') opcode++;
+    return strcasecmp(opcode, name) == 0;
+}
+
+/**
+ * @brief Count the bytes a data directive emits
+ *
+ * @param operand Comma-separated items
+ * @param item_size Bytes per numeric item
+ * @return Number of bytes
+ */
+static long data_bytes(const char *operand, int item_size) {
+    long bytes = 0;
+    bool item = false;
+    for (const char *p = operand ? operand : ""; *p; p++) {
+        if (*p == '"') {
+            // A string emits one byte per character
+            for (p++; *p && *p != '"'; p++) bytes++;
+            if (!*p) break;
+            item = false;
+            continue;
+        }
+        if (*p == ',') {
+            if (item) bytes += item_size;
+            item = false;
+        } else if (*p != ' ' && *p != '\t') {
+            item = true;
+        }
+    }
+    if (item) bytes += item_size;
+    return bytes;
+}
+
+/**
+ * @brief Check for a directive that reserves storage without a fill value
+ */
+bool is_reserve_directive(const AstNode *node) {
+    const char *opcode = node->opcode;
+    if (node->op != OP_NONE || !opcode || !opcode[0] || !node->operand) return false;
+    if (!directive_is(opcode, "res") && !directive_is(opcode, "ds") && !directive_is(opcode, "dsb") &&
+        !directive_is(opcode, "blkb") && !directive_is(opcode, "skip")) {
+        return false;
+    }
+    return !strchr(node->operand, ',') && parse_address(node->operand) >= 0;
+}
+
+/**
+ * @brief Count the bytes a directive emits
+ *
+ * Labels, comments, symbol definitions and origins emit nothing;
+ * .byte/.db and .word/.dw emit their items, reserve directives their
+ * count.
+ */
+long directive_bytes(const AstNode *node) {
+    const char *opcode = node->opcode ? node->opcode : "";
+    if (!opcode[0] || strcmp(opcode, "=") == 0 || directive_is(opcode, "org") ||
+        directive_is(opcode, "equ") || directive_is(opcode, "set")) {
+        return 0;
+    }
+    if (directive_is(opcode, "byte") || directive_is(opcode, "db") || directive_is(opcode, "by")) {
+        return data_bytes(node->operand, 1);
+    }
+    if (directive_is(opcode, "word") || directive_is(opcode, "dw") || directive_is(opcode, "wo")) {
+        return data_bytes(node->operand, 2);
+    }
+    if (is_reserve_directive(node)) return parse_address(node->operand);
+    return -1;
+}
+
+/**
+ * @brief Estimate the assembled address of every node
+ *
+ * Origin directives (* = addr, *=addr, .org addr, org addr) set the
+ * address; instructions advance it by their size and directives by
+ * directive_bytes(). Any other directive that may emit code makes the
+ * address unknown until the next origin.
+ */
+long* estimate_node_addresses(const Program *prog) {
+    long *address = malloc((prog->count > 0 ? prog->count : 1) * sizeof(long));
+    if (!address) return NULL;
+
+    long pc = -1;
+    for (int i = 0; i < prog->count; i++) {
+        const AstNode *node = &prog->nodes[i];
+        const char *label = node->label ? node->label : "";
+        const char *opcode = node->opcode ? node->opcode : "";
+
+        if (strcmp(label, "*") == 0 && strcmp(opcode, "=") == 0) {
+            pc = parse_address(node->operand);
+        } else if (label[0] == '*' && label[1] == '=') {
+            pc = parse_address(label + 2);
+        } else if (node->op == OP_NONE && opcode[0] && directive_is(opcode, "org")) {
+            pc = parse_address(node->operand);
+        }
+        address[i] = pc;
+        if (pc < 0 || node_is_dead(prog, i)) continue;
+
+        long bytes = directive_bytes(node);
+        if (node->op != OP_NONE) {
+            InstrCost cost = node_cost(prog, i);
+            bytes = cost.valid ? cost.bytes : -1;
+        }
+        pc = bytes < 0 ? -1 : pc + bytes;
+    }
+    return address;
+}
+
+/**
+ * @brief Check whether a taken branch crosses a page
+ */
+bool branch_crosses_page(const Program *prog, const long *address, int branch, int target) {
+    if (!address || address[branch] < 0 || address[target] < 0) return false;
+    InstrCost cost = node_cost(prog, branch);
+    if (!cost.valid || cost.page_penalty == 0) return false;
+    return ((address[branch] + cost.bytes) >> 8) != (address[target] >> 8);
+}
+
+/**
+ * @brief Encoded size of a live node
+ *
+ * @param prog Program owning the node
+ * @param index Node index
+ * @return Bytes, or -1 for a directive of unknown size (a macro call
+ *         may even hide branches)
+ */
+static long span_bytes(const Program *prog, int index) {
+    const AstNode *node = &prog->nodes[index];
+    if (node->op == OP_NONE) return directive_bytes(node);
+    return node_cost(prog, index).bytes;
+}
+
+/**
+ * @brief Sum the encoded size of the live nodes in a range
+ */
+bool byte_span(const Program *prog, int from, int to, int *bytes) {
+    *bytes = 0;
+    for (int i = from; i < to; i++) {
+        if (node_is_dead(prog, i)) continue;
+        long size = span_bytes(prog, i);
+        if (size < 0) return false;
+        *bytes += (int)size;
+        if (*bytes > BRANCH_SCAN_BYTES) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Displacement a branch needs to reach a node
+ */
+bool branch_offset(const Program *prog, int branch, int target, int *offset) {
+    int bytes;
+    if (target > branch) {
+        if (!byte_span(prog, branch + 1, target, &bytes)) return false;
+        *offset = bytes;
+    } else {
+        if (!byte_span(prog, target, branch + 1, &bytes)) return false;
+        *offset = -bytes;
+    }
+    return true;
+}
+
+/**
+ * @brief Find the label a branch names
+ *
+ * @param prog Program owning the node
+ * @param index Branch node index
+ * @return Label, or NULL if the operand is not a plain label
+ */
+static const CfgLabel* branch_label(const Program *prog, int index) {
+    const char *operand = prog->nodes[index].operand;
+    if (!operand || !operand[0]) return NULL;
+    if (prog->nodes[index].mode == AM_ZP_RELATIVE) {
+        // BBRn $12,target
+        const char *comma = strchr(operand, ',');
+        if (!comma) return NULL;
+        operand = comma + 1 + strspn(comma + 1, " \t");
+    }
+    return cfg_find_label(prog->cfg, operand, strlen(operand), index);
+}
+
+/**
+ * @brief Check that branches around an insertion point still reach
+ */
+bool branches_reach(const Program *prog, int index, int growth, int *lo, int *hi) {
+    int bytes = 0;
+    *lo = index;
+    for (int k = index - 1; k >= 0 && bytes <= 127; k--) {
+        const AstNode *node = &prog->nodes[k];
+        *lo = k;
+        if (node_is_dead(prog, k)) continue;
+        long size = span_bytes(prog, k);
+        if (size < 0) return false;
+        if (node->mode == AM_RELATIVE || node->mode == AM_ZP_RELATIVE) {
+            const CfgLabel *target = branch_label(prog, k);
+            int offset;
+            if (!target) return false;
+            if (target->node > index &&
+                (!branch_offset(prog, k, target->node, &offset) || offset + growth > 127)) {
+                return false;
+            }
+        }
+        bytes += (int)size;
+    }
+
+    bytes = 0;
+    *hi = index;
+    for (int k = index + 1; k < prog->count && bytes <= 128; k++) {
+        const AstNode *node = &prog->nodes[k];
+        *hi = k;
+        if (node_is_dead(prog, k)) continue;
+        long size = span_bytes(prog, k);
+        if (size < 0) return false;
+        if (node->mode == AM_RELATIVE || node->mode == AM_ZP_RELATIVE) {
+            const CfgLabel *target = branch_label(prog, k);
+            int offset;
+            if (!target) return false;
+            if (target->node < index &&
+                (!branch_offset(prog, k, target->node, &offset) || offset - growth < -128)) {
+                return false;
+            }
+        }
+        bytes += (int)size;
+    }
+    return true;
+}
+
+/**
+ * @brief Check that branches still reach with one more insertion
+ */
+bool growth_fits(const Program *prog, CodeGrowth *growth, const CodeGrowth *chosen, int count) {
+    growth->lo = growth->hi = growth->index;
+    if (growth->bytes <= 0) return true;
+    if (!branches_reach(prog, growth->index, growth->bytes, &growth->lo, &growth->hi)) return false;
+
+    int nearby = 0;
+    for (int k = 0; k < count; k++) {
+        if (chosen[k].bytes > 0 && chosen[k].lo <= growth->hi && chosen[k].hi >= growth->lo) {
+            nearby += chosen[k].bytes;
+        }
+    }
+    return nearby == 0 ||
+           branches_reach(prog, growth->index, growth->bytes + nearby, &growth->lo, &growth->hi);
+}
@@ -0,0 +1,352 @@
+/**
+ * @file cost.h
+ * @brief Cycle and byte cost model
+ *
+ * Describes what each opcode and addressing mode costs on every supported
+ * CPU: encoded size, base cycles, page-cross penalty and the extra cycles
+ * of a taken branch. Passes use it to check that a rewrite pays off under
+ * the selected optimization mode (-speed or -size), and the output stage
+ * uses it to report cycles and bytes saved per routine.
+ *
+ * Timings for the 6502, 65C02 and 65816 follow the manufacturer data
+ * sheets; the 65816 is assumed to run with 8-bit registers (see
+ * wide_instruction_cost() for 16-bit ones). 45GS02
+ * timings are approximate full-speed figures without wait states: one
+ * cycle per instruction byte plus one per memory access, and no
+ * page-cross penalties.
+ */
+
+#ifndef COST_H
+#define COST_H
+
+#include "../types.h"
+
+#define COST_LOOP_WEIGHT 10       /**< Assumed iterations per loop nesting level */
+#define COST_MAX_LOOP_DEPTH 4     /**< Nesting depth beyond which weights stop growing */
+
+/**
+ * @brief Cost of one instruction form
+ */
+typedef struct {
+    unsigned char bytes;        /**< Encoded size including prefixes and operand */
+    unsigned char cycles;       /**< Base cycle count (branch not taken) */
+    unsigned char page_penalty; /**< Extra cycles when indexing or a branch crosses a page */
+    unsigned char branch_taken; /**< Extra cycles when a conditional branch is taken */
+    bool valid;                 /**< Opcode and addressing mode exist on the CPU */
+} InstrCost;
+
+/**
+ * @brief Static cycle and byte total of a run of instructions
+ */
+typedef struct {
+    int cycles;                 /**< Sum of base cycles */
+    int bytes;                  /**< Sum of encoded sizes */
+} CostTotal;
+
+/**
+ * @brief Cost of one node as recorded by measure_node_costs()
+ */
+typedef struct {
+    InstrCost cost;             /**< Cost of one execution */
+    long runs;                  /**< Executions per pass (see estimate_node_runs()) */
+    long weight;                /**< Loop-weighted executions */
+} NodeCost;
+
+/**
+ * @brief Cost totals of one routine
+ *
+ * A routine runs from a global label up to the next one. Code before
+ * the first global label forms a routine of its own.
+ */
+typedef struct {
+    int node;                   /**< First node index of the routine */
+    CostTotal cost;             /**< Cost of the live instructions in the routine */
+} RoutineCost;
+
+/**
+ * @brief Cost totals of a whole program, split by routine
+ */
+typedef struct {
+    RoutineCost *routines;      /**< Routines in source order */
+    int count;                  /**< Number of routines */
+    CostTotal total;            /**< Sum over all routines */
+} CostSummary;
+
+/**
+ * @brief Look up the cost of an opcode and addressing mode
+ *
+ * @param op Opcode
+ * @param mode Addressing mode
+ * @param cpu Target CPU
+ * @return Cost of the instruction form; valid is false if the CPU
+ *         does not have it
+ */
+InstrCost instruction_cost(Opcode op, AddrMode mode, CpuType cpu);
+
+/**
+ * @brief Cost of a 65816 instruction running with a 16-bit register
+ *
+ * With the accumulator (M flag) or the index registers (X flag) 16
+ * bits wide, an instruction on that register moves one more byte of
+ * memory, and its immediate operand is one byte longer.
+ *
+ * @param op Opcode
+ * @param mode Addressing mode
+ * @return Cost of the instruction form; valid is false if the 65816
+ *         does not have it
+ */
+InstrCost wide_instruction_cost(Opcode op, AddrMode mode);
+
+/**
+ * @brief Cost of a program node on the program's target CPU
+ *
+ * @param prog Program owning the node
+ * @param index Node index
+ * @return Cost of the instruction, or an all-zero cost for dead nodes,
+ *         directives and unknown instruction forms
+ */
+InstrCost node_cost(const Program *prog, int index);
+
+/**
+ * @brief Add the cost of a program node to a running total
+ *
+ * @param total Total to update
+ * @param prog Program owning the node
+ * @param index Node index
+ */
+void cost_add_node(CostTotal *total, const Program *prog, int index);
+
+/**
+ * @brief Add the cost of an instruction form to a running total
+ *
+ * @param total Total to update
+ * @param cost Instruction cost (ignored if not valid)
+ */
+void cost_add(CostTotal *total, InstrCost cost);
+
+/**
+ * @brief Decide whether a rewrite pays off under the program's mode
+ *
+ * -speed compares cycles first and uses bytes to break ties; -size
+ * compares bytes first and uses cycles to break ties.
+ *
+ * @param prog Program being optimized
+ * @param before Cost of the original instructions
+ * @param after Cost of the replacement
+ * @return true if the replacement is strictly better
+ */
+bool cost_is_better(const Program *prog, CostTotal before, CostTotal after);
+
+/**
+ * @brief Decide whether a rewrite pays off under a given mode
+ *
+ * Like cost_is_better(), for passes that choose the mode per block
+ * (see mode_at()).
+ *
+ * @param mode Mode to decide under
+ * @param before Cost of the original instructions
+ * @param after Cost of the replacement
+ * @return true if the replacement is strictly better
+ */
+bool cost_is_better_for(OptMode mode, CostTotal before, CostTotal after);
+
+/**
+ * @brief Loop weight of a nesting depth
+ *
+ * Hot-path estimates multiply the cost of code inside loops by this
+ * weight (see cfg_loop_depths()).
+ *
+ * @param depth Loop nesting depth
+ * @return COST_LOOP_WEIGHT raised to the depth, capped at
+ *         COST_MAX_LOOP_DEPTH
+ */
+long loop_weight(int depth);
+
+/**
+ * @brief Trip count of a counted loop block
+ *
+ * Recognizes a block that branches back to itself with BNE or BPL on an
+ * index register stepped by DEX, DEY, INX or INY (any number of times,
+ * all in the same block), loaded with an immediate in the block that
+ * enters the loop. Unrolled loops are counted like the originals.
+ *
+ * @param prog Program owning the nodes
+ * @param cfg Control flow graph of the program
+ * @param b Block index
+ * @return Iterations per entry, or 0 if the block is not such a loop
+ */
+int loop_trip_count(const Program *prog, const struct Cfg *cfg, int b);
+
+/**
+ * @brief Estimate how often every node runs
+ *
+ * Nodes in a counted loop (see loop_trip_count()) run once per trip.
+ * Unweighted, every other node runs once; weighted, other loops count
+ * loop_weight() of their depth and counted loops are weighted by the
+ * depth of the loops around them.
+ *
+ * @param prog Program to measure
+ * @param cfg Control flow graph of the program
+ * @param weighted Weight loops of unknown trip count by nesting depth
+ * @return New array of prog->count executions (caller frees), or NULL on
+ *         allocation failure
+ */
+long* estimate_node_runs(const Program *prog, const struct Cfg *cfg, bool weighted);
+
+/**
+ * @brief Check whether a node starts a new routine
+ *
+ * @param node Node to check
+ * @return true for global labels that are not equates
+ */
+bool is_routine_start(const AstNode *node);
+
+/**
+ * @brief Record the current cost of every node
+ *
+ * Taken before optimization, the result lets reports compare input and
+ * output over the final block structure. Executions are those of the
+ * input, so a loop that is later unrolled keeps its original trip count.
+ *
+ * @param prog Program to measure
+ * @return New array of prog->count costs (caller frees), or NULL on
+ *         allocation failure
+ */
+NodeCost* measure_node_costs(const Program *prog);
+
+/**
+ * @brief Measure the live code of a program, routine by routine
+ *
+ * Cycles count each node once per execution where the trip count of its
+ * loop is known (see estimate_node_runs()), once otherwise.
+ *
+ * @param prog Program to measure
+ * @return New summary, or NULL on allocation failure
+ */
+CostSummary* measure_program_cost(const Program *prog);
+
+/**
+ * @brief Free a cost summary
+ * @param summary Summary to free (NULL-safe)
+ */
+void free_cost_summary(CostSummary *summary);
+
+/**
+ * @brief Check for a directive that reserves storage without a fill value
+ *
+ * Recognizes .res, .ds, .dsb, .blkb and .skip (with '.', '!' or no
+ * prefix) with a single numeric count.
+ *
+ * @param node Node to check
+ * @return true if the node reserves uninitialized storage
+ */
+bool is_reserve_directive(const AstNode *node);
+
+/**
+ * @brief Count the bytes a directive emits
+ *
+ * @param node Directive node (OP_NONE)
+ * @return Bytes emitted: 0 for labels, comments, symbol definitions
+ *         and origins, the data of .byte/.db and .word/.dw, the count
+ *         of reserve directives; -1 if unknown
+ */
+long directive_bytes(const AstNode *node);
+
+/**
+ * @brief Estimate the assembled address of every node
+ *
+ * Follows origin directives (* = addr, *=addr, .org, org), instruction
+ * sizes and .byte/.word data. After any other directive that may emit
+ * bytes the address is unknown until the next origin.
+ *
+ * @param prog Program to lay out
+ * @return New array of prog->count addresses, -1 where unknown (caller
+ *         frees), or NULL on allocation failure
+ */
+long* estimate_node_addresses(const Program *prog);
+
+/**
+ * @brief Check whether a taken branch crosses a page
+ *
+ * The 6502 takes one extra cycle when a taken branch lands on another
+ * page than the instruction after the branch.
+ *
+ * @param prog Program owning the nodes
+ * @param address Node addresses (see estimate_node_addresses())
+ * @param branch Branch node index
+ * @param target Target node index
+ * @return true if both addresses are known, the CPU charges the
+ *         penalty and the pages differ
+ */
+bool branch_crosses_page(const Program *prog, const long *address, int branch, int target);
+
+#define BRANCH_SCAN_BYTES 256   /**< Longest byte distance byte_span() measures */
+
+/**
+ * @brief Sum the encoded size of the live nodes in a range
+ *
+ * @param prog Program owning the nodes
+ * @param from First node index
+ * @param to One past the last node index
+ * @param bytes Receives the size
+ * @return false if a directive of unknown size is in the range or the
+ *         size exceeds BRANCH_SCAN_BYTES
+ */
+bool byte_span(const Program *prog, int from, int to, int *bytes);
+
+/**
+ * @brief Displacement a branch needs to reach a node
+ *
+ * @param prog Program owning the nodes
+ * @param branch Branch node index
+ * @param target Target node index
+ * @param offset Receives the displacement from the end of the branch
+ * @return false if the distance cannot be measured
+ */
+bool branch_offset(const Program *prog, int branch, int target, int *offset);
+
+/**
+ * @brief Check that branches around an insertion point still reach
+ *
+ * Passes that insert code call this before growing the program: every
+ * short branch (Bcc, BRA, BBRn/BBSn) across the insertion point must
+ * stay within its -128..127 byte reach. A directive of unknown size
+ * within reach, or a branch whose target is not a plain label, fails
+ * the check.
+ *
+ * @param prog Program owning the nodes (prog->cfg must be built)
+ * @param index Node the code is inserted after
+ * @param growth Bytes the insertion adds
+ * @param lo Receives the first node whose branches were checked
+ * @param hi Receives the last node whose branches were checked
+ * @return true if every branch across the insertion point stays in range
+ */
+bool branches_reach(const Program *prog, int index, int growth, int *lo, int *hi);
+
+/**
+ * @brief Code a pass inserts at one point
+ */
+typedef struct {
+    int index;                  /**< Node the code goes after */
+    int bytes;                  /**< Bytes it adds (negative if the code shrinks) */
+    int lo;                     /**< First node whose branches were checked */
+    int hi;                     /**< Last node whose branches were checked */
+} CodeGrowth;
+
+/**
+ * @brief Check that branches still reach with one more insertion
+ *
+ * A branch across this insertion and one already chosen lies in the
+ * checked range of both, so it is checked with the bytes of every
+ * chosen insertion whose range overlaps.
+ *
+ * @param prog Program owning the nodes (prog->cfg must be built)
+ * @param growth Insertion to check; index and bytes set, lo and hi
+ *        receive the checked range
+ * @param chosen Insertions already chosen
+ * @param count Number of chosen insertions
+ * @return true if every branch across the insertion stays in range
+ */
+bool growth_fits(const Program *prog, CodeGrowth *growth, const CodeGrowth *chosen, int count);
+
+#endif // COST_H
@@ -0,0 +1,143 @@
+/**
+ * @file dataflow.c
+ * @brief Forward register/flag dataflow implementation
+ *
+ * Classic iterative worklist solver. Exit states only ever lose facts
+ * as more predecessors are merged in, so every block is revisited a
+ * bounded number of times.
+ */
+
+#include "dataflow.h"
+#include "cfg.h"
+#include "registers.h"
+#include "../program/program.h"
+#include <stdlib.h>
+
+/**
+ * @brief Run the instructions of one block over a state
+ *
+ * @param prog Program owning the nodes
+ * @param block Block to transfer
+ * @param state State on entry, updated to the state on exit
+ */
+static void transfer_block(const Program *prog, const BasicBlock *block, RegisterState *state) {
+    if (block->is_data) {
+        init_entry_register_state(state, prog->cpu_type);
+        return;
+    }
+
+    for (int i = block->start; i < block->end; i++) {
+        if (node_is_dead(prog, i)) continue;
+        update_register_state(&prog->nodes[i], state);
+    }
+}
+
+/**
+ * @brief Solve the forward register dataflow of a program
+ *
+ * @param prog Program to analyze (prog->cfg must be built)
+ * @return Solved dataflow, or NULL if there is no graph or memory ran out
+ */
+Dataflow* solve_register_dataflow(const Program *prog) {
+    const Cfg *cfg = prog->cfg;
+    if (!cfg) return NULL;
+
+    int blocks = cfg->block_count;
+    int alloc = blocks > 0 ? blocks : 1;
+    Dataflow *df = malloc(sizeof(Dataflow));
+    RegisterState *out = malloc(alloc * sizeof(RegisterState));
+    bool *has_out = calloc(alloc, sizeof(bool));
+    int *queue = malloc(alloc * sizeof(int));
+    bool *queued = calloc(alloc, sizeof(bool));
+    if (df) df->block_in = malloc(alloc * sizeof(RegisterState));
+
+    if (!df || !df->block_in || !out || !has_out || !queue || !queued) {
+        if (df) free(df->block_in);
+        free(df);
+        free(out);
+        free(has_out);
+        free(queue);
+        free(queued);
+        return NULL;
+    }
+
+    df->block_count = blocks;
+    df->visits = 0;
+
+    // Seed the worklist with every block in source order
+    int head = 0, length = 0;
+    for (int b = 0; b < blocks; b++) {
+        init_entry_register_state(&df->block_in[b], prog->cpu_type);
+        queue[length++] = b;
+        queued[b] = true;
+    }
+
+    while (length > 0) {
+        int b = queue[head];
+        head = (head + 1) % blocks;
+        length--;
+        queued[b] = false;
+
+        const BasicBlock *block = &cfg->blocks[b];
+
+        // Entry state: merge of all predecessors that have been solved
+        RegisterState in;
+        bool reached = false;
+        init_entry_register_state(&in, prog->cpu_type);
+        if (!block->unknown_entry) {
+            for (int p = 0; p < block->pred_count; p++) {
+                int pred = cfg->preds[block->pred_start + p];
+                if (!has_out[pred]) continue;
+                if (!reached) {
+                    in = out[pred];
+                    reached = true;
+                } else {
+                    merge_register_state(&in, &out[pred]);
+                }
+            }
+            if (!reached) {
+                // Not reachable (yet); an unreached block assumes nothing
+                init_entry_register_state(&in, prog->cpu_type);
+            }
+        }
+        in.a_modified = in.x_modified = in.y_modified = in.z_modified = false;
+        df->block_in[b] = in;
+
+        RegisterState exit_state = in;
+        transfer_block(prog, block, &exit_state);
+        df->visits++;
+
+        // Only an unreached block with no solved predecessor stays unsolved
+        if (!block->unknown_entry && !reached && block->pred_count > 0) continue;
+
+        if (has_out[b] && register_state_equal(&out[b], &exit_state)) continue;
+        out[b] = exit_state;
+        has_out[b] = true;
+
+        for (int s = 0; s < block->succ_count; s++) {
+            int succ = block->succ[s];
+            if (queued[succ]) continue;
+            queue[(head + length) % blocks] = succ;
+            length++;
+            queued[succ] = true;
+        }
+    }
+
+    free(out);
+    free(has_out);
+    free(queue);
+    free(queued);
+    return df;
+}
+
+/**
+ * @brief Free a solved dataflow
+ *
+ * @param df Dataflow to free (NULL-safe)
+ */
+void free_dataflow(Dataflow *df) {
+    if (!df) return;
+
+    free(df->block_in);
+    free(df);
+}
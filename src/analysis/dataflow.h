@@ -0,0 +1,44 @@
+/**
+ * @file dataflow.h
+ * @brief Forward register/flag dataflow over the control flow graph
+ *
+ * Propagates RegisterState through the basic blocks of prog->cfg and
+ * merges it at join points until a fixed point is reached, including
+ * around loop back-edges. Passes use the per-block entry states to
+ * prove instructions redundant.
+ */
+
+#ifndef DATAFLOW_H
+#define DATAFLOW_H
+
+#include "../types.h"
+
+/**
+ * @brief Solved register dataflow of a program
+ */
+typedef struct {
+    RegisterState *block_in;    /**< Register state on entry to each block */
+    int block_count;            /**< Number of entries in block_in */
+    int visits;                 /**< Block transfers needed to converge */
+} Dataflow;
+
+/**
+ * @brief Solve the forward register dataflow of a program
+ *
+ * Blocks flagged unknown_entry and blocks no path reaches start with
+ * nothing known (see init_entry_register_state()). Every other block
+ * starts with the merge of its predecessors' exit states. Dead nodes
+ * are skipped.
+ *
+ * @param prog Program to analyze (prog->cfg must be built)
+ * @return Solved dataflow, or NULL if there is no graph or memory ran out
+ */
+Dataflow* solve_register_dataflow(const Program *prog);
+
+/**
+ * @brief Free a solved dataflow
+ * @param df Dataflow to free (NULL-safe)
+ */
+void free_dataflow(Dataflow *df);
+
+#endif // DATAFLOW_H
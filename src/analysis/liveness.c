@@ -0,0 +1,249 @@
+/**
+ * @file liveness.c
+ * @brief Backward register/flag liveness implementation
+ *
+ * Iterative worklist solver running against the edges of the graph.
+ * Live sets only ever grow as successors are merged in, so every block
+ * is revisited a bounded number of times.
+ */
+
+#include "liveness.h"
+#include "cfg.h"
+#include "registers.h"
+#include "../program/program.h"
+#include <stdlib.h>
+
+/**
+ * @brief Get the registers and flags an instruction always overwrites
+ *
+ * REP and SEP only change the flags their operand selects. On the 65816
+ * writes of A are left out when whole_a is set, since an 8-bit write
+ * leaves the high byte in place.
+ *
+ * @param prog Program owning the node
+ * @param node Instruction node
+ * @param whole_a A stands for both bytes of the 65816 accumulator
+ * @return RF_* mask of the registers and flags killed
+ */
+static unsigned int instruction_kills(const Program *prog, const AstNode *node, bool whole_a) {
+    unsigned int kills = opcode_writes(node->op, node->mode);
+    if (node->op == OP_REP || node->op == OP_SEP) {
+        int bits = node->mode == AM_IMMEDIATE ? parse_immediate_value(node->operand) : -1;
+        kills = 0;
+        if (bits >= 0) {
+            if (bits & 0x01) kills |= RF_C;
+            if (bits & 0x02) kills |= RF_ZF;
+            if (bits & 0x40) kills |= RF_V;
+            if (bits & 0x80) kills |= RF_N;
+        }
+    }
+    if (whole_a && prog->cpu_type == CPU_65816) kills &= ~RF_A;
+    return kills;
+}
+
+/**
+ * @brief Step liveness backward over one instruction
+ *
+ * @param prog Program owning the node
+ * @param index Node index (must be an instruction)
+ * @param live Live registers/flags after the instruction
+ * @param whole_a A stands for both bytes of the 65816 accumulator
+ * @return Live registers/flags before the instruction
+ */
+static unsigned int step_before(const Program *prog, int index, unsigned int live, bool whole_a) {
+    const AstNode *node = &prog->nodes[index];
+
+    // The callee may read anything
+    if (opcode_info(node->op)->flow == FLOW_CALL) return LIVE_TRACKED;
+
+    unsigned int kills = instruction_kills(prog, node, whole_a) & LIVE_TRACKED;
+    return (live & ~kills) | (opcode_reads(node->op, node->mode) & LIVE_TRACKED);
+}
+
+/**
+ * @brief Step liveness backward over one instruction
+ *
+ * @param prog Program owning the node
+ * @param index Node index (must be an instruction)
+ * @param live Live registers/flags after the instruction
+ * @return Live registers/flags before the instruction
+ */
+unsigned int live_before(const Program *prog, int index, unsigned int live) {
+    return step_before(prog, index, live, true);
+}
+
+/**
+ * @brief Get the registers live on leaving a block for the outside
+ *
+ * @param prog Program owning the nodes
+ * @param cfg Graph of the program
+ * @param b Block index
+ * @return LIVE_TRACKED if control may leave the graph at the end of the
+ *         block, 0 otherwise
+ */
+static unsigned int exit_live(const Program *prog, const Cfg *cfg, int b) {
+    const BasicBlock *block = &cfg->blocks[b];
+    if (block->unknown_exit || block->is_data) return LIVE_TRACKED;
+
+    int flow = FLOW_NONE;
+    for (int i = block->end - 1; i >= block->start; i--) {
+        if (prog->nodes[i].op != OP_NONE) {
+            flow = opcode_info(prog->nodes[i].op)->flow;
+            break;
+        }
+    }
+    if (flow == FLOW_RETURN || flow == FLOW_STOP) return LIVE_TRACKED;
+
+    // Falling off the end of the program
+    if (flow != FLOW_JUMP && b + 1 == cfg->block_count) return LIVE_TRACKED;
+    return 0;
+}
+
+/**
+ * @brief Step liveness backward over a whole block
+ *
+ * @param prog Program owning the nodes
+ * @param block Block to transfer
+ * @param live Live registers/flags on exit from the block
+ * @param whole_a A stands for both bytes of the 65816 accumulator
+ * @return Live registers/flags on entry to the block
+ */
+static unsigned int transfer_block(const Program *prog, const BasicBlock *block, unsigned int live,
+                                   bool whole_a) {
+    if (block->is_data) return LIVE_TRACKED;
+
+    for (int i = block->end - 1; i >= block->start; i--) {
+        if (node_is_dead(prog, i) || prog->nodes[i].op == OP_NONE) continue;
+        live = step_before(prog, i, live, whole_a);
+    }
+    return live;
+}
+
+/**
+ * @brief Solve the backward liveness of a program
+ *
+ * @param prog Program to analyze (prog->cfg must be built)
+ * @param whole_a A stands for both bytes of the 65816 accumulator
+ * @return Solved liveness, or NULL if there is no graph or memory ran out
+ */
+static Liveness* solve(const Program *prog, bool whole_a) {
+    const Cfg *cfg = prog->cfg;
+    if (!cfg) return NULL;
+
+    int blocks = cfg->block_count;
+    int alloc = blocks > 0 ? blocks : 1;
+    Liveness *lv = malloc(sizeof(Liveness));
+    unsigned int *in = calloc(alloc, sizeof(unsigned int));
+    int *queue = malloc(alloc * sizeof(int));
+    bool *queued = calloc(alloc, sizeof(bool));
+    if (lv) lv->block_out = malloc(alloc * sizeof(unsigned int));
+
+    if (!lv || !lv->block_out || !in || !queue || !queued) {
+        if (lv) free(lv->block_out);
+        free(lv);
+        free(in);
+        free(queue);
+        free(queued);
+        return NULL;
+    }
+
+    lv->block_count = blocks;
+    lv->visits = 0;
+
+    // Seed the worklist with every block, last first
+    int head = 0, length = 0;
+    for (int b = blocks - 1; b >= 0; b--) {
+        lv->block_out[b] = 0;
+        queue[length++] = b;
+        queued[b] = true;
+    }
+
+    while (length > 0) {
+        int b = queue[head];
+        head = (head + 1) % blocks;
+        length--;
+        queued[b] = false;
+
+        const BasicBlock *block = &cfg->blocks[b];
+        unsigned int out = exit_live(prog, cfg, b);
+        for (int s = 0; s < block->succ_count; s++) {
+            out |= in[block->succ[s]];
+        }
+        lv->block_out[b] = out;
+
+        unsigned int entry = transfer_block(prog, block, out, whole_a);
+        lv->visits++;
+        if (entry == in[b]) continue;
+        in[b] = entry;
+
+        for (int p = 0; p < block->pred_count; p++) {
+            int pred = cfg->preds[block->pred_start + p];
+            if (queued[pred]) continue;
+            queue[(head + length) % blocks] = pred;
+            length++;
+            queued[pred] = true;
+        }
+    }
+
+    free(in);
+    free(queue);
+    free(queued);
+    return lv;
+}
+
+/**
+ * @brief Solve the backward liveness of a program
+ *
+ * @param prog Program to analyze (prog->cfg must be built)
+ * @return Solved liveness, or NULL if there is no graph or memory ran out
+ */
+Liveness* solve_liveness(const Program *prog) {
+    return solve(prog, true);
+}
+
+/**
+ * @brief Solve the liveness of the low byte of A (65816)
+ *
+ * @param prog Program to analyze (prog->cfg must be built)
+ * @return Solved liveness, or NULL if there is no graph or memory ran out
+ */
+Liveness* solve_byte_liveness(const Program *prog) {
+    return solve(prog, false);
+}
+
+/**
+ * @brief Free a solved liveness
+ *
+ * @param lv Liveness to free (NULL-safe)
+ */
+void free_liveness(Liveness *lv) {
+    if (!lv) return;
+
+    free(lv->block_out);
+    free(lv);
+}
+
+/**
+ * @brief Check whether registers are overwritten before anything reads them
+ *
+ * @param prog Program owning the nodes
+ * @param index Node after which to start scanning
+ * @param end One past the last node to scan
+ * @param regs RF_* registers/flags to check
+ * @return true if every register in the mask is written before it is read
+ */
+bool registers_dead_after(const Program *prog, int index, int end, unsigned int regs) {
+    for (int i = index + 1; i < end && regs; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i)) continue;
+        if (node->op == OP_NONE) {
+            if (node->opcode && node->opcode[0]) return false;
+            continue;
+        }
+
+        if (opcode_reads(node->op, node->mode) & regs) return false;
+        if (opcode_info(node->op)->flow != FLOW_NONE) return false;
+        regs &= ~instruction_kills(prog, node, true);
+    }
+    return regs == 0;
+}
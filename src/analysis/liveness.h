@@ -0,0 +1,91 @@
+/**
+ * @file liveness.h
+ * @brief Backward register/flag liveness over the control flow graph
+ *
+ * A register or flag is live at a point if some path from there reads
+ * it before writing it. Liveness is tracked for A, X, Y, Z and the C,
+ * N, Z and V flags; everything else an instruction touches (memory,
+ * stack, D, I) is never considered dead.
+ *
+ * Calls and returns are handled conservatively: a subroutine may read
+ * every register and flag and returns with all of them live, and so do
+ * jumps that leave the graph.
+ */
+
+#ifndef LIVENESS_H
+#define LIVENESS_H
+
+#include "../types.h"
+
+/** Registers and flags liveness is tracked for */
+#define LIVE_TRACKED (RF_REGS | RF_NZCV)
+
+/**
+ * @brief Solved liveness of a program
+ */
+typedef struct {
+    unsigned int *block_out;    /**< Live registers/flags on exit from each block */
+    int block_count;            /**< Number of entries in block_out */
+    int visits;                 /**< Block transfers needed to converge */
+} Liveness;
+
+/**
+ * @brief Solve the backward liveness of a program
+ *
+ * Blocks that return, stop, leave through an unresolved jump or fall
+ * off the end of the program exit with everything live; data blocks
+ * are entered with everything live. Dead nodes are skipped.
+ *
+ * @param prog Program to analyze (prog->cfg must be built)
+ * @return Solved liveness, or NULL if there is no graph or memory ran out
+ */
+Liveness* solve_liveness(const Program *prog);
+
+/**
+ * @brief Solve the liveness of the low byte of A (65816)
+ *
+ * Like solve_liveness(), except that every write of A ends its
+ * liveness, so A stands for the low byte alone: what byte-wide code
+ * leaves behind. The same as solve_liveness() on the other CPUs.
+ *
+ * @param prog Program to analyze (prog->cfg must be built)
+ * @return Solved liveness, or NULL if there is no graph or memory ran out
+ */
+Liveness* solve_byte_liveness(const Program *prog);
+
+/**
+ * @brief Free a solved liveness
+ * @param lv Liveness to free (NULL-safe)
+ */
+void free_liveness(Liveness *lv);
+
+/**
+ * @brief Step liveness backward over one instruction
+ *
+ * On the 65816 writes of A do not end its liveness, since an 8-bit
+ * write leaves the high byte in place. REP and SEP only end the
+ * liveness of the flags their operand selects.
+ *
+ * @param prog Program owning the node
+ * @param index Node index (must be an instruction)
+ * @param live Live registers/flags after the instruction
+ * @return Live registers/flags before the instruction
+ */
+unsigned int live_before(const Program *prog, int index, unsigned int live);
+
+/**
+ * @brief Check whether registers are overwritten before anything reads them
+ *
+ * Scans forward from the node after index. Registers that reach a
+ * branch, jump, call, return or directive, or the end of the range, are
+ * considered live.
+ *
+ * @param prog Program owning the nodes
+ * @param index Node after which to start scanning
+ * @param end One past the last node to scan
+ * @param regs RF_* registers/flags to check
+ * @return true if every register in the mask is written before it is read
+ */
+bool registers_dead_after(const Program *prog, int index, int end, unsigned int regs);
+
+#endif // LIVENESS_H
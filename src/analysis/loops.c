@@ -0,0 +1,304 @@
+/**
+ * @file loops.c
+ * @brief Dominators and natural loops implementation
+ *
+ * Dominators are solved with the iterative algorithm of Cooper, Harvey
+ * and Kennedy over a reverse postorder of the graph, which converges in
+ * a couple of sweeps for assembly code. Dominance tests then use the
+ * preorder interval of each block in the dominator tree, so finding the
+ * back-edges is linear in the number of edges.
+ */
+
+#include "loops.h"
+#include "cfg.h"
+#include <stdlib.h>
+
+/**
+ * @brief Scratch arrays of the dominator computation
+ *
+ * Index block_count stands for the virtual root preceding every entry
+ * point.
+ */
+typedef struct {
+    int *order;                 /**< Blocks in reverse postorder, root first */
+    int *rpo;                   /**< Position of each block in order, -1 if unreachable */
+    int *idom;                  /**< Immediate dominator of each block */
+    int *pre;                   /**< Preorder number in the dominator tree */
+    int *post;                  /**< Last preorder number below the block */
+    int reached;                /**< Entries of order in use */
+} Dominators;
+
+/**
+ * @brief Number the blocks reachable from the entry points in reverse postorder
+ *
+ * @param cfg Graph to number
+ * @param dom Dominator arrays to fill in (order and rpo)
+ * @param stack Scratch array of block_count + 1 entries
+ * @param next Scratch array of block_count + 1 entries
+ */
+static void number_blocks(const Cfg *cfg, Dominators *dom, int *stack, int *next) {
+    int n = cfg->block_count;
+    int root = n;
+    int posts = 0;
+
+    for (int b = 0; b <= n; b++) {
+        dom->rpo[b] = -1;
+        next[b] = 0;
+    }
+
+    // Depth-first from the root; order is filled from the back
+    int depth = 0;
+    stack[depth++] = root;
+    dom->rpo[root] = 0;
+    while (depth > 0) {
+        int b = stack[depth - 1];
+        int succ = -1;
+
+        if (b == root) {
+            while (next[b] < n && succ < 0) {
+                int e = next[b]++;
+                if (cfg->blocks[e].unknown_entry && dom->rpo[e] < 0) succ = e;
+            }
+        } else {
+            const BasicBlock *block = &cfg->blocks[b];
+            while (next[b] < block->succ_count && succ < 0) {
+                int s = block->succ[next[b]++];
+                if (dom->rpo[s] < 0) succ = s;
+            }
+        }
+
+        if (succ >= 0) {
+            dom->rpo[succ] = 0;
+            stack[depth++] = succ;
+        } else {
+            next[b] = posts++;
+            depth--;
+        }
+    }
+
+    // next[] now holds the postorder number of every reached block
+    dom->reached = posts;
+    for (int b = 0; b <= n; b++) {
+        if (dom->rpo[b] < 0) continue;
+        dom->rpo[b] = posts - 1 - next[b];
+        dom->order[dom->rpo[b]] = b;
+    }
+}
+
+/**
+ * @brief Find the nearest common dominator of two blocks
+ *
+ * @param dom Dominator arrays (rpo and the idom entries solved so far)
+ * @param a Block
+ * @param b Block
+ * @return Common dominator
+ */
+static int intersect(const Dominators *dom, int a, int b) {
+    while (a != b) {
+        while (dom->rpo[a] > dom->rpo[b]) a = dom->idom[a];
+        while (dom->rpo[b] > dom->rpo[a]) b = dom->idom[b];
+    }
+    return a;
+}
+
+/**
+ * @brief Solve the immediate dominator of every reachable block
+ *
+ * @param cfg Graph to analyze
+ * @param dom Dominator arrays with the blocks numbered
+ */
+static void solve_dominators(const Cfg *cfg, Dominators *dom) {
+    int root = cfg->block_count;
+    for (int b = 0; b <= root; b++) {
+        dom->idom[b] = -1;
+    }
+    dom->idom[root] = root;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int k = 1; k < dom->reached; k++) {
+            int b = dom->order[k];
+            const BasicBlock *block = &cfg->blocks[b];
+            int idom = block->unknown_entry ? root : -1;
+
+            for (int p = 0; p < block->pred_count; p++) {
+                int pred = cfg->preds[block->pred_start + p];
+                if (dom->rpo[pred] < 0 || dom->idom[pred] < 0) continue;
+                idom = idom < 0 ? pred : intersect(dom, pred, idom);
+            }
+            if (idom != dom->idom[b]) {
+                dom->idom[b] = idom;
+                changed = true;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Number the dominator tree in preorder
+ *
+ * @param cfg Graph the tree belongs to
+ * @param dom Dominator arrays with idom solved
+ * @param first Scratch array of block_count + 2 entries
+ * @param child Scratch array of block_count + 1 entries
+ */
+static void number_dominator_tree(const Cfg *cfg, Dominators *dom, int *first, int *child) {
+    int n = cfg->block_count;
+    int root = n;
+
+    // Children of every block, back to back (counting sort by idom)
+    for (int b = 0; b <= n + 1; b++) first[b] = 0;
+    for (int k = 1; k < dom->reached; k++) first[dom->idom[dom->order[k]] + 1]++;
+    for (int b = 0; b <= n; b++) first[b + 1] += first[b];
+    for (int k = 1; k < dom->reached; k++) {
+        int b = dom->order[k];
+        child[first[dom->idom[b]]++] = b;
+    }
+    for (int b = n; b > 0; b--) first[b] = first[b - 1];
+    first[0] = 0;
+
+    // Iterative preorder walk; post[] doubles as the child cursor and
+    // order, no longer needed, as the stack
+    int *stack = dom->order;
+    int depth = 0;
+    int number = 0;
+    stack[depth++] = root;
+    dom->pre[root] = number++;
+    dom->post[root] = first[root];
+    while (depth > 0) {
+        int b = stack[depth - 1];
+        if (dom->post[b] < first[b + 1]) {
+            int c = child[dom->post[b]++];
+            dom->pre[c] = number++;
+            dom->post[c] = first[c];
+            stack[depth++] = c;
+        } else {
+            dom->post[b] = number - 1;
+            depth--;
+        }
+    }
+}
+
+/**
+ * @brief Check whether one reachable block dominates another
+ *
+ * @param dom Solved dominator arrays
+ * @param a Possible dominator
+ * @param b Block
+ * @return true if every path to b passes through a
+ */
+static bool dominates(const Dominators *dom, int a, int b) {
+    return dom->pre[a] <= dom->pre[b] && dom->post[b] <= dom->post[a];
+}
+
+/**
+ * @brief Find the natural loops of a graph
+ *
+ * @param cfg Graph to analyze
+ * @return New loop set, or NULL on allocation failure
+ */
+CfgLoops* find_natural_loops(const Cfg *cfg) {
+    int n = cfg->block_count;
+    size_t alloc = (size_t)n + 2;
+    Dominators dom;
+    dom.order = malloc(alloc * sizeof(int));
+    dom.rpo = malloc(alloc * sizeof(int));
+    dom.idom = malloc(alloc * sizeof(int));
+    dom.pre = malloc(alloc * sizeof(int));
+    dom.post = malloc(alloc * sizeof(int));
+    int *scratch = malloc(alloc * sizeof(int));
+    int *scratch2 = malloc(alloc * sizeof(int));
+    CfgLoops *loops = calloc(1, sizeof(CfgLoops));
+    int loop_capacity = 0, body_capacity = 0, body_count = 0;
+
+    bool ok = dom.order && dom.rpo && dom.idom && dom.pre && dom.post && scratch && scratch2 &&
+              loops;
+    if (ok) {
+        number_blocks(cfg, &dom, scratch, scratch2);
+        solve_dominators(cfg, &dom);
+        number_dominator_tree(cfg, &dom, scratch, scratch2);
+
+        // scratch: loop that last visited each block; scratch2: flood stack
+        for (int b = 0; b < n; b++) scratch[b] = -1;
+
+        for (int b = 0; b < n && ok; b++) {
+            if (dom.rpo[b] < 0) continue;
+            const BasicBlock *block = &cfg->blocks[b];
+
+            for (int s = 0; s < block->succ_count && ok; s++) {
+                int head = block->succ[s];
+                if (!dominates(&dom, head, b)) continue;
+
+                if (loops->count == loop_capacity) {
+                    loop_capacity = loop_capacity ? loop_capacity * 2 : 16;
+                    CfgLoop *grown = realloc(loops->loops, loop_capacity * sizeof(CfgLoop));
+                    if (!grown) { ok = false; break; }
+                    loops->loops = grown;
+                }
+                int l = loops->count++;
+                CfgLoop *loop = &loops->loops[l];
+                loop->header = head;
+                loop->latch = b;
+                loop->body_start = body_count;
+
+                // Flood backward from the latch, stopping at the header
+                int depth = 0;
+                scratch[head] = l;
+                scratch2[depth++] = head;
+                if (scratch[b] != l) {
+                    scratch[b] = l;
+                    scratch2[depth++] = b;
+                }
+                for (int k = 1; k < depth; k++) {
+                    const BasicBlock *member = &cfg->blocks[scratch2[k]];
+                    for (int p = 0; p < member->pred_count; p++) {
+                        int pred = cfg->preds[member->pred_start + p];
+                        if (dom.rpo[pred] < 0 || scratch[pred] == l) continue;
+                        scratch[pred] = l;
+                        scratch2[depth++] = pred;
+                    }
+                }
+
+                if (body_count + depth > body_capacity) {
+                    while (body_count + depth > body_capacity) {
+                        body_capacity = body_capacity ? body_capacity * 2 : 64;
+                    }
+                    int *grown = realloc(loops->body, body_capacity * sizeof(int));
+                    if (!grown) { ok = false; break; }
+                    loops->body = grown;
+                }
+                for (int k = 0; k < depth; k++) {
+                    loops->body[body_count++] = scratch2[k];
+                }
+                loop->body_count = depth;
+            }
+        }
+    }
+
+    free(dom.order);
+    free(dom.rpo);
+    free(dom.idom);
+    free(dom.pre);
+    free(dom.post);
+    free(scratch);
+    free(scratch2);
+    if (!ok) {
+        free_natural_loops(loops);
+        return NULL;
+    }
+    return loops;
+}
+
+/**
+ * @brief Free a loop set
+ *
+ * @param loops Loops to free (NULL-safe)
+ */
+void free_natural_loops(CfgLoops *loops) {
+    if (!loops) return;
+
+    free(loops->loops);
+    free(loops->body);
+    free(loops);
+}
@@ -0,0 +1,59 @@
+/**
+ * @file loops.h
+ * @brief Dominators and natural loops of the control flow graph
+ *
+ * A block dominates another if every path from an entry point to the
+ * second passes through the first. An edge whose target dominates its
+ * source is a back-edge; its natural loop is the target (the header)
+ * plus every block that reaches the source without passing through the
+ * header.
+ *
+ * The graph may have many entry points (see BasicBlock::unknown_entry),
+ * so dominators are computed from a virtual root that precedes all of
+ * them. Blocks no entry point reaches belong to no loop.
+ */
+
+#ifndef LOOPS_H
+#define LOOPS_H
+
+#include "../types.h"
+
+struct Cfg;
+
+/**
+ * @brief Natural loop of one back-edge
+ */
+typedef struct {
+    int header;                 /**< Block the back-edge jumps to */
+    int latch;                  /**< Block the back-edge leaves from */
+    int body_start;             /**< First block of the loop in CfgLoops::body */
+    int body_count;             /**< Blocks in the loop, header included */
+} CfgLoop;
+
+/**
+ * @brief Natural loops of a graph
+ */
+typedef struct {
+    CfgLoop *loops;             /**< Loops, ordered by latch block */
+    int count;                  /**< Number of loops */
+    int *body;                  /**< Block lists of all loops, back to back */
+} CfgLoops;
+
+/**
+ * @brief Find the natural loops of a graph
+ *
+ * Every back-edge yields its own loop, so a header with several latches
+ * heads several loops.
+ *
+ * @param cfg Graph to analyze
+ * @return New loop set, or NULL on allocation failure
+ */
+CfgLoops* find_natural_loops(const struct Cfg *cfg);
+
+/**
+ * @brief Free a loop set
+ * @param loops Loops to free (NULL-safe)
+ */
+void free_natural_loops(CfgLoops *loops);
+
+#endif // LOOPS_H
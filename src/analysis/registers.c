@@ -13,733 +13,961 @@
  */
 
 #include "registers.h"
+#include "../program/program.h"
+#include <ctype.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <strings.h>
 
 /**
- * @brief Update register state based on an instruction
- *
- * Analyzes a single 6502 instruction and updates the register state
- * to reflect its effects. For each instruction, determines:
- * - Which registers are modified
- * - Whether register values are known (immediate mode loads)
- * - Which processor flags are affected
- * - Whether flag states are known
+ * @brief Reset a register state to "nothing known"
  *
- * The function handles all standard 6502 opcodes plus 65C02 and 45GS02
- * extensions. Branch targets reset register knowledge conservatively.
- *
- * @param node AST node containing the instruction and operand
- * @param state Register state to update (modified in place)
+ * @param state Register state to initialize
  */
-void update_register_state(AstNode *node, RegisterState *state) {
-    if (!node || !node->opcode) return;
-
-    // Reset modification flags
-    state->a_modified = false;
-    state->x_modified = false;
-    state->y_modified = false;
-    state->z_modified = false;
-
-    // === LOAD INSTRUCTIONS ===
-    // LDA - Load Accumulator: Sets N and Z flags
-    if (strcasecmp(node->opcode, "LDA") == 0) {
-        state->a_modified = true;
-        state->n_known = true;
-        state->z_flag_known = true;
+void init_register_state(RegisterState *state) {
+    memset(state, 0, sizeof(*state));
+    state->a_num = -1;
+    state->x_num = -1;
+    state->y_num = -1;
+    state->z_num = -1;
+    state->m_width = 8;
+    state->x_width = 8;
+}
 
-        if (node->operand && node->operand[0] == '#') {
-            // Immediate mode - we know the exact value
-            state->a_known = true;
-            strcpy(state->a_value, node->operand);
-            state->a_zero = (strcmp(node->operand, "#$00") == 0 || strcmp(node->operand, "#0") == 0);
-            state->z_flag_set = state->a_zero;
-            // For N flag, we'd need to parse the value to check bit 7
-            // Simplified: if value is $80-$FF, N is set
-            state->n_set = false; // Conservative - would need full value parsing
-        } else {
-            // Memory load - value unknown
-            state->a_known = false;
-            state->a_zero = false;
-            state->a_value[0] = '\0';
-            state->z_flag_set = false; // Unknown
-            state->n_set = false;      // Unknown
-            state->z_flag_known = false;
-            state->n_known = false;
-        }
+/**
+ * @brief Reset a register state for code entered from outside
+ *
+ * @param state Register state to initialize
+ * @param cpu Target CPU
+ */
+void init_entry_register_state(RegisterState *state, CpuType cpu) {
+    init_register_state(state);
+    if (cpu == CPU_65816) {
+        state->wide_capable = true;
+        state->m_width = 0;
+        state->x_width = 0;
     }
+}
 
-    // LDX - Load X Register: Sets N and Z flags
-    else if (strcasecmp(node->opcode, "LDX") == 0) {
-        state->x_modified = true;
-        state->n_known = true;
-        state->z_flag_known = true;
-
-        if (node->operand && node->operand[0] == '#') {
-            state->x_known = true;
-            strcpy(state->x_value, node->operand);
-            state->x_zero = (strcmp(node->operand, "#$00") == 0 || strcmp(node->operand, "#0") == 0);
-            state->z_flag_set = state->x_zero;
-            state->n_set = false; // Conservative
-        } else {
-            state->x_known = false;
-            state->x_zero = false;
-            state->x_value[0] = '\0';
-            state->z_flag_known = false;
-            state->n_known = false;
+/**
+ * @brief Get the side-table register state slot for a node
+ *
+ * The table is allocated on first use and grown when nodes have been
+ * added since, so programs that never ask for per-node state pay nothing.
+ * New slots start out as "nothing known".
+ *
+ * @param prog Program owning the side table
+ * @param node Node whose state slot to return
+ * @return Pointer to the node's slot, or NULL on allocation failure
+ */
+RegisterState* get_node_register_state(Program *prog, const AstNode *node) {
+    if (node->index < 0) return NULL;
+
+    if (node->index >= prog->reg_state_count) {
+        int count = prog->count > node->index ? prog->count : node->index + 1;
+        RegisterState *states = realloc(prog->reg_states, count * sizeof(RegisterState));
+        if (!states) return NULL;
+        for (int i = prog->reg_state_count; i < count; i++) {
+            init_register_state(&states[i]);
         }
+        prog->reg_states = states;
+        prog->reg_state_count = count;
     }
 
-    // LDY - Load Y Register: Sets N and Z flags
-    else if (strcasecmp(node->opcode, "LDY") == 0) {
-        state->y_modified = true;
-        state->n_known = true;
-        state->z_flag_known = true;
+    return &prog->reg_states[node->index];
+}
 
-        if (node->operand && node->operand[0] == '#') {
-            state->y_known = true;
-            strcpy(state->y_value, node->operand);
-            state->y_zero = (strcmp(node->operand, "#$00") == 0 || strcmp(node->operand, "#0") == 0);
-            state->z_flag_set = state->y_zero;
-            state->n_set = false; // Conservative
-        } else {
-            state->y_known = false;
-            state->y_zero = false;
-            state->y_value[0] = '\0';
-            state->z_flag_known = false;
-            state->n_known = false;
-        }
-    }
+/**
+ * @brief Release the register state side table
+ *
+ * @param prog Program owning the side table
+ */
+void free_register_states(Program *prog) {
+    free(prog->reg_states);
+    prog->reg_states = NULL;
+    prog->reg_state_count = 0;
+}
 
-    // LDZ - Load Z Register (45GS02): Sets N and Z flags
-    else if (strcasecmp(node->opcode, "LDZ") == 0) {
-        state->z_modified = true;
-        state->n_known = true;
-        state->z_flag_known = true;
+/* Register selectors for the helpers below */
+#define REG_A 'A'
+#define REG_X 'X'
+#define REG_Y 'Y'
+#define REG_Z 'Z'
 
-        if (node->operand && node->operand[0] == '#') {
-            state->z_known = true;
-            strcpy(state->z_value, node->operand);
-            state->z_zero = (strcmp(node->operand, "#$00") == 0 || strcmp(node->operand, "#0") == 0);
-            state->z_flag_set = state->z_zero;
-            state->n_set = false; // Conservative
-        } else {
-            state->z_known = false;
-            state->z_zero = false;
-            state->z_value[0] = '\0';
-            state->z_flag_known = false;
-            state->n_known = false;
-        }
-    }
+/**
+ * @brief Pointers to the fields describing one register
+ */
+typedef struct {
+    bool *known;
+    bool *zero;
+    bool *modified;
+    char *value;
+    short *num;
+} RegFields;
 
-    // === STORE INSTRUCTIONS ===
-    // STA, STX, STY, STZ - Store instructions: No flags affected
-    else if (strcasecmp(node->opcode, "STA") == 0 ||
-             strcasecmp(node->opcode, "STX") == 0 ||
-             strcasecmp(node->opcode, "STY") == 0 ||
-             strcasecmp(node->opcode, "STZ") == 0) {
-        // Store operations don't affect registers or flags
+/**
+ * @brief Get the fields of one register
+ *
+ * @param state Register state
+ * @param reg REG_A, REG_X, REG_Y or REG_Z
+ * @return Pointers into state
+ */
+static RegFields reg_fields(RegisterState *state, char reg) {
+    switch (reg) {
+        case REG_X:
+            return (RegFields){&state->x_known, &state->x_zero, &state->x_modified,
+                               state->x_value, &state->x_num};
+        case REG_Y:
+            return (RegFields){&state->y_known, &state->y_zero, &state->y_modified,
+                               state->y_value, &state->y_num};
+        case REG_Z:
+            return (RegFields){&state->z_known, &state->z_zero, &state->z_modified,
+                               state->z_value, &state->z_num};
+        default:
+            return (RegFields){&state->a_known, &state->a_zero, &state->a_modified,
+                               state->a_value, &state->a_num};
     }
+}
 
-    // === TRANSFER INSTRUCTIONS ===
-    // TAX - Transfer A to X: Sets N and Z flags
-    else if (strcasecmp(node->opcode, "TAX") == 0) {
-        state->x_modified = true;
-        state->x_known = state->a_known;
-        if (state->a_known) {
-            strcpy(state->x_value, state->a_value);
-            state->x_zero = state->a_zero;
-        }
-        state->n_known = state->a_known;
-        state->z_flag_known = state->a_known;
-        if (state->a_known) {
-            state->z_flag_set = state->a_zero;
-        }
+/**
+ * @brief Get the width of a register
+ *
+ * @param state Register state
+ * @param reg 'A', 'X', 'Y' or 'Z'
+ * @return 8 or 16 bits, or 0 if unknown
+ */
+int register_width(const RegisterState *state, char reg) {
+    if (!state->wide_capable) return 8;
+    switch (reg) {
+        case REG_A:          return state->m_width;
+        case REG_X: case REG_Y: return state->x_width;
+        default:             return 8;
     }
+}
 
-    // TXA - Transfer X to A: Sets N and Z flags
-    else if (strcasecmp(node->opcode, "TXA") == 0) {
-        state->a_modified = true;
-        state->a_known = state->x_known;
-        if (state->x_known) {
-            strcpy(state->a_value, state->x_value);
-            state->a_zero = state->x_zero;
-        }
-        state->n_known = state->x_known;
-        state->z_flag_known = state->x_known;
-        if (state->x_known) {
-            state->z_flag_set = state->x_zero;
+/**
+ * @brief Parse an immediate operand into a byte value
+ *
+ * Understands #$hex, #%binary, #decimal and the #< / #> low/high byte
+ * operators applied to a numeric literal.
+ *
+ * @param operand Operand text starting with '#'
+ * @return Value 0-255, or -1 if the operand is symbolic
+ */
+int parse_immediate_value(const char *operand) {
+    if (!operand || operand[0] != '#') return -1;
+
+    const char *p = operand + 1;
+    int shift = 0;
+    if (*p == '<') {
+        p++;
+    } else if (*p == '>') {
+        shift = 8;
+        p++;
+    }
+
+    int base = 10;
+    if (*p == '$') {
+        base = 16;
+        p++;
+    } else if (*p == '%') {
+        base = 2;
+        p++;
+    }
+    if (!*p) return -1;
+
+    long value = 0;
+    for (; *p && !isspace((unsigned char)*p); p++) {
+        int digit;
+        if (isdigit((unsigned char)*p)) {
+            digit = *p - '0';
+        } else if (isxdigit((unsigned char)*p)) {
+            digit = toupper((unsigned char)*p) - 'A' + 10;
+        } else {
+            return -1;
         }
+        if (digit >= base) return -1;
+        value = value * base + digit;
+        if (value > 0xFFFFFF) return -1;
     }
 
-    // TAY - Transfer A to Y: Sets N and Z flags
-    else if (strcasecmp(node->opcode, "TAY") == 0) {
-        state->y_modified = true;
-        state->y_known = state->a_known;
-        if (state->a_known) {
-            strcpy(state->y_value, state->a_value);
-            state->y_zero = state->a_zero;
-        }
-        state->n_known = state->a_known;
-        state->z_flag_known = state->a_known;
-        if (state->a_known) {
-            state->z_flag_set = state->a_zero;
-        }
-    }
+    value >>= shift;
+    if (shift == 0 && value > 0xFF && operand[1] != '<') return -1;
+    return (int)(value & 0xFF);
+}
 
-    // TYA - Transfer Y to A: Sets N and Z flags
-    else if (strcasecmp(node->opcode, "TYA") == 0) {
-        state->a_modified = true;
-        state->a_known = state->y_known;
-        if (state->y_known) {
-            strcpy(state->a_value, state->y_value);
-            state->a_zero = state->y_zero;
-        }
-        state->n_known = state->y_known;
-        state->z_flag_known = state->y_known;
-        if (state->y_known) {
-            state->z_flag_set = state->y_zero;
-        }
-    }
+/**
+ * @brief Mark a register as written with an unknown value
+ *
+ * @param state Register state
+ * @param reg Register selector
+ */
+static void reg_unknown(RegisterState *state, char reg) {
+    RegFields r = reg_fields(state, reg);
+    *r.known = false;
+    *r.zero = false;
+    *r.modified = true;
+    r.value[0] = '\0';
+    *r.num = -1;
+    if (state->nz_source == reg) state->nz_source = 0;
+}
 
-    // TSX - Transfer SP to X: Sets N and Z flags
-    else if (strcasecmp(node->opcode, "TSX") == 0) {
-        state->x_modified = true;
-        state->x_known = false; // SP value typically unknown
-        state->n_known = false;
-        state->z_flag_known = false;
-    }
+/**
+ * @brief Set a register to a known numeric value
+ *
+ * @param state Register state
+ * @param reg Register selector
+ * @param value Byte value
+ */
+static void reg_set_num(RegisterState *state, char reg, int value) {
+    RegFields r = reg_fields(state, reg);
+    *r.known = true;
+    *r.num = (short)(value & 0xFF);
+    *r.zero = (*r.num == 0);
+    *r.modified = true;
+    snprintf(r.value, sizeof(state->a_value), "#$%02X", *r.num);
+}
 
-    // TXS - Transfer X to SP: No flags affected
-    else if (strcasecmp(node->opcode, "TXS") == 0) {
-        // No flags or visible registers modified
+/**
+ * @brief Set a register to a value computed from known inputs
+ *
+ * The inputs are bytes, so the result is only exact while the register
+ * is 8 bits wide; a wider register becomes unknown.
+ *
+ * @param state Register state
+ * @param reg Register selector
+ * @param value Computed value
+ */
+static void reg_set_result(RegisterState *state, char reg, int value) {
+    if (register_width(state, reg) == 8) {
+        reg_set_num(state, reg, value);
+    } else {
+        reg_unknown(state, reg);
     }
+}
 
-    // === INCREMENT/DECREMENT ===
-    // INX - Increment X: Sets N and Z flags
-    else if (strcasecmp(node->opcode, "INX") == 0) {
-        state->x_modified = true;
-        state->x_known = false; // Value changes, typically becomes unknown
-        state->x_zero = false;  // Very unlikely to wrap to zero
-        state->n_known = false;
-        state->z_flag_known = false;
-    }
+/**
+ * @brief Set a register from an immediate operand
+ *
+ * Symbolic immediates (#<label) are kept as text so identical operands
+ * still compare equal. Operands too long to store make the value
+ * unknown rather than being truncated.
+ *
+ * @param state Register state
+ * @param reg Register selector
+ * @param operand Immediate operand text
+ */
+static void reg_set_operand(RegisterState *state, char reg, const char *operand) {
+    int value = parse_immediate_value(operand);
+    if (value >= 0) {
+        reg_set_num(state, reg, value);
+        return;
+    }
+
+    RegFields r = reg_fields(state, reg);
+    size_t len = operand ? strlen(operand) : 0;
+    if (len == 0 || len >= sizeof(state->a_value)) {
+        reg_unknown(state, reg);
+        return;
+    }
+    *r.known = true;
+    *r.zero = false;
+    *r.modified = true;
+    *r.num = -1;
+    memcpy(r.value, operand, len + 1);
+}
 
-    // INY - Increment Y: Sets N and Z flags
-    else if (strcasecmp(node->opcode, "INY") == 0) {
-        state->y_modified = true;
-        state->y_known = false;
-        state->y_zero = false;
-        state->n_known = false;
-        state->z_flag_known = false;
-    }
+/**
+ * @brief Copy one register into another (TAX, TYA, ...)
+ *
+ * @param state Register state
+ * @param dst Destination register
+ * @param src Source register
+ */
+static void reg_copy(RegisterState *state, char dst, char src) {
+    int width = register_width(state, src);
+    if (width == 0 || width != register_width(state, dst)) {
+        reg_unknown(state, dst);
+        return;
+    }
+
+    RegFields s = reg_fields(state, src);
+    RegFields d = reg_fields(state, dst);
+    *d.known = *s.known;
+    *d.zero = *s.zero;
+    *d.num = *s.num;
+    *d.modified = true;
+    memcpy(d.value, s.value, sizeof(state->a_value));
+}
 
-    // DEX - Decrement X: Sets N and Z flags
-    else if (strcasecmp(node->opcode, "DEX") == 0) {
-        state->x_modified = true;
-        state->x_known = false;
-        state->n_known = false;
-        state->z_flag_known = false;
+/**
+ * @brief Record that N and Z now reflect a register's value
+ *
+ * A known value of a 16-bit register is a zero-extended byte, so N is
+ * clear; while the width is unknown N is only known for values below
+ * $80.
+ *
+ * @param state Register state
+ * @param reg Register the flags were computed from
+ */
+static void set_nz_from(RegisterState *state, char reg) {
+    RegFields r = reg_fields(state, reg);
+    int width = register_width(state, reg);
+    bool num = *r.known && *r.num >= 0;
+    state->nz_source = reg;
+    state->n_known = num && (width != 0 || *r.num < 0x80);
+    state->z_flag_known = num;
+    if (num) {
+        state->n_set = width == 8 && (*r.num & 0x80) != 0;
+        state->z_flag_set = (*r.num == 0);
     }
+}
 
-    // DEY - Decrement Y: Sets N and Z flags
-    else if (strcasecmp(node->opcode, "DEY") == 0) {
-        state->y_modified = true;
-        state->y_known = false;
-        state->n_known = false;
-        state->z_flag_known = false;
-    }
+/**
+ * @brief Record that N and Z hold an unknown value
+ *
+ * @param state Register state
+ */
+static void set_nz_unknown(RegisterState *state) {
+    state->nz_source = 0;
+    state->n_known = false;
+    state->z_flag_known = false;
+}
 
-    // INC - Increment Memory or A: Sets N and Z flags
-    else if (strcasecmp(node->opcode, "INC") == 0) {
-        if (!node->operand || node->operand[0] == 'A' || node->operand[0] == 'a') {
-            // INC A (65C02)
-            state->a_modified = true;
-            state->a_known = false;
-        }
-        state->n_known = false;
-        state->z_flag_known = false;
-    }
+/**
+ * @brief Apply an increment or decrement to a register
+ *
+ * @param state Register state
+ * @param reg Register selector
+ * @param delta +1 or -1
+ */
+static void reg_step(RegisterState *state, char reg, int delta) {
+    RegFields r = reg_fields(state, reg);
+    if (*r.known && *r.num >= 0) {
+        reg_set_result(state, reg, *r.num + delta);
+    } else {
+        reg_unknown(state, reg);
+    }
+    set_nz_from(state, reg);
+}
 
-    // DEC - Decrement Memory or A: Sets N and Z flags
-    else if (strcasecmp(node->opcode, "DEC") == 0) {
-        if (!node->operand || node->operand[0] == 'A' || node->operand[0] == 'a') {
-            // DEC A (65C02)
-            state->a_modified = true;
-            state->a_known = false;
-        }
-        state->n_known = false;
-        state->z_flag_known = false;
-    }
+/**
+ * @brief Apply a compare instruction (CMP, CPX, CPY, CPZ)
+ *
+ * CMP #0 always sets carry and leaves N/Z reflecting the register.
+ * Other compares are evaluated when both sides are known numbers.
+ *
+ * @param state Register state
+ * @param node Compare instruction
+ * @param reg Register being compared
+ */
+static void apply_compare(RegisterState *state, const AstNode *node, char reg) {
+    RegFields r = reg_fields(state, reg);
+    int operand = node->mode == AM_IMMEDIATE ? parse_immediate_value(node->operand) : -1;
 
-    // === ARITHMETIC ===
-    // ADC - Add with Carry: Sets C, N, Z, V flags
-    else if (strcasecmp(node->opcode, "ADC") == 0) {
-        state->a_modified = true;
-        state->a_known = false;
-        state->c_known = false;  // Result of carry depends on operands
-        state->n_known = false;
-        state->z_flag_known = false;
-        state->v_known = false;  // Overflow depends on operands
+    if (operand == 0) {
+        state->c_known = true;
+        state->c_set = true;
+        set_nz_from(state, reg);
+        return;
     }
 
-    // SBC - Subtract with Carry: Sets C, N, Z, V flags
-    else if (strcasecmp(node->opcode, "SBC") == 0) {
-        state->a_modified = true;
-        state->a_known = false;
+    state->nz_source = 0;
+    if (operand > 0 && *r.known && *r.num >= 0 && register_width(state, reg) == 8) {
+        int diff = (*r.num - operand) & 0xFF;
+        state->c_known = true;
+        state->c_set = *r.num >= operand;
+        state->n_known = true;
+        state->n_set = (diff & 0x80) != 0;
+        state->z_flag_known = true;
+        state->z_flag_set = (diff == 0);
+    } else {
         state->c_known = false;
         state->n_known = false;
         state->z_flag_known = false;
-        state->v_known = false;
-    }
-
-    // === LOGICAL OPERATIONS ===
-    // AND - Logical AND: Sets N and Z flags
-    else if (strcasecmp(node->opcode, "AND") == 0) {
-        state->a_modified = true;
-        state->a_known = false;
-        state->n_known = false;
-        state->z_flag_known = false;
-        // C and V are not affected
-    }
-
-    // ORA - Logical OR: Sets N and Z flags
-    else if (strcasecmp(node->opcode, "ORA") == 0) {
-        state->a_modified = true;
-        state->a_known = false;
-        state->n_known = false;
-        state->z_flag_known = false;
-    }
-
-    // EOR - Logical XOR: Sets N and Z flags
-    else if (strcasecmp(node->opcode, "EOR") == 0) {
-        state->a_modified = true;
-        state->a_known = false;
-        state->n_known = false;
-        state->z_flag_known = false;
     }
+}
 
-    // === SHIFT AND ROTATE ===
-    // ASL - Arithmetic Shift Left: Sets C, N, Z flags
-    else if (strcasecmp(node->opcode, "ASL") == 0) {
-        if (!node->operand || node->operand[0] == 'A' || node->operand[0] == 'a') {
-            state->a_modified = true;
-            state->a_known = false;
-        }
-        state->c_known = false;  // Bit 7 goes to carry
-        state->n_known = false;
-        state->z_flag_known = false;
-    }
+/**
+ * @brief Apply a shift or rotate of the accumulator
+ *
+ * @param state Register state
+ * @param op OP_ASL, OP_LSR, OP_ROL or OP_ROR
+ */
+static void apply_shift_a(RegisterState *state, Opcode op) {
+    bool rotate = (op == OP_ROL || op == OP_ROR);
+    bool computable = state->a_known && state->a_num >= 0 && (!rotate || state->c_known) &&
+                      register_width(state, REG_A) == 8;
 
-    // LSR - Logical Shift Right: Sets C, N, Z flags (N always 0)
-    else if (strcasecmp(node->opcode, "LSR") == 0) {
-        if (!node->operand || node->operand[0] == 'A' || node->operand[0] == 'a') {
-            state->a_modified = true;
-            state->a_known = false;
-        }
-        state->c_known = false;  // Bit 0 goes to carry
-        state->n_known = true;
-        state->n_set = false;    // LSR always clears N
-        state->z_flag_known = false;
-    }
+    if (!computable) {
+        reg_unknown(state, REG_A);
+        state->c_known = false;
+        set_nz_from(state, REG_A);
+        return;
+    }
+
+    int a = state->a_num;
+    int carry_in = state->c_set ? 1 : 0;
+    int result;
+    switch (op) {
+        case OP_ASL: state->c_set = (a & 0x80) != 0; result = a << 1; break;
+        case OP_LSR: state->c_set = (a & 0x01) != 0; result = a >> 1; break;
+        case OP_ROL: state->c_set = (a & 0x80) != 0; result = (a << 1) | carry_in; break;
+        default:     state->c_set = (a & 0x01) != 0; result = (a >> 1) | (carry_in << 7); break;
+    }
+    state->c_known = true;
+    reg_set_num(state, REG_A, result);
+    set_nz_from(state, REG_A);
+}
 
-    // ROL - Rotate Left: Sets C, N, Z flags
-    else if (strcasecmp(node->opcode, "ROL") == 0) {
-        if (!node->operand || node->operand[0] == 'A' || node->operand[0] == 'a') {
-            state->a_modified = true;
-            state->a_known = false;
-        }
-        state->c_known = false;  // Bit 7 goes to carry
-        state->n_known = false;
-        state->z_flag_known = false;
-    }
+/**
+ * @brief Apply AND/ORA/EOR to the accumulator
+ *
+ * @param state Register state
+ * @param node Logical instruction
+ */
+static void apply_logical(RegisterState *state, const AstNode *node) {
+    int operand = node->mode == AM_IMMEDIATE ? parse_immediate_value(node->operand) : -1;
+
+    if (state->a_known && state->a_num >= 0 && operand >= 0) {
+        int a = state->a_num;
+        int result = node->op == OP_AND ? (a & operand) :
+                     node->op == OP_ORA ? (a | operand) : (a ^ operand);
+        reg_set_result(state, REG_A, result);
+    } else if (node->op == OP_AND && operand == 0) {
+        reg_set_num(state, REG_A, 0);
+    } else if (node->op == OP_ORA && operand == 0xFF) {
+        reg_set_result(state, REG_A, 0xFF);
+    } else {
+        reg_unknown(state, REG_A);
+    }
+    set_nz_from(state, REG_A);
+}
 
-    // ROR - Rotate Right: Sets C, N, Z flags
-    else if (strcasecmp(node->opcode, "ROR") == 0) {
-        if (!node->operand || node->operand[0] == 'A' || node->operand[0] == 'a') {
-            state->a_modified = true;
-            state->a_known = false;
-        }
-        state->c_known = false;  // Bit 0 goes to carry
-        state->n_known = false;  // Depends on carry flag going into bit 7
-        state->z_flag_known = false;
+/**
+ * @brief Forget everything a subroutine call or unknown code may change
+ *
+ * @param state Register state
+ */
+static void clobber_all(RegisterState *state) {
+    reg_unknown(state, REG_A);
+    reg_unknown(state, REG_X);
+    reg_unknown(state, REG_Y);
+    reg_unknown(state, REG_Z);
+    state->c_known = false;
+    state->v_known = false;
+    set_nz_unknown(state);
+    if (state->wide_capable) {
+        state->m_width = 0;
+        state->x_width = 0;
     }
+}
 
-    // === COMPARISON ===
-    // CMP - Compare Accumulator: Sets C, N, Z flags
-    else if (strcasecmp(node->opcode, "CMP") == 0) {
-        state->c_known = false;  // Set if A >= operand
-        state->n_known = false;
-        state->z_flag_known = false; // Set if A == operand
-    }
+/**
+ * @brief Change the width of A or of the index registers (65816)
+ *
+ * A value does not survive a width change it may not have been written
+ * for: REP #$20 brings in the hidden high byte of A, SEP #$10 clears the
+ * high bytes of X and Y.
+ *
+ * @param state Register state
+ * @param reg REG_A for the accumulator (M flag), REG_X for X and Y (X flag)
+ * @param width New width in bits, 0 if unknown
+ */
+static void set_width(RegisterState *state, char reg, int width) {
+    unsigned char *field = reg == REG_A ? &state->m_width : &state->x_width;
+    if (width != 0 && *field == width) return;
 
-    // CPX - Compare X: Sets C, N, Z flags
-    else if (strcasecmp(node->opcode, "CPX") == 0) {
-        state->c_known = false;
-        state->n_known = false;
-        state->z_flag_known = false;
+    *field = (unsigned char)width;
+    if (reg == REG_A) {
+        reg_unknown(state, REG_A);
+    } else {
+        reg_unknown(state, REG_X);
+        reg_unknown(state, REG_Y);
     }
+}
 
-    // CPY - Compare Y: Sets C, N, Z flags
-    else if (strcasecmp(node->opcode, "CPY") == 0) {
+/**
+ * @brief Apply REP or SEP (65816)
+ *
+ * Each bit of the operand clears (REP) or sets (SEP) one status flag:
+ * $01 C, $02 Z, $10 X, $20 M, $40 V, $80 N. I and D are not tracked.
+ *
+ * @param state Register state
+ * @param node REP or SEP instruction
+ */
+static void apply_status_bits(RegisterState *state, const AstNode *node) {
+    bool set = node->op == OP_SEP;
+    int bits = node->mode == AM_IMMEDIATE ? parse_immediate_value(node->operand) : -1;
+    if (bits < 0) {
+        set_width(state, REG_A, 0);
+        set_width(state, REG_X, 0);
         state->c_known = false;
-        state->n_known = false;
-        state->z_flag_known = false;
+        state->v_known = false;
+        set_nz_unknown(state);
+        return;
     }
 
-    // === FLAG MANIPULATION ===
-    // CLC - Clear Carry: Clears C flag
-    else if (strcasecmp(node->opcode, "CLC") == 0) {
+    if (bits & 0x20) set_width(state, REG_A, set ? 8 : 16);
+    if (bits & 0x10) set_width(state, REG_X, set ? 8 : 16);
+    if (bits & 0x01) {
         state->c_known = true;
-        state->c_set = false;
+        state->c_set = set;
     }
-
-    // SEC - Set Carry: Sets C flag
-    else if (strcasecmp(node->opcode, "SEC") == 0) {
-        state->c_known = true;
-        state->c_set = true;
-    }
-
-    // CLV - Clear Overflow: Clears V flag
-    else if (strcasecmp(node->opcode, "CLV") == 0) {
+    if (bits & 0x40) {
         state->v_known = true;
-        state->v_set = false;
-    }
-
-    // CLI - Clear Interrupt: Clears I flag (not tracked)
-    else if (strcasecmp(node->opcode, "CLI") == 0) {
-        // I flag not tracked in this implementation
+        state->v_set = set;
     }
-
-    // SEI - Set Interrupt: Sets I flag (not tracked)
-    else if (strcasecmp(node->opcode, "SEI") == 0) {
-        // I flag not tracked
-    }
-
-    // CLD - Clear Decimal: Clears D flag (not tracked)
-    else if (strcasecmp(node->opcode, "CLD") == 0) {
-        // D flag not tracked
+    if (bits & 0x82) state->nz_source = 0;
+    if (bits & 0x80) {
+        state->n_known = true;
+        state->n_set = set;
     }
-
-    // SED - Set Decimal: Sets D flag (not tracked)
-    else if (strcasecmp(node->opcode, "SED") == 0) {
-        // D flag not tracked
+    if (bits & 0x02) {
+        state->z_flag_known = true;
+        state->z_flag_set = set;
     }
+}
 
-    // === STACK OPERATIONS ===
-    // PHA - Push Accumulator: No flags affected
-    else if (strcasecmp(node->opcode, "PHA") == 0) {
-        // No register or flag changes
-    }
+/**
+ * @brief Update register state based on an instruction
+ *
+ * Analyzes a single 6502 instruction and updates the register state
+ * to reflect its effects. For each instruction, determines:
+ * - Which registers are modified
+ * - Register values, when they follow from immediates or known inputs
+ * - Which processor flags are affected and their values when known
+ * - Which register N and Z currently reflect (nz_source)
+ *
+ * The function handles all standard 6502 opcodes plus 65C02 and 45GS02
+ * extensions. Instructions without a precise model fall back to the
+ * opcode table and forget every register and flag they write, so the
+ * result is always safe to optimize against.
+ *
+ * @param node AST node containing the instruction and operand
+ * @param state Register state to update (modified in place)
+ */
+void update_register_state(AstNode *node, RegisterState *state) {
+    if (!node || node->op == OP_NONE) return;
 
-    // PHP - Push Processor Status: No flags affected
-    else if (strcasecmp(node->opcode, "PHP") == 0) {
-        // No register or flag changes
-    }
+    // Reset modification flags
+    state->a_modified = false;
+    state->x_modified = false;
+    state->y_modified = false;
+    state->z_modified = false;
 
-    // PLA - Pull Accumulator: Sets N and Z flags
-    else if (strcasecmp(node->opcode, "PLA") == 0) {
-        state->a_modified = true;
-        state->a_known = false;  // Value from stack is unknown
-        state->n_known = false;
-        state->z_flag_known = false;
-    }
+    switch (node->op) {
+        // === LOAD INSTRUCTIONS ===
+        // LDA/LDX/LDY/LDZ - Load register: Sets N and Z flags
+        case OP_LDA: case OP_LDX: case OP_LDY: case OP_LDZ: {
+            char reg = node->op == OP_LDA ? REG_A : node->op == OP_LDX ? REG_X :
+                       node->op == OP_LDY ? REG_Y : REG_Z;
+            if (node->mode == AM_IMMEDIATE) {
+                // Immediate mode - we know the exact value
+                reg_set_operand(state, reg, node->operand);
+            } else {
+                // Memory load - value unknown
+                reg_unknown(state, reg);
+            }
+            set_nz_from(state, reg);
+            break;
+        }
 
-    // PLP - Pull Processor Status: All flags affected
-    else if (strcasecmp(node->opcode, "PLP") == 0) {
-        // All flags become unknown (restored from stack)
-        state->c_known = false;
-        state->n_known = false;
-        state->z_flag_known = false;
-        state->v_known = false;
-    }
+        // === STORE INSTRUCTIONS ===
+        // STA, STX, STY, STZ - Store instructions: No flags affected
+        case OP_STA: case OP_STX: case OP_STY: case OP_STZ:
+            // Store operations don't affect registers or flags
+            break;
+
+        // === TRANSFER INSTRUCTIONS ===
+        // Register to register transfers: Set N and Z flags
+        case OP_TAX: reg_copy(state, REG_X, REG_A); set_nz_from(state, REG_X); break;
+        case OP_TXA: reg_copy(state, REG_A, REG_X); set_nz_from(state, REG_A); break;
+        case OP_TAY: reg_copy(state, REG_Y, REG_A); set_nz_from(state, REG_Y); break;
+        case OP_TYA: reg_copy(state, REG_A, REG_Y); set_nz_from(state, REG_A); break;
+        case OP_TAZ: reg_copy(state, REG_Z, REG_A); set_nz_from(state, REG_Z); break;
+        case OP_TZA: reg_copy(state, REG_A, REG_Z); set_nz_from(state, REG_A); break;
+        case OP_TXY: reg_copy(state, REG_Y, REG_X); set_nz_from(state, REG_Y); break;
+        case OP_TYX: reg_copy(state, REG_X, REG_Y); set_nz_from(state, REG_X); break;
+
+        // TSX - Transfer SP to X: Sets N and Z flags
+        case OP_TSX:
+            reg_unknown(state, REG_X); // SP value typically unknown
+            set_nz_from(state, REG_X);
+            break;
+
+        // TXS - Transfer X to SP: No flags affected
+        case OP_TXS:
+            // No flags or visible registers modified
+            break;
+
+        // === INCREMENT/DECREMENT ===
+        // Register increments/decrements: Set N and Z flags
+        case OP_INX: reg_step(state, REG_X, 1); break;
+        case OP_INY: reg_step(state, REG_Y, 1); break;
+        case OP_INZ: reg_step(state, REG_Z, 1); break;
+        case OP_DEX: reg_step(state, REG_X, -1); break;
+        case OP_DEY: reg_step(state, REG_Y, -1); break;
+        case OP_DEZ: reg_step(state, REG_Z, -1); break;
+
+        // INC/DEC - Memory or A (65C02 INC A): Sets N and Z flags
+        case OP_INC: case OP_DEC:
+            if (node->mode == AM_ACCUMULATOR) {
+                reg_step(state, REG_A, node->op == OP_INC ? 1 : -1);
+            } else {
+                set_nz_unknown(state);
+            }
+            break;
 
-    // === BRANCHES & JUMPS ===
-    // Branch and jump instructions don't affect registers or flags
-    else if (strcasecmp(node->opcode, "BCC") == 0 ||
-             strcasecmp(node->opcode, "BCS") == 0 ||
-             strcasecmp(node->opcode, "BEQ") == 0 ||
-             strcasecmp(node->opcode, "BNE") == 0 ||
-             strcasecmp(node->opcode, "BMI") == 0 ||
-             strcasecmp(node->opcode, "BPL") == 0 ||
-             strcasecmp(node->opcode, "BVC") == 0 ||
-             strcasecmp(node->opcode, "BVS") == 0 ||
-             strcasecmp(node->opcode, "BRA") == 0 || // 65C02
-             strcasecmp(node->opcode, "JMP") == 0 ||
-             strcasecmp(node->opcode, "JSR") == 0 ||
-             strcasecmp(node->opcode, "RTS") == 0 ||
-             strcasecmp(node->opcode, "RTI") == 0) {
-        // No register or flag changes
-        // Note: RTI restores flags but we treat it as unknown
-        if (strcasecmp(node->opcode, "RTI") == 0) {
+        // === ARITHMETIC ===
+        // ADC/SBC - Sets C, N, Z, V flags (decimal mode makes results unknown)
+        case OP_ADC: case OP_SBC:
+            reg_unknown(state, REG_A);
             state->c_known = false;
-            state->n_known = false;
-            state->z_flag_known = false;
             state->v_known = false;
+            set_nz_from(state, REG_A);
+            break;
+
+        // === LOGICAL OPERATIONS ===
+        // AND/ORA/EOR - Sets N and Z flags, C and V are not affected
+        case OP_AND: case OP_ORA: case OP_EOR:
+            apply_logical(state, node);
+            break;
+
+        // === SHIFT AND ROTATE ===
+        // ASL/LSR/ROL/ROR - Sets C, N, Z flags
+        case OP_ASL: case OP_LSR: case OP_ROL: case OP_ROR:
+            if (node->mode == AM_ACCUMULATOR) {
+                apply_shift_a(state, node->op);
+            } else {
+                state->c_known = false;
+                set_nz_unknown(state);
+                if (node->op == OP_LSR) {
+                    state->n_known = true;
+                    state->n_set = false;    // LSR always clears N
+                }
+            }
+            break;
+
+        // === COMPARISON ===
+        // CMP/CPX/CPY/CPZ - Sets C, N, Z flags
+        case OP_CMP: apply_compare(state, node, REG_A); break;
+        case OP_CPX: apply_compare(state, node, REG_X); break;
+        case OP_CPY: apply_compare(state, node, REG_Y); break;
+        case OP_CPZ: apply_compare(state, node, REG_Z); break;
+
+        // === FLAG MANIPULATION ===
+        // CLC - Clear Carry: Clears C flag
+        case OP_CLC:
+            state->c_known = true;
+            state->c_set = false;
+            break;
+
+        // SEC - Set Carry: Sets C flag
+        case OP_SEC:
+            state->c_known = true;
+            state->c_set = true;
+            break;
+
+        // CLV - Clear Overflow: Clears V flag
+        case OP_CLV:
+            state->v_known = true;
+            state->v_set = false;
+            break;
+
+        // CLI/SEI/CLD/SED - I and D flags are not tracked
+        case OP_CLI: case OP_SEI: case OP_CLD: case OP_SED:
+            break;
+
+        // === STACK OPERATIONS ===
+        // PHA/PHP/PHX/PHY/PHZ - Push: No flags affected
+        case OP_PHA: case OP_PHP: case OP_PHX: case OP_PHY: case OP_PHZ:
+            break;
+
+        // PLA/PLX/PLY/PLZ - Pull register: Sets N and Z flags
+        case OP_PLA: case OP_PLX: case OP_PLY: case OP_PLZ: {
+            char reg = node->op == OP_PLA ? REG_A : node->op == OP_PLX ? REG_X :
+                       node->op == OP_PLY ? REG_Y : REG_Z;
+            reg_unknown(state, reg);  // Value from stack is unknown
+            set_nz_from(state, reg);
+            break;
         }
-        // JSR may trash A,X,Y depending on subroutine
-        if (strcasecmp(node->opcode, "JSR") == 0) {
-            state->a_known = false;
-            state->x_known = false;
-            state->y_known = false;
-            state->z_known = false;
+
+        // PLP/RTI - All flags restored from the stack, on the 65816 the
+        // register widths too
+        case OP_PLP: case OP_RTI:
             state->c_known = false;
-            state->n_known = false;
-            state->z_flag_known = false;
             state->v_known = false;
+            set_nz_unknown(state);
+            if (state->wide_capable) {
+                set_width(state, REG_A, 0);
+                set_width(state, REG_X, 0);
+            }
+            break;
+
+        // === 65816 SPECIFIC ===
+        // REP/SEP - Clear/set status bits, including the register widths
+        case OP_REP: case OP_SEP:
+            apply_status_bits(state, node);
+            break;
+
+        // XCE - Swap C and the emulation flag; emulation mode forces
+        // 8-bit registers, native mode keeps the widths it finds
+        case OP_XCE:
+            if (!(state->c_known && !state->c_set)) {
+                bool entering = state->c_known;
+                set_width(state, REG_A, entering || state->m_width == 8 ? 8 : 0);
+                set_width(state, REG_X, entering || state->x_width == 8 ? 8 : 0);
+            }
+            state->c_known = false;
+            break;
+
+        // === BRANCHES & JUMPS ===
+        // Branch and jump instructions don't affect registers or flags
+        case OP_BCC: case OP_BCS: case OP_BEQ: case OP_BNE:
+        case OP_BMI: case OP_BPL: case OP_BVC: case OP_BVS:
+        case OP_BRA: case OP_BRL: case OP_BBR: case OP_BBS:
+        case OP_JMP: case OP_JML: case OP_RTS: case OP_RTL: case OP_RTN:
+            break;
+
+        // JSR/JSL/BSR - The subroutine may change any register or flag
+        case OP_JSR: case OP_JSL: case OP_BSR:
+            clobber_all(state);
+            break;
+
+        // === 45GS02 SPECIFIC ===
+        // NEG - Negate Accumulator (45GS02): Sets N and Z flags
+        case OP_NEG:
+            if (state->a_known && state->a_num >= 0) {
+                reg_set_num(state, REG_A, -state->a_num);
+            } else {
+                reg_unknown(state, REG_A);
+            }
+            set_nz_from(state, REG_A);
+            break;
+
+        // ASR - Arithmetic Shift Right (45GS02): Sets N, Z, C flags
+        case OP_ASR:
+            if (node->mode == AM_ACCUMULATOR && state->a_known && state->a_num >= 0) {
+                state->c_known = true;
+                state->c_set = (state->a_num & 0x01) != 0;
+                reg_set_num(state, REG_A, (state->a_num >> 1) | (state->a_num & 0x80));
+                set_nz_from(state, REG_A);
+            } else {
+                if (node->mode == AM_ACCUMULATOR) reg_unknown(state, REG_A);
+                state->c_known = false;
+                if (node->mode == AM_ACCUMULATOR) {
+                    set_nz_from(state, REG_A);  // Sign bit is preserved
+                } else {
+                    set_nz_unknown(state);
+                }
+            }
+            break;
+
+        // === BIT TEST ===
+        // BIT - Bit Test: Sets N, V, Z flags (immediate form only Z)
+        case OP_BIT:
+            set_nz_unknown(state);
+            if (node->mode != AM_IMMEDIATE) state->v_known = false;
+            break;
+
+        // NOP - No operation
+        case OP_NOP:
+            // No changes
+            break;
+
+        default: {
+            // Not modelled precisely: forget whatever the opcode table says it writes
+            unsigned int writes = opcode_writes(node->op, node->mode);
+            if (writes & RF_A) reg_unknown(state, REG_A);
+            if (writes & RF_X) reg_unknown(state, REG_X);
+            if (writes & RF_Y) reg_unknown(state, REG_Y);
+            if (writes & RF_Z) reg_unknown(state, REG_Z);
+            if (writes & RF_C) state->c_known = false;
+            if (writes & RF_V) state->v_known = false;
+            if (writes & RF_NZ) set_nz_unknown(state);
+            break;
         }
     }
+}
 
-    // === 45GS02 SPECIFIC ===
-    // NEG - Negate Accumulator (45GS02): Sets N, Z, C flags
-    else if (strcasecmp(node->opcode, "NEG") == 0) {
-        state->a_modified = true;
-        state->a_known = false;
-        state->n_known = false;
-        state->z_flag_known = false;
-        state->c_known = false;
+/**
+ * @brief Merge the register state of another control flow path
+ *
+ * Keeps only facts that hold on both paths.
+ *
+ * @param into State to narrow (modified in place)
+ * @param other State arriving on the other path
+ */
+void merge_register_state(RegisterState *into, const RegisterState *other) {
+    static const char regs[] = {REG_A, REG_X, REG_Y, REG_Z};
+    char nz_source = into->nz_source;  // Flags may track a register whose value differs
+    for (size_t i = 0; i < sizeof(regs); i++) {
+        RegFields a = reg_fields(into, regs[i]);
+        RegFields b = reg_fields((RegisterState *)other, regs[i]);
+        if (*a.known && !(*b.known && *a.num == *b.num && strcmp(a.value, b.value) == 0)) {
+            reg_unknown(into, regs[i]);
+        }
+        *a.modified = false;
     }
+    into->nz_source = nz_source;
 
-    // ASR - Arithmetic Shift Right (45GS02): Sets N, Z, C flags
-    else if (strcasecmp(node->opcode, "ASR") == 0) {
-        state->a_modified = true;
-        state->a_known = false;
-        state->n_known = false;  // Sign bit is preserved
-        state->z_flag_known = false;
-        state->c_known = false;
+    if (into->c_known && !(other->c_known && into->c_set == other->c_set)) into->c_known = false;
+    if (into->v_known && !(other->v_known && into->v_set == other->v_set)) into->v_known = false;
+    if (into->n_known && !(other->n_known && into->n_set == other->n_set)) into->n_known = false;
+    if (into->z_flag_known && !(other->z_flag_known && into->z_flag_set == other->z_flag_set)) {
+        into->z_flag_known = false;
     }
+    if (into->nz_source != other->nz_source) into->nz_source = 0;
 
-    // === BIT TEST ===
-    // BIT - Bit Test: Sets N, V, Z flags
-    else if (strcasecmp(node->opcode, "BIT") == 0) {
-        state->n_known = false;  // Bit 7 of operand
-        state->v_known = false;  // Bit 6 of operand
-        state->z_flag_known = false; // Result of A & operand
-    }
+    into->wide_capable = into->wide_capable || other->wide_capable;
+    if (into->m_width != other->m_width) into->m_width = 0;
+    if (into->x_width != other->x_width) into->x_width = 0;
+}
 
-    // NOP - No operation
-    else if (strcasecmp(node->opcode, "NOP") == 0) {
-        // No changes
-    }
+/**
+ * @brief Compare two register states for dataflow convergence
+ *
+ * Ignores the per-instruction modification flags.
+ *
+ * @param a First state
+ * @param b Second state
+ * @return true if both states carry the same knowledge
+ */
+bool register_state_equal(const RegisterState *a, const RegisterState *b) {
+    static const char regs[] = {REG_A, REG_X, REG_Y, REG_Z};
+    for (size_t i = 0; i < sizeof(regs); i++) {
+        RegFields ra = reg_fields((RegisterState *)a, regs[i]);
+        RegFields rb = reg_fields((RegisterState *)b, regs[i]);
+        if (*ra.known != *rb.known) return false;
+        if (*ra.known && (*ra.num != *rb.num || strcmp(ra.value, rb.value) != 0)) return false;
+    }
+
+    return a->c_known == b->c_known && (!a->c_known || a->c_set == b->c_set) &&
+           a->v_known == b->v_known && (!a->v_known || a->v_set == b->v_set) &&
+           a->n_known == b->n_known && (!a->n_known || a->n_set == b->n_set) &&
+           a->z_flag_known == b->z_flag_known && (!a->z_flag_known || a->z_flag_set == b->z_flag_set) &&
+           a->nz_source == b->nz_source && a->wide_capable == b->wide_capable &&
+           a->m_width == b->m_width && a->x_width == b->x_width;
 }
 
 // Print register state for debugging
-void print_register_state(const RegisterState *state, int line_num) {
+void print_register_state(FILE *fp, const RegisterState *state, int line_num) {
     if (!state) return;
 
-    printf("  Register state at line %d:\n", line_num);
-    printf("    A: known=%s, zero=%s, value=%s, modified=%s\n",
+    fprintf(fp, "  Register state at line %d:\n", line_num);
+    fprintf(fp, "    A: known=%s, zero=%s, value=%s, modified=%s\n",
            state->a_known ? "yes" : "no",
            state->a_zero ? "yes" : "no",
            state->a_known ? state->a_value : "unknown",
            state->a_modified ? "yes" : "no");
-    printf("    X: known=%s, zero=%s, value=%s, modified=%s\n",
+    fprintf(fp, "    X: known=%s, zero=%s, value=%s, modified=%s\n",
            state->x_known ? "yes" : "no",
            state->x_zero ? "yes" : "no",
            state->x_known ? state->x_value : "unknown",
            state->x_modified ? "yes" : "no");
-    printf("    Y: known=%s, zero=%s, value=%s, modified=%s\n",
+    fprintf(fp, "    Y: known=%s, zero=%s, value=%s, modified=%s\n",
            state->y_known ? "yes" : "no",
            state->y_zero ? "yes" : "no",
            state->y_known ? state->y_value : "unknown",
            state->y_modified ? "yes" : "no");
-    printf("    Z: known=%s, zero=%s, value=%s, modified=%s\n",
+    fprintf(fp, "    Z: known=%s, zero=%s, value=%s, modified=%s\n",
            state->z_known ? "yes" : "no",
            state->z_zero ? "yes" : "no",
            state->z_known ? state->z_value : "unknown",
            state->z_modified ? "yes" : "no");
-    printf("    Flags:\n");
-    printf("      C (Carry):    known=%s, set=%s\n",
+    fprintf(fp, "    Flags:\n");
+    fprintf(fp, "      C (Carry):    known=%s, set=%s\n",
            state->c_known ? "yes" : "no",
            state->c_known ? (state->c_set ? "yes" : "no") : "unknown");
-    printf("      N (Negative): known=%s, set=%s\n",
+    fprintf(fp, "      N (Negative): known=%s, set=%s\n",
            state->n_known ? "yes" : "no",
            state->n_known ? (state->n_set ? "yes" : "no") : "unknown");
-    printf("      Z (Zero):     known=%s, set=%s\n",
+    fprintf(fp, "      Z (Zero):     known=%s, set=%s\n",
            state->z_flag_known ? "yes" : "no",
            state->z_flag_known ? (state->z_flag_set ? "yes" : "no") : "unknown");
-    printf("      V (Overflow): known=%s, set=%s\n",
+    fprintf(fp, "      V (Overflow): known=%s, set=%s\n",
            state->v_known ? "yes" : "no",
            state->v_known ? (state->v_set ? "yes" : "no") : "unknown");
+    if (state->wide_capable) {
+        fprintf(fp, "    Widths: A=%s, X/Y=%s\n",
+               state->m_width == 16 ? "16" : state->m_width == 8 ? "8" : "unknown",
+               state->x_width == 16 ? "16" : state->x_width == 8 ? "8" : "unknown");
+    }
 }
 
-// Validate register and flag tracking
+/**
+ * @brief Validate register and flag tracking throughout program
+ *
+ * One walk over the program: the register tracker runs on every
+ * instruction for the modification counts and the -trace 2 dump, and
+ * the registers and flags each instruction writes come from the opcode
+ * table.
+ *
+ * @param prog Program to validate
+ */
 void validate_register_and_flag_tracking(Program *prog) {
-    printf("\n=== Register and Flag Tracking Validation ===\n");
+    program_log(prog, "\n=== Register and Flag Tracking Validation ===\n");
 
     RegisterState state;
-    // Initialize state
-    state.a_known = false;
-    state.x_known = false;
-    state.y_known = false;
-    state.z_known = false;
-    state.a_zero = false;
-    state.x_zero = false;
-    state.y_zero = false;
-    state.z_zero = false;
-    state.a_modified = false;
-    state.x_modified = false;
-    state.y_modified = false;
-    state.z_modified = false;
-    state.a_value[0] = '\0';
-    state.x_value[0] = '\0';
-    state.y_value[0] = '\0';
-    state.z_value[0] = '\0';
-    state.c_known = false;
-    state.n_known = false;
-    state.z_flag_known = false;
-    state.v_known = false;
-    state.c_set = false;
-    state.n_set = false;
-    state.z_flag_set = false;
-    state.v_set = false;
+    init_entry_register_state(&state, prog->cpu_type);
 
     int instruction_count = 0;
     int register_modifications = 0;
     int flag_modifications = 0;
-
-    AstNode *node = prog->root;
-    while (node) {
-        if (node->opcode) {
-            instruction_count++;
-
-            // Save previous state
-            RegisterState prev_state = state;
-
-            // Update state based on instruction
-            update_register_state(node, &state);
-
-            // Check if registers were modified
-            if (state.a_modified) register_modifications++;
-            if (state.x_modified) register_modifications++;
-            if (state.y_modified) register_modifications++;
-            if (state.z_modified) register_modifications++;
-
-            // Check if flags were modified (compare with previous state)
-            if (state.c_known != prev_state.c_known || state.c_set != prev_state.c_set) flag_modifications++;
-            if (state.n_known != prev_state.n_known || state.n_set != prev_state.n_set) flag_modifications++;
-            if (state.z_flag_known != prev_state.z_flag_known || state.z_flag_set != prev_state.z_flag_set) flag_modifications++;
-            if (state.v_known != prev_state.v_known || state.v_set != prev_state.v_set) flag_modifications++;
-
-            // For verbose output, print state after each instruction
-            if (prog->trace_level >= 2) {
-                printf("\nLine %d: %s %s\n", node->line_num, node->opcode,
-                       node->operand ? node->operand : "");
-                print_register_state(&state, node->line_num);
-            }
-
-            // Reset state at branch targets (control flow convergence)
-            if (node->is_branch_target) {
-                // Conservative: assume registers and flags are unknown at branch targets
-                state.a_known = false;
-                state.x_known = false;
-                state.y_known = false;
-                state.z_known = false;
-                state.c_known = false;
-                state.n_known = false;
-                state.z_flag_known = false;
-                state.v_known = false;
-            }
+    unsigned int written = 0;
+
+    for (int i = 0; i < prog->count; i++) {
+        AstNode *node = &prog->nodes[i];
+        if (node->op == OP_NONE) continue;
+        instruction_count++;
+
+        RegisterState prev_state = state;
+        update_register_state(node, &state);
+        written |= opcode_writes(node->op, node->mode);
+
+        if (state.a_modified) register_modifications++;
+        if (state.x_modified) register_modifications++;
+        if (state.y_modified) register_modifications++;
+        if (state.z_modified) register_modifications++;
+
+        // Flags whose known value changed
+        if (state.c_known != prev_state.c_known || state.c_set != prev_state.c_set) flag_modifications++;
+        if (state.n_known != prev_state.n_known || state.n_set != prev_state.n_set) flag_modifications++;
+        if (state.z_flag_known != prev_state.z_flag_known || state.z_flag_set != prev_state.z_flag_set) flag_modifications++;
+        if (state.v_known != prev_state.v_known || state.v_set != prev_state.v_set) flag_modifications++;
+
+        if (prog->trace_level >= 2) {
+            program_log(prog, "\nLine %d: %s %s\n", node->line_num, node->opcode,
+                   node->operand ? node->operand : "");
+            if (prog->log) print_register_state(prog->log, &state, node->line_num);
         }
-        node = node->next;
-    }
-
-    printf("\n=== Validation Summary ===\n");
-    printf("Total instructions analyzed: %d\n", instruction_count);
-    printf("Register modifications detected: %d\n", register_modifications);
-    printf("Flag modifications detected: %d\n", flag_modifications);
-
-    // Summary of register usage
-    printf("\n=== Register Usage Summary ===\n");
-    state = (RegisterState){0}; // Reset
-    state.a_known = false;
-    state.x_known = false;
-    state.y_known = false;
-    state.z_known = false;
-    state.c_known = false;
-    state.n_known = false;
-    state.z_flag_known = false;
-    state.v_known = false;
-
-    bool a_used = false, x_used = false, y_used = false, z_used = false;
-    bool c_affected = false, n_affected = false, z_affected = false, v_affected = false;
-
-    node = prog->root;
-    while (node) {
-        if (node->opcode) {
-            RegisterState temp_state = state;
-            update_register_state(node, &temp_state);
-
-            if (temp_state.a_modified) a_used = true;
-            if (temp_state.x_modified) x_used = true;
-            if (temp_state.y_modified) y_used = true;
-            if (temp_state.z_modified) z_used = true;
-
-            // Check if instruction affects flags
-            if (strcasecmp(node->opcode, "CLC") == 0 || strcasecmp(node->opcode, "SEC") == 0 ||
-                strcasecmp(node->opcode, "ADC") == 0 || strcasecmp(node->opcode, "SBC") == 0 ||
-                strcasecmp(node->opcode, "ASL") == 0 || strcasecmp(node->opcode, "LSR") == 0 ||
-                strcasecmp(node->opcode, "ROL") == 0 || strcasecmp(node->opcode, "ROR") == 0 ||
-                strcasecmp(node->opcode, "CMP") == 0 || strcasecmp(node->opcode, "CPX") == 0 ||
-                strcasecmp(node->opcode, "CPY") == 0) {
-                c_affected = true;
-            }
-
-            if (strcasecmp(node->opcode, "LDA") == 0 || strcasecmp(node->opcode, "LDX") == 0 ||
-                strcasecmp(node->opcode, "LDY") == 0 || strcasecmp(node->opcode, "LDZ") == 0 ||
-                strcasecmp(node->opcode, "TAX") == 0 || strcasecmp(node->opcode, "TXA") == 0 ||
-                strcasecmp(node->opcode, "TAY") == 0 || strcasecmp(node->opcode, "TYA") == 0 ||
-                strcasecmp(node->opcode, "AND") == 0 || strcasecmp(node->opcode, "ORA") == 0 ||
-                strcasecmp(node->opcode, "EOR") == 0 || strcasecmp(node->opcode, "ASL") == 0 ||
-                strcasecmp(node->opcode, "LSR") == 0 || strcasecmp(node->opcode, "ROL") == 0 ||
-                strcasecmp(node->opcode, "ROR") == 0 || strcasecmp(node->opcode, "ADC") == 0 ||
-                strcasecmp(node->opcode, "SBC") == 0 || strcasecmp(node->opcode, "CMP") == 0 ||
-                strcasecmp(node->opcode, "CPX") == 0 || strcasecmp(node->opcode, "CPY") == 0 ||
-                strcasecmp(node->opcode, "INX") == 0 || strcasecmp(node->opcode, "INY") == 0 ||
-                strcasecmp(node->opcode, "DEX") == 0 || strcasecmp(node->opcode, "DEY") == 0 ||
-                strcasecmp(node->opcode, "INC") == 0 || strcasecmp(node->opcode, "DEC") == 0 ||
-                strcasecmp(node->opcode, "BIT") == 0) {
-                n_affected = true;
-            }
 
-            if (strcasecmp(node->opcode, "LDA") == 0 || strcasecmp(node->opcode, "LDX") == 0 ||
-                strcasecmp(node->opcode, "LDY") == 0 || strcasecmp(node->opcode, "LDZ") == 0 ||
-                strcasecmp(node->opcode, "TAX") == 0 || strcasecmp(node->opcode, "TXA") == 0 ||
-                strcasecmp(node->opcode, "TAY") == 0 || strcasecmp(node->opcode, "TYA") == 0 ||
-                strcasecmp(node->opcode, "AND") == 0 || strcasecmp(node->opcode, "ORA") == 0 ||
-                strcasecmp(node->opcode, "EOR") == 0 || strcasecmp(node->opcode, "ASL") == 0 ||
-                strcasecmp(node->opcode, "LSR") == 0 || strcasecmp(node->opcode, "ROL") == 0 ||
-                strcasecmp(node->opcode, "ROR") == 0 || strcasecmp(node->opcode, "ADC") == 0 ||
-                strcasecmp(node->opcode, "SBC") == 0 || strcasecmp(node->opcode, "CMP") == 0 ||
-                strcasecmp(node->opcode, "CPX") == 0 || strcasecmp(node->opcode, "CPY") == 0 ||
-                strcasecmp(node->opcode, "INX") == 0 || strcasecmp(node->opcode, "INY") == 0 ||
-                strcasecmp(node->opcode, "DEX") == 0 || strcasecmp(node->opcode, "DEY") == 0 ||
-                strcasecmp(node->opcode, "INC") == 0 || strcasecmp(node->opcode, "DEC") == 0 ||
-                strcasecmp(node->opcode, "BIT") == 0) {
-                z_affected = true;
-            }
-
-            if (strcasecmp(node->opcode, "ADC") == 0 || strcasecmp(node->opcode, "SBC") == 0 ||
-                strcasecmp(node->opcode, "BIT") == 0 || strcasecmp(node->opcode, "CLV") == 0) {
-                v_affected = true;
-            }
+        // Reset state at branch targets (control flow convergence)
+        if (node->is_branch_target) {
+            // Conservative: assume registers and flags are unknown at branch targets
+            init_entry_register_state(&state, prog->cpu_type);
         }
-        node = node->next;
     }
 
-    printf("Registers used:\n");
-    printf("  A (Accumulator): %s\n", a_used ? "YES" : "NO");
-    printf("  X (Index X):     %s\n", x_used ? "YES" : "NO");
-    printf("  Y (Index Y):     %s\n", y_used ? "YES" : "NO");
-    printf("  Z (Z register):  %s%s\n", z_used ? "YES" : "NO",
+    program_log(prog, "\n=== Validation Summary ===\n");
+    program_log(prog, "Total instructions analyzed: %d\n", instruction_count);
+    program_log(prog, "Register modifications detected: %d\n", register_modifications);
+    program_log(prog, "Flag modifications detected: %d\n", flag_modifications);
+
+    program_log(prog, "\n=== Register Usage Summary ===\n");
+    program_log(prog, "Registers used:\n");
+    program_log(prog, "  A (Accumulator): %s\n", written & RF_A ? "YES" : "NO");
+    program_log(prog, "  X (Index X):     %s\n", written & RF_X ? "YES" : "NO");
+    program_log(prog, "  Y (Index Y):     %s\n", written & RF_Y ? "YES" : "NO");
+    program_log(prog, "  Z (Z register):  %s%s\n", written & RF_Z ? "YES" : "NO",
            prog->is_45gs02 ? "" : " (45GS02 only)");
 
-    printf("\nFlags affected:\n");
-    printf("  C (Carry):       %s\n", c_affected ? "YES" : "NO");
-    printf("  N (Negative):    %s\n", n_affected ? "YES" : "NO");
-    printf("  Z (Zero):        %s\n", z_affected ? "YES" : "NO");
-    printf("  V (Overflow):    %s\n", v_affected ? "YES" : "NO");
+    program_log(prog, "\nFlags affected:\n");
+    program_log(prog, "  C (Carry):       %s\n", written & RF_C ? "YES" : "NO");
+    program_log(prog, "  N (Negative):    %s\n", written & RF_N ? "YES" : "NO");
+    program_log(prog, "  Z (Zero):        %s\n", written & RF_ZF ? "YES" : "NO");
+    program_log(prog, "  V (Overflow):    %s\n", written & RF_V ? "YES" : "NO");
 
-    printf("\n=== Validation Complete ===\n");
+    program_log(prog, "\n=== Validation Complete ===\n");
 }
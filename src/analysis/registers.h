@@ -11,13 +11,72 @@
 #define REGISTERS_H
 
 #include "../types.h"
+#include <stdio.h>
+
+/**
+ * @brief Reset a register state to "nothing known"
+ *
+ * Clears every register value, modification flag and processor flag.
+ *
+ * @param state Register state to initialize
+ */
+void init_register_state(RegisterState *state);
+
+/**
+ * @brief Reset a register state for code entered from outside
+ *
+ * Like init_register_state(), except that on the 65816 the register
+ * widths are unknown too: the caller may have left A or the index
+ * registers 16 bits wide.
+ *
+ * @param state Register state to initialize
+ * @param cpu Target CPU
+ */
+void init_entry_register_state(RegisterState *state, CpuType cpu);
+
+/**
+ * @brief Get the width of a register
+ *
+ * Always 8 bits except on the 65816, where REP and SEP switch A (M
+ * flag) and X/Y (X flag) between 8 and 16 bits.
+ *
+ * @param state Register state
+ * @param reg 'A', 'X', 'Y' or 'Z'
+ * @return 8 or 16 bits, or 0 if unknown
+ */
+int register_width(const RegisterState *state, char reg);
+
+/**
+ * @brief Get the side-table register state slot for a node
+ *
+ * Per-node register state is not stored in AstNode. Instead the program
+ * keeps an optional array indexed by AstNode::index that is allocated
+ * the first time a pass (or -trace 2) asks for it.
+ *
+ * @param prog Program owning the side table
+ * @param node Node whose state slot to return
+ * @return Pointer to the node's slot, or NULL on allocation failure
+ */
+RegisterState* get_node_register_state(Program *prog, const AstNode *node);
+
+/**
+ * @brief Release the register state side table
+ *
+ * Safe to call when the table was never allocated.
+ *
+ * @param prog Program owning the side table
+ */
+void free_register_states(Program *prog);
 
 /**
  * @brief Update register state based on an instruction
  *
  * Updates the register state structure based on the effects of a
  * single instruction. Tracks which registers are modified, their
- * known values (if immediate mode), and processor flag changes.
+ * known values (immediates and values derived from them), processor
+ * flag changes and which register N/Z currently reflect. Instructions
+ * without a precise model forget everything they write, so the result
+ * is safe to optimize against.
  *
  * Handles all 6502/65C02/45GS02 instructions including:
  * - Load/store operations (LDA, STA, etc.)
@@ -29,12 +88,47 @@
  * - Flag manipulation (CLC, SEC, CLV)
  * - Stack operations (PHA, PLA, PHP, PLP)
  * - Control flow (branches, jumps, JSR, RTS, RTI)
+ * - Register widths on the 65816 (REP, SEP, XCE, PLP); values are only
+ *   computed while the register is 8 bits wide
  *
  * @param node AST node containing the instruction
  * @param state Register state to update (modified in place)
  */
 void update_register_state(AstNode *node, RegisterState *state);
 
+/**
+ * @brief Parse an immediate operand into a byte value
+ *
+ * Understands #$hex, #%binary, #decimal and the #< / #> low/high byte
+ * operators applied to a numeric literal.
+ *
+ * @param operand Operand text starting with '#'
+ * @return Value 0-255, or -1 if the operand is symbolic
+ */
+int parse_immediate_value(const char *operand);
+
+/**
+ * @brief Merge the register state of another control flow path
+ *
+ * Used at control flow join points: a register or flag stays known
+ * only if it holds the same value on both paths.
+ *
+ * @param into State to narrow (modified in place)
+ * @param other State arriving on the other path
+ */
+void merge_register_state(RegisterState *into, const RegisterState *other);
+
+/**
+ * @brief Compare two register states for dataflow convergence
+ *
+ * Ignores the per-instruction modification flags.
+ *
+ * @param a First state
+ * @param b Second state
+ * @return true if both states carry the same knowledge
+ */
+bool register_state_equal(const RegisterState *a, const RegisterState *b);
+
 /**
  * @brief Print register state for debugging
  *
@@ -42,10 +136,11 @@ void update_register_state(AstNode *node, RegisterState *state);
  * modification flags, and processor flag states. Used for
  * debugging and verbose optimization tracing.
  *
+ * @param fp Stream to print to
  * @param state Register state to print
  * @param line_num Line number associated with this state
  */
-void print_register_state(const RegisterState *state, int line_num);
+void print_register_state(FILE *fp, const RegisterState *state, int line_num);
 
 /**
  * @brief Validate register and flag tracking throughout program
@@ -58,8 +153,9 @@ void print_register_state(const RegisterState *state, int line_num);
  * - Register usage summary
  * - Flag usage summary
  *
- * Used for validation and debugging the optimizer. Outputs detailed
- * trace when trace_level >= 2.
+ * Used for validation and debugging the optimizer; runs only when
+ * prog->validate is set (-validate). Also prints the state after every
+ * instruction when trace_level >= 2.
  *
  * @param prog Program to validate
  */
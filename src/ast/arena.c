@@ -0,0 +1,178 @@
+/**
+ * @file arena.c
+ * @brief Bump/arena allocator implementation
+ *
+ * Implements chunked bump allocation. Individual allocations are never
+ * freed; the arena is released as a whole when the program is freed.
+ */
+
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+/** Alignment guaranteed for every allocation */
+#define ARENA_ALIGN (2 * sizeof(void *))
+
+/** Size of the chunk header, rounded up to keep data aligned */
+#define ARENA_HEADER ((sizeof(ArenaChunk) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+/**
+ * @brief Allocate a new chunk and push it onto the arena
+ *
+ * @param arena Arena to extend
+ * @param min_size Minimum usable size required
+ * @return New chunk, or NULL on allocation failure
+ */
+static ArenaChunk* arena_new_chunk(Arena *arena, size_t min_size) {
+    size_t size = arena->chunk_size;
+    if (size < min_size) size = min_size;
+
+    ArenaChunk *chunk = malloc(ARENA_HEADER + size);
+    if (!chunk) return NULL;
+
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->next = arena->head;
+    arena->head = chunk;
+    arena->bytes_reserved += size;
+    return chunk;
+}
+
+/**
+ * @brief Create a new arena
+ *
+ * The first chunk is allocated lazily on the first allocation.
+ *
+ * @param chunk_size Size of each chunk (0 selects ARENA_DEFAULT_CHUNK)
+ * @return Pointer to the new arena, or NULL on allocation failure
+ */
+Arena* arena_create(size_t chunk_size) {
+    Arena *arena = malloc(sizeof(Arena));
+    if (!arena) return NULL;
+
+    arena->head = NULL;
+    arena->chunk_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK;
+    arena->bytes_used = 0;
+    arena->bytes_reserved = 0;
+    return arena;
+}
+
+/**
+ * @brief Allocate memory from the arena
+ *
+ * Rounds the request up to ARENA_ALIGN and bumps the offset in the
+ * current chunk, starting a new chunk when the current one is full.
+ *
+ * @param arena Arena to allocate from
+ * @param size Number of bytes to allocate
+ * @return Pointer to the memory, or NULL on allocation failure
+ */
+void* arena_alloc(Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    ArenaChunk *chunk = arena->head;
+    if (!chunk || chunk->size - chunk->used < size) {
+        chunk = arena_new_chunk(arena, size);
+        if (!chunk) return NULL;
+    }
+
+    void *ptr = (char *)chunk + ARENA_HEADER + chunk->used;
+    chunk->used += size;
+    arena->bytes_used += size;
+    return ptr;
+}
+
+/**
+ * @brief Copy a string of known length into the arena
+ *
+ * @param arena Arena to allocate from
+ * @param str Source characters (need not be NUL-terminated)
+ * @param len Number of characters to copy
+ * @return NUL-terminated copy, or NULL on allocation failure
+ */
+char* arena_strndup(Arena *arena, const char *str, size_t len) {
+    char *copy = arena_alloc(arena, len + 1);
+    if (copy) {
+        memcpy(copy, str, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+/**
+ * @brief Copy a NUL-terminated string into the arena
+ *
+ * @param arena Arena to allocate from
+ * @param str String to copy
+ * @return Copy of the string, or NULL on allocation failure
+ */
+char* arena_strdup(Arena *arena, const char *str) {
+    return arena_strndup(arena, str, strlen(str));
+}
+
+/**
+ * @brief Release all allocations but keep the arena usable
+ *
+ * @param arena Arena to reset
+ */
+void arena_reset(Arena *arena) {
+    if (!arena || !arena->head) return;
+
+    ArenaChunk *keep = arena->head;
+    ArenaChunk *chunk = keep->next;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    keep->next = NULL;
+    keep->used = 0;
+    arena->bytes_used = 0;
+    arena->bytes_reserved = keep->size;
+}
+
+/**
+ * @brief Move every allocation of one arena into another
+ *
+ * The chunks of src are linked in behind the chunk dst is filling, so
+ * dst keeps allocating where it left off.
+ *
+ * @param dst Arena that takes over the chunks
+ * @param src Arena to empty and free (NULL-safe)
+ */
+void arena_adopt(Arena *dst, Arena *src) {
+    if (!src) return;
+
+    if (src->head) {
+        ArenaChunk *tail = src->head;
+        while (tail->next) tail = tail->next;
+
+        if (dst->head) {
+            tail->next = dst->head->next;
+            dst->head->next = src->head;
+        } else {
+            dst->head = src->head;
+        }
+        dst->bytes_used += src->bytes_used;
+        dst->bytes_reserved += src->bytes_reserved;
+    }
+    free(src);
+}
+
+/**
+ * @brief Free the arena and everything allocated from it
+ *
+ * @param arena Arena to destroy (NULL-safe)
+ */
+void arena_destroy(Arena *arena) {
+    if (!arena) return;
+
+    ArenaChunk *chunk = arena->head;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+}
@@ -0,0 +1,108 @@
+/**
+ * @file arena.h
+ * @brief Bump/arena allocator for AST nodes and their strings
+ *
+ * Provides a simple region allocator owned by a Program. The
+ * label/opcode/operand/comment strings hanging off AST nodes are carved
+ * out of large chunks, so parsing costs one pointer bump per allocation
+ * and the whole program is released with a single call.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_DEFAULT_CHUNK (64 * 1024)  /**< Default chunk size in bytes */
+
+/**
+ * @brief One contiguous block of arena memory
+ *
+ * Chunks form a singly linked list, newest first. Allocation data
+ * follows the header directly.
+ */
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;    /**< Previously filled chunk */
+    size_t size;                /**< Usable bytes in this chunk */
+    size_t used;                /**< Bytes already handed out */
+} ArenaChunk;
+
+/**
+ * @brief Arena allocator state
+ */
+typedef struct {
+    ArenaChunk *head;           /**< Chunk currently being filled */
+    size_t chunk_size;          /**< Size of newly created chunks */
+    size_t bytes_used;          /**< Total bytes handed out */
+    size_t bytes_reserved;      /**< Total bytes obtained from malloc */
+} Arena;
+
+/**
+ * @brief Create a new arena
+ *
+ * @param chunk_size Size of each chunk (0 selects ARENA_DEFAULT_CHUNK)
+ * @return Pointer to the new arena, or NULL on allocation failure
+ */
+Arena* arena_create(size_t chunk_size);
+
+/**
+ * @brief Allocate memory from the arena
+ *
+ * Returns suitably aligned memory that stays valid until the arena is
+ * reset or destroyed. Requests larger than the chunk size get a
+ * dedicated chunk.
+ *
+ * @param arena Arena to allocate from
+ * @param size Number of bytes to allocate
+ * @return Pointer to the memory, or NULL on allocation failure
+ */
+void* arena_alloc(Arena *arena, size_t size);
+
+/**
+ * @brief Copy a string of known length into the arena
+ *
+ * @param arena Arena to allocate from
+ * @param str Source characters (need not be NUL-terminated)
+ * @param len Number of characters to copy
+ * @return NUL-terminated copy, or NULL on allocation failure
+ */
+char* arena_strndup(Arena *arena, const char *str, size_t len);
+
+/**
+ * @brief Copy a NUL-terminated string into the arena
+ *
+ * @param arena Arena to allocate from
+ * @param str String to copy
+ * @return Copy of the string, or NULL on allocation failure
+ */
+char* arena_strdup(Arena *arena, const char *str);
+
+/**
+ * @brief Release all allocations but keep the arena usable
+ *
+ * Frees every chunk except the most recent one, which is rewound and
+ * reused for subsequent allocations.
+ *
+ * @param arena Arena to reset
+ */
+void arena_reset(Arena *arena);
+
+/**
+ * @brief Move every allocation of one arena into another
+ *
+ * Memory handed out by src stays valid and is from now on released
+ * together with dst. src itself is freed.
+ *
+ * @param dst Arena that takes over the chunks
+ * @param src Arena to empty and free (NULL-safe)
+ */
+void arena_adopt(Arena *dst, Arena *src);
+
+/**
+ * @brief Free the arena and everything allocated from it
+ *
+ * @param arena Arena to destroy (NULL-safe)
+ */
+void arena_destroy(Arena *arena);
+
+#endif // ARENA_H
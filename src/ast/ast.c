@@ -2,94 +2,76 @@
  * @file ast.c
  * @brief Abstract Syntax Tree node implementation
  *
- * Implements AST node creation, initialization, and memory management.
+ * Implements AST node initialization and in-place rewriting. Node slots
+ * belong to the program's node array and strings to its arena, so there
+ * is no per-node free.
  */
 
 #include "ast.h"
-#include <stdlib.h>
+#include <ctype.h>
 #include <string.h>
 
 /**
- * @brief Create a new AST node
+ * @brief Initialize an AST node
  *
- * Allocates a new AST node and initializes all fields to safe defaults:
+ * Sets all fields of a node slot to safe defaults:
  * - Pointers: NULL
  * - Booleans: false
- * - Register state: all unknown/unmodified
- * - Processor flags: all unknown
+ * - Index: -1 until the node is placed in a program
  *
- * @param type The type of node to create
+ * Register state is not stored on the node; see
+ * get_node_register_state() for the optional side table.
+ *
+ * @param node Node slot to initialize
+ * @param type The type of node
  * @param line_num Line number in original source
- * @return Pointer to newly allocated node
  */
-AstNode* create_ast_node(NodeType type, int line_num) {
-    AstNode *node = malloc(sizeof(AstNode));
+void init_ast_node(AstNode *node, NodeType type, int line_num) {
     node->type = type;
     node->line_num = line_num;
+    node->index = -1;
     node->label = NULL;
     node->opcode = NULL;
+    node->op = OP_NONE;
+    node->mode = AM_NONE;
     node->operand = NULL;
     node->comment = NULL;
-    node->next = NULL;
-    node->child = NULL;
-    node->sibling = NULL;
-    node->is_dead = false;
     node->no_optimize = false;
     node->is_local_label = false;
     node->is_branch_target = false;
     node->optimization_count = 0;
-
-    // Initialize register state
-    node->reg_state.a_known = false;
-    node->reg_state.x_known = false;
-    node->reg_state.y_known = false;
-    node->reg_state.z_known = false;
-    node->reg_state.a_zero = false;
-    node->reg_state.x_zero = false;
-    node->reg_state.y_zero = false;
-    node->reg_state.z_zero = false;
-    node->reg_state.a_modified = false;
-    node->reg_state.x_modified = false;
-    node->reg_state.y_modified = false;
-    node->reg_state.z_modified = false;
-    node->reg_state.a_value[0] = '\0';
-    node->reg_state.x_value[0] = '\0';
-    node->reg_state.y_value[0] = '\0';
-    node->reg_state.z_value[0] = '\0';
-
-    // Initialize flag state
-    node->reg_state.c_known = false;
-    node->reg_state.n_known = false;
-    node->reg_state.z_flag_known = false;
-    node->reg_state.v_known = false;
-    node->reg_state.c_set = false;
-    node->reg_state.n_set = false;
-    node->reg_state.z_flag_set = false;
-    node->reg_state.v_set = false;
-
-    return node;
+    node->source = NULL;
+    node->source_len = 0;
+    node->rewritten = false;
 }
 
 /**
- * @brief Free an AST node and all its children recursively
+ * @brief Replace the opcode of an AST node
  *
- * Frees all dynamically allocated memory associated with a node,
- * including strings (label, opcode, operand, comment) and
- * recursively frees child and sibling nodes.
+ * Points the node at the canonical upper-case mnemonic, or at a
+ * lower-case copy in the arena when the original source used
+ * lower-case mnemonics.
  *
- * @param node Node to free (NULL-safe)
+ * @param arena Arena that owns the node
+ * @param node Node to modify
+ * @param op New opcode
  */
-void free_ast_node(AstNode *node) {
-    if (!node) return;
-
-    if (node->label) free(node->label);
-    if (node->opcode) free(node->opcode);
-    if (node->operand) free(node->operand);
-    if (node->comment) free(node->comment);
+void set_node_opcode(Arena *arena, AstNode *node, Opcode op) {
+    const char *name = opcode_name(op);
+    bool lower = node->opcode && islower((unsigned char)node->opcode[0]);
 
-    // Free children recursively
-    free_ast_node(node->child);
-    free_ast_node(node->sibling);
+    node->op = op;
+    node->mode = classify_operand(op, node->operand);
+    node->opcode = name;
 
-    free(node);
+    if (lower) {
+        size_t len = strlen(name);
+        char *copy = arena_strndup(arena, name, len);
+        if (copy) {
+            for (size_t i = 0; i < len; i++) {
+                copy[i] = (char)tolower((unsigned char)copy[i]);
+            }
+            node->opcode = copy;
+        }
+    }
 }
@@ -2,8 +2,9 @@
  * @file ast.h
  * @brief Abstract Syntax Tree node management
  *
- * Provides functions for creating, initializing, and freeing AST nodes.
- * Each node represents a line or element of assembly code.
+ * Provides functions for initializing and rewriting AST nodes.
+ * Each node represents a line or element of assembly code. Nodes live
+ * in the program's node array and their strings in the program's arena.
  */
 
 #ifndef AST_H
@@ -12,26 +13,29 @@
 #include "../types.h"
 
 /**
- * @brief Create a new AST node
+ * @brief Initialize an AST node
  *
- * Allocates and initializes a new AST node with default values.
- * All pointers are set to NULL, booleans to false, and register
- * state is initialized to unknown.
+ * Fills a node slot with default values. All pointers are set to NULL
+ * and booleans to false.
  *
- * @param type The type of node to create (label, opcode, etc.)
+ * @param node Node slot to initialize
+ * @param type The type of node (label, opcode, etc.)
  * @param line_num Line number in original source file
- * @return Pointer to newly allocated node, or NULL on allocation failure
  */
-AstNode* create_ast_node(NodeType type, int line_num);
+void init_ast_node(AstNode *node, NodeType type, int line_num);
 
 /**
- * @brief Free an AST node and all its children
+ * @brief Replace the opcode of an AST node
  *
- * Recursively frees an AST node, its children, siblings, and all
- * allocated strings (label, opcode, operand, comment).
+ * Used by optimization passes that rewrite an instruction in place
+ * (e.g. STA -> STZ). Updates the interned opcode, the opcode text
+ * (keeping the source's letter case) and re-classifies the addressing
+ * mode against the node's current operand.
  *
- * @param node Node to free (may be NULL)
+ * @param arena Arena that owns the node
+ * @param node Node to modify
+ * @param op New opcode
  */
-void free_ast_node(AstNode *node);
+void set_node_opcode(Arena *arena, AstNode *node, Opcode op);
 
 #endif // AST_H
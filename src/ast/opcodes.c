@@ -0,0 +1,609 @@
+/**
+ * @file opcodes.c
+ * @brief Interned opcode table and addressing mode classification
+ *
+ * Holds the static description of every supported mnemonic and a small
+ * hash table used by the parser to resolve mnemonic text into Opcode
+ * values. All lookups are case-insensitive.
+ */
+
+#include "opcodes.h"
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+
+/* Shorthands for the table below */
+#define MEM   RF_MEM
+#define A     RF_A
+#define X     RF_X
+#define Y     RF_Y
+#define Z     RF_Z
+#define SP    RF_SP
+#define Q     RF_REGS
+
+/**
+ * @brief Opcode table indexed by Opcode
+ *
+ * Memory operands of read-modify-write instructions (ASL, INC, ...) are
+ * listed as RF_MEM; opcode_reads()/opcode_writes() swap them for the
+ * accumulator (or Q) when the instruction is used in accumulator form.
+ */
+static const OpcodeInfo opcode_table[OP_COUNT] = {
+    [OP_NONE] = {"",    0,          FLOW_NONE,   0,                  0},
+
+    /* NMOS 6502 */
+    [OP_ADC] = {"ADC", CPUM_ALL,    FLOW_NONE,   A | RF_C | RF_D | MEM, A | RF_NZCV},
+    [OP_AND] = {"AND", CPUM_ALL,    FLOW_NONE,   A | MEM,            A | RF_NZ},
+    [OP_ASL] = {"ASL", CPUM_ALL,    FLOW_NONE,   MEM,                MEM | RF_NZC},
+    [OP_BCC] = {"BCC", CPUM_ALL,    FLOW_BRANCH, RF_C,               0},
+    [OP_BCS] = {"BCS", CPUM_ALL,    FLOW_BRANCH, RF_C,               0},
+    [OP_BEQ] = {"BEQ", CPUM_ALL,    FLOW_BRANCH, RF_ZF,              0},
+    [OP_BIT] = {"BIT", CPUM_ALL,    FLOW_NONE,   A | MEM,            RF_N | RF_ZF | RF_V},
+    [OP_BMI] = {"BMI", CPUM_ALL,    FLOW_BRANCH, RF_N,               0},
+    [OP_BNE] = {"BNE", CPUM_ALL,    FLOW_BRANCH, RF_ZF,              0},
+    [OP_BPL] = {"BPL", CPUM_ALL,    FLOW_BRANCH, RF_N,               0},
+    [OP_BRK] = {"BRK", CPUM_ALL,    FLOW_STOP,   RF_FLAGS | SP,      RF_I | RF_D | SP},
+    [OP_BVC] = {"BVC", CPUM_ALL,    FLOW_BRANCH, RF_V,               0},
+    [OP_BVS] = {"BVS", CPUM_ALL,    FLOW_BRANCH, RF_V,               0},
+    [OP_CLC] = {"CLC", CPUM_ALL,    FLOW_NONE,   0,                  RF_C},
+    [OP_CLD] = {"CLD", CPUM_ALL,    FLOW_NONE,   0,                  RF_D},
+    [OP_CLI] = {"CLI", CPUM_ALL,    FLOW_NONE,   0,                  RF_I},
+    [OP_CLV] = {"CLV", CPUM_ALL,    FLOW_NONE,   0,                  RF_V},
+    [OP_CMP] = {"CMP", CPUM_ALL,    FLOW_NONE,   A | MEM,            RF_NZC},
+    [OP_CPX] = {"CPX", CPUM_ALL,    FLOW_NONE,   X | MEM,            RF_NZC},
+    [OP_CPY] = {"CPY", CPUM_ALL,    FLOW_NONE,   Y | MEM,            RF_NZC},
+    [OP_DEC] = {"DEC", CPUM_ALL,    FLOW_NONE,   MEM,                MEM | RF_NZ},
+    [OP_DEX] = {"DEX", CPUM_ALL,    FLOW_NONE,   X,                  X | RF_NZ},
+    [OP_DEY] = {"DEY", CPUM_ALL,    FLOW_NONE,   Y,                  Y | RF_NZ},
+    [OP_EOR] = {"EOR", CPUM_ALL,    FLOW_NONE,   A | MEM,            A | RF_NZ},
+    [OP_INC] = {"INC", CPUM_ALL,    FLOW_NONE,   MEM,                MEM | RF_NZ},
+    [OP_INX] = {"INX", CPUM_ALL,    FLOW_NONE,   X,                  X | RF_NZ},
+    [OP_INY] = {"INY", CPUM_ALL,    FLOW_NONE,   Y,                  Y | RF_NZ},
+    [OP_JMP] = {"JMP", CPUM_ALL,    FLOW_JUMP,   0,                  0},
+    [OP_JSR] = {"JSR", CPUM_ALL,    FLOW_CALL,   SP,                 SP},
+    [OP_LDA] = {"LDA", CPUM_ALL,    FLOW_NONE,   MEM,                A | RF_NZ},
+    [OP_LDX] = {"LDX", CPUM_ALL,    FLOW_NONE,   MEM,                X | RF_NZ},
+    [OP_LDY] = {"LDY", CPUM_ALL,    FLOW_NONE,   MEM,                Y | RF_NZ},
+    [OP_LSR] = {"LSR", CPUM_ALL,    FLOW_NONE,   MEM,                MEM | RF_NZC},
+    [OP_NOP] = {"NOP", CPUM_ALL,    FLOW_NONE,   0,                  0},
+    [OP_ORA] = {"ORA", CPUM_ALL,    FLOW_NONE,   A | MEM,            A | RF_NZ},
+    [OP_PHA] = {"PHA", CPUM_ALL,    FLOW_NONE,   A | SP,             SP},
+    [OP_PHP] = {"PHP", CPUM_ALL,    FLOW_NONE,   RF_FLAGS | SP,      SP},
+    [OP_PLA] = {"PLA", CPUM_ALL,    FLOW_NONE,   SP,                 A | RF_NZ | SP},
+    [OP_PLP] = {"PLP", CPUM_ALL,    FLOW_NONE,   SP,                 RF_FLAGS | SP},
+    [OP_ROL] = {"ROL", CPUM_ALL,    FLOW_NONE,   RF_C | MEM,         MEM | RF_NZC},
+    [OP_ROR] = {"ROR", CPUM_ALL,    FLOW_NONE,   RF_C | MEM,         MEM | RF_NZC},
+    [OP_RTI] = {"RTI", CPUM_ALL,    FLOW_RETURN, SP,                 RF_FLAGS | SP},
+    [OP_RTS] = {"RTS", CPUM_ALL,    FLOW_RETURN, SP,                 SP},
+    [OP_SBC] = {"SBC", CPUM_ALL,    FLOW_NONE,   A | RF_C | RF_D | MEM, A | RF_NZCV},
+    [OP_SEC] = {"SEC", CPUM_ALL,    FLOW_NONE,   0,                  RF_C},
+    [OP_SED] = {"SED", CPUM_ALL,    FLOW_NONE,   0,                  RF_D},
+    [OP_SEI] = {"SEI", CPUM_ALL,    FLOW_NONE,   0,                  RF_I},
+    [OP_STA] = {"STA", CPUM_ALL,    FLOW_NONE,   A,                  MEM},
+    [OP_STX] = {"STX", CPUM_ALL,    FLOW_NONE,   X,                  MEM},
+    [OP_STY] = {"STY", CPUM_ALL,    FLOW_NONE,   Y,                  MEM},
+    [OP_TAX] = {"TAX", CPUM_ALL,    FLOW_NONE,   A,                  X | RF_NZ},
+    [OP_TAY] = {"TAY", CPUM_ALL,    FLOW_NONE,   A,                  Y | RF_NZ},
+    [OP_TSX] = {"TSX", CPUM_ALL,    FLOW_NONE,   SP,                 X | RF_NZ},
+    [OP_TXA] = {"TXA", CPUM_ALL,    FLOW_NONE,   X,                  A | RF_NZ},
+    [OP_TXS] = {"TXS", CPUM_ALL,    FLOW_NONE,   X,                  SP},
+    [OP_TYA] = {"TYA", CPUM_ALL,    FLOW_NONE,   Y,                  A | RF_NZ},
+
+    /* 65C02 */
+    [OP_BRA] = {"BRA", CPUM_CMOS,   FLOW_JUMP,   0,                  0},
+    [OP_PHX] = {"PHX", CPUM_CMOS,   FLOW_NONE,   X | SP,             SP},
+    [OP_PHY] = {"PHY", CPUM_CMOS,   FLOW_NONE,   Y | SP,             SP},
+    [OP_PLX] = {"PLX", CPUM_CMOS,   FLOW_NONE,   SP,                 X | RF_NZ | SP},
+    [OP_PLY] = {"PLY", CPUM_CMOS,   FLOW_NONE,   SP,                 Y | RF_NZ | SP},
+    /* STZ stores zero on 65C02 but the Z register on 45GS02 */
+    [OP_STZ] = {"STZ", CPUM_CMOS,   FLOW_NONE,   Z,                  MEM},
+    [OP_TRB] = {"TRB", CPUM_CMOS,   FLOW_NONE,   A | MEM,            MEM | RF_ZF},
+    [OP_TSB] = {"TSB", CPUM_CMOS,   FLOW_NONE,   A | MEM,            MEM | RF_ZF},
+    [OP_BBR] = {"BBR", CPUM_65C02 | CPUM_45GS02, FLOW_BRANCH, MEM,   0},
+    [OP_BBS] = {"BBS", CPUM_65C02 | CPUM_45GS02, FLOW_BRANCH, MEM,   0},
+    [OP_RMB] = {"RMB", CPUM_65C02 | CPUM_45GS02, FLOW_NONE,   MEM,   MEM},
+    [OP_SMB] = {"SMB", CPUM_65C02 | CPUM_45GS02, FLOW_NONE,   MEM,   MEM},
+    [OP_STP] = {"STP", CPUM_65C02 | CPUM_65816,  FLOW_STOP,   0,     0},
+    [OP_WAI] = {"WAI", CPUM_65C02 | CPUM_65816,  FLOW_NONE,   0,     0},
+
+    /* 65816 */
+    [OP_BRL] = {"BRL", CPUM_65816,  FLOW_JUMP,   0,                  0},
+    [OP_COP] = {"COP", CPUM_65816,  FLOW_STOP,   RF_FLAGS | SP,      RF_I | RF_D | SP},
+    [OP_JML] = {"JML", CPUM_65816,  FLOW_JUMP,   0,                  0},
+    [OP_JSL] = {"JSL", CPUM_65816,  FLOW_CALL,   SP,                 SP},
+    [OP_MVN] = {"MVN", CPUM_65816,  FLOW_NONE,   A | X | Y | MEM,    A | X | Y | MEM},
+    [OP_MVP] = {"MVP", CPUM_65816,  FLOW_NONE,   A | X | Y | MEM,    A | X | Y | MEM},
+    [OP_PEA] = {"PEA", CPUM_65816,  FLOW_NONE,   SP,                 SP},
+    [OP_PEI] = {"PEI", CPUM_65816,  FLOW_NONE,   SP | MEM,           SP},
+    [OP_PER] = {"PER", CPUM_65816,  FLOW_NONE,   SP,                 SP},
+    [OP_PHB] = {"PHB", CPUM_65816,  FLOW_NONE,   SP,                 SP},
+    [OP_PHD] = {"PHD", CPUM_65816,  FLOW_NONE,   SP,                 SP},
+    [OP_PHK] = {"PHK", CPUM_65816,  FLOW_NONE,   SP,                 SP},
+    [OP_PLB] = {"PLB", CPUM_65816,  FLOW_NONE,   SP,                 RF_NZ | SP},
+    [OP_PLD] = {"PLD", CPUM_65816,  FLOW_NONE,   SP,                 RF_NZ | SP},
+    [OP_REP] = {"REP", CPUM_65816,  FLOW_NONE,   0,                  RF_FLAGS},
+    [OP_RTL] = {"RTL", CPUM_65816,  FLOW_RETURN, SP,                 SP},
+    [OP_SEP] = {"SEP", CPUM_65816,  FLOW_NONE,   0,                  RF_FLAGS},
+    [OP_TCD] = {"TCD", CPUM_65816,  FLOW_NONE,   A,                  RF_NZ},
+    [OP_TCS] = {"TCS", CPUM_65816,  FLOW_NONE,   A,                  SP},
+    [OP_TDC] = {"TDC", CPUM_65816,  FLOW_NONE,   0,                  A | RF_NZ},
+    [OP_TSC] = {"TSC", CPUM_65816,  FLOW_NONE,   SP,                 A | RF_NZ},
+    [OP_TXY] = {"TXY", CPUM_65816,  FLOW_NONE,   X,                  Y | RF_NZ},
+    [OP_TYX] = {"TYX", CPUM_65816,  FLOW_NONE,   Y,                  X | RF_NZ},
+    [OP_WDM] = {"WDM", CPUM_65816,  FLOW_NONE,   0,                  0},
+    [OP_XBA] = {"XBA", CPUM_65816,  FLOW_NONE,   A,                  A | RF_NZ},
+    [OP_XCE] = {"XCE", CPUM_65816,  FLOW_NONE,   RF_C,               RF_C},
+
+    /* 45GS02 (MEGA65) */
+    [OP_ASR] = {"ASR", CPUM_45GS02, FLOW_NONE,   MEM,                MEM | RF_NZC},
+    [OP_ASW] = {"ASW", CPUM_45GS02, FLOW_NONE,   MEM,                MEM | RF_NZC},
+    [OP_BSR] = {"BSR", CPUM_45GS02, FLOW_CALL,   SP,                 SP},
+    [OP_CLE] = {"CLE", CPUM_45GS02, FLOW_NONE,   0,                  0},
+    [OP_CPZ] = {"CPZ", CPUM_45GS02, FLOW_NONE,   Z | MEM,            RF_NZC},
+    [OP_DEW] = {"DEW", CPUM_45GS02, FLOW_NONE,   MEM,                MEM | RF_NZ},
+    [OP_DEZ] = {"DEZ", CPUM_45GS02, FLOW_NONE,   Z,                  Z | RF_NZ},
+    [OP_EOM] = {"EOM", CPUM_45GS02, FLOW_NONE,   0,                  0},
+    [OP_INW] = {"INW", CPUM_45GS02, FLOW_NONE,   MEM,                MEM | RF_NZ},
+    [OP_INZ] = {"INZ", CPUM_45GS02, FLOW_NONE,   Z,                  Z | RF_NZ},
+    [OP_LDZ] = {"LDZ", CPUM_45GS02, FLOW_NONE,   MEM,                Z | RF_NZ},
+    [OP_MAP] = {"MAP", CPUM_45GS02, FLOW_NONE,   Q,                  0},
+    [OP_NEG] = {"NEG", CPUM_45GS02, FLOW_NONE,   A,                  A | RF_NZ},
+    [OP_PHW] = {"PHW", CPUM_45GS02, FLOW_NONE,   SP | MEM,           SP},
+    [OP_PHZ] = {"PHZ", CPUM_45GS02, FLOW_NONE,   Z | SP,             SP},
+    [OP_PLZ] = {"PLZ", CPUM_45GS02, FLOW_NONE,   SP,                 Z | RF_NZ | SP},
+    [OP_ROW] = {"ROW", CPUM_45GS02, FLOW_NONE,   RF_C | MEM,         MEM | RF_NZC},
+    [OP_RTN] = {"RTN", CPUM_45GS02, FLOW_RETURN, SP,                 SP},
+    [OP_SEE] = {"SEE", CPUM_45GS02, FLOW_NONE,   0,                  0},
+    [OP_TAB] = {"TAB", CPUM_45GS02, FLOW_NONE,   A,                  RF_B},
+    [OP_TAZ] = {"TAZ", CPUM_45GS02, FLOW_NONE,   A,                  Z | RF_NZ},
+    [OP_TBA] = {"TBA", CPUM_45GS02, FLOW_NONE,   RF_B,               A | RF_NZ},
+    [OP_TSY] = {"TSY", CPUM_45GS02, FLOW_NONE,   SP,                 Y | RF_NZ},
+    [OP_TYS] = {"TYS", CPUM_45GS02, FLOW_NONE,   Y,                  SP},
+    [OP_TZA] = {"TZA", CPUM_45GS02, FLOW_NONE,   Z,                  A | RF_NZ},
+
+    /* 45GS02 Q register (Q = Z:Y:X:A) */
+    [OP_ADCQ] = {"ADCQ", CPUM_45GS02, FLOW_NONE, Q | RF_C | MEM,     Q | RF_NZCV},
+    [OP_ANDQ] = {"ANDQ", CPUM_45GS02, FLOW_NONE, Q | MEM,            Q | RF_NZ},
+    [OP_ASLQ] = {"ASLQ", CPUM_45GS02, FLOW_NONE, MEM,                MEM | RF_NZC},
+    [OP_ASRQ] = {"ASRQ", CPUM_45GS02, FLOW_NONE, MEM,                MEM | RF_NZC},
+    [OP_BITQ] = {"BITQ", CPUM_45GS02, FLOW_NONE, Q | MEM,            RF_N | RF_ZF | RF_V},
+    [OP_CMPQ] = {"CMPQ", CPUM_45GS02, FLOW_NONE, Q | MEM,            RF_NZC},
+    [OP_DEQ]  = {"DEQ",  CPUM_45GS02, FLOW_NONE, MEM,                MEM | RF_NZ},
+    [OP_EORQ] = {"EORQ", CPUM_45GS02, FLOW_NONE, Q | MEM,            Q | RF_NZ},
+    [OP_INQ]  = {"INQ",  CPUM_45GS02, FLOW_NONE, MEM,                MEM | RF_NZ},
+    [OP_LDQ]  = {"LDQ",  CPUM_45GS02, FLOW_NONE, MEM,                Q | RF_NZ},
+    [OP_LSRQ] = {"LSRQ", CPUM_45GS02, FLOW_NONE, MEM,                MEM | RF_NZC},
+    [OP_ORQ]  = {"ORQ",  CPUM_45GS02, FLOW_NONE, Q | MEM,            Q | RF_NZ},
+    [OP_ROLQ] = {"ROLQ", CPUM_45GS02, FLOW_NONE, RF_C | MEM,         MEM | RF_NZC},
+    [OP_RORQ] = {"RORQ", CPUM_45GS02, FLOW_NONE, RF_C | MEM,         MEM | RF_NZC},
+    [OP_SBCQ] = {"SBCQ", CPUM_45GS02, FLOW_NONE, Q | RF_C | MEM,     Q | RF_NZCV},
+    [OP_STQ]  = {"STQ",  CPUM_45GS02, FLOW_NONE, Q,                  MEM},
+};
+
+#undef MEM
+#undef A
+#undef X
+#undef Y
+#undef Z
+#undef SP
+#undef Q
+
+/**
+ * @brief Alternative spellings accepted by common assemblers
+ */
+static const struct {
+    const char *name;
+    Opcode op;
+} opcode_aliases[] = {
+    {"INA", OP_INC}, {"DEA", OP_DEC},
+    {"TAS", OP_TCS}, {"TSA", OP_TSC}, {"TAD", OP_TCD}, {"TDA", OP_TDC},
+    {"SWA", OP_XBA}, {"CPQ", OP_CMPQ},
+    {"BBR0", OP_BBR}, {"BBR1", OP_BBR}, {"BBR2", OP_BBR}, {"BBR3", OP_BBR},
+    {"BBR4", OP_BBR}, {"BBR5", OP_BBR}, {"BBR6", OP_BBR}, {"BBR7", OP_BBR},
+    {"BBS0", OP_BBS}, {"BBS1", OP_BBS}, {"BBS2", OP_BBS}, {"BBS3", OP_BBS},
+    {"BBS4", OP_BBS}, {"BBS5", OP_BBS}, {"BBS6", OP_BBS}, {"BBS7", OP_BBS},
+    {"RMB0", OP_RMB}, {"RMB1", OP_RMB}, {"RMB2", OP_RMB}, {"RMB3", OP_RMB},
+    {"RMB4", OP_RMB}, {"RMB5", OP_RMB}, {"RMB6", OP_RMB}, {"RMB7", OP_RMB},
+    {"SMB0", OP_SMB}, {"SMB1", OP_SMB}, {"SMB2", OP_SMB}, {"SMB3", OP_SMB},
+    {"SMB4", OP_SMB}, {"SMB5", OP_SMB}, {"SMB6", OP_SMB}, {"SMB7", OP_SMB},
+};
+
+#define OPCODE_HASH_BITS 9
+#define OPCODE_HASH_SIZE (1u << OPCODE_HASH_BITS)
+
+/** Hash table of packed mnemonic keys; slot value 0 means empty */
+static uint32_t hash_keys[OPCODE_HASH_SIZE];
+static unsigned char hash_ops[OPCODE_HASH_SIZE];
+static bool opcodes_ready = false;
+
+/**
+ * @brief Pack up to four mnemonic characters into an upper-case key
+ *
+ * @param name Mnemonic text
+ * @param len Mnemonic length
+ * @return Packed key, or 0 if the text cannot be a mnemonic
+ */
+static uint32_t pack_mnemonic(const char *name, size_t len) {
+    if (len < 3 || len > 4) return 0;
+
+    uint32_t key = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)toupper((unsigned char)name[i]);
+        if (!isalnum(c)) return 0;
+        key = (key << 8) | c;
+    }
+    return key;
+}
+
+/**
+ * @brief Map a packed key to its home slot
+ */
+static unsigned int hash_slot(uint32_t key) {
+    return (unsigned int)((key * 2654435761u) >> (32 - OPCODE_HASH_BITS));
+}
+
+/**
+ * @brief Insert a mnemonic into the hash table
+ */
+static void hash_insert(const char *name, Opcode op) {
+    uint32_t key = pack_mnemonic(name, strlen(name));
+    unsigned int slot = hash_slot(key);
+    while (hash_keys[slot] != 0 && hash_keys[slot] != key) {
+        slot = (slot + 1) & (OPCODE_HASH_SIZE - 1);
+    }
+    hash_keys[slot] = key;
+    hash_ops[slot] = (unsigned char)op;
+}
+
+/**
+ * @brief Build the mnemonic lookup table
+ */
+void opcodes_init(void) {
+    if (opcodes_ready) return;
+
+    for (int op = OP_NONE + 1; op < OP_COUNT; op++) {
+        hash_insert(opcode_table[op].name, (Opcode)op);
+    }
+    for (size_t i = 0; i < sizeof(opcode_aliases) / sizeof(opcode_aliases[0]); i++) {
+        hash_insert(opcode_aliases[i].name, opcode_aliases[i].op);
+    }
+    opcodes_ready = true;
+}
+
+/**
+ * @brief Resolve a mnemonic to its Opcode
+ *
+ * @param name Mnemonic text (need not be NUL-terminated)
+ * @param len Length of the mnemonic
+ * @return Matching opcode, or OP_NONE if the text is not an instruction
+ */
+Opcode lookup_opcode(const char *name, size_t len) {
+    if (!name) return OP_NONE;
+
+    uint32_t key = pack_mnemonic(name, len);
+    if (key == 0) return OP_NONE;
+
+    unsigned int slot = hash_slot(key);
+    while (hash_keys[slot] != 0) {
+        if (hash_keys[slot] == key) return (Opcode)hash_ops[slot];
+        slot = (slot + 1) & (OPCODE_HASH_SIZE - 1);
+    }
+    return OP_NONE;
+}
+
+/**
+ * @brief Get the static description of an opcode
+ */
+const OpcodeInfo* opcode_info(Opcode op) {
+    if (op <= OP_NONE || op >= OP_COUNT) return &opcode_table[OP_NONE];
+    return &opcode_table[op];
+}
+
+/**
+ * @brief Get the canonical mnemonic of an opcode
+ */
+const char* opcode_name(Opcode op) {
+    return opcode_info(op)->name;
+}
+
+/**
+ * @brief Check whether an opcode exists on a CPU
+ */
+bool opcode_available(Opcode op, unsigned int cpus) {
+    return (opcode_info(op)->cpus & cpus) != 0;
+}
+
+/**
+ * @brief Whether an opcode has an accumulator (or Q) form
+ */
+static bool has_accumulator_form(Opcode op) {
+    switch (op) {
+        case OP_ASL: case OP_LSR: case OP_ROL: case OP_ROR:
+        case OP_INC: case OP_DEC: case OP_ASR:
+        case OP_ASLQ: case OP_LSRQ: case OP_ROLQ: case OP_RORQ:
+        case OP_ASRQ: case OP_INQ: case OP_DEQ:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Whether an opcode operates on the 32-bit Q register
+ */
+static bool is_quad_opcode(Opcode op) {
+    return op >= OP_ADCQ && op <= OP_STQ;
+}
+
+/**
+ * @brief Parse a literal number ($hex, %binary, 0xhex or decimal)
+ *
+ * @param p Text to parse
+ * @param value Receives the parsed value
+ * @param digits Receives the number of digits written
+ * @return Pointer past the literal, or p if no literal was found
+ */
+static const char* parse_literal(const char *p, long *value, int *digits) {
+    const char *start = p;
+    int base = 10;
+
+    if (*p == '$') {
+        base = 16;
+        p++;
+    } else if (*p == '%') {
+        base = 2;
+        p++;
+    } else if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        base = 16;
+        p += 2;
+    }
+
+    long v = 0;
+    int n = 0;
+    for (;; p++, n++) {
+        int d;
+        if (isdigit((unsigned char)*p)) d = *p - '0';
+        else if (base == 16 && isxdigit((unsigned char)*p)) d = toupper((unsigned char)*p) - 'A' + 10;
+        else break;
+        if (d >= base) break;
+        v = v * base + d;
+    }
+
+    if (n == 0) return start;
+    *value = v;
+    *digits = n;
+    return p;
+}
+
+/**
+ * @brief Check whether a text is entirely one literal number
+ *
+ * @param text Text to parse
+ * @param len Length of the text
+ * @param value Receives the value
+ * @return false if the text is anything else
+ */
+static bool whole_literal(const char *text, size_t len, long *value) {
+    int digits;
+    const char *end = parse_literal(text, value, &digits);
+    return end != text && (size_t)(end - text) == len;
+}
+
+/**
+ * @brief Split a plain or indexed address operand
+ */
+bool split_operand(const char *text, SplitOperand *out) {
+    const char *comma = strchr(text, ',');
+    size_t len = comma ? (size_t)(comma - text) : strlen(text);
+    while (len > 0 && isspace((unsigned char)text[len - 1])) len--;
+    if (len == 0) return false;
+
+    out->text = text;
+    out->suffix = comma ? comma : "";
+    out->offset = 0;
+    if (whole_literal(text, len, &out->offset)) {
+        out->root_len = 0;
+        return true;
+    }
+
+    const char *sign = NULL;
+    for (size_t i = 1; i < len; i++) {
+        if (text[i] == '+' || text[i] == '-') sign = text + i;
+    }
+    if (sign && whole_literal(sign + 1, len - (sign + 1 - text), &out->offset)) {
+        if (*sign == '-') out->offset = -out->offset;
+        len = sign - text;
+    }
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (!isalnum(c) && c != '_' && c != '.' && c != '@' && c != ':' && c != '!') return false;
+    }
+    if (isdigit((unsigned char)text[0])) return false;
+    out->root_len = len;
+    return true;
+}
+
+/**
+ * @brief Check whether two split operands name the same symbol
+ */
+bool same_operand_root(const SplitOperand *a, const SplitOperand *b) {
+    return a->root_len == b->root_len && strncmp(a->text, b->text, a->root_len) == 0;
+}
+
+/**
+ * @brief Check whether an operand addresses a fixed distance from another
+ */
+bool operand_at_offset(const char *base, const char *other, long delta) {
+    SplitOperand a, b;
+    if (!split_operand(base, &a) || !split_operand(other, &b)) return false;
+    return same_operand_root(&a, &b) && b.offset == a.offset + delta &&
+           strcasecmp(a.suffix, b.suffix) == 0;
+}
+
+/**
+ * @brief Classify a base address expression as zero page, absolute or long
+ *
+ * @param p Start of the address expression
+ * @param len Length of the address expression
+ * @return 0 for zero page, 1 for absolute, 2 for long (24-bit)
+ */
+static int address_size(const char *p, size_t len) {
+    while (len > 0 && isspace((unsigned char)*p)) { p++; len--; }
+    while (len > 0 && isspace((unsigned char)p[len - 1])) len--;
+
+    /* Explicit size prefixes: ca65 z:/a:/f:, generic < forces zero page */
+    if (len > 2 && p[1] == ':') {
+        if (p[0] == 'z' || p[0] == 'Z') return 0;
+        if (p[0] == 'a' || p[0] == 'A') return 1;
+        if (p[0] == 'f' || p[0] == 'F') return 2;
+    }
+    if (len > 0 && p[0] == '<') return 0;
+
+    long value;
+    int digits;
+    const char *end = parse_literal(p, &value, &digits);
+    if (end == p || (size_t)(end - p) != len) return 1;  /* Symbol or expression */
+
+    if (value > 0xFFFF) return 2;
+    if (value <= 0xFF && !(p[0] == '$' && digits > 2)) return 0;
+    return 1;
+}
+
+/**
+ * @brief Check for an index suffix such as ",X" at the end of an operand
+ *
+ * @param operand Operand text
+ * @param len Operand length (trailing whitespace already removed)
+ * @param reg Upper-case register letter to look for
+ * @return Length of the operand before the suffix, or 0 if absent
+ */
+static size_t index_suffix(const char *operand, size_t len, char reg) {
+    if (len < 3) return 0;
+    if (toupper((unsigned char)operand[len - 1]) != reg) return 0;
+
+    size_t i = len - 1;
+    while (i > 0 && isspace((unsigned char)operand[i - 1])) i--;
+    if (i == 0 || operand[i - 1] != ',') return 0;
+    return i - 1;
+}
+
+/**
+ * @brief Classify an operand into an addressing mode
+ */
+AddrMode classify_operand(Opcode op, const char *operand) {
+    if (op == OP_NONE) return AM_NONE;
+
+    size_t len = operand ? strlen(operand) : 0;
+    while (len > 0 && isspace((unsigned char)operand[len - 1])) len--;
+
+    if (len == 0) {
+        return has_accumulator_form(op) ? AM_ACCUMULATOR : AM_IMPLIED;
+    }
+    if (len == 1 && (operand[0] == 'A' || operand[0] == 'a') && has_accumulator_form(op)) {
+        return AM_ACCUMULATOR;
+    }
+    if (len == 1 && (operand[0] == 'Q' || operand[0] == 'q') && is_quad_opcode(op)) {
+        return AM_ACCUMULATOR;
+    }
+    if (operand[0] == '#') return AM_IMMEDIATE;
+
+    const OpcodeInfo *info = opcode_info(op);
+    if (op == OP_BBR || op == OP_BBS) return AM_ZP_RELATIVE;
+    if (op == OP_MVN || op == OP_MVP) return AM_BLOCK_MOVE;
+    if (info->flow == FLOW_BRANCH || op == OP_BRA || op == OP_BRL || op == OP_BSR) {
+        return AM_RELATIVE;
+    }
+
+    size_t base;
+    if (operand[0] == '(') {
+        if ((base = index_suffix(operand, len, 'Y')) > 0) {
+            /* ($12),Y or ($12,S),Y / ($12,SP),Y */
+            const char *close = memchr(operand, ')', base);
+            const char *comma = memchr(operand, ',', close ? (size_t)(close - operand) : base);
+            return comma ? AM_STACK_INDIRECT_Y : AM_INDIRECT_INDEXED;
+        }
+        if (index_suffix(operand, len, 'Z') > 0) return AM_INDIRECT_Z;
+        if (operand[len - 1] == ')') {
+            if (index_suffix(operand, len - 1, 'X') > 0) {
+                return (op == OP_JMP || op == OP_JSR) ? AM_ABS_INDEXED_INDIRECT : AM_INDEXED_INDIRECT;
+            }
+            return (op == OP_JMP || op == OP_JSR || op == OP_JML) ? AM_INDIRECT : AM_ZP_INDIRECT;
+        }
+        /* Parenthesized expression used as a plain address */
+    } else if (operand[0] == '[') {
+        if (index_suffix(operand, len, 'Y') > 0) return AM_INDIRECT_LONG_Y;
+        if (index_suffix(operand, len, 'Z') > 0) return AM_FLAT_INDIRECT_Z;
+        return AM_INDIRECT_LONG;
+    }
+
+    if ((base = index_suffix(operand, len, 'S')) > 0) return AM_STACK_RELATIVE;
+    if ((base = index_suffix(operand, len, 'X')) > 0) {
+        int size = address_size(operand, base);
+        return size == 0 ? AM_ZEROPAGE_X : size == 2 ? AM_LONG_X : AM_ABSOLUTE_X;
+    }
+    if ((base = index_suffix(operand, len, 'Y')) > 0) {
+        return address_size(operand, base) == 0 ? AM_ZEROPAGE_Y : AM_ABSOLUTE_Y;
+    }
+
+    if (info->flow == FLOW_JUMP || info->flow == FLOW_CALL) {
+        return (op == OP_JML || op == OP_JSL) ? AM_LONG : AM_ABSOLUTE;
+    }
+
+    int size = address_size(operand, len);
+    return size == 0 ? AM_ZEROPAGE : size == 2 ? AM_LONG : AM_ABSOLUTE;
+}
+
+/**
+ * @brief Registers and flags read by an instruction
+ */
+unsigned int opcode_reads(Opcode op, AddrMode mode) {
+    unsigned int reads = opcode_info(op)->reads;
+
+    if (mode == AM_ACCUMULATOR || mode == AM_IMPLIED) {
+        if ((reads & RF_MEM) && has_accumulator_form(op)) {
+            reads |= is_quad_opcode(op) ? RF_REGS : RF_A;
+        }
+        reads &= ~RF_MEM;
+    } else if (mode == AM_IMMEDIATE) {
+        reads &= ~RF_MEM;
+    }
+
+    switch (mode) {
+        case AM_ZEROPAGE_X: case AM_ABSOLUTE_X: case AM_INDEXED_INDIRECT:
+        case AM_ABS_INDEXED_INDIRECT: case AM_LONG_X:
+            reads |= RF_X;
+            break;
+        case AM_ZEROPAGE_Y: case AM_ABSOLUTE_Y: case AM_INDIRECT_INDEXED:
+        case AM_INDIRECT_LONG_Y:
+            reads |= RF_Y;
+            break;
+        case AM_INDIRECT_Z: case AM_FLAT_INDIRECT_Z:
+            reads |= RF_Z;
+            break;
+        case AM_STACK_RELATIVE:
+            reads |= RF_SP;
+            break;
+        case AM_STACK_INDIRECT_Y:
+            reads |= RF_SP | RF_Y;
+            break;
+        default:
+            break;
+    }
+    return reads;
+}
+
+/**
+ * @brief Registers and flags written by an instruction
+ */
+unsigned int opcode_writes(Opcode op, AddrMode mode) {
+    unsigned int writes = opcode_info(op)->writes;
+
+    if ((mode == AM_ACCUMULATOR || mode == AM_IMPLIED) && has_accumulator_form(op)) {
+        writes &= ~RF_MEM;
+        writes |= is_quad_opcode(op) ? RF_REGS : RF_A;
+    }
+    // BIT #imm (65C02 and later) sets only Z; N and V are untouched
+    if (op == OP_BIT && mode == AM_IMMEDIATE) writes = RF_ZF;
+    return writes;
+}
@@ -0,0 +1,266 @@
+/**
+ * @file opcodes.h
+ * @brief Interned opcode table and addressing mode classification
+ *
+ * The parser resolves every mnemonic once into a compact Opcode value and
+ * classifies its operand into an AddrMode. Optimization passes and register
+ * tracking then switch on these integers instead of comparing strings, and
+ * mnemonic matching is case-insensitive everywhere.
+ */
+
+#ifndef OPCODES_H
+#define OPCODES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Instruction mnemonic
+ *
+ * OP_NONE marks lines whose opcode field is not a known instruction
+ * (assembler directives, data, macros, equates).
+ */
+typedef enum {
+    OP_NONE = 0,
+
+    /* NMOS 6502 */
+    OP_ADC, OP_AND, OP_ASL, OP_BCC, OP_BCS, OP_BEQ, OP_BIT, OP_BMI,
+    OP_BNE, OP_BPL, OP_BRK, OP_BVC, OP_BVS, OP_CLC, OP_CLD, OP_CLI,
+    OP_CLV, OP_CMP, OP_CPX, OP_CPY, OP_DEC, OP_DEX, OP_DEY, OP_EOR,
+    OP_INC, OP_INX, OP_INY, OP_JMP, OP_JSR, OP_LDA, OP_LDX, OP_LDY,
+    OP_LSR, OP_NOP, OP_ORA, OP_PHA, OP_PHP, OP_PLA, OP_PLP, OP_ROL,
+    OP_ROR, OP_RTI, OP_RTS, OP_SBC, OP_SEC, OP_SED, OP_SEI, OP_STA,
+    OP_STX, OP_STY, OP_TAX, OP_TAY, OP_TSX, OP_TXA, OP_TXS, OP_TYA,
+
+    /* 65C02 */
+    OP_BRA, OP_PHX, OP_PHY, OP_PLX, OP_PLY, OP_STZ, OP_TRB, OP_TSB,
+    OP_BBR, OP_BBS, OP_RMB, OP_SMB, OP_STP, OP_WAI,
+
+    /* 65816 */
+    OP_BRL, OP_COP, OP_JML, OP_JSL, OP_MVN, OP_MVP, OP_PEA, OP_PEI,
+    OP_PER, OP_PHB, OP_PHD, OP_PHK, OP_PLB, OP_PLD, OP_REP, OP_RTL,
+    OP_SEP, OP_TCD, OP_TCS, OP_TDC, OP_TSC, OP_TXY, OP_TYX, OP_WDM,
+    OP_XBA, OP_XCE,
+
+    /* 45GS02 (MEGA65) */
+    OP_ASR, OP_ASW, OP_BSR, OP_CLE, OP_CPZ, OP_DEW, OP_DEZ, OP_EOM,
+    OP_INW, OP_INZ, OP_LDZ, OP_MAP, OP_NEG, OP_PHW, OP_PHZ, OP_PLZ,
+    OP_ROW, OP_RTN, OP_SEE, OP_TAB, OP_TAZ, OP_TBA, OP_TSY, OP_TYS,
+    OP_TZA,
+
+    /* 45GS02 32-bit Q register pseudo-ops (NEG NEG prefix) */
+    OP_ADCQ, OP_ANDQ, OP_ASLQ, OP_ASRQ, OP_BITQ, OP_CMPQ, OP_DEQ,
+    OP_EORQ, OP_INQ, OP_LDQ, OP_LSRQ, OP_ORQ, OP_ROLQ, OP_RORQ,
+    OP_SBCQ, OP_STQ,
+
+    OP_COUNT
+} Opcode;
+
+/**
+ * @brief Operand addressing mode
+ *
+ * Zero page and absolute forms are distinguished only when the operand is
+ * a literal address; symbolic operands are classified as absolute because
+ * their size is unknown until assembly.
+ */
+typedef enum {
+    AM_NONE = 0,             /**< No instruction on this line */
+    AM_IMPLIED,              /**< CLC, RTS, TAX */
+    AM_ACCUMULATOR,          /**< ASL, ASL A, INC A */
+    AM_IMMEDIATE,            /**< #value */
+    AM_ZEROPAGE,             /**< $12 */
+    AM_ZEROPAGE_X,           /**< $12,X */
+    AM_ZEROPAGE_Y,           /**< $12,Y */
+    AM_ABSOLUTE,             /**< $1234 or symbol */
+    AM_ABSOLUTE_X,           /**< $1234,X */
+    AM_ABSOLUTE_Y,           /**< $1234,Y */
+    AM_INDIRECT,             /**< JMP ($1234) */
+    AM_INDEXED_INDIRECT,     /**< ($12,X) */
+    AM_INDIRECT_INDEXED,     /**< ($12),Y */
+    AM_ZP_INDIRECT,          /**< ($12) (65C02) */
+    AM_INDIRECT_Z,           /**< ($12),Z (45GS02) */
+    AM_ABS_INDEXED_INDIRECT, /**< JMP ($1234,X) (65C02) */
+    AM_RELATIVE,             /**< Branch target */
+    AM_ZP_RELATIVE,          /**< BBRn $12,target (65C02) */
+    AM_LONG,                 /**< $123456 (65816) */
+    AM_LONG_X,               /**< $123456,X (65816) */
+    AM_STACK_RELATIVE,       /**< $12,S (65816) */
+    AM_STACK_INDIRECT_Y,     /**< ($12,S),Y / ($12,SP),Y */
+    AM_INDIRECT_LONG,        /**< [$12] (65816) */
+    AM_INDIRECT_LONG_Y,      /**< [$12],Y (65816) */
+    AM_FLAT_INDIRECT_Z,      /**< [$12],Z (45GS02 32-bit pointer) */
+    AM_BLOCK_MOVE,           /**< MVN src,dst (65816) */
+    AM_COUNT
+} AddrMode;
+
+/* CPU availability mask for OpcodeInfo.cpus */
+#define CPUM_6502   0x01  /**< Available on NMOS 6502 */
+#define CPUM_65C02  0x02  /**< Available on 65C02 */
+#define CPUM_65816  0x04  /**< Available on 65816 */
+#define CPUM_45GS02 0x08  /**< Available on 45GS02 */
+#define CPUM_ALL    (CPUM_6502 | CPUM_65C02 | CPUM_65816 | CPUM_45GS02)
+#define CPUM_CMOS   (CPUM_65C02 | CPUM_65816 | CPUM_45GS02)
+
+/* Register and flag masks for OpcodeInfo.reads / OpcodeInfo.writes */
+#define RF_A    0x0001  /**< Accumulator */
+#define RF_X    0x0002  /**< X index register */
+#define RF_Y    0x0004  /**< Y index register */
+#define RF_Z    0x0008  /**< Z register (45GS02) */
+#define RF_B    0x0010  /**< B base page register (45GS02) */
+#define RF_SP   0x0020  /**< Stack pointer */
+#define RF_C    0x0100  /**< Carry flag */
+#define RF_N    0x0200  /**< Negative flag */
+#define RF_ZF   0x0400  /**< Zero flag */
+#define RF_V    0x0800  /**< Overflow flag */
+#define RF_D    0x1000  /**< Decimal flag */
+#define RF_I    0x2000  /**< Interrupt disable flag */
+#define RF_MEM  0x4000  /**< Memory operand */
+
+#define RF_REGS  (RF_A | RF_X | RF_Y | RF_Z)
+#define RF_NZ    (RF_N | RF_ZF)
+#define RF_NZC   (RF_N | RF_ZF | RF_C)
+#define RF_NZCV  (RF_N | RF_ZF | RF_C | RF_V)
+#define RF_FLAGS (RF_NZCV | RF_D | RF_I)
+#define RF_ALL   (RF_REGS | RF_B | RF_SP | RF_FLAGS | RF_MEM)
+
+/* Control flow classification for OpcodeInfo.flow */
+#define FLOW_NONE    0     /**< Falls through to the next instruction */
+#define FLOW_BRANCH  1     /**< Conditional branch */
+#define FLOW_JUMP    2     /**< Unconditional jump (JMP, BRA, BRL, JML) */
+#define FLOW_CALL    3     /**< Subroutine call (JSR, JSL, BSR) */
+#define FLOW_RETURN  4     /**< Return (RTS, RTI, RTL, RTN) */
+#define FLOW_STOP    5     /**< Halts or traps (BRK, STP, COP) */
+
+/**
+ * @brief Static description of one mnemonic
+ *
+ * reads/writes describe the registers and flags the instruction touches
+ * regardless of addressing mode. Index registers used for addressing and
+ * accumulator-vs-memory forms of shifts are resolved by
+ * opcode_reads()/opcode_writes().
+ */
+typedef struct {
+    const char *name;        /**< Canonical upper-case mnemonic */
+    unsigned char cpus;      /**< CPUM_* availability mask */
+    unsigned char flow;      /**< FLOW_* control flow class */
+    unsigned short reads;    /**< RF_* registers/flags read */
+    unsigned short writes;   /**< RF_* registers/flags written */
+} OpcodeInfo;
+
+/**
+ * @brief Build the mnemonic lookup table
+ *
+ * Must be called once before any parsing and before worker threads are
+ * started. Subsequent calls are no-ops.
+ */
+void opcodes_init(void);
+
+/**
+ * @brief Resolve a mnemonic to its Opcode
+ *
+ * Matching is case-insensitive. Common aliases such as INA/DEA are mapped
+ * to their canonical opcode.
+ *
+ * @param name Mnemonic text (need not be NUL-terminated)
+ * @param len Length of the mnemonic
+ * @return Matching opcode, or OP_NONE if the text is not an instruction
+ */
+Opcode lookup_opcode(const char *name, size_t len);
+
+/**
+ * @brief Get the static description of an opcode
+ * @param op Opcode to describe
+ * @return Pointer into the opcode table (never NULL)
+ */
+const OpcodeInfo* opcode_info(Opcode op);
+
+/**
+ * @brief Get the canonical mnemonic of an opcode
+ * @param op Opcode to name
+ * @return Upper-case mnemonic, or "" for OP_NONE
+ */
+const char* opcode_name(Opcode op);
+
+/**
+ * @brief Classify an operand into an addressing mode
+ *
+ * @param op Opcode the operand belongs to
+ * @param operand Operand text (may be NULL or empty)
+ * @return Addressing mode, or AM_NONE if op is OP_NONE
+ */
+AddrMode classify_operand(Opcode op, const char *operand);
+
+/**
+ * @brief An operand split into symbol, byte offset and index suffix
+ *
+ * Covers name, name+k, name-k, a literal address and any of them
+ * followed by an index suffix; see split_operand().
+ */
+typedef struct {
+    const char *text;           /**< Operand text */
+    size_t root_len;            /**< Length of the symbol (0 for a literal address) */
+    long offset;                /**< Byte offset added to the symbol */
+    const char *suffix;         /**< Index suffix (",X", ",Y") or "" */
+} SplitOperand;
+
+/**
+ * @brief Split a plain or indexed address operand
+ *
+ * @param text Operand text
+ * @param out Receives the parts
+ * @return false if the operand has any other form
+ */
+bool split_operand(const char *text, SplitOperand *out);
+
+/**
+ * @brief Check whether two split operands name the same symbol
+ *
+ * @param a First operand
+ * @param b Second operand
+ * @return true if the symbols (or both literal addresses) match
+ */
+bool same_operand_root(const SplitOperand *a, const SplitOperand *b);
+
+/**
+ * @brief Check whether an operand addresses a fixed distance from another
+ *
+ * @param base Base operand
+ * @param other Operand to check
+ * @param delta Byte distance from base
+ * @return true if other is base + delta with the same index suffix
+ */
+bool operand_at_offset(const char *base, const char *other, long delta);
+
+/**
+ * @brief Registers and flags read by an instruction
+ *
+ * Combines the opcode's intrinsic reads with index registers consumed by
+ * the addressing mode.
+ *
+ * @param op Opcode
+ * @param mode Addressing mode
+ * @return RF_* mask
+ */
+unsigned int opcode_reads(Opcode op, AddrMode mode);
+
+/**
+ * @brief Registers and flags written by an instruction
+ *
+ * Resolves accumulator vs memory forms of read-modify-write
+ * instructions (ASL, INC, ...) and BIT #imm, which sets only Z.
+ *
+ * @param op Opcode
+ * @param mode Addressing mode
+ * @return RF_* mask
+ */
+unsigned int opcode_writes(Opcode op, AddrMode mode);
+
+/**
+ * @brief Check whether an opcode exists on a CPU
+ * @param op Opcode to check
+ * @param cpus CPUM_* mask of the target CPU
+ * @return true if the instruction is available
+ */
+bool opcode_available(Opcode op, unsigned int cpus);
+
+#endif // OPCODES_H
@@ -9,7 +9,29 @@
 #include "parser.h"
 #include <string.h>
 #include <ctype.h>
-#include <stdlib.h>
+
+/**
+ * @brief Terminate a field in place, or copy it if that is not possible
+ *
+ * A field can be cut in place when the byte after it is a separator the
+ * parser has already stepped over (whitespace, a label colon or the end
+ * of the line). A field immediately followed by a comment is copied so
+ * the comment keeps its first character.
+ *
+ * @param arena Arena for the fallback copy
+ * @param start First byte of the field
+ * @param len Length of the field
+ * @return NUL-terminated field text
+ */
+static char* cut_field(Arena *arena, char *start, size_t len) {
+    char next = start[len];
+    if (next == '\0') return start;
+    if (next == ':' || isspace((unsigned char)next)) {
+        start[len] = '\0';
+        return start;
+    }
+    return arena_strndup(arena, start, len);
+}
 
 /**
  * @brief Parse an assembly line into an AST node
@@ -20,122 +42,102 @@
  * 3. Operands: Follow opcodes
  * 4. Comments: Start with assembler-specific character(s)
  *
+ * The opcode is resolved once into an interned Opcode and the operand
+ * classified into an AddrMode, so later passes never compare mnemonic
+ * strings.
+ *
  * The function handles:
  * - Local vs global label detection
  * - Colon-terminated labels (ca65, ACME, etc.)
  * - No-colon labels (Merlin)
  * - Comment character detection (';' or '//')
  *
+ * Fields have no length limit. They are located first and then split
+ * out of the line in place, so the node strings point into line and
+ * only a field that runs straight into a comment is copied.
+ *
+ * @param arena Arena for fields that cannot be split in place
  * @param node Node to populate with parsed components
- * @param line Source line to parse
+ * @param line Writable source line (must outlive the node)
  * @param line_num Line number (unused, kept for future diagnostics)
  * @param config Assembler syntax configuration
  */
-void parse_line_ast(AstNode *node, const char *line, int line_num, AsmConfig *config) {
+void parse_line_ast(Arena *arena, AstNode *node, char *line, int line_num, AsmConfig *config) {
     (void)line_num;  // Suppress unused parameter warning
-    const char *p = line;
-    while (*p && isspace(*p)) p++;
+    char *p = line;
+    while (*p && isspace((unsigned char)*p)) p++;
+
+    char *label = NULL;
+    size_t label_len = 0;
+    char *opcode = NULL;
+    size_t opcode_len = 0;
+    char *operand = NULL;
+    size_t operand_len = 0;
 
     // Check for label (starts at column 0 or ends with :)
     bool potential_label = false;
-    if (line[0] != ' ' && line[0] != '\t' && line[0] != ' ' && !is_comment_start(line, config)) {
+    if (line[0] != ' ' && line[0] != '\t' && !is_comment_start(line, config)) {
         potential_label = true;
     }
 
     if (potential_label) {
-        int i = 0;
-
         // Parse label - stops at whitespace or colon
-        while (*p && !isspace(*p) && *p != ':' && !is_comment_start(p, config) && i < 63) {
-            i++;
+        while (*p && !isspace((unsigned char)*p) && *p != ':' && !is_comment_start(p, config)) {
             p++;
         }
-
-        // Allocate and copy label
-        node->label = malloc(i + 1);
-        if (node->label) {
-            strncpy(node->label, line, i);
-            node->label[i] = '\0';
-        }
-
-        // Check if this is a local label
-        if (is_local_label(node->label, config)) {
-            node->is_local_label = true;
-        }
+        label = line;
+        label_len = (size_t)(p - line);
 
         // Check if this is actually a label
         if (config->supports_colon_labels && *p == ':') {
             // Definitely a label
             node->type = NODE_LABEL;
             p++; // Skip colon
-        } else if (i > 0 && node->label[0]) {
+        } else if (label_len > 0) {
             // Might be a label (for Merlin style without colons)
             // We'll assume it is if followed by whitespace or end of line
             node->type = NODE_LABEL;
         }
 
-        while (*p && isspace(*p)) p++;
+        while (*p && isspace((unsigned char)*p)) p++;
     } else {
         node->type = NODE_ASM_LINE;
     }
 
     // Skip comments
-    if (is_comment_start(p, config) || *p == ' ') return;
-
-    // Parse opcode
-    int i = 0;
-    while (*p && !isspace(*p) && !is_comment_start(p, config) && i < 15) {
-        i++;
-        p++;
-    }
-
-    // Allocate and copy opcode
-    node->opcode = malloc(i + 1);
-    if (node->opcode) {
-        strncpy(node->opcode, line + (p - line - i), i);
-        node->opcode[i] = '\0';
-    }
-
-    while (*p && isspace(*p)) p++;
-
-    // Parse operand
-    i = 0;
-    while (*p && !is_comment_start(p, config) && i < 63) {
-        i++;
-        p++;
-    }
-
-    // Allocate and copy operand
-    node->operand = malloc(i + 1);
-    if (node->operand) {
-        strncpy(node->operand, line + (p - line - i), i);
-        node->operand[i] = '\0';
-    }
-
-    // Trim trailing whitespace
-    while (i > 0 && isspace(node->operand[i-1])) {
-        node->operand[--i] = '\0';
-    }
-
-    // Parse comment if present
-    if (is_comment_start(p, config)) {
-        // Skip past comment start character(s)
-        const char *comment_start = p;
-        if (strcmp(config->comment_char, "//") == 0) {
-            p += 2;
-        } else {
-            p += 1;
+    if (!is_comment_start(p, config) && *p != ' ') {
+        // Parse opcode
+        opcode = p;
+        while (*p && !isspace((unsigned char)*p) && !is_comment_start(p, config)) p++;
+        opcode_len = (size_t)(p - opcode);
+        node->op = lookup_opcode(opcode, opcode_len);
+
+        while (*p && isspace((unsigned char)*p)) p++;
+
+        // Parse operand, trimming trailing whitespace
+        operand = p;
+        while (*p && !is_comment_start(p, config)) p++;
+        operand_len = (size_t)(p - operand);
+        while (operand_len > 0 && isspace((unsigned char)operand[operand_len - 1])) operand_len--;
+
+        // The rest of the line is the comment (including comment character)
+        if (is_comment_start(p, config)) {
+            node->comment = p;
         }
+    }
 
-        // Copy the rest of the line as comment (including comment character)
-        size_t comment_len = strlen(comment_start);
-        if (comment_len > 0) {
-            node->comment = malloc(comment_len + 1);
-            if (node->comment) {
-                strcpy(node->comment, comment_start);
-            }
+    // Split the fields only now, so scanning never runs into an early NUL
+    if (label) {
+        node->label = cut_field(arena, label, label_len);
+        if (is_local_label(node->label, config)) {
+            node->is_local_label = true;
         }
     }
+    if (opcode) {
+        node->opcode = cut_field(arena, opcode, opcode_len);
+        node->operand = cut_field(arena, operand, operand_len);
+        node->mode = classify_operand(node->op, node->operand);
+    }
 }
 
 /**
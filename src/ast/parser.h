@@ -20,12 +20,16 @@
  * assembler-specific syntax like colon-terminated labels and
  * different comment styles.
  *
+ * The line is split in place: node strings point into it, so it must
+ * stay alive and unmodified for as long as the node.
+ *
+ * @param arena Arena for fields that cannot be split in place
  * @param node Node to populate with parsed data
- * @param line Assembly source line to parse
+ * @param line Writable, NUL-terminated assembly source line
  * @param line_num Line number (currently unused, for future diagnostics)
  * @param config Assembler syntax configuration
  */
-void parse_line_ast(AstNode *node, const char *line, int line_num, AsmConfig *config);
+void parse_line_ast(Arena *arena, AstNode *node, char *line, int line_num, AsmConfig *config);
 
 /**
  * @brief Build complete AST from program lines
@@ -0,0 +1,167 @@
+/**
+ * @file opt6502.c
+ * @brief Embeddable optimizer API implementation
+ *
+ * A handle keeps only the settings and the result of the last run. Each
+ * run builds a fresh program with its log silenced, so the library never
+ * prints, and renders the output with write_program_to_memory().
+ */
+
+#include "opt6502.h"
+#include "../types.h"
+#include "../program/program.h"
+#include "../optimizations/optimizer.h"
+#include "../optimizations/rules.h"
+#include "../output/output.h"
+#include "../analysis/cost.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/**
+ * @brief Optimizer handle
+ */
+struct Opt6502 {
+    OptMode mode;               /**< Optimization mode */
+    AsmType asm_type;           /**< Assembler syntax */
+    CpuType cpu_type;           /**< Target CPU */
+    int trace_level;            /**< Trace comment level */
+    int jobs;                   /**< Worker threads per run */
+    char *output;               /**< Output of the last run, or NULL */
+    size_t output_len;          /**< Length of output */
+    Opt6502Stats stats;         /**< Statistics of the last run */
+};
+
+/**
+ * @brief Fill in the default settings
+ * @param options Settings to initialize
+ */
+void opt6502_default_options(Opt6502Options *options) {
+    options->mode = OPT6502_SPEED;
+    options->cpu = "6502";
+    options->assembler = "generic";
+    options->trace_level = 0;
+    options->jobs = 1;
+}
+
+/**
+ * @brief Create an optimizer handle
+ *
+ * @param options Settings (NULL for the defaults)
+ * @return New handle, or NULL if a setting is unknown or memory is short
+ */
+Opt6502* opt6502_create(const Opt6502Options *options) {
+    Opt6502Options defaults;
+    if (!options) {
+        opt6502_default_options(&defaults);
+        options = &defaults;
+    }
+
+    CpuType cpu = CPU_6502;
+    const char *cpu_name = options->cpu ? options->cpu : "6502";
+    const char *asm_name = options->assembler ? options->assembler : "generic";
+    AsmType asm_type = parse_asm_type(asm_name);
+    if (!parse_cpu_type(cpu_name, &cpu)) return NULL;
+    if (asm_type == ASM_GENERIC && strcasecmp(asm_name, "generic") != 0) return NULL;
+
+    Opt6502 *opt = calloc(1, sizeof(Opt6502));
+    if (!opt) return NULL;
+    opt->mode = options->mode == OPT6502_SIZE ? OPT_SIZE : OPT_SPEED;
+    opt->asm_type = asm_type;
+    opt->cpu_type = cpu;
+    opt->trace_level = options->trace_level > 0 ? options->trace_level : 0;
+    opt->jobs = options->jobs > 1 ? options->jobs : 1;
+
+    opcodes_init();
+    rules_init();
+    return opt;
+}
+
+/**
+ * @brief Optimize a source buffer
+ *
+ * @param opt Optimizer handle
+ * @param source Assembly source text
+ * @param len Length of the text in bytes
+ * @return false on allocation failure (there is no output)
+ */
+bool opt6502_run(Opt6502 *opt, const char *source, size_t len) {
+    free(opt->output);
+    opt->output = NULL;
+    opt->output_len = 0;
+    memset(&opt->stats, 0, sizeof(opt->stats));
+
+    SourceBuffer *buffer = source_copy(source, len);
+    if (!buffer) return false;
+
+    Program *prog = create_program(opt->mode, opt->asm_type);
+    set_program_cpu(prog, opt->cpu_type);
+    prog->trace_level = opt->trace_level;
+    prog->jobs = opt->jobs;
+    prog->log = NULL;
+    load_program_source(prog, buffer);
+
+    CostSummary *before = measure_program_cost(prog);
+    optimize_program_ast(prog);
+    CostSummary *after = measure_program_cost(prog);
+
+    opt->output = write_program_to_memory(prog, &opt->output_len);
+
+    Opt6502Stats *stats = &opt->stats;
+    stats->lines = prog->count;
+    stats->optimizations = prog->optimizations;
+    for (int i = 0; i < prog->count; i++) {
+        if (node_is_dead(prog, i)) stats->removed++;
+    }
+    if (before && after) {
+        stats->cycles_before = before->total.cycles;
+        stats->cycles_after = after->total.cycles;
+        stats->bytes_before = before->total.bytes;
+        stats->bytes_after = after->total.bytes;
+    }
+
+    free_cost_summary(before);
+    free_cost_summary(after);
+    free_program_ast(prog);
+    return opt->output != NULL;
+}
+
+/**
+ * @brief Optimized source of the last run
+ *
+ * @param opt Optimizer handle
+ * @param len Where to store the length (may be NULL)
+ * @return NUL-terminated text owned by the handle, or NULL before a
+ *         successful run
+ */
+const char* opt6502_output(const Opt6502 *opt, size_t *len) {
+    if (len) *len = opt->output_len;
+    return opt->output;
+}
+
+/**
+ * @brief Statistics of the last run
+ * @param opt Optimizer handle
+ * @return Statistics owned by the handle
+ */
+const Opt6502Stats* opt6502_stats(const Opt6502 *opt) {
+    return &opt->stats;
+}
+
+/**
+ * @brief Free an optimizer handle and its output
+ * @param opt Handle to free (NULL-safe)
+ */
+void opt6502_destroy(Opt6502 *opt) {
+    if (!opt) return;
+    free(opt->output);
+    free(opt);
+}
+
+/**
+ * @brief Version of the optimizer
+ * @return Version string
+ */
+const char* opt6502_version(void) {
+    return OPT6502_VERSION;
+}
@@ -0,0 +1,134 @@
+/**
+ * @file opt6502.h
+ * @brief Embeddable optimizer API (libopt6502)
+ *
+ * Optimizes assembly source held in memory and returns the optimized
+ * source and statistics in memory. Nothing is printed and no files are
+ * touched, so assemblers and editors can call the optimizer in-process
+ * on every save instead of running the command line tool.
+ *
+ * This header is self-contained; callers need nothing else from src/.
+ * Handles are independent, so different threads may use different
+ * handles at the same time, once the first opt6502_create() call (which
+ * sets up shared read-only tables) has returned.
+ *
+ * Typical use:
+ * @code
+ *   Opt6502Options options;
+ *   opt6502_default_options(&options);
+ *   options.cpu = "65c02";
+ *
+ *   Opt6502 *opt = opt6502_create(&options);
+ *   if (opt && opt6502_run(opt, text, text_len)) {
+ *       size_t len;
+ *       const char *out = opt6502_output(opt, &len);
+ *       ...
+ *   }
+ *   opt6502_destroy(opt);
+ * @endcode
+ */
+
+#ifndef OPT6502_H
+#define OPT6502_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define OPT6502_API_VERSION 1   /**< Incremented on incompatible API changes */
+
+/**
+ * @brief What to optimize for
+ */
+typedef enum {
+    OPT6502_SPEED,              /**< Fewest cycles (default) */
+    OPT6502_SIZE                /**< Fewest bytes */
+} Opt6502Mode;
+
+/**
+ * @brief Settings of an optimizer handle
+ */
+typedef struct {
+    Opt6502Mode mode;           /**< Speed or size */
+    const char *cpu;            /**< "6502", "65c02", "65816" or "45gs02" */
+    const char *assembler;      /**< Assembler syntax as for -asm ("generic", "ca65", ...) */
+    int trace_level;            /**< Trace comments in the output (0 = none) */
+    int jobs;                   /**< Worker threads per run (see -j) */
+} Opt6502Options;
+
+/**
+ * @brief Statistics of the last run
+ */
+typedef struct {
+    int lines;                  /**< Input lines */
+    int optimizations;          /**< Optimizations applied */
+    int removed;                /**< Lines removed */
+    int cycles_before;          /**< Estimated cycles of the input */
+    int cycles_after;           /**< Estimated cycles of the output */
+    int bytes_before;           /**< Estimated bytes of the input */
+    int bytes_after;            /**< Estimated bytes of the output */
+} Opt6502Stats;
+
+/** Optimizer handle (opaque) */
+typedef struct Opt6502 Opt6502;
+
+/**
+ * @brief Fill in the default settings
+ *
+ * Speed, 6502, generic syntax, no tracing, one thread.
+ *
+ * @param options Settings to initialize
+ */
+void opt6502_default_options(Opt6502Options *options);
+
+/**
+ * @brief Create an optimizer handle
+ *
+ * @param options Settings (NULL for the defaults); strings are copied
+ * @return New handle, or NULL if a setting is unknown or memory is short
+ */
+Opt6502* opt6502_create(const Opt6502Options *options);
+
+/**
+ * @brief Optimize a source buffer
+ *
+ * Replaces the output and statistics of any earlier run on the handle.
+ * The buffer need not be NUL-terminated and is not kept.
+ *
+ * @param opt Optimizer handle
+ * @param source Assembly source text
+ * @param len Length of the text in bytes
+ * @return false on allocation failure (there is no output)
+ */
+bool opt6502_run(Opt6502 *opt, const char *source, size_t len);
+
+/**
+ * @brief Optimized source of the last run
+ *
+ * @param opt Optimizer handle
+ * @param len Where to store the length (may be NULL)
+ * @return NUL-terminated text owned by the handle, valid until the next
+ *         run or opt6502_destroy(); NULL before a successful run
+ */
+const char* opt6502_output(const Opt6502 *opt, size_t *len);
+
+/**
+ * @brief Statistics of the last run
+ *
+ * @param opt Optimizer handle
+ * @return Statistics owned by the handle (all zero before a run)
+ */
+const Opt6502Stats* opt6502_stats(const Opt6502 *opt);
+
+/**
+ * @brief Free an optimizer handle and its output
+ * @param opt Handle to free (NULL-safe)
+ */
+void opt6502_destroy(Opt6502 *opt);
+
+/**
+ * @brief Version of the optimizer
+ * @return Version string, e.g. "1.0"
+ */
+const char* opt6502_version(void);
+
+#endif // OPT6502_H
@@ -14,18 +14,301 @@
  * - Optimizer control directives (#NOOPT, #OPT)
  *
  * Usage:
- *   opt6502 [-speed|-size] [-cpu <type>] [-asm <type>] [-trace <level>] input.asm [output.asm]
+ *   opt6502 [-speed|-size] [-cpu <type>] [-asm <type>] [-trace <level>]
+ *           [-validate] [-report <file>] [-report-format json|csv] [-stats[=json]]
+ *           [-stream] [-window <lines>] [-j <jobs>] [-cache <dir>]
+ *           [-rules <file>] [-unroll-budget <bytes>] [-zp-free <bytes>] [-dma]
+ *           [-superopt <memo>] [-profile <counts>]
+ *           input.asm [output.asm]
+ *   opt6502 [options] -batch input.asm... [@list]
+ *   opt6502 [options] -server [-socket <path>]
+ *
+ * Either file name may be '-' for standard input or standard output.
+ * In batch mode every file is an input and its output is written next to
+ * it (see batch.h).
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "types.h"
 #include "program/program.h"
 #include "optimizations/optimizer.h"
+#include "optimizations/rules.h"
+#include "optimizations/superopt.h"
 #include "output/output.h"
+#include "output/report.h"
+#include "program/stats.h"
+#include "program/parallel.h"
+#include "program/batch.h"
+#include "program/cache.h"
+#include "program/server.h"
+#include "program/stream.h"
+#include "program/profile.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include <ctype.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Take over standard output for the optimized code
+ *
+ * Progress messages are printed to stdout throughout the optimizer, so
+ * when the optimized code itself goes to standard output the original
+ * descriptor is kept for the code and stdout is pointed at stderr.
+ *
+ * @return Stream writing to the original standard output, or NULL on
+ *         failure
+ */
+static FILE* claim_stdout(void) {
+    fflush(stdout);
+#ifdef _WIN32
+    int fd = _dup(_fileno(stdout));
+    FILE *out = fd >= 0 ? _fdopen(fd, "w") : NULL;
+    if (out) _dup2(_fileno(stderr), _fileno(stdout));
+    else if (fd >= 0) _close(fd);
+#else
+    int fd = dup(STDOUT_FILENO);
+    FILE *out = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (out) dup2(STDERR_FILENO, STDOUT_FILENO);
+    else if (fd >= 0) close(fd);
+#endif
+    return out;
+}
+
+/**
+ * @brief Parse a list of free zero page bytes (-zp-free)
+ *
+ * Accepts comma-separated addresses and ranges in hex ($FB, 0xFB) or
+ * decimal, for example $FB-$FE,$02.
+ *
+ * @param text List to parse
+ * @param flags 256 flags; the listed bytes are set
+ * @return false if the list is malformed or leaves the zero page
+ */
+static bool parse_zp_free(const char *text, unsigned char *flags) {
+    const char *p = text;
+    while (*p) {
+        long range[2];
+        for (int k = 0; k < 2; k++) {
+            int base = 10;
+            if (*p == '$') {
+                base = 16;
+                p++;
+            } else if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+                base = 16;
+                p += 2;
+            }
+            char *end;
+            range[k] = strtol(p, &end, base);
+            if (end == p || range[k] < 0 || range[k] > 0xFF) return false;
+            p = end;
+            if (k == 0 && *p != '-') {
+                range[1] = range[0];
+                break;
+            }
+            if (k == 0) p++;
+        }
+        if (range[1] < range[0]) return false;
+        for (long b = range[0]; b <= range[1]; b++) flags[b] = 1;
+        if (*p == ',') {
+            p++;
+            if (!*p) return false;
+        } else if (*p) {
+            return false;
+        }
+    }
+    return p != text;
+}
+
+/**
+ * @brief Optimize the input in bounded-memory windows (-stream)
+ *
+ * @param prog Empty program holding the settings
+ * @param in Input stream
+ * @param out Output stream
+ * @param output_name Output name for messages
+ * @param window_lines Minimum lines per window
+ * @return 0 on success, 1 on error
+ */
+static int run_stream(Program *prog, FILE *in, FILE *out, const char *output_name,
+                      int window_lines) {
+    printf("Streaming in windows of at least %d lines...\n", window_lines);
+    OutBuf buf;
+    outbuf_init_file(&buf, out);
+    write_output_header(prog, &buf, false);
+
+    StreamResult result;
+    bool ok = optimize_stream(prog, in, &buf, window_lines, &result);
+    write_output_footer(prog, &buf);
+    if (!outbuf_close(&buf)) {
+        fprintf(stderr, "Error: Cannot write to %s\n", output_name);
+        ok = false;
+    }
+
+    printf("\n=== Optimization Summary ===\n");
+    printf("Read %ld lines in %d windows\n", result.lines, result.windows);
+    printf("Applied %d optimizations\n", prog->optimizations);
+    CostSummary before = { NULL, 0, result.before };
+    CostSummary after = { NULL, 0, result.after };
+    print_cost_savings(prog, &before, &after);
+    printf("Wrote optimized code to %s\n", output_name);
+    printf("Removed %ld dead code lines\n", result.removed);
+
+    if (prog->stats) prog->stats->lines = result.lines;
+    return ok ? 0 : 1;
+}
+
+/**
+ * @brief Write finished output text to the output file
+ *
+ * @param text Output text
+ * @param len Output length
+ * @param out Open output stream (standard output), or NULL to create
+ *            output_file
+ * @param output_file Output file name
+ * @return false if the output could not be written (already reported)
+ */
+static bool write_output_text(const char *text, size_t len, FILE *out, const char *output_file) {
+    FILE *fp = out ? out : fopen(output_file, "w");
+    bool ok = fp && fwrite(text, 1, len, fp) == len;
+    if (fp && fclose(fp) != 0) ok = false;
+    if (!ok) fprintf(stderr, "Error: Cannot write to %s\n", output_file);
+    return ok;
+}
+
+/**
+ * @brief Write the cached result of the input, if there is one (-cache)
+ *
+ * @param prog Program holding the settings (no lines loaded)
+ * @param cache_dir Cache directory
+ * @param key Key of the input
+ * @param out Open output stream, or NULL to create output_file
+ * @param output_file Output file name
+ * @return true if a cached result was written
+ */
+static bool run_cached(Program *prog, const char *cache_dir, CacheKey key, FILE *out,
+                       const char *output_file) {
+    double t = stats_now();
+    size_t len = 0;
+    CacheStats summary;
+    char *text = cache_lookup(cache_dir, key, &len, &summary);
+    stats_add_time(prog->stats, "cache", t);
+    if (!text) return false;
+
+    printf("Cache hit: %016llx in %s\n", (unsigned long long)key.hash, cache_dir);
+    t = stats_now();
+    bool ok = write_output_text(text, len, out, output_file);
+    stats_add_time(prog->stats, "output", t);
+    free(text);
+    if (!ok) return false;
+
+    printf("\n=== Optimization Summary ===\n");
+    printf("Applied %d optimizations\n", summary.optimizations);
+    printf("Wrote optimized code to %s\n", output_file);
+    printf("Removed %d dead code lines\n", summary.removed);
+
+    if (prog->stats) {
+        prog->stats->lines = summary.lines;
+        print_run_stats(prog->stats, stdout);
+        free_run_stats(prog->stats);
+        prog->stats = NULL;
+    }
+    return true;
+}
+
+/**
+ * @brief Optimize many files in one process (-batch, @list)
+ *
+ * Prints one line per file in command line order once all files are
+ * done; a file that fails is reported and the others still run.
+ *
+ * @param batch Input files
+ * @param mode Optimization mode
+ * @param asm_type Assembler syntax
+ * @param cpu_type Target CPU
+ * @param jobs Files optimized at a time
+ * @param stats_enabled Print the total time and throughput (-stats)
+ * @param stats_json Print them as JSON (-stats=json)
+ * @param rules Peephole rules (-rules), or NULL for the built-in set
+ * @param unroll_budget Bytes loop unrolling may add per loop (-unroll-budget)
+ * @param zp_free Free zero page bytes (-zp-free), or NULL
+ * @param dma_jobs Replace block copies and fills with DMA jobs (-dma)
+ * @param superopt Superoptimizer memo (-superopt), or NULL
+ * @param cache_dir Cache directory (-cache), or NULL
+ * @param single_file_options -stream or -report was given
+ * @return 0 if every file was optimized, 1 otherwise
+ */
+static int run_batch(Batch *batch, OptMode mode, AsmType asm_type, CpuType cpu_type,
+                     int jobs, bool stats_enabled, bool stats_json, const RuleSet *rules,
+                     int unroll_budget, const unsigned char *zp_free, bool dma_jobs,
+                     struct SuperoptMemo *superopt, const char *cache_dir,
+                     bool single_file_options) {
+    if (single_file_options) {
+        fprintf(stderr, "Error: -stream and -report cannot be combined with -batch\n");
+        return 1;
+    }
+    if (batch->count == 0) {
+        fprintf(stderr, "Error: No input files\n");
+        return 1;
+    }
+    for (int i = 0; i < batch->count; i++) {
+        if (strcmp(batch->files[i].input, "-") == 0) {
+            fprintf(stderr, "Error: Standard input cannot be used with -batch\n");
+            return 1;
+        }
+    }
+
+    Program *settings = create_program(mode, asm_type);
+    set_program_cpu(settings, cpu_type);
+    settings->jobs = jobs;
+    settings->rules = rules;
+    settings->unroll_budget = unroll_budget;
+    settings->zp_free = zp_free;
+    settings->dma_jobs = dma_jobs;
+    settings->superopt = superopt;
+    if (stats_enabled) settings->stats = create_run_stats();
+    if (settings->stats) settings->stats->json = stats_json;
+
+    printf("Assembler: %s (comments: %s)\n", settings->config.name, settings->config.comment_char);
+    printf("Optimizing %d files for %s on %d thread%s...\n", batch->count,
+           mode == OPT_SPEED ? "speed" : "size", jobs, jobs == 1 ? "" : "s");
+
+    double t = stats_now();
+    int failed = optimize_batch(settings, batch, cache_dir);
+    stats_add_time(settings->stats, "batch", t);
+
+    long lines = 0;
+    int optimizations = 0;
+    for (int i = 0; i < batch->count; i++) {
+        const BatchFile *file = &batch->files[i];
+        if (!file->ok) {
+            fprintf(stderr, "Error: %s\n", file->error);
+            continue;
+        }
+        printf("%s -> %s: %d lines, %d optimizations, %d lines removed%s\n",
+               file->input, file->output, file->lines, file->optimizations, file->removed,
+               file->cached ? " (cached)" : "");
+        lines += file->lines;
+        optimizations += file->optimizations;
+    }
+    printf("\n=== Batch Summary ===\n");
+    printf("Optimized %d of %d files (%d failed)\n", batch->count - failed, batch->count, failed);
+    printf("Applied %d optimizations\n", optimizations);
+
+    if (settings->stats) {
+        settings->stats->lines = lines;
+        print_run_stats(settings->stats, stdout);
+        free_run_stats(settings->stats);
+    }
+    free_program_ast(settings);
+    return failed ? 1 : 0;
+}
 
 /**
  * @brief Main entry point
@@ -39,6 +322,32 @@
  * - -cpu <type>: Target CPU (6502, 65c02, 65816, 45gs02)
  * - -asm <type>: Assembler syntax (ca65, kick, acme, dasm, etc.)
  * - -trace <level>: Optimization trace level (1=basic, 2=verbose)
+ * - -validate: Print the register and flag tracking report
+ * - -report <file>: Write static cycle/byte estimates (see report.h)
+ * - -report-format <fmt>: Report format, json or csv (default: from
+ *   the report file extension, otherwise json)
+ * - -stats: Print time per phase and round, throughput, hits and
+ *   savings per rewrite rule, and peak memory (-stats=json: as JSON)
+ * - -stream: Optimize in bounded-memory windows (see stream.h)
+ * - -window <lines>: Minimum lines per window (implies -stream)
+ * - -j <jobs>: Optimize routines on this many threads (0 = one per CPU)
+ * - -cache <dir>: Reuse results stored in a cache directory (see cache.h)
+ * - -rules <file>: Add peephole rules from a rule file (see rules.h)
+ * - -unroll-budget <bytes>: Bytes loop unrolling may add per loop in
+ *   speed mode (0 disables unrolling)
+ * - -zp-free <bytes>: Zero page bytes hot variables may move to, as a
+ *   list of addresses and ranges (see parse_zp_free())
+ * - -dma: Replace block copies and fills with MEGA65 DMA jobs (45GS02,
+ *   speed mode; see dma.c)
+ * - -superopt <memo>: Search hot code for cheaper equivalent sequences,
+ *   remembering results in a memo file (see superopt.c)
+ * - -profile <counts>: Optimize what an emulator run shows hot for speed
+ *   and the rest for size (see profile.h)
+ * - -batch: Treat every file argument as an input (see run_batch())
+ * - @<list>: Add the files named in a response file (implies -batch)
+ * - -server (or --server): Serve requests from standard input or a
+ *   socket (see server.h)
+ * - -socket <path>: Unix domain socket for -server (implies -server)
  *
  * Special CPU notes:
  * - 65C02: Enables STZ instruction (stores zero)
@@ -55,6 +364,29 @@ int main(int argc, char *argv[]) {
     const char *input_file = NULL;
     const char *output_file = "output.asm";
     int trace_level_arg = 0;
+    const char *report_file = NULL;
+    ReportFormat report_format = REPORT_JSON;
+    bool report_format_set = false;
+    bool validate = false;
+    bool stats_enabled = false;
+    bool stats_json = false;
+    bool stream = false;
+    int window_lines = STREAM_WINDOW_LINES;
+    int jobs = 1;
+    bool batch_mode = false;
+    const char *cache_dir = NULL;
+    const char *rules_file = NULL;
+    int unroll_budget = UNROLL_DEFAULT_BUDGET;
+    static unsigned char zp_free_bytes[256];
+    const unsigned char *zp_free = NULL;
+    bool dma_jobs = false;
+    const char *superopt_file = NULL;
+    const char *profile_file = NULL;
+    bool server_mode = false;
+    const char *socket_path = NULL;
+    const char *cpu_name = "6502";
+    const char *asm_name = "generic";
+    Batch batch = { NULL, 0, 0 };
 
     // Parse arguments
     for (int i = 1; i < argc; i++) {
@@ -68,33 +400,186 @@ int main(int argc, char *argv[]) {
             } else {
                 trace_level_arg = 1; // Default to level 1 if no level specified
             }
+        } else if (strcmp(argv[i], "-validate") == 0) {
+            validate = true;
+        } else if (strcmp(argv[i], "-stats") == 0) {
+            stats_enabled = true;
+        } else if (strcmp(argv[i], "-stats=json") == 0) {
+            stats_enabled = true;
+            stats_json = true;
+        } else if (strcmp(argv[i], "-stream") == 0) {
+            stream = true;
+        } else if (strcmp(argv[i], "-window") == 0 && i + 1 < argc) {
+            window_lines = atoi(argv[++i]);
+            if (window_lines <= 0) {
+                fprintf(stderr, "Error: Window size must be a positive line count\n");
+                return 1;
+            }
+            stream = true;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+            if (jobs < 0 || !isdigit(argv[i][0])) {
+                fprintf(stderr, "Error: Job count must be a number (0 = one per CPU)\n");
+                return 1;
+            }
+            if (jobs == 0) jobs = parallel_cpu_count();
+            if (jobs > PARALLEL_MAX_WORKERS) jobs = PARALLEL_MAX_WORKERS;
+        } else if (strcmp(argv[i], "-report") == 0 && i + 1 < argc) {
+            report_file = argv[++i];
+        } else if (strcmp(argv[i], "-report-format") == 0 && i + 1 < argc) {
+            if (!parse_report_format(argv[++i], &report_format)) {
+                fprintf(stderr, "Error: Unknown report format %s (use json or csv)\n", argv[i]);
+                return 1;
+            }
+            report_format_set = true;
         } else if (strcmp(argv[i], "-asm") == 0 && i + 1 < argc) {
-            asm_type = parse_asm_type(argv[++i]);
+            asm_name = argv[++i];
+            asm_type = parse_asm_type(asm_name);
         } else if (strcmp(argv[i], "-cpu") == 0 && i + 1 < argc) {
-            i++;
-            if (strcasecmp(argv[i], "6502") == 0) {
-                cpu_type = CPU_6502;
-            } else if (strcasecmp(argv[i], "65c02") == 0) {
-                cpu_type = CPU_65C02;
-            } else if (strcasecmp(argv[i], "65816") == 0) {
-                cpu_type = CPU_65816;
-            } else if (strcasecmp(argv[i], "45gs02") == 0) {
-                cpu_type = CPU_45GS02;
+            if (parse_cpu_type(argv[++i], &cpu_type)) cpu_name = argv[i];
+        } else if (strcmp(argv[i], "-cache") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "-rules") == 0 && i + 1 < argc) {
+            rules_file = argv[++i];
+        } else if (strcmp(argv[i], "-unroll-budget") == 0 && i + 1 < argc) {
+            unroll_budget = atoi(argv[++i]);
+            if (unroll_budget < 0 || !isdigit(argv[i][0])) {
+                fprintf(stderr, "Error: Unroll budget must be a byte count (0 = no unrolling)\n");
+                return 1;
             }
-        } else if (!input_file) {
-            input_file = argv[i];
+        } else if (strcmp(argv[i], "-zp-free") == 0 && i + 1 < argc) {
+            if (!parse_zp_free(argv[++i], zp_free_bytes)) {
+                fprintf(stderr, "Error: -zp-free takes zero page addresses and ranges ($FB-$FE,$02)\n");
+                return 1;
+            }
+            zp_free = zp_free_bytes;
+        } else if (strcmp(argv[i], "-dma") == 0) {
+            dma_jobs = true;
+        } else if (strcmp(argv[i], "-superopt") == 0 && i + 1 < argc) {
+            superopt_file = argv[++i];
+        } else if (strcmp(argv[i], "-profile") == 0 && i + 1 < argc) {
+            profile_file = argv[++i];
+        } else if (strcmp(argv[i], "-server") == 0 || strcmp(argv[i], "--server") == 0) {
+            server_mode = true;
+        } else if (strcmp(argv[i], "-socket") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+            server_mode = true;
+        } else if (strcmp(argv[i], "-batch") == 0) {
+            batch_mode = true;
+        } else if (argv[i][0] == '@' && argv[i][1]) {
+            if (!batch_add_list(&batch, argv[i] + 1)) {
+                fprintf(stderr, "Error: Cannot read file list %s\n", argv[i] + 1);
+                free_batch(&batch);
+                return 1;
+            }
+            batch_mode = true;
         } else {
-            output_file = argv[i];
+            // Every file is a batch input; otherwise input then output
+            if (!batch_add_file(&batch, argv[i])) {
+                fprintf(stderr, "Error: Out of memory\n");
+                free_batch(&batch);
+                return 1;
+            }
+            if (!input_file) {
+                input_file = argv[i];
+            } else {
+                output_file = argv[i];
+            }
         }
     }
 
+    if (server_mode && rules_file) {
+        fprintf(stderr, "Error: -rules cannot be combined with -server\n");
+        free_batch(&batch);
+        return 1;
+    }
+    if (server_mode && superopt_file) {
+        fprintf(stderr, "Error: -superopt cannot be combined with -server\n");
+        free_batch(&batch);
+        return 1;
+    }
+    if (profile_file && (server_mode || batch_mode)) {
+        fprintf(stderr, "Error: -profile cannot be combined with %s\n",
+                server_mode ? "-server" : "-batch");
+        free_batch(&batch);
+        return 1;
+    }
+    if (server_mode) {
+        free_batch(&batch);
+        Opt6502Options defaults;
+        opt6502_default_options(&defaults);
+        defaults.mode = mode == OPT_SIZE ? OPT6502_SIZE : OPT6502_SPEED;
+        defaults.cpu = cpu_name;
+        defaults.assembler = asm_name;
+        defaults.trace_level = trace_level_arg;
+        defaults.jobs = jobs;
+        return run_server(&defaults, socket_path);
+    }
+
+    RuleSet *rules = NULL;
+    if (rules_file) {
+        rules = create_rule_set();
+        if (!rules || !rule_set_load_file(rules, rules_file)) {
+            free_rule_set(rules);
+            free_batch(&batch);
+            return 1;
+        }
+    }
+
+    struct SuperoptMemo *superopt = NULL;
+    if (superopt_file) {
+        superopt = open_superopt_memo(superopt_file);
+        if (!superopt) {
+            fprintf(stderr, "Error: Out of memory\n");
+            free_rule_set(rules);
+            free_batch(&batch);
+            return 1;
+        }
+    }
+
+    if (batch_mode) {
+        int status = run_batch(&batch, mode, asm_type, cpu_type, jobs, stats_enabled,
+                               stats_json, rules, unroll_budget, zp_free, dma_jobs, superopt,
+                               cache_dir, stream || report_file);
+        free_batch(&batch);
+        free_rule_set(rules);
+        if (!close_superopt_memo(superopt)) status = 1;
+        return status;
+    }
+    free_batch(&batch);
+
     if (!input_file || argc < 3) {
-        printf("Usage: %s [-speed|-size] [-asm <type>] [-cpu <type>] [-trace <level>] input.asm [output.asm]\n", argv[0]);
+        printf("Usage: %s [-speed|-size] [-asm <type>] [-cpu <type>] [-trace <level>] [-report <file>] input.asm [output.asm]\n", argv[0]);
+        printf("       %s [options] -batch input.asm... [@list]\n", argv[0]);
+        printf("       %s [options] -server [-socket <path>]\n", argv[0]);
         printf("  -speed: Optimize for execution speed\n");
         printf("  -size:  Optimize for code size\n");
         printf("  -asm:   Assembler type (default: generic)\n");
         printf("  -cpu:   Target CPU (6502, 65c02, 65816, 45gs02)\n");
         printf("  -trace: Generate optimization trace comments in output (level 1 = basic, level 2 = expanded)\n");
+        printf("  -validate: Print a register and flag tracking report (per instruction with -trace 2)\n");
+        printf("  -report: Write static cycle/byte estimates per routine and block (JSON or CSV)\n");
+        printf("  -report-format: Report format, json or csv (default: from report file extension)\n");
+        printf("  -stats: Print time per phase and round, throughput (lines/sec), hits and\n");
+        printf("          savings per rewrite rule, and peak memory (-stats=json: as JSON)\n");
+        printf("  -stream: Optimize and write one window at a time in bounded memory\n");
+        printf("  -window: Minimum lines per -stream window (default: %d)\n", STREAM_WINDOW_LINES);
+        printf("  -j:     Optimize routines on this many threads (0 = one per CPU, default: 1)\n");
+        printf("  -batch: Optimize every input file in one process; each output is written\n");
+        printf("          next to its input as <name>%s<ext> (-j files at a time)\n", BATCH_SUFFIX);
+        printf("  @list:  Add the files named in list, one per line (implies -batch)\n");
+        printf("  -cache: Reuse optimized output stored in this directory for unchanged input\n");
+        printf("  -rules: Add the peephole rules in this file to the built-in ones (see README)\n");
+        printf("  -unroll-budget: Bytes -speed loop unrolling may add per loop (0 = off, default: %d)\n",
+               UNROLL_DEFAULT_BUDGET);
+        printf("  -zp-free: Free zero page bytes to move hot variables to, e.g. $FB-$FE,$02\n");
+        printf("  -dma:   Replace block copies and fills with DMA jobs (45GS02, -speed)\n");
+        printf("  -superopt: Search hot code for cheaper sequences, remembering results in this file\n");
+        printf("  -profile: Execution counts per line or address; what ran hot is optimized for\n");
+        printf("          speed and the rest for size (see README)\n");
+        printf("  -server: Serve optimization requests on standard input/output (see README)\n");
+        printf("  -socket: Serve requests on this Unix domain socket instead (implies -server)\n");
+        printf("  Use - as input or output file name for standard input or output\n");
         printf("\nSupported assemblers:\n");
         printf("  generic   - Generic (supports both ; and // comments)\n");
         printf("  ca65      - ca65 (cc65 assembler)\n");
@@ -122,26 +607,81 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    // Read input file
-    FILE *fp = fopen(input_file, "r");
-    if (!fp) {
+    if (stream && report_file) {
+        fprintf(stderr, "Error: -report cannot be combined with -stream\n");
+        return 1;
+    }
+    if (stream && cache_dir) {
+        fprintf(stderr, "Error: -cache cannot be combined with -stream\n");
+        return 1;
+    }
+    if (stream && zp_free) {
+        fprintf(stderr, "Error: -zp-free cannot be combined with -stream\n");
+        return 1;
+    }
+    if (stream && profile_file) {
+        fprintf(stderr, "Error: -profile cannot be combined with -stream\n");
+        return 1;
+    }
+
+    // Optimized code on standard output: progress messages go to stderr
+    FILE *out = NULL;
+    if (strcmp(output_file, "-") == 0) {
+        out = claim_stdout();
+        if (!out) {
+            fprintf(stderr, "Error: Cannot write to standard output\n");
+            return 1;
+        }
+        output_file = "standard output";
+    }
+
+    // Read input file (or open it for streaming)
+    bool from_stdin = strcmp(input_file, "-") == 0;
+    SourceBuffer *source = NULL;
+    FILE *in = NULL;
+    if (stream) {
+        in = from_stdin ? stdin : fopen(input_file, "rb");
+    } else {
+        source = from_stdin ? source_read(stdin) : source_open(input_file);
+    }
+    if (!source && !in) {
         fprintf(stderr, "Error: Cannot open %s\n", input_file);
+        free_rule_set(rules);
+        close_superopt_memo(superopt);
         return 1;
     }
+    if (stream && !out) {
+        out = fopen(output_file, "w");
+        if (!out) {
+            fprintf(stderr, "Error: Cannot write to %s\n", output_file);
+            free_rule_set(rules);
+            close_superopt_memo(superopt);
+            return 1;
+        }
+    }
 
     Program *prog = create_program(mode, asm_type);
-    prog->cpu_type = cpu_type;
-    prog->allow_65c02 = (cpu_type == CPU_65C02 || cpu_type == CPU_65816);
-    prog->is_45gs02 = (cpu_type == CPU_45GS02);
+    set_program_cpu(prog, cpu_type);
     prog->trace_level = trace_level_arg;
-
-    // 45GS02 is backwards compatible with 65C02 but has different STZ behavior
-    if (prog->is_45gs02) {
-        prog->allow_65c02 = true;  // Can use most 65C02 instructions
+    prog->validate = validate;
+    prog->jobs = jobs;
+    prog->rules = rules;
+    prog->unroll_budget = unroll_budget;
+    prog->zp_free = zp_free;
+    prog->dma_jobs = dma_jobs;
+    prog->superopt = superopt;
+    if (profile_file) {
+        prog->profile = load_profile(profile_file);
+        if (!prog->profile) {
+            source_close(source);
+            free_program_ast(prog);
+            free_rule_set(rules);
+            close_superopt_memo(superopt);
+            return 1;
+        }
     }
-
-    char line[MAX_LINE];
-    int current_line_num = 0;
+    if (stats_enabled) prog->stats = create_run_stats();
+    if (prog->stats) prog->stats->json = stats_json;
 
     printf("Assembler: %s (comments: %s)\n", prog->config.name, prog->config.comment_char);
     printf("Target CPU: %s", cpu_type == CPU_6502 ? "6502" :
@@ -166,14 +706,52 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    while (fgets(line, MAX_LINE, fp)) {
-        // Remove newline
-        line[strcspn(line, "\r\n")] = '\0';
-        add_line_ast(prog, line, current_line_num++);
+    if (stream) {
+        int status = run_stream(prog, in, out, output_file, window_lines);
+        if (in != stdin) fclose(in);
+        fclose(out);
+        if (prog->stats) {
+            print_run_stats(prog->stats, stdout);
+            free_run_stats(prog->stats);
+        }
+        free_program_ast(prog);
+        free_rule_set(rules);
+        if (!close_superopt_memo(superopt)) status = 1;
+        return status;
+    }
+
+    // A cached result skips everything else; -report needs a real run
+    CacheKey key = { 0, 0 };
+    if (cache_dir) {
+        key = cache_key(prog, source->data, source->size);
+        if (!report_file && run_cached(prog, cache_dir, key, out, output_file)) {
+            source_close(source);
+            free_program_ast(prog);
+            free_rule_set(rules);
+            close_superopt_memo(superopt);
+            return 0;
+        }
     }
-    fclose(fp);
+
+    double t = stats_now();
+    load_program_source(prog, source);
+    stats_add_time(prog->stats, "parse", t);
 
     printf("Read %d lines from %s\n", prog->count, input_file);
+    if (prog->profile) {
+        if (!apply_profile(prog, prog->profile)) {
+            fprintf(stderr, "Error: Out of memory\n");
+            free_program_ast(prog);
+            free_rule_set(rules);
+            close_superopt_memo(superopt);
+            return 1;
+        }
+        printf("Profile: %d counts", prog->profile->entry_count);
+        if (prog->profile->unmatched > 0) {
+            printf(" (%d matched no instruction)", prog->profile->unmatched);
+        }
+        printf(", hot at %ld executions\n", prog->profile->hot_count);
+    }
     printf("Optimizing for %s...\n", mode == OPT_SPEED ? "speed" : "size");
 
     if (prog->is_45gs02) {
@@ -186,26 +764,62 @@ int main(int argc, char *argv[]) {
     printf("  %s#OPT    - Re-enable optimizations from this point\n\n", prog->config.comment_char);
 
     // Perform optimizations
+    CostSummary *cost_before = measure_program_cost(prog);
+    NodeCost *node_costs_before = report_file ? measure_node_costs(prog) : NULL;
     optimize_program_ast(prog);
+    CostSummary *cost_after = measure_program_cost(prog);
 
     printf("\n=== Optimization Summary ===\n");
     printf("Applied %d optimizations\n", prog->optimizations);
+    print_cost_savings(prog, cost_before, cost_after);
+    free_cost_summary(cost_before);
+    free_cost_summary(cost_after);
+
+    int lines_removed = 0;
+    for (int i = 0; i < prog->count; i++) {
+        if (node_is_dead(prog, i)) lines_removed++;
+    }
 
     // Write output
-    write_output_ast(prog, output_file);
+    t = stats_now();
+    if (cache_dir) {
+        size_t len = 0;
+        char *text = write_program_to_memory(prog, &len);
+        if (text && write_output_text(text, len, out, output_file)) {
+            CacheStats summary = { prog->count, prog->optimizations, lines_removed };
+            double tc = stats_now();
+            cache_store(cache_dir, key, text, len, &summary, 0);
+            stats_add_time(prog->stats, "cache", tc);
+        } else if (!text) {
+            fprintf(stderr, "Error: Out of memory writing %s\n", output_file);
+        }
+        free(text);
+    } else if (out) {
+        OutBuf buf;
+        outbuf_init_file(&buf, out);
+        write_program_ast(prog, &buf);
+        if (!outbuf_close(&buf)) fprintf(stderr, "Error: Cannot write to %s\n", output_file);
+        fclose(out);
+    } else {
+        write_output_ast(prog, output_file);
+    }
+    stats_add_time(prog->stats, "output", t);
     printf("Wrote optimized code to %s\n", output_file);
 
+    if (report_file) {
+        if (!report_format_set) report_format = report_format_for_file(report_file);
+        if (node_costs_before &&
+            write_cost_report(prog, node_costs_before, input_file, report_file, report_format)) {
+            printf("Wrote cost report to %s\n", report_file);
+        }
+        free(node_costs_before);
+    }
+
     if (prog->trace_level > 0) { // Check trace_level for general trace messages
         printf("Optimization trace comments included in output (Level %d)\n", prog->trace_level);
     }
 
     // Statistics
-    int lines_removed = 0;
-    AstNode *node = prog->root;
-    while (node) {
-        if (node->is_dead) lines_removed++;
-        node = node->next;
-    }
     printf("Removed %d dead code lines\n", lines_removed);
     printf("Final line count: %d (%.1f%% reduction)\n",
            prog->count - lines_removed,
@@ -215,6 +829,13 @@ int main(int argc, char *argv[]) {
         printf("\n** Remember: On 45GS02, STZ stores the Z register! **\n");
     }
 
+    if (prog->stats) {
+        prog->stats->lines = prog->count;
+        print_run_stats(prog->stats, stdout);
+        free_run_stats(prog->stats);
+    }
+
     free_program_ast(prog);
-    return 0;
+    free_rule_set(rules);
+    return close_superopt_memo(superopt) ? 0 : 1;
 }
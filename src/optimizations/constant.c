@@ -2,73 +2,168 @@
  * @file constant.c
  * @brief Constant propagation optimization
  *
- * Tracks known register values through the program and eliminates
- * redundant immediate loads.
+ * Uses the forward register dataflow over the control flow graph to
+ * find instructions whose effect is already in place and removes them:
+ * redundant immediate loads, CLC/SEC of a carry that is already known,
+ * compares against zero whose flags are already set, and REP/SEP of
+ * register widths already in place on the 65816.
  */
 
 #include "optimizer.h"
+#include "../analysis/cfg.h"
+#include "../analysis/dataflow.h"
+#include "../analysis/liveness.h"
+#include "../analysis/registers.h"
+#include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
 
 /**
- * @brief Constant propagation - track and eliminate redundant loads
+ * @brief Get the register a load or compare instruction targets
  *
- * Tracks the accumulator value through the program flow and removes
- * redundant immediate loads:
+ * @param op Opcode
+ * @return 'A', 'X', 'Y', 'Z', or 0 for other opcodes
+ */
+static char target_register(Opcode op) {
+    switch (op) {
+        case OP_LDA: case OP_CMP: return 'A';
+        case OP_LDX: case OP_CPX: return 'X';
+        case OP_LDY: case OP_CPY: return 'Y';
+        case OP_LDZ: case OP_CPZ: return 'Z';
+        default: return 0;
+    }
+}
+
+/**
+ * @brief Check whether a register already holds an immediate's value
  *
- *   LDA #$42       <- A = $42
- *   STA address
- *   LDA #$42       <- redundant, A is already $42
+ * @param state Register state before the load
+ * @param reg Register selector
+ * @param operand Immediate operand of the load
+ * @param value Parsed operand value (-1 if symbolic)
+ * @return true if the register is known to equal the operand
+ */
+static bool register_holds(const RegisterState *state, char reg, const char *operand, int value) {
+    bool known;
+    short num;
+    const char *text;
+    switch (reg) {
+        case 'X': known = state->x_known; num = state->x_num; text = state->x_value; break;
+        case 'Y': known = state->y_known; num = state->y_num; text = state->y_value; break;
+        case 'Z': known = state->z_known; num = state->z_num; text = state->z_value; break;
+        default:  known = state->a_known; num = state->a_num; text = state->a_value; break;
+    }
+
+    if (!known) return false;
+    if (value >= 0) return num == value;
+    return num < 0 && strcmp(text, operand) == 0;
+}
+
+/**
+ * @brief Check whether an instruction has no effect in the given state
  *
- * The optimization:
- * - Tracks LDA immediate values
- * - Removes subsequent LDA with the same value
- * - Invalidates tracking when A is modified by other instructions
- * - Resets tracking at branch targets (control flow convergence)
+ * @param prog Program owning the nodes
+ * @param index Node index
+ * @param end One past the last node of the node's block
+ * @param state Register state before the instruction
+ * @return true if removing the instruction cannot change behavior
+ */
+static bool is_redundant(const Program *prog, int index, int end, const RegisterState *state) {
+    const AstNode *node = &prog->nodes[index];
+    char reg = target_register(node->op);
+
+    switch (node->op) {
+        case OP_CLC:
+            return state->c_known && !state->c_set;
+
+        case OP_SEC:
+            return state->c_known && state->c_set;
+
+        case OP_LDA: case OP_LDX: case OP_LDY: case OP_LDZ: {
+            if (node->mode != AM_IMMEDIATE) return false;
+            int value = parse_immediate_value(node->operand);
+            if (!register_holds(state, reg, node->operand, value)) return false;
+
+            // N and Z must already match what the load would produce (a
+            // 16-bit load of a byte value clears N)
+            if (state->nz_source == reg) return true;
+            int width = register_width(state, reg);
+            if (value >= 0 && (width != 0 || value < 0x80) && state->n_known &&
+                state->z_flag_known && state->n_set == (width == 8 && (value & 0x80) != 0) &&
+                state->z_flag_set == (value == 0)) {
+                return true;
+            }
+            return registers_dead_after(prog, index, end, RF_NZ);
+        }
+
+        case OP_REP: case OP_SEP: {
+            // Only width bits, each already as the instruction would leave it
+            int bits = node->mode == AM_IMMEDIATE ? parse_immediate_value(node->operand) : -1;
+            int width = node->op == OP_REP ? 16 : 8;
+            if (bits <= 0 || (bits & ~0x30)) return false;
+            if ((bits & 0x20) && register_width(state, 'A') != width) return false;
+            if ((bits & 0x10) && register_width(state, 'X') != width) return false;
+            return state->wide_capable;
+        }
+
+        case OP_CMP: case OP_CPX: case OP_CPY: case OP_CPZ:
+            // Compare with zero only sets C and copies the register into N/Z
+            if (node->mode != AM_IMMEDIATE || parse_immediate_value(node->operand) != 0) return false;
+            if (state->nz_source != reg) return false;
+            return (state->c_known && state->c_set) || registers_dead_after(prog, index, end, RF_C);
+
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Constant propagation - remove instructions whose effect is known
+ *
+ * Solves the register dataflow over the control flow graph, so values
+ * survive labels that are only reached from known places and loop
+ * back-edges, then walks every block from its entry state and removes:
+ *
+ *   LDA/LDX/LDY/LDZ #value   <- register already holds value and N/Z match
+ *   CLC / SEC                <- carry already has that value
+ *   CMP/CPX/CPY/CPZ #0       <- N/Z already reflect the register, C known set
+ *                               or overwritten before use
+ *   REP/SEP #$10/#$20/#$30   <- 65816 registers already have that width
+ *
+ * Removing such an instruction leaves every live register and flag
+ * unchanged, so the solved states stay valid while the pass runs.
  *
  * @param prog Program to optimize
  */
 void optimize_constant_propagation_ast(Program *prog) {
-    char last_a_value[64] = "";
-    bool a_known = false;
-
-    AstNode *node = prog->root;
-    while (node) {
-        if (node->is_dead || node->is_branch_target || node->no_optimize) {
-            a_known = false;
-            node = node->next;
-            continue;
-        }
+    Dataflow *df = solve_register_dataflow(prog);
+    if (!df) return;
 
-        // Track LDA immediate values
-        if (node->opcode && strcmp(node->opcode, "LDA") == 0 &&
-            node->operand && node->operand[0] == '#') {
-            strncpy(last_a_value, node->operand, 63);
-            a_known = true;
-        }
-        // If we see another LDA with same value, remove it
-        else if (a_known && node->opcode && strcmp(node->opcode, "LDA") == 0 &&
-                 node->operand && strcmp(node->operand, last_a_value) == 0) {
-            node->is_dead = true;
-            prog->optimizations++;
-        }
-        // Operations that modify A
-        else if (node->opcode && (strcmp(node->opcode, "ADC") == 0 ||
-                                  strcmp(node->opcode, "SBC") == 0 ||
-                                  strcmp(node->opcode, "AND") == 0 ||
-                                  strcmp(node->opcode, "ORA") == 0 ||
-                                  strcmp(node->opcode, "EOR") == 0 ||
-                                  strcmp(node->opcode, "LDA") == 0 ||
-                                  strcmp(node->opcode, "PLA") == 0 ||
-                                  strcmp(node->opcode, "TXA") == 0 ||
-                                  strcmp(node->opcode, "TYA") == 0 ||
-                                  strcmp(node->opcode, "ASL") == 0 ||
-                                  strcmp(node->opcode, "LSR") == 0 ||
-                                  strcmp(node->opcode, "ROL") == 0 ||
-                                  strcmp(node->opcode, "ROR") == 0)) {
-            a_known = false;
+    const Cfg *cfg = prog->cfg;
+    for (int b = 0; b < cfg->block_count; b++) {
+        const BasicBlock *block = &cfg->blocks[b];
+        RegisterState state = df->block_in[b];
+
+        for (int i = block->start; i < block->end; i++) {
+            AstNode *node = &prog->nodes[i];
+            if (node_is_dead(prog, i) || node->op == OP_NONE) continue;
+
+            if (!node->no_optimize && is_redundant(prog, i, block->end, &state)) {
+                mark_node_dead(prog, i);
+                count_optimization(prog, "constant_propagation.redundant");
+                if (prog->trace_level > 1) {
+                    program_log(prog, "DEBUG const: Removed redundant %s %s at line %d\n", node->opcode,
+                           node->operand ? node->operand : "", node->line_num);
+                }
+                continue;
+            }
+
+            update_register_state(node, &state);
         }
+    }
 
-        node = node->next;
+    if (prog->trace_level > 1) {
+        program_log(prog, "DEBUG const: Dataflow converged after %d block visits\n", df->visits);
     }
+    free_dataflow(df);
 }
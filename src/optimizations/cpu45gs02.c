@@ -8,174 +8,422 @@
  * - STZ instruction that stores Z register (NOT zero like 65C02!)
  * - NEG instruction (two's complement negation)
  * - ASR instruction (arithmetic shift right, preserves sign)
+ * - 32-bit Q register (Z:Y:X:A) loads, stores and arithmetic
  *
  * CRITICAL: The 45GS02's STZ stores the Z REGISTER, not zero!
  * This is completely different from the 65C02's STZ instruction.
  */
 
 #include "optimizer.h"
+#include "../ast/ast.h"
+#include "../analysis/cfg.h"
+#include "../analysis/cost.h"
+#include "../analysis/liveness.h"
+#include "../program/stats.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 
+/** Instructions in the longest quad chain: four load, operate, store groups */
+#define QUAD_MAX_NODES 12
+
 /**
- * @brief 45GS02-specific optimizations
+ * @brief Check whether rewriting nodes in place pays off
  *
- * Implements several 45GS02-specific optimization patterns:
+ * @param prog Program being optimized
+ * @param start First node of the pattern
+ * @param count Number of nodes in the pattern
+ * @param ops New opcode of each node, keeping its operand, or OP_NONE
+ *            if the node is removed
+ * @return true if the rewritten nodes are cheaper under the selected mode
+ */
+static bool rewrite_pays_off(const Program *prog, int start, int count, const Opcode *ops) {
+    CostTotal before = {0, 0};
+    CostTotal after = {0, 0};
+
+    for (int k = 0; k < count; k++) {
+        const AstNode *node = &prog->nodes[start + k];
+        cost_add_node(&before, prog, start + k);
+        if (ops[k] == OP_NONE) continue;
+
+        InstrCost cost = instruction_cost(ops[k], node->mode, prog->cpu_type);
+        if (!cost.valid) return false;
+        cost_add(&after, cost);
+    }
+    return cost_is_better(prog, before, after);
+}
+
+/**
+ * @brief 45GS02-specific optimizations
  *
- * 1. Z Register usage for repeated stores:
- *    LDA #val / STA addr1 / LDA #val / STA addr2
+ * Reuses a Z register load for later stores of the same value:
+ *    LDZ #val / ... / LDA #val / STA addr
  *    Becomes:
- *    LDZ #val / STZ addr1 / STZ addr2 (removes second LDA)
+ *    LDZ #val / ... / STZ addr
  *
- * 2. NEG instruction (two's complement):
- *    EOR #$FF / SEC / ADC #$00
- *    Becomes:
- *    NEG
+ * The fixed-length 45GS02 patterns (LDZ for repeated stores, NEG and
+ * ASR) are peephole rules; see rules.c.
  *
- * 3. ASR instruction (arithmetic shift right):
- *    CMP #$80 / ROR
- *    Becomes:
- *    ASR
+ * Each rewrite is checked against the cost model (cost.h) and only
+ * applied if it is cheaper under the selected mode. A bare STA -> STZ
+ * after LDZ costs the same and is no longer applied.
  *
  * IMPORTANT: Does NOT convert LDA #0 / STA to STZ, because on 45GS02,
  * STZ stores the Z register, not zero! Use LDZ #0 / STZ explicitly if
  * you want to store zero on 45GS02.
  *
  * @param prog Program to optimize (only runs if is_45gs02=true)
+ * @param start First node index to examine
+ * @param end One past the last node index to examine
  */
-void optimize_45gs02_instructions_ast(Program *prog) {
+void optimize_45gs02_instructions_ast(Program *prog, int start, int end) {
     if (!prog->is_45gs02) return;
 
-    AstNode *node = prog->root;
-    while (node) {
-        if (node->is_dead || node->no_optimize) {
-            node = node->next;
-            continue;
-        }
-
-        // ===== Z Register Optimizations =====
-
-        // Pattern: Multiple stores of SAME VALUE using LDA #val, STA -> LDZ #val, then STZ
-        // Generalized for any immediate value, not just zero
-        // Look for: LDA #val, STA addr1, LDA #val, STA addr2
-        if (node->opcode && strcmp(node->opcode, "LDA") == 0 && node->operand && node->operand[0] == '#' &&
-            node->next && node->next->opcode && strcmp(node->next->opcode, "STA") == 0 &&
-            node->next->next && node->next->next->opcode && strcmp(node->next->next->opcode, "LDA") == 0 &&
-            node->next->next->operand && node->next->next->operand[0] == '#' &&
-            node->next->next->next && node->next->next->next->opcode && strcmp(node->next->next->next->opcode, "STA") == 0 &&
-            !node->next->no_optimize && !node->next->next->no_optimize && !node->next->next->next->no_optimize &&
-            strcmp(node->operand, node->next->next->operand) == 0) {  // Same value!
-
-            // Convert to: LDZ #val, STZ addr1, STZ addr2
-            node->opcode = realloc(node->opcode, 4);
-            if (node->opcode) {
-                strcpy(node->opcode, "LDZ");
-            }
-
-            node->next->opcode = realloc(node->next->opcode, 4);
-            if (node->next->opcode) {
-                strcpy(node->next->opcode, "STZ");
-            }
-
-            node->next->next->is_dead = true;  // Remove second LDA
-
-            node->next->next->next->opcode = realloc(node->next->next->next->opcode, 4);
-            if (node->next->next->next->opcode) {
-                strcpy(node->next->next->next->opcode, "STZ");
-            }
+    for (int i = start; i < end; i++) {
+        AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i) || node->no_optimize) continue;
 
-            prog->optimizations++;
-        }
-
-        // Also handle cases where we already have LDZ followed by stores
         // Pattern: LDZ #val, STA addr1, STA addr2, ... -> LDZ #val, STZ addr1, STZ addr2, ...
         // Also handles: LDZ #val, ..., LDA #val, STA addr -> LDZ #val, ..., STZ addr (with LDA marked dead)
-        if (node->opcode && strcmp(node->opcode, "LDZ") == 0 && node->operand && node->operand[0] == '#') {
+        if (node->op == OP_LDZ && node->operand && node->operand[0] == '#') {
             // Look ahead for STA instructions that could become STZ
-            AstNode *current = node->next;
-            while (current) {
-                if (current->is_dead || current->no_optimize) {
-                    current = current->next;
+            int j = i + 1;
+            while (j < prog->count) {
+                AstNode *current = &prog->nodes[j];
+                if (node_is_dead(prog, j) || current->no_optimize) {
+                    j++;
                     continue;
                 }
 
-                if (current->opcode && strcmp(current->opcode, "STA") == 0 &&
+                if (current->op == OP_STA &&
                     !current->is_branch_target) {
-                    // Convert STA to STZ (stores Z register value)
-                    current->opcode = realloc(current->opcode, 4);
-                    if (current->opcode) {
-                        strcpy(current->opcode, "STZ");
-                    }
-                    prog->optimizations++;
-                    current = current->next;
-                } else if (current->opcode && strcmp(current->opcode, "LDA") == 0 &&
+                    // STA -> STZ alone saves nothing, leave it
+                    j++;
+                } else if (current->op == OP_LDA &&
                            current->operand && node->operand &&
                            strcmp(current->operand, node->operand) == 0 &&
-                           current->next && current->next->opcode &&
-                           strcmp(current->next->opcode, "STA") == 0) {
+                           j + 1 < prog->count && prog->nodes[j + 1].op == OP_STA &&
+                           rewrite_pays_off(prog, j, 2, (const Opcode[]){OP_NONE, OP_STZ})) {
                     // LDA with same value followed by STA - mark LDA dead and convert STA to STZ
-                    current->is_dead = true;
-                    AstNode *sta_node = current->next;
-                    sta_node->opcode = realloc(sta_node->opcode, 4);
-                    if (sta_node->opcode) {
-                        strcpy(sta_node->opcode, "STZ");
-                    }
-                    prog->optimizations++;
-                    current = sta_node->next;
-                } else if (current->opcode && (strcmp(current->opcode, "LDA") == 0 ||
-                                              strcmp(current->opcode, "LDZ") == 0 ||
-                                              strcmp(current->opcode, "TAX") == 0 ||
-                                              strcmp(current->opcode, "TAY") == 0)) {
+                    mark_node_dead(prog, j);
+                    rewrite_node_opcode(prog, j + 1, OP_STZ);
+                    count_optimization(prog, "45gs02.ldz_reuse");
+                    j += 2;
+                } else if (current->op == OP_LDA || current->op == OP_LDZ ||
+                           current->op == OP_TAX || current->op == OP_TAY) {
                     // Something that would change what we're storing (with different value)
                     break;
                 } else {
-                    current = current->next;
+                    j++;
                 }
             }
         }
+    }
+}
+
+/**
+ * @brief Byte of Q a register holds
+ *
+ * @param op Load or store opcode
+ * @param load true to match loads, false to match stores
+ * @return 0 for A, 1 for X, 2 for Y, 3 for Z, or -1 for any other opcode
+ */
+static int quad_byte(Opcode op, bool load) {
+    switch (op) {
+        case OP_LDA: return load ? 0 : -1;
+        case OP_LDX: return load ? 1 : -1;
+        case OP_LDY: return load ? 2 : -1;
+        case OP_LDZ: return load ? 3 : -1;
+        case OP_STA: return load ? -1 : 0;
+        case OP_STX: return load ? -1 : 1;
+        case OP_STY: return load ? -1 : 2;
+        case OP_STZ: return load ? -1 : 3;
+        default: return -1;
+    }
+}
 
-        // 45GS02 has NEG instruction (negate accumulator)
-        // Pattern: EOR #$FF, SEC, ADC #$00 -> NEG
-        if (node->opcode && strcmp(node->opcode, "EOR") == 0 &&
-            node->operand && strcmp(node->operand, "#$FF") == 0 &&
-            node->next && node->next->opcode && strcmp(node->next->opcode, "SEC") == 0 &&
-            node->next->next && node->next->next->opcode && strcmp(node->next->next->opcode, "ADC") == 0 &&
-            node->next->next->operand && strcmp(node->next->next->operand, "#$00") == 0 &&
-            !node->next->no_optimize && !node->next->next->no_optimize &&
-            !node->next->next->is_branch_target) {
-
-            // Replace with NEG
-            node->opcode = realloc(node->opcode, 4);
-            if (node->opcode) {
-                strcpy(node->opcode, "NEG");
+/**
+ * @brief Quad form of an accumulator operation
+ *
+ * @param op Opcode
+ * @return ADCQ, SBCQ, ANDQ, ORAQ or EORQ, or OP_NONE
+ */
+static Opcode quad_operation(Opcode op) {
+    switch (op) {
+        case OP_ADC: return OP_ADCQ;
+        case OP_SBC: return OP_SBCQ;
+        case OP_AND: return OP_ANDQ;
+        case OP_ORA: return OP_ORQ;
+        case OP_EOR: return OP_EORQ;
+        default: return OP_NONE;
+    }
+}
+
+/**
+ * @brief Collect the next instructions of a straight run of code
+ *
+ * Labels, directives and lines excluded from optimization end the run.
+ *
+ * @param prog Program owning the nodes
+ * @param first First instruction of the run
+ * @param end One past the last node of the block
+ * @param count Instructions to collect
+ * @param nodes Receives their indices
+ * @return true if the run holds count instructions with operands
+ */
+static bool collect_run(const Program *prog, int first, int end, int count, int *nodes) {
+    int i = first;
+    for (int k = 0; k < count; k++) {
+        if (k > 0) {
+            for (i++; i < end; i++) {
+                const AstNode *node = &prog->nodes[i];
+                if (node_is_dead(prog, i)) continue;
+                if (node->label && node->label[0]) return false;
+                if (node->op != OP_NONE) break;
+                if (node->opcode && node->opcode[0]) return false;
             }
-            node->operand = NULL;
-            node->next->is_dead = true;
-            node->next->next->is_dead = true;
-            prog->optimizations++;
+            if (i >= end) return false;
         }
+        const AstNode *node = &prog->nodes[i];
+        if (node->no_optimize || !node->operand) return false;
+        nodes[k] = i;
+    }
+    return true;
+}
 
-        // ===== ASR (Arithmetic Shift Right) =====
+/**
+ * @brief Check that operands address the four bytes of a quad in memory
+ *
+ * @param prog Program owning the nodes
+ * @param nodes Node of each byte, byte 0 first
+ * @return true if every node addresses byte k of the operand of byte 0
+ *         in the same zero page or absolute mode
+ */
+static bool quad_operands(const Program *prog, const int *nodes) {
+    const AstNode *base = &prog->nodes[nodes[0]];
+    if (base->mode != AM_ZEROPAGE && base->mode != AM_ABSOLUTE) return false;
+    for (int k = 1; k < 4; k++) {
+        const AstNode *node = &prog->nodes[nodes[k]];
+        if (node->mode != base->mode || !operand_at_offset(base->operand, node->operand, k)) {
+            return false;
+        }
+    }
+    return true;
+}
 
-        // 45GS02 has ASR instruction (arithmetic shift right, preserves sign)
-        // Pattern: CMP #$80, ROR -> ASR
-        if (node->opcode && strcmp(node->opcode, "CMP") == 0 &&
-            node->operand && strcmp(node->operand, "#$80") == 0 &&
-            node->next && node->next->opcode && strcmp(node->next->opcode, "ROR") == 0 &&
-            !node->next->no_optimize &&
-            !node->next->is_branch_target) {
+/**
+ * @brief Check whether a quad written at one operand changes another
+ *        that is read byte by byte in the same chain
+ *
+ * @param read Operand read
+ * @param write Operand written
+ * @return true unless the operands are distinct symbols or the same quad
+ */
+static bool quads_overlap(const char *read, const char *write) {
+    SplitOperand a, b;
+    if (!split_operand(read, &a) || !split_operand(write, &b)) return true;
+    if (a.root_len == 0 && b.root_len == 0) return a.offset != b.offset && labs(a.offset - b.offset) < 4;
+    return same_operand_root(&a, &b) && a.offset != b.offset;
+}
 
-            // Can use ASR for signed right shift
-            node->opcode = realloc(node->opcode, 4);
-            if (node->opcode) {
-                strcpy(node->opcode, "ASR");
-            }
-            node->operand = NULL;
-            node->next->is_dead = true;
-            prog->optimizations++;
+/**
+ * @brief Rewrite a matched chain as quad instructions
+ *
+ * The first nodes of the chain become the quad instructions, taking
+ * the operands of byte 0; the others are removed.
+ *
+ * @param prog Program being optimized
+ * @param nodes Chain nodes, in program order
+ * @param count Number of chain nodes
+ * @param ops Quad opcodes, in order
+ * @param operands Operand of each quad instruction
+ * @param op_count Number of quad instructions
+ * @return true if the rewrite was applied (the cost model prefers it)
+ */
+static bool rewrite_quads(Program *prog, const int *nodes, int count, const Opcode *ops,
+                          const char *const *operands, int op_count) {
+    CostTotal before = {0, 0};
+    CostTotal after = {0, 0};
+    AddrMode modes[3];
+    for (int k = 0; k < count; k++) cost_add_node(&before, prog, nodes[k]);
+    for (int k = 0; k < op_count; k++) {
+        modes[k] = classify_operand(ops[k], operands[k]);
+        InstrCost cost = instruction_cost(ops[k], modes[k], prog->cpu_type);
+        if (!cost.valid) return false;
+        cost_add(&after, cost);
+    }
+    if (!cost_is_better(prog, before, after)) return false;
+
+    for (int k = 0; k < op_count; k++) {
+        AstNode *node = &prog->nodes[nodes[k]];
+        CostTotal old = {0, 0};
+        cost_add_node(&old, prog, nodes[k]);
+        node->operand = (char *)operands[k];
+        set_node_opcode(prog->arena, node, ops[k]);
+        note_node_changed(prog, nodes[k]);
+        InstrCost cost = instruction_cost(ops[k], modes[k], prog->cpu_type);
+        stats_note_change(prog->stats, 0, 1, old.cycles - cost.cycles, old.bytes - cost.bytes);
+    }
+    for (int k = op_count; k < count; k++) mark_node_dead(prog, nodes[k]);
+    return true;
+}
+
+/**
+ * @brief Fuse four loads (or four stores) of A, X, Y and Z into LDQ (STQ)
+ *
+ * The registers may come in any order. LDQ sets N and Z from all 32
+ * bits, so both must be dead after a load chain.
+ *
+ * @param prog Program being optimized
+ * @param first First node of the chain
+ * @param end One past the last node of the block
+ * @param after Live registers/flags after each node
+ * @return true if the chain was rewritten
+ */
+static bool fuse_register_chain(Program *prog, int first, int end, const unsigned int *after) {
+    int run[4], byte_node[4] = {-1, -1, -1, -1};
+    bool load = quad_byte(prog->nodes[first].op, true) >= 0;
+    if (!collect_run(prog, first, end, 4, run)) return false;
+    for (int k = 0; k < 4; k++) {
+        int byte = quad_byte(prog->nodes[run[k]].op, load);
+        if (byte < 0 || byte_node[byte] >= 0) return false;
+        byte_node[byte] = run[k];
+    }
+    if (!quad_operands(prog, byte_node)) return false;
+    if (load && (after[run[3]] & RF_NZ)) return false;
+
+    Opcode op = load ? OP_LDQ : OP_STQ;
+    const char *operand = prog->nodes[byte_node[0]].operand;
+    if (!rewrite_quads(prog, run, 4, &op, &operand, 1)) return false;
+    count_optimization(prog, load ? "45gs02.quad_load" : "45gs02.quad_store");
+    return true;
+}
+
+/**
+ * @brief Fuse a four byte copy or operation through A into quad instructions
+ *
+ *   LDA a / ADC b / STA r          LDQ a
+ *   LDA a+1 / ADC b+1 / STA r+1    ADCQ b
+ *   ... (four groups)        ->    STQ r
+ *
+ * The operation (ADC, SBC, AND, ORA or EOR) may be absent, which makes
+ * the chain a copy. The carry runs through ADCQ and SBCQ as it does
+ * through the byte chain, and N, C and V end up the same; Z is set from
+ * all 32 bits, so it must be dead, as must A, X, Y and Z. Each byte of
+ * the chain is read before a byte of the result is written, so the
+ * result may only share a symbol with a source at the same offset.
+ *
+ * @param prog Program being optimized
+ * @param first First node of the chain (LDA)
+ * @param end One past the last node of the block
+ * @param after Live registers/flags after each node
+ * @param decimal The program uses decimal mode (no ADCQ/SBCQ)
+ * @return true if the chain was rewritten
+ */
+static bool fuse_accumulator_chain(Program *prog, int first, int end, const unsigned int *after,
+                                   bool decimal) {
+    int run[QUAD_MAX_NODES];
+    if (!collect_run(prog, first, end, 2, run)) return false;
+    Opcode op = prog->nodes[run[1]].op;
+    Opcode quad = quad_operation(op);
+    if (quad == OP_NONE && op != OP_STA) return false;
+    if (decimal && (quad == OP_ADCQ || quad == OP_SBCQ)) return false;
+
+    int group = quad == OP_NONE ? 2 : 3;
+    if (!collect_run(prog, first, end, 4 * group, run)) return false;
+    int loads[4], operations[4], stores[4];
+    for (int k = 0; k < 4; k++) {
+        loads[k] = run[k * group];
+        operations[k] = run[k * group + 1];
+        stores[k] = run[k * group + group - 1];
+        if (prog->nodes[loads[k]].op != OP_LDA || prog->nodes[stores[k]].op != OP_STA ||
+            (group == 3 && prog->nodes[operations[k]].op != op)) {
+            return false;
         }
+    }
+    if (!quad_operands(prog, loads) || !quad_operands(prog, stores) ||
+        (group == 3 && !quad_operands(prog, operations))) {
+        return false;
+    }
 
-        node = node->next;
+    const char *result = prog->nodes[stores[0]].operand;
+    if (quads_overlap(prog->nodes[loads[0]].operand, result) ||
+        (group == 3 && quads_overlap(prog->nodes[operations[0]].operand, result))) {
+        return false;
     }
+    if (after[run[4 * group - 1]] & (RF_REGS | RF_ZF)) return false;
+
+    Opcode ops[3] = {OP_LDQ, quad, OP_STQ};
+    const char *operands[3] = {prog->nodes[loads[0]].operand, prog->nodes[operations[0]].operand,
+                               result};
+    if (group == 2) {
+        ops[1] = OP_STQ;
+        operands[1] = result;
+    }
+    if (!rewrite_quads(prog, run, 4 * group, ops, operands, group)) return false;
+    count_optimization(prog, group == 2 ? "45gs02.quad_copy" : "45gs02.quad_operation");
+    return true;
+}
+
+/**
+ * @brief 45GS02 32-bit quad fusion
+ *
+ * Turns byte-wise handling of four consecutive memory bytes into the
+ * Q register (Z:Y:X:A) instructions:
+ *
+ *   LDA v / LDX v+1 / LDY v+2 / LDZ v+3   ->  LDQ v
+ *   STA v / STX v+1 / STY v+2 / STZ v+3   ->  STQ v
+ *   four LDA / [ADC|SBC|AND|ORA|EOR] / STA groups  ->  LDQ / xxxQ / STQ
+ *
+ * The chains must be straight runs in one block and address zero page
+ * or absolute operands of the form name+k. Registers and flags the
+ * quad form changes must be dead according to the liveness; distinct
+ * symbols are assumed not to overlap. Programs that set decimal mode
+ * keep their byte-wise ADC and SBC chains. Each rewrite is checked
+ * against the cost model.
+ *
+ * @param prog Program to optimize (only runs if is_45gs02=true)
+ */
+void optimize_45gs02_quads_ast(Program *prog) {
+    if (!prog->is_45gs02 || !prog->cfg) return;
+
+    Liveness *lv = solve_liveness(prog);
+    unsigned int *after = lv ? malloc((prog->count > 0 ? prog->count : 1) * sizeof(unsigned int)) : NULL;
+    if (!after) {
+        free_liveness(lv);
+        return;
+    }
+
+    bool decimal = false;
+    for (int i = 0; i < prog->count && !decimal; i++) {
+        decimal = prog->nodes[i].op == OP_SED && !node_is_dead(prog, i);
+    }
+
+    const Cfg *cfg = prog->cfg;
+    for (int b = 0; b < cfg->block_count; b++) {
+        const BasicBlock *block = &cfg->blocks[b];
+        if (block->is_data) continue;
+
+        unsigned int live = lv->block_out[b];
+        for (int i = block->end - 1; i >= block->start; i--) {
+            after[i] = live;
+            if (node_is_dead(prog, i) || prog->nodes[i].op == OP_NONE) continue;
+            live = live_before(prog, i, live);
+        }
+
+        for (int i = block->start; i < block->end; i++) {
+            const AstNode *node = &prog->nodes[i];
+            if (node_is_dead(prog, i) || node->no_optimize || !node->operand) continue;
+
+            if (node->op == OP_LDA && fuse_accumulator_chain(prog, i, block->end, after, decimal)) {
+                continue;
+            }
+            if (quad_byte(node->op, true) >= 0 || quad_byte(node->op, false) >= 0) {
+                fuse_register_chain(prog, i, block->end, after);
+            }
+        }
+    }
+
+    free(after);
+    free_liveness(lv);
 }
@@ -0,0 +1,418 @@
+/**
+ * @file cpu65816.c
+ * @brief 65816-specific optimizations
+ *
+ * Uses the register widths the dataflow tracks through REP and SEP (see
+ * registers.h) to copy byte pairs a word at a time:
+ *
+ *   LDA src                  REP #$20
+ *   STA dst        becomes   LDA src
+ *   LDA src+1                STA dst
+ *   STA dst+1                SEP #$20
+ *
+ * A run of such copies shares one REP/SEP pair, and pairs of immediate
+ * bytes become one 16-bit immediate. The copy may go through A, X or Y:
+ * it needs a register that is 8 bits wide on entry and, like N and Z,
+ * dead afterwards. An 8-bit write of A leaves the high byte B in place
+ * while a 16-bit load changes it, so A only qualifies when nothing reads
+ * it again; X or Y is the usual choice. The rewrite is only applied when
+ * the cost model says it pays off, which a single copy between zero
+ * page bytes does not.
+ *
+ * The 16-bit copy reads both source bytes before writing the first
+ * destination byte, so a destination one byte above its source (the
+ * same symbol, offset by one) is left alone. Distinct symbols are
+ * assumed not to overlap.
+ *
+ * The pass also removes SEP/REP pairs that undo each other.
+ */
+
+#include "optimizer.h"
+#include "../ast/ast.h"
+#include "../analysis/cfg.h"
+#include "../analysis/cost.h"
+#include "../analysis/dataflow.h"
+#include "../analysis/liveness.h"
+#include "../analysis/registers.h"
+#include "../program/stats.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#define WIDE_MAX_COPIES 32          /**< Byte pair copies sharing one REP/SEP pair */
+#define WIDE_OPERAND_SIZE 64        /**< Size of a combined immediate operand */
+
+/**
+ * @brief Registers a word copy may go through
+ */
+static const struct {
+    char reg;                   /**< Register selector for register_width() */
+    Opcode load;                /**< Load instruction */
+    Opcode store;               /**< Store instruction */
+    unsigned int flag;          /**< RF_* mask of the register */
+    int width_bit;              /**< REP/SEP bit of its width */
+} copy_regs[] = {
+    {'A', OP_LDA, OP_STA, RF_A, 0x20},
+    {'X', OP_LDX, OP_STX, RF_X, 0x10},
+    {'Y', OP_LDY, OP_STY, RF_Y, 0x10},
+};
+
+/**
+ * @brief One byte pair copy: load, store, load, store
+ */
+typedef struct {
+    int nodes[4];               /**< Node indices in program order */
+    const char *src;            /**< Source operand of the low byte */
+    AddrMode src_mode;          /**< Source addressing mode */
+    const char *dst;            /**< Destination operand of the low byte */
+    AddrMode dst_mode;          /**< Destination addressing mode */
+} ByteCopy;
+
+/**
+ * @brief Combine two immediate bytes into one 16-bit immediate
+ *
+ * @param lo Immediate operand of the low byte
+ * @param hi Immediate operand of the high byte
+ * @param out Receives the combined operand
+ * @param size Size of out
+ * @return false unless both are numbers or they are #<expr and #>expr
+ */
+static bool combine_immediates(const char *lo, const char *hi, char *out, size_t size) {
+    int low = parse_immediate_value(lo);
+    int high = parse_immediate_value(hi);
+    if (low >= 0 && high >= 0) {
+        snprintf(out, size, "#$%04X", high << 8 | low);
+        return true;
+    }
+    if (strncmp(lo, "#<", 2) == 0 && strncmp(hi, "#>", 2) == 0 &&
+        strcmp(lo + 2, hi + 2) == 0 && strlen(lo + 2) + 2 <= size) {
+        snprintf(out, size, "#%s", lo + 2);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Find the next instruction of a straight run of code
+ *
+ * @param prog Program owning the nodes
+ * @param index Node to start after
+ * @param end One past the last node of the block
+ * @return Index of the next live instruction, or -1 if a label, a
+ *         directive, a line excluded from optimization or the end of
+ *         the block comes first
+ */
+static int next_instruction(const Program *prog, int index, int end) {
+    for (int i = index + 1; i < end; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i)) continue;
+        if (node->label && node->label[0]) return -1;
+        if (node->op == OP_NONE) {
+            if (node->opcode && node->opcode[0]) return -1;
+            continue;
+        }
+        return node->no_optimize ? -1 : i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Match one byte pair copy
+ *
+ * @param prog Program owning the nodes
+ * @param first Node of the first load
+ * @param end One past the last node of the block
+ * @param load Load opcode of the copy
+ * @param copy Receives the copy
+ * @return true if the four instructions form a copy of two bytes
+ */
+static bool match_copy(const Program *prog, int first, int end, Opcode load, ByteCopy *copy) {
+    copy->nodes[0] = first;
+    for (int k = 1; k < 4; k++) {
+        copy->nodes[k] = next_instruction(prog, copy->nodes[k - 1], end);
+        if (copy->nodes[k] < 0) return false;
+    }
+
+    const AstNode *n[4];
+    for (int k = 0; k < 4; k++) {
+        n[k] = &prog->nodes[copy->nodes[k]];
+        if (!n[k]->operand || n[k]->no_optimize) return false;
+    }
+    Opcode store = load == OP_LDA ? OP_STA : load == OP_LDX ? OP_STX : OP_STY;
+    if (n[0]->op != load || n[2]->op != load || n[1]->op != store || n[3]->op != store ||
+        n[0]->mode != n[2]->mode || n[1]->mode != n[3]->mode ||
+        !operand_at_offset(n[1]->operand, n[3]->operand, 1)) {
+        return false;
+    }
+
+    copy->src = n[0]->operand;
+    copy->src_mode = n[0]->mode;
+    copy->dst = n[1]->operand;
+    copy->dst_mode = n[1]->mode;
+    if (n[0]->mode == AM_IMMEDIATE) {
+        char text[WIDE_OPERAND_SIZE];
+        return combine_immediates(n[0]->operand, n[2]->operand, text, sizeof(text));
+    }
+    if (!operand_at_offset(n[0]->operand, n[2]->operand, 1)) return false;
+
+    // Writing dst must not change the source byte read after it
+    SplitOperand src, dst;
+    if (!split_operand(copy->src, &src) || !split_operand(copy->dst, &dst)) return false;
+    if (same_operand_root(&src, &dst) &&
+        (strcasecmp(src.suffix, dst.suffix) != 0 || dst.offset == src.offset + 1)) {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Check whether registers are written before anything reads them
+ *
+ * Scans the rest of the block and falls back on the solved liveness at
+ * its end. An 8-bit write of A ends the liveness of its low byte, which
+ * is all a byte copy changes; with whole_a set, A stays live until
+ * nothing reads it, since its high byte survives such writes. lv must
+ * be solved to match: solve_liveness() for whole_a, otherwise
+ * solve_byte_liveness().
+ *
+ * @param prog Program owning the nodes
+ * @param lv Solved liveness
+ * @param b Block index
+ * @param index Node after which to start scanning
+ * @param regs RF_* registers/flags to check
+ * @param whole_a Include the high byte of A
+ * @return true if every register in the mask is dead after index
+ */
+static bool dead_after(const Program *prog, const Liveness *lv, int b, int index,
+                       unsigned int regs, bool whole_a) {
+    const BasicBlock *block = &prog->cfg->blocks[b];
+    for (int i = index + 1; i < block->end && regs; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i)) continue;
+        if (node->op == OP_NONE) {
+            if (node->opcode && node->opcode[0]) return false;
+            continue;
+        }
+
+        int flow = opcode_info(node->op)->flow;
+        if (flow == FLOW_CALL || flow == FLOW_RETURN || flow == FLOW_STOP) return false;
+        if (opcode_reads(node->op, node->mode) & regs) return false;
+        if (flow != FLOW_NONE) break;
+
+        unsigned int kills = node->op == OP_REP || node->op == OP_SEP ? 0 :
+                             opcode_writes(node->op, node->mode);
+        if (whole_a) kills &= ~RF_A;
+        regs &= ~kills;
+    }
+    return !(regs & lv->block_out[b]);
+}
+
+/**
+ * @brief Rewrite a node as another instruction
+ *
+ * @param prog Program owning the node
+ * @param index Node index
+ * @param op New opcode
+ * @param operand New operand (arena string)
+ * @param mode Addressing mode of the operand
+ */
+static void write_instruction(Program *prog, int index, Opcode op, const char *operand,
+                              AddrMode mode) {
+    AstNode *node = &prog->nodes[index];
+    node->operand = (char *)operand;
+    set_node_opcode(prog->arena, node, op);
+    node->mode = mode;
+    note_node_changed(prog, index);
+}
+
+/**
+ * @brief Fuse a run of byte pair copies into 16-bit copies
+ *
+ * @param prog Program being optimized
+ * @param lb Solved liveness of the low byte of A
+ * @param lv Solved liveness of the whole of A
+ * @param b Block index
+ * @param first Node of the first load
+ * @param state Register state before the first load
+ * @return true if the run was rewritten
+ */
+static bool fuse_copies(Program *prog, const Liveness *lb, const Liveness *lv, int b, int first,
+                        const RegisterState *state) {
+    const AstNode *node = &prog->nodes[first];
+    int from = node->op == OP_LDA ? 0 : node->op == OP_LDX ? 1 : node->op == OP_LDY ? 2 : -1;
+    if (from < 0 || register_width(state, copy_regs[from].reg) != 8) return false;
+
+    const BasicBlock *block = &prog->cfg->blocks[b];
+    ByteCopy copies[WIDE_MAX_COPIES];
+    int count = 0;
+    int at = first;
+    while (count < WIDE_MAX_COPIES && at >= 0 &&
+           match_copy(prog, at, block->end, copy_regs[from].load, &copies[count])) {
+        at = next_instruction(prog, copies[count].nodes[3], block->end);
+        count++;
+    }
+    if (count == 0) return false;
+
+    int last = copies[count - 1].nodes[3];
+    CostTotal before = {0, 0};
+    for (int c = 0; c < count; c++) {
+        for (int k = 0; k < 4; k++) cost_add_node(&before, prog, copies[c].nodes[k]);
+    }
+
+    // Cheapest register the copy may go through
+    int best = -1;
+    CostTotal best_cost = before;
+    for (int r = 0; r < (int)(sizeof(copy_regs) / sizeof(copy_regs[0])); r++) {
+        if (register_width(state, copy_regs[r].reg) != 8) continue;
+        unsigned int regs = copy_regs[from].flag | copy_regs[r].flag | RF_NZ;
+        if (!dead_after(prog, lb, b, last, regs, false)) continue;
+        if (copy_regs[r].flag == RF_A && !dead_after(prog, lv, b, last, RF_A, true)) continue;
+
+        CostTotal after = {0, 0};
+        cost_add(&after, instruction_cost(OP_REP, AM_IMMEDIATE, CPU_65816));
+        cost_add(&after, instruction_cost(OP_SEP, AM_IMMEDIATE, CPU_65816));
+        bool legal = true;
+        for (int c = 0; c < count && legal; c++) {
+            InstrCost load = wide_instruction_cost(copy_regs[r].load, copies[c].src_mode);
+            InstrCost store = wide_instruction_cost(copy_regs[r].store, copies[c].dst_mode);
+            legal = load.valid && store.valid;
+            cost_add(&after, load);
+            cost_add(&after, store);
+        }
+        if (legal && cost_is_better(prog, best_cost, after)) {
+            best = r;
+            best_cost = after;
+        }
+    }
+    if (best < 0) return false;
+
+    // Combined immediates, made before anything is rewritten
+    const char *sources[WIDE_MAX_COPIES];
+    for (int c = 0; c < count; c++) {
+        sources[c] = copies[c].src;
+        if (copies[c].src_mode != AM_IMMEDIATE) continue;
+        char text[WIDE_OPERAND_SIZE];
+        combine_immediates(copies[c].src, prog->nodes[copies[c].nodes[2]].operand, text,
+                           sizeof(text));
+        sources[c] = arena_strdup(prog->arena, text);
+        if (!sources[c]) return false;
+    }
+
+    char bits[8];
+    snprintf(bits, sizeof(bits), "#$%02X", copy_regs[best].width_bit);
+    const char *rep = arena_strdup(prog->arena, bits);
+    if (!rep) return false;
+
+    // Write REP, the word copies and SEP over the first slots, kill the rest
+    int slots[WIDE_MAX_COPIES * 4];
+    for (int c = 0; c < count; c++) {
+        for (int k = 0; k < 4; k++) slots[c * 4 + k] = copies[c].nodes[k];
+    }
+    CostTotal kept = {0, 0};
+    for (int s = 0; s < count * 2 + 2; s++) cost_add_node(&kept, prog, slots[s]);
+
+    write_instruction(prog, slots[0], OP_REP, rep, AM_IMMEDIATE);
+    for (int c = 0; c < count; c++) {
+        write_instruction(prog, slots[1 + c * 2], copy_regs[best].load, sources[c],
+                          copies[c].src_mode);
+        write_instruction(prog, slots[2 + c * 2], copy_regs[best].store, copies[c].dst,
+                          copies[c].dst_mode);
+    }
+    write_instruction(prog, slots[count * 2 + 1], OP_SEP, rep, AM_IMMEDIATE);
+    for (int s = count * 2 + 2; s < count * 4; s++) mark_node_dead(prog, slots[s]);
+
+    // Killed slots were credited by mark_node_dead(); the rewritten ones
+    // go from their old cost to the new sequence
+    stats_note_change(prog->stats, 0, count * 2 + 2, kept.cycles - best_cost.cycles,
+                      kept.bytes - best_cost.bytes);
+    count_optimization(prog, "65816.word_copy");
+    if (prog->trace_level > 1) {
+        program_log(prog, "DEBUG 65816: %d byte pair copies through %c at line %d\n", count,
+                    copy_regs[best].reg, prog->nodes[first].line_num);
+    }
+    return true;
+}
+
+/**
+ * @brief Remove a SEP/REP pair that undoes itself
+ *
+ * SEP #n directly followed by REP #n leaves every register as it was if
+ * the widths n selects were already 16 bits, and REP #n; SEP #n if they
+ * were 8 bits.
+ *
+ * @param prog Program being optimized
+ * @param index Node of the first instruction
+ * @param end One past the last node of the block
+ * @param state Register state before the first instruction
+ * @return true if the pair was removed
+ */
+static bool remove_width_pair(Program *prog, int index, int end, const RegisterState *state) {
+    const AstNode *node = &prog->nodes[index];
+    if ((node->op != OP_REP && node->op != OP_SEP) || node->mode != AM_IMMEDIATE) return false;
+
+    int bits = parse_immediate_value(node->operand);
+    if (bits <= 0 || (bits & ~0x30)) return false;
+    int next = next_instruction(prog, index, end);
+    if (next < 0) return false;
+    const AstNode *undo = &prog->nodes[next];
+    Opcode inverse = node->op == OP_REP ? OP_SEP : OP_REP;
+    if (undo->op != inverse || undo->mode != AM_IMMEDIATE ||
+        parse_immediate_value(undo->operand) != bits) {
+        return false;
+    }
+
+    int width = node->op == OP_REP ? 8 : 16;
+    if ((bits & 0x20) && register_width(state, 'A') != width) return false;
+    if ((bits & 0x10) && register_width(state, 'X') != width) return false;
+
+    mark_node_dead(prog, index);
+    mark_node_dead(prog, next);
+    count_optimization(prog, "65816.width_pair");
+    return true;
+}
+
+/**
+ * @brief 65816-specific optimizations - word copies and width pairs
+ *
+ * Solves the register dataflow (for the widths) and both liveness views, then
+ * walks every block: byte pair copies with 8-bit registers become
+ * 16-bit copies where the cost model says so, and SEP/REP pairs that
+ * undo each other go. Rewritten runs end with the widths they started
+ * with, so the solved states stay valid while the pass runs.
+ *
+ * @param prog Program to optimize
+ */
+void optimize_65816_instructions_ast(Program *prog) {
+    if (prog->cpu_type != CPU_65816 || !prog->cfg) return;
+
+    Dataflow *df = solve_register_dataflow(prog);
+    Liveness *lb = df ? solve_byte_liveness(prog) : NULL;
+    Liveness *lv = lb ? solve_liveness(prog) : NULL;
+    if (!lv) {
+        free_dataflow(df);
+        free_liveness(lb);
+        return;
+    }
+
+    const Cfg *cfg = prog->cfg;
+    for (int b = 0; b < cfg->block_count; b++) {
+        const BasicBlock *block = &cfg->blocks[b];
+        if (block->is_data) continue;
+        RegisterState state = df->block_in[b];
+
+        for (int i = block->start; i < block->end; i++) {
+            AstNode *node = &prog->nodes[i];
+            if (node_is_dead(prog, i) || node->op == OP_NONE) continue;
+
+            if (!node->no_optimize) {
+                if (remove_width_pair(prog, i, block->end, &state)) continue;
+                fuse_copies(prog, lb, lv, b, i, &state);
+            }
+            update_register_state(node, &state);
+        }
+    }
+
+    free_dataflow(df);
+    free_liveness(lb);
+    free_liveness(lv);
+}
@@ -11,8 +11,8 @@
  */
 
 #include "optimizer.h"
+#include "../analysis/cost.h"
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 
@@ -42,123 +42,119 @@
  * The optimization:
  * 1. Finds LDA #$00 instructions
  * 2. Scans forward to find following STA instructions
- * 3. Converts all STAs to STZ
+ * 3. Converts the STAs whose addressing mode STZ supports (not abs,Y
+ *    or indirect); any other STA still needs A and keeps the LDA
  * 4. Only removes LDA #$00 if A value is not used afterward
+ * 5. Only applies the rewrite if the cost model (cost.h) says it is
+ *    cheaper under the selected mode
  *
  * CRITICAL: Disabled for 45GS02 where STZ has different semantics!
  *
  * @param prog Program to optimize (must have allow_65c02=true, is_45gs02=false)
+ * @param start First node index to examine
+ * @param end One past the last node index to examine
  */
-void optimize_65c02_instructions_ast(Program *prog) {
+void optimize_65c02_instructions_ast(Program *prog, int start, int end) {
     if (!prog->allow_65c02 || prog->is_45gs02) return;  // Don't apply to 45GS02!
 
-    AstNode *node = prog->root;
-
-    while (node) {
-        if (node->is_dead || node->no_optimize) {
-            node = node->next;
-            continue;
-        }
+    for (int i = start; i < end; i++) {
+        AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i) || node->no_optimize) continue;
 
         // Pattern: LDA #$00 followed by one or more STA -> convert all STA to STZ
         // If A is not used after the STAs, also mark LDA #$00 as dead
-        if (node->opcode && strcmp(node->opcode, "LDA") == 0 &&
+        if (node->op == OP_LDA &&
             node->operand && (strcmp(node->operand, "#$00") == 0 || strcmp(node->operand, "#0") == 0)) {
 
             // First pass: scan forward to check if A is used and find STAs
-            AstNode *current = node->next;
             bool found_sta = false;
             bool a_value_used = false;  // Track if accumulator value is used (not just modified)
+            bool done = false;
+            CostTotal before = {0, 0};
+            CostTotal after = {0, 0};
 
-            while (current && !current->is_branch_target) {
-                if (current->is_dead || current->no_optimize) {
-                    current = current->next;
-                    continue;
-                }
+            for (int j = i + 1; j < prog->count && !done; j++) {
+                AstNode *current = &prog->nodes[j];
+                if (current->is_branch_target) break;
+                if (node_is_dead(prog, j) || current->no_optimize) continue;
 
-                if (current->opcode && strcmp(current->opcode, "STA") == 0) {
-                    found_sta = true;
-                    current = current->next;
-                } else if (current->opcode && (
-                    strcmp(current->opcode, "ADC") == 0 ||
-                    strcmp(current->opcode, "SBC") == 0 ||
-                    strcmp(current->opcode, "AND") == 0 ||
-                    strcmp(current->opcode, "ORA") == 0 ||
-                    strcmp(current->opcode, "EOR") == 0 ||
-                    strcmp(current->opcode, "CMP") == 0 ||
-                    strcmp(current->opcode, "BIT") == 0 ||
-                    strcmp(current->opcode, "PHA") == 0 ||
-                    strcmp(current->opcode, "TAX") == 0 ||
-                    strcmp(current->opcode, "TAY") == 0)) {
-                    // Instruction uses A value - can't remove LDA but can still convert STA to STZ
-                    a_value_used = true;
-                    break;
-                } else if (current->opcode && (
-                    strcmp(current->opcode, "LDA") == 0 ||
-                    strcmp(current->opcode, "PLA") == 0 ||
-                    strcmp(current->opcode, "TXA") == 0 ||
-                    strcmp(current->opcode, "TYA") == 0)) {
-                    // A is reloaded/modified - safe to remove original LDA
-                    break;
-                } else {
-                    // Other instructions that don't use A - safe to continue
-                    current = current->next;
+                switch (current->op) {
+                    case OP_STA:
+                        cost_add_node(&before, prog, j);
+                        if (instruction_cost(OP_STZ, current->mode, prog->cpu_type).valid) {
+                            cost_add(&after, instruction_cost(OP_STZ, current->mode, prog->cpu_type));
+                            found_sta = true;
+                        } else {
+                            // No STZ form for this mode - the STA still needs A = 0
+                            cost_add_node(&after, prog, j);
+                            a_value_used = true;
+                        }
+                        break;
+
+                    case OP_ADC: case OP_SBC: case OP_AND: case OP_ORA: case OP_EOR:
+                    case OP_CMP: case OP_BIT: case OP_PHA: case OP_TAX: case OP_TAY:
+                        // Instruction uses A value - can't remove LDA but can still convert STA to STZ
+                        a_value_used = true;
+                        done = true;
+                        break;
+
+                    case OP_LDA: case OP_PLA: case OP_TXA: case OP_TYA:
+                        // A is reloaded/modified - safe to remove original LDA
+                        done = true;
+                        break;
+
+                    default:
+                        // Other instructions that don't use A - safe to continue
+                        break;
                 }
             }
 
-            // Second pass: convert STAs to STZ if we found any
-            if (found_sta) {
-                current = node->next;
-                while (current && !current->is_branch_target) {
-                    if (current->is_dead || current->no_optimize) {
-                        current = current->next;
-                        continue;
-                    }
+            cost_add_node(&before, prog, i);
+            if (a_value_used) cost_add_node(&after, prog, i);
 
-                    if (current->opcode && strcmp(current->opcode, "STA") == 0) {
-                        // Convert STA to STZ
-                        current->opcode = realloc(current->opcode, 4);
-                        if (current->opcode) {
-                            strcpy(current->opcode, "STZ");
-                        }
-                        prog->optimizations++;
-                        current = current->next;
-                    } else if (current->opcode && (
-                        strcmp(current->opcode, "LDA") == 0 ||
-                        strcmp(current->opcode, "PLA") == 0 ||
-                        strcmp(current->opcode, "TXA") == 0 ||
-                        strcmp(current->opcode, "TYA") == 0 ||
-                        strcmp(current->opcode, "ADC") == 0 ||
-                        strcmp(current->opcode, "SBC") == 0 ||
-                        strcmp(current->opcode, "AND") == 0 ||
-                        strcmp(current->opcode, "ORA") == 0 ||
-                        strcmp(current->opcode, "EOR") == 0 ||
-                        strcmp(current->opcode, "CMP") == 0 ||
-                        strcmp(current->opcode, "BIT") == 0 ||
-                        strcmp(current->opcode, "PHA") == 0 ||
-                        strcmp(current->opcode, "TAX") == 0 ||
-                        strcmp(current->opcode, "TAY") == 0)) {
-                        // A is modified or used - stop scanning
-                        break;
-                    } else {
-                        current = current->next;
+            // Second pass: convert STAs to STZ if we found any and it pays off
+            if (found_sta && cost_is_better(prog, before, after)) {
+                // Remove LDA #$00 first so -stats credits it to the STZ rewrite
+                if (!a_value_used) mark_node_dead(prog, i);
+
+                done = false;
+                for (int j = i + 1; j < prog->count && !done; j++) {
+                    AstNode *current = &prog->nodes[j];
+                    if (current->is_branch_target) break;
+                    if (node_is_dead(prog, j) || current->no_optimize) continue;
+
+                    switch (current->op) {
+                        case OP_STA:
+                            // Convert STA to STZ where the addressing mode allows it
+                            if (instruction_cost(OP_STZ, current->mode, prog->cpu_type).valid) {
+                                rewrite_node_opcode(prog, j, OP_STZ);
+                                count_optimization(prog, "65c02.sta_to_stz");
+                            }
+                            break;
+
+                        case OP_LDA: case OP_PLA: case OP_TXA: case OP_TYA:
+                        case OP_ADC: case OP_SBC: case OP_AND: case OP_ORA: case OP_EOR:
+                        case OP_CMP: case OP_BIT: case OP_PHA: case OP_TAX: case OP_TAY:
+                            // A is modified or used - stop scanning
+                            done = true;
+                            break;
+
+                        default:
+                            break;
                     }
                 }
 
-                // Only mark LDA #$00 as dead if A value is not used later
+                // Report whether LDA #$00 went away
                 if (!a_value_used) {
-                    node->is_dead = true;
                     if (prog->trace_level > 1) {
-                        printf("DEBUG 65c02: Marked LDA #0 at line %d as dead, converted STAs to STZ\n", node->line_num);
+                        program_log(prog, "DEBUG 65c02: Marked LDA #0 at line %d as dead, converted STAs to STZ\n", node->line_num);
                     }
                 } else {
                     if (prog->trace_level > 1) {
-                        printf("DEBUG 65c02: Kept LDA #0 at line %d (A used later), but converted STAs to STZ\n", node->line_num);
+                        program_log(prog, "DEBUG 65c02: Kept LDA #0 at line %d (A used later), but converted STAs to STZ\n", node->line_num);
                     }
                 }
             }
         }
-
-        node = node->next;
     }
 }
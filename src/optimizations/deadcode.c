@@ -7,7 +7,6 @@
  */
 
 #include "optimizer.h"
-#include <string.h>
 
 /**
  * @brief Dead code elimination - remove unreachable instructions
@@ -24,31 +23,29 @@
  * - An instruction with no_optimize flag
  *
  * @param prog Program to optimize
+ * @param start First node index to examine
+ * @param end One past the last node index to examine
  */
-void optimize_dead_code_ast(Program *prog) {
-    AstNode *node = prog->root;
-    while (node) {
-        if (node->is_dead || node->no_optimize) {
-            node = node->next;
-            continue;
-        }
+void optimize_dead_code_ast(Program *prog, int start, int end) {
+    for (int i = start; i < end; i++) {
+        AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i) || node->no_optimize) continue;
 
         // Unconditional jump followed by unreachable code
-        if ((node->opcode && (strcmp(node->opcode, "JMP") == 0 ||
-                              strcmp(node->opcode, "RTS") == 0 ||
-                              strcmp(node->opcode, "RTI") == 0)) &&
-            node->next && !node->next->is_branch_target && !node->next->label) {
+        if ((node->op == OP_JMP || node->op == OP_RTS || node->op == OP_RTI) &&
+            i + 1 < prog->count &&
+            !prog->nodes[i + 1].is_branch_target && !prog->nodes[i + 1].label) {
 
-            AstNode *current = node->next;
-            while (current && !current->is_branch_target &&
-                   !current->label && !current->no_optimize &&
-                   current->opcode) {
-                current->is_dead = true;
-                prog->optimizations++;
-                current = current->next;
+            for (int j = i + 1; j < prog->count; j++) {
+                AstNode *current = &prog->nodes[j];
+                if (current->is_branch_target || current->label ||
+                    current->no_optimize || !current->opcode) {
+                    break;
+                }
+                if (node_is_dead(prog, j)) continue;  // Already removed
+                mark_node_dead(prog, j);
+                count_optimization(prog, "dead_code.unreachable");
             }
         }
-
-        node = node->next;
     }
 }
@@ -0,0 +1,113 @@
+/**
+ * @file deadstore.c
+ * @brief Dead register and flag result elimination
+ *
+ * Uses the backward liveness over the control flow graph to find
+ * instructions whose only effect is on registers and flags nothing
+ * reads afterwards, and removes them: loads, transfers, CLC/SEC/CLV,
+ * compares and register arithmetic.
+ */
+
+#include "optimizer.h"
+#include "../analysis/cfg.h"
+#include "../analysis/liveness.h"
+
+/**
+ * @brief Check whether an instruction does nothing but set registers and flags
+ *
+ * Memory operands are only accepted in zero page: reading an absolute
+ * address may have side effects on I/O registers. NEG is left alone
+ * since NEG NEG is the 45GS02 prefix of 32-bit instructions.
+ *
+ * @param node Node to check
+ * @return Name the removal is counted under, or NULL if the
+ *         instruction has other effects
+ */
+static const char* removable_kind(const AstNode *node) {
+    switch (node->mode) {
+        case AM_IMPLIED: case AM_ACCUMULATOR: case AM_IMMEDIATE:
+        case AM_ZEROPAGE: case AM_ZEROPAGE_X: case AM_ZEROPAGE_Y:
+            break;
+        default:
+            return NULL;
+    }
+
+    switch (node->op) {
+        case OP_LDA: case OP_LDX: case OP_LDY: case OP_LDZ:
+            return "dead_store.load";
+
+        case OP_TAX: case OP_TAY: case OP_TXA: case OP_TYA: case OP_TSX:
+        case OP_TXY: case OP_TYX: case OP_TAZ: case OP_TZA: case OP_TBA:
+            return "dead_store.transfer";
+
+        case OP_CLC: case OP_SEC: case OP_CLV:
+            return "dead_store.flag";
+
+        case OP_ADC: case OP_SBC: case OP_AND: case OP_ORA: case OP_EOR:
+        case OP_CMP: case OP_CPX: case OP_CPY: case OP_CPZ: case OP_BIT:
+        case OP_INX: case OP_INY: case OP_INZ: case OP_DEX: case OP_DEY:
+        case OP_DEZ:
+            return "dead_store.compute";
+
+        case OP_ASL: case OP_LSR: case OP_ROL: case OP_ROR: case OP_ASR:
+        case OP_INC: case OP_DEC:
+            return node->mode == AM_ACCUMULATOR ? "dead_store.compute" : NULL;
+
+        default:
+            return NULL;
+    }
+}
+
+/**
+ * @brief Dead store elimination - remove results nothing reads
+ *
+ * Solves the backward liveness over the control flow graph, then walks
+ * every block from its exit and removes each instruction that only
+ * writes registers and flags that are dead after it:
+ *
+ *   LDX #$00          <- removed: X is loaded again before any use
+ *   LDX #$10
+ *
+ *   CLC               <- removed: carry is set again before any use
+ *   SEC
+ *
+ * Removing an instruction only removes reads, so the solved block exit
+ * states stay valid (if pessimistic) while the pass runs.
+ *
+ * @param prog Program to optimize
+ */
+void optimize_dead_stores_ast(Program *prog) {
+    Liveness *lv = solve_liveness(prog);
+    if (!lv) return;
+
+    const Cfg *cfg = prog->cfg;
+    for (int b = 0; b < cfg->block_count; b++) {
+        const BasicBlock *block = &cfg->blocks[b];
+        if (block->is_data) continue;
+        unsigned int live = lv->block_out[b];
+
+        for (int i = block->end - 1; i >= block->start; i--) {
+            AstNode *node = &prog->nodes[i];
+            if (node_is_dead(prog, i) || node->op == OP_NONE) continue;
+
+            const char *kind = node->no_optimize ? NULL : removable_kind(node);
+            unsigned int writes = opcode_writes(node->op, node->mode);
+            if (kind && writes && !(writes & ~LIVE_TRACKED) && !(writes & live)) {
+                mark_node_dead(prog, i);
+                count_optimization(prog, kind);
+                if (prog->trace_level > 1) {
+                    program_log(prog, "DEBUG dead store: Removed %s %s at line %d\n", node->opcode,
+                           node->operand ? node->operand : "", node->line_num);
+                }
+                continue;
+            }
+
+            live = live_before(prog, i, live);
+        }
+    }
+
+    if (prog->trace_level > 1) {
+        program_log(prog, "DEBUG dead store: Liveness converged after %d block visits\n", lv->visits);
+    }
+    free_liveness(lv);
+}
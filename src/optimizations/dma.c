@@ -0,0 +1,847 @@
+/**
+ * @file dma.c
+ * @brief F018 DMA job substitution (45GS02, speed mode, -dma)
+ *
+ * The MEGA65 DMA controller copies or fills memory far faster than the
+ * CPU can move it a byte at a time. With -dma this pass replaces block
+ * copies and fills with an enhanced DMA job:
+ *
+ *   LDX #$00                          LDA #$00
+ * loop:                               STA $D702
+ *   LDA src,X                         STA $D704
+ *   STA dst,X          becomes        LDA #>dma_job_1
+ *   INX                               STA $D701
+ *   CPX #$40                          LDA #<dma_job_1
+ *   BNE loop                          STA $D705
+ *                                     LDA src+63
+ *                                     LDX #$40
+ *                                     CPX #$40
+ *
+ * and puts the job list (F018B format, source and destination in
+ * megabyte 0) in front of the next global label that follows an RTS or
+ * an unconditional jump, where execution never reaches it. The loads
+ * after the trigger leave the registers and flags as the loop did;
+ * dead store elimination removes those nothing reads.
+ *
+ * Two shapes are recognized:
+ * - Counted loops of a single block (the shapes loop unrolling handles,
+ *   see unroll.c, plus a CPX/CPY #n before BNE) whose body is
+ *   LDA src,X / STA dst,X (copy) or STA dst,X after an LDA #value
+ *   (fill), with the index visiting one range of bytes without wrapping
+ * - Straight runs of LDA src+k / STA dst+k (copy) or one LDA #value
+ *   followed by STA dst+k (fill) over consecutive bytes, through A, X
+ *   or Y
+ *
+ * The DMA controller works on physical addresses, so the pass assumes
+ * what -dma states: the addresses the code uses are the bank 0 RAM
+ * addresses (no MAP translation, base page at $00), and the MEGA65 I/O
+ * is visible at $D700. Literal zero page and $D000-$DFFF operands are
+ * left alone. The source and destination of one job must be distinct
+ * symbols, which are assumed not to overlap. A job is only used where
+ * the cost model, with the approximate DMA timings below, says it is
+ * faster. With a profile (-profile), jobs replace hot code only, in
+ * either mode.
+ *
+ * Substitution inserts nodes, so it runs once, before the control flow
+ * graph the other passes use is rebuilt.
+ */
+
+#include "optimizer.h"
+#include "../ast/ast.h"
+#include "../analysis/cfg.h"
+#include "../analysis/cost.h"
+#include "../analysis/loops.h"
+#include "../analysis/registers.h"
+#include "../program/profile.h"
+#include "../program/stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DMA_JOB_CYCLES 24           /**< Job list fetch and start, in CPU cycles */
+#define DMA_COPY_CYCLES 2           /**< Cycles per byte copied */
+#define DMA_FILL_CYCLES 1           /**< Cycles per byte filled */
+#define DMA_LIST_BYTES 18           /**< Option bytes plus the F018B list */
+#define DMA_MAX_RUN 1024            /**< Most byte copies in one straight run */
+#define DMA_PLACE_SCAN 4096         /**< Nodes searched for a job list location */
+#define DMA_TEXT_SIZE 96            /**< Size of an address expression */
+#define DMA_JOB_NODES 16            /**< Nodes a job inserts, at most */
+
+/**
+ * @brief One block copy or fill and its replacement
+ */
+typedef struct {
+    int first;                  /**< First node replaced */
+    int last;                   /**< Last node replaced; the new code goes after it */
+    int place;                  /**< Node the job list goes in front of */
+    bool loop;                  /**< Replaces a counted loop (else a straight run) */
+    bool fill;                  /**< Fill rather than copy */
+    int count;                  /**< Bytes moved */
+    Opcode load;                /**< Register the trigger goes through (LDA, LDX, LDY) */
+    Opcode counter_load;        /**< Loop counter load (LDX or LDY) */
+    int final;                  /**< Loop counter value after the loop */
+    bool compare;               /**< Loop ends with CPX/CPY (restore its flags) */
+    char src[DMA_TEXT_SIZE];    /**< Source address, or the fill value */
+    char dst[DMA_TEXT_SIZE];    /**< Destination address */
+    char restore[DMA_TEXT_SIZE];/**< Operand reloading the register the trigger used */
+} DmaJob;
+
+/**
+ * @brief Matching store of a load
+ *
+ * @param load LDA, LDX or LDY
+ * @return STA, STX or STY, or OP_NONE
+ */
+static Opcode store_of(Opcode load) {
+    return load == OP_LDA ? OP_STA : load == OP_LDX ? OP_STX : load == OP_LDY ? OP_STY : OP_NONE;
+}
+
+/**
+ * @brief Write the address of a byte of an operand as an expression
+ *
+ * @param op Split operand
+ * @param index Byte added to the operand
+ * @param out Receives the expression
+ * @param size Size of out
+ * @return false if the expression does not fit
+ */
+static bool address_text(const SplitOperand *op, long index, char *out, size_t size) {
+    long offset = op->offset + index;
+    int n;
+    if (op->root_len == 0) {
+        n = snprintf(out, size, "$%04lX", offset & 0xFFFF);
+    } else if (offset == 0) {
+        n = snprintf(out, size, "%.*s", (int)op->root_len, op->text);
+    } else {
+        n = snprintf(out, size, "%.*s%c%ld", (int)op->root_len, op->text,
+                     offset < 0 ? '-' : '+', offset < 0 ? -offset : offset);
+    }
+    return n > 0 && (size_t)n < size;
+}
+
+/**
+ * @brief Check that a range of bytes may be handed to the DMA controller
+ *
+ * @param op Split operand of the range
+ * @param lo First byte, added to the operand
+ * @param count Bytes in the range
+ * @return false for literal ranges touching zero page, I/O or $10000
+ */
+static bool dma_range(const SplitOperand *op, long lo, int count) {
+    if (op->root_len > 0) return true;
+    long start = op->offset + lo;
+    long end = start + count - 1;
+    return start >= 0x100 && end <= 0xFFFF && (end < 0xD000 || start > 0xDFFF);
+}
+
+/**
+ * @brief Check that the source and destination of a copy are distinct
+ *
+ * @param src Split source operand
+ * @param src_lo First source byte
+ * @param dst Split destination operand
+ * @param dst_lo First destination byte
+ * @param count Bytes copied
+ * @return true if the ranges cannot overlap
+ */
+static bool distinct_ranges(const SplitOperand *src, long src_lo, const SplitOperand *dst,
+                            long dst_lo, int count) {
+    if (src->root_len == 0 && dst->root_len == 0) {
+        long a = src->offset + src_lo, b = dst->offset + dst_lo;
+        return a + count <= b || b + count <= a;
+    }
+    return !same_operand_root(src, dst);
+}
+
+/**
+ * @brief Find where the job list may go
+ *
+ * The list goes right after an RTS or an unconditional jump that a
+ * global label follows, so code never runs into it and no local label
+ * scope is split. Directives on the way end the search, since they may
+ * switch segments.
+ *
+ * @param prog Program owning the nodes
+ * @param from Node after which to search
+ * @return Node index, or -1 if there is no such place nearby
+ */
+static int find_list_place(const Program *prog, int from) {
+    int place = -1;
+    int stop = from + DMA_PLACE_SCAN < prog->count ? from + DMA_PLACE_SCAN : prog->count;
+    for (int i = from + 1; i < stop; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i)) continue;
+        if (node->label && node->label[0]) {
+            if (place >= 0 && !node->is_local_label) return place;
+            place = -1;
+        }
+        if (node->op == OP_NONE) {
+            if (node->opcode && node->opcode[0]) return -1;
+            continue;
+        }
+        int flow = opcode_info(node->op)->flow;
+        place = flow == FLOW_RETURN || flow == FLOW_JUMP ? i + 1 : -1;
+    }
+    return -1;
+}
+
+/**
+ * @brief Collect the instructions of a block
+ *
+ * @param prog Program owning the nodes
+ * @param block Block
+ * @param nodes Receives the instruction indices
+ * @param max Capacity of nodes
+ * @return Number of instructions, or -1 if the block holds labels after
+ *         its first node, directives or lines excluded from optimization,
+ *         or more than max instructions
+ */
+static int block_instructions(const Program *prog, const BasicBlock *block, int *nodes, int max) {
+    int n = 0;
+    for (int i = block->start; i < block->end; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i)) continue;
+        if (i != block->start && node->label && node->label[0]) return -1;
+        if (node->op == OP_NONE) {
+            if (node->opcode && node->opcode[0]) return -1;
+            continue;
+        }
+        if (node->no_optimize || n == max) return -1;
+        nodes[n++] = i;
+    }
+    return n;
+}
+
+/**
+ * @brief Find the last write of a register before a loop
+ *
+ * Scans back through the block that falls into the loop; a label or a
+ * flow instruction on the way ends the search.
+ *
+ * @param prog Program owning the nodes
+ * @param from Last node before the loop
+ * @param stop First node of the block
+ * @param reg RF_* register
+ * @return Index of the immediate load that sets it, or -1
+ */
+static int find_immediate_load(const Program *prog, int from, int stop, unsigned int reg) {
+    for (int i = from; i >= stop; i--) {
+        const AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i)) continue;
+        bool labeled = node->label && node->label[0];
+        if (node->op == OP_NONE) {
+            if (labeled || (node->opcode && node->opcode[0])) return -1;
+            continue;
+        }
+        if (opcode_writes(node->op, node->mode) & reg) {
+            Opcode load = reg == RF_A ? OP_LDA : reg == RF_X ? OP_LDX : OP_LDY;
+            return node->op == load && node->mode == AM_IMMEDIATE ? i : -1;
+        }
+        if (labeled || opcode_info(node->op)->flow != FLOW_NONE) return -1;
+    }
+    return -1;
+}
+
+/**
+ * @brief Work out the trips of a counted loop and the index range it visits
+ *
+ * @param first Counter value in the first iteration
+ * @param delta Counter change per iteration (+1 or -1)
+ * @param branch BNE or BPL
+ * @param limit CPX/CPY immediate, or -1 without a compare
+ * @param job Receives count and final
+ * @param lo Receives the lowest index visited
+ * @param last Receives the index of the last iteration
+ * @return false if the index wraps or the count is not known
+ */
+static bool loop_range(int first, int delta, Opcode branch, int limit, DmaJob *job, int *lo,
+                       int *last) {
+    int trips;
+    if (limit >= 0) {
+        if (branch != OP_BNE) return false;
+        trips = (delta > 0 ? limit - first : first - limit) & 0xFF;
+        if (trips == 0) trips = 256;
+        job->final = limit;
+    } else if (branch == OP_BNE) {
+        trips = delta < 0 ? (first ? first : 256) : 256 - first;
+        job->final = 0;
+    } else {
+        if (first > 0x7F) return false;
+        trips = delta < 0 ? first + 1 : 0x80 - first;
+        job->final = delta < 0 ? 0xFF : 0x80;
+    }
+
+    *last = first + delta * (trips - 1);
+    *lo = delta > 0 ? first : *last;
+    if (*lo < 0 || *lo + trips - 1 > 0xFF) return false;
+    job->count = trips;
+    return true;
+}
+
+/**
+ * @brief Recognize a counted copy or fill loop
+ *
+ * The block must be a natural loop of its own, entered only by falling
+ * in from the block before it, with a header label only its branch
+ * refers to.
+ *
+ * @param prog Program owning the nodes
+ * @param b Loop block
+ * @param job Receives the job
+ * @param loop_cost Receives the cycles and bytes of the loop
+ * @return true if the loop moves one range of bytes
+ */
+static bool recognize_loop(const Program *prog, int b, DmaJob *job, CostTotal *loop_cost) {
+    const Cfg *cfg = prog->cfg;
+    const BasicBlock *block = &cfg->blocks[b];
+    if (b == 0 || block->unknown_entry || block->is_data || block->pred_count != 2) return false;
+    for (int p = 0; p < block->pred_count; p++) {
+        int pred = cfg->preds[block->pred_start + p];
+        if (pred != b && pred != b - 1) return false;
+    }
+
+    const AstNode *head = &prog->nodes[block->start];
+    if (!head->label || !head->label[0]) return false;
+    const CfgLabel *label = cfg_find_label(cfg, head->label, strlen(head->label), block->start);
+    if (!label || label->node != block->start || label->refs != 1 || label->called ||
+        label->address_taken || label->ambiguous) {
+        return false;
+    }
+
+    int nodes[5];
+    int n = block_instructions(prog, block, nodes, 5);
+    if (n < 3) return false;
+    const AstNode *br = &prog->nodes[nodes[n - 1]];
+    if ((br->op != OP_BNE && br->op != OP_BPL) || !br->operand ||
+        cfg_find_label(cfg, br->operand, strlen(br->operand), nodes[n - 1]) != label) {
+        return false;
+    }
+
+    // Optional compare, then the step
+    int limit = -1;
+    int step = n - 2;
+    const AstNode *cmp = &prog->nodes[nodes[step]];
+    if ((cmp->op == OP_CPX || cmp->op == OP_CPY) && cmp->mode == AM_IMMEDIATE) {
+        limit = parse_immediate_value(cmp->operand);
+        if (limit < 0) return false;
+        step--;
+    }
+    Opcode op = prog->nodes[nodes[step]].op;
+    int delta = op == OP_INX || op == OP_INY ? 1 : -1;
+    unsigned int counter = op == OP_INX || op == OP_DEX ? RF_X : op == OP_INY || op == OP_DEY ? RF_Y : 0;
+    if (!counter || (limit >= 0 && (cmp->op == OP_CPX) != (counter == RF_X)) || step < 1 || step > 2) {
+        return false;
+    }
+    AddrMode indexed = counter == RF_X ? AM_ABSOLUTE_X : AM_ABSOLUTE_Y;
+
+    // Body: LDA src,i / STA dst,i, or STA dst,i
+    const AstNode *store = &prog->nodes[nodes[step - 1]];
+    const AstNode *load = step == 2 ? &prog->nodes[nodes[0]] : NULL;
+    if (store->op != OP_STA || store->mode != indexed) return false;
+    if (load && (load->op != OP_LDA || load->mode != indexed)) return false;
+
+    int start = cfg->blocks[b - 1].start;
+    int counter_node = find_immediate_load(prog, block->start - 1, start, counter);
+    if (counter_node < 0) return false;
+    int first = parse_immediate_value(prog->nodes[counter_node].operand);
+    int lo, last;
+    if (first < 0 || !loop_range(first, delta, br->op, limit, job, &lo, &last)) return false;
+
+    SplitOperand src, dst;
+    if (!split_operand(store->operand, &dst) || !dma_range(&dst, lo, job->count) ||
+        !address_text(&dst, lo, job->dst, sizeof(job->dst))) {
+        return false;
+    }
+    if (load) {
+        if (!split_operand(load->operand, &src) || !dma_range(&src, lo, job->count) ||
+            !distinct_ranges(&src, lo, &dst, lo, job->count) ||
+            !address_text(&src, lo, job->src, sizeof(job->src)) ||
+            !address_text(&src, last, job->restore, sizeof(job->restore))) {
+            return false;
+        }
+    } else {
+        int value = find_immediate_load(prog, block->start - 1, start, RF_A);
+        if (value < 0) return false;
+        const char *text = prog->nodes[value].operand;
+        if (strlen(text) >= sizeof(job->src)) return false;
+        snprintf(job->src, sizeof(job->src), "%s", text + 1);
+        snprintf(job->restore, sizeof(job->restore), "%s", text);
+    }
+
+    job->first = block->start;
+    job->last = nodes[n - 1];
+    job->loop = true;
+    job->fill = load == NULL;
+    job->load = OP_LDA;
+    job->counter_load = counter == RF_X ? OP_LDX : OP_LDY;
+    job->compare = limit >= 0;
+
+    // Every iteration runs the whole body; all but the last take the branch
+    CostTotal body = {0, 0};
+    for (int k = 0; k < n; k++) cost_add_node(&body, prog, nodes[k]);
+    InstrCost branch = node_cost(prog, nodes[n - 1]);
+    loop_cost->cycles = (long)job->count * body.cycles + (long)(job->count - 1) * branch.branch_taken;
+    loop_cost->bytes = body.bytes;
+    return true;
+}
+
+/**
+ * @brief Recognize a straight run of byte copies or stores
+ *
+ * @param prog Program owning the nodes
+ * @param first Node of the first load
+ * @param end One past the last node of the block
+ * @param job Receives the job
+ * @param run_cost Receives the cycles and bytes of the run
+ * @return true if the run moves at least two consecutive bytes
+ */
+static bool recognize_run(const Program *prog, int first, int end, DmaJob *job, CostTotal *run_cost) {
+    const AstNode *load = &prog->nodes[first];
+    Opcode store = store_of(load->op);
+    if (store == OP_NONE || load->no_optimize || !load->operand) return false;
+    bool fill = load->mode == AM_IMMEDIATE;
+    if (!fill && load->mode != AM_ABSOLUTE) return false;
+
+    // A copy alternates stores and loads, a fill only stores
+    const char *dst_base = NULL;
+    CostTotal total = {0, 0};
+    cost_add_node(&total, prog, first);
+    int count = 0, last = -1;
+    bool want_load = false;
+    for (int i = first + 1; i < end && count < DMA_MAX_RUN; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i)) continue;
+        if ((node->label && node->label[0]) || node->no_optimize) break;
+        if (node->op == OP_NONE) {
+            if (node->opcode && node->opcode[0]) break;
+            continue;
+        }
+        if (!node->operand || node->mode != AM_ABSOLUTE) break;
+
+        if (want_load) {
+            if (node->op != load->op || !operand_at_offset(load->operand, node->operand, count)) break;
+        } else {
+            if (node->op != store) break;
+            if (count == 0) dst_base = node->operand;
+            else if (!operand_at_offset(dst_base, node->operand, count)) break;
+        }
+        cost_add_node(&total, prog, i);
+        if (!want_load) {
+            count++;
+            last = i;
+            *run_cost = total;
+        }
+        if (!fill) want_load = !want_load;
+    }
+    if (count < 2) return false;
+
+    SplitOperand src, dst;
+    if (!split_operand(dst_base, &dst) || !dma_range(&dst, 0, count) ||
+        !address_text(&dst, 0, job->dst, sizeof(job->dst))) {
+        return false;
+    }
+    if (fill) {
+        if (strlen(load->operand) >= sizeof(job->src)) return false;
+        snprintf(job->src, sizeof(job->src), "%s", load->operand + 1);
+        snprintf(job->restore, sizeof(job->restore), "%s", load->operand);
+    } else if (!split_operand(load->operand, &src) || !dma_range(&src, 0, count) ||
+               !distinct_ranges(&src, 0, &dst, 0, count) ||
+               !address_text(&src, 0, job->src, sizeof(job->src)) ||
+               !address_text(&src, count - 1, job->restore, sizeof(job->restore))) {
+        return false;
+    }
+
+    job->first = first;
+    job->last = last;
+    job->loop = false;
+    job->fill = fill;
+    job->count = count;
+    job->load = load->op;
+    job->counter_load = OP_NONE;
+    job->compare = false;
+    return true;
+}
+
+/**
+ * @brief Cost of the code replacing a block copy or fill
+ *
+ * Covers the trigger, the loads after it, the job list and the time the
+ * DMA controller takes.
+ *
+ * @param prog Program being optimized
+ * @param job Job
+ * @return Cycles and bytes
+ */
+static CostTotal job_cost(const Program *prog, const DmaJob *job) {
+    CpuType cpu = prog->cpu_type;
+    Opcode store = store_of(job->load);
+    CostTotal cost = {0, DMA_LIST_BYTES};
+
+    // Trigger: two immediate loads of the list address, one of zero
+    for (int k = 0; k < 3; k++) cost_add(&cost, instruction_cost(job->load, AM_IMMEDIATE, cpu));
+    for (int k = 0; k < 4; k++) cost_add(&cost, instruction_cost(store, AM_ABSOLUTE, cpu));
+
+    cost_add(&cost, instruction_cost(job->load, job->fill ? AM_IMMEDIATE : AM_ABSOLUTE, cpu));
+    if (job->loop) {
+        cost_add(&cost, instruction_cost(job->counter_load, AM_IMMEDIATE, cpu));
+        if (job->compare) {
+            Opcode cmp = job->counter_load == OP_LDX ? OP_CPX : OP_CPY;
+            cost_add(&cost, instruction_cost(cmp, AM_IMMEDIATE, cpu));
+        }
+    }
+    cost.cycles += DMA_JOB_CYCLES + (long)job->count * (job->fill ? DMA_FILL_CYCLES : DMA_COPY_CYCLES);
+    return cost;
+}
+
+/**
+ * @brief Check that branches reach once a job is in place
+ *
+ * The trigger replaces the job's code and the list goes in front of
+ * its place; no short branch across either may end up out of range.
+ *
+ * @param prog Program being optimized
+ * @param job Job, with its place
+ * @param cost Cost of the job (see job_cost())
+ * @param growth Insertions of the jobs already chosen, two per job;
+ *        entries 2 * count and 2 * count + 1 receive this job's
+ * @param count Number of chosen jobs
+ * @return true if every branch across the insertions stays in range
+ */
+static bool job_fits(const Program *prog, const DmaJob *job, CostTotal cost, CodeGrowth *growth,
+                     int count) {
+    CostTotal replaced = {0, 0};
+    for (int i = job->first; i <= job->last; i++) {
+        if (!node_is_dead(prog, i) && prog->nodes[i].op != OP_NONE) cost_add_node(&replaced, prog, i);
+    }
+
+    CodeGrowth *trigger = &growth[2 * count];
+    CodeGrowth *list = &growth[2 * count + 1];
+    trigger->index = job->last;
+    trigger->bytes = cost.bytes - DMA_LIST_BYTES - replaced.bytes;
+    list->index = job->place - 1;
+    list->bytes = DMA_LIST_BYTES;
+    return growth_fits(prog, trigger, growth, 2 * count) && growth_fits(prog, list, growth, 2 * count + 1);
+}
+
+/**
+ * @brief Fill in a new instruction node
+ *
+ * @param prog Program owning the arena
+ * @param node Node to fill in
+ * @param like Node whose mnemonic case and line number the new one takes
+ * @param op Opcode
+ * @param operand Operand text (copied into the arena)
+ */
+static void make_instruction(Program *prog, AstNode *node, const AstNode *like, Opcode op,
+                             const char *operand) {
+    init_ast_node(node, NODE_ASM_LINE, like->line_num);
+    node->opcode = like->opcode;
+    node->operand = arena_strdup(prog->arena, operand);
+    set_node_opcode(prog->arena, node, op);
+    node->rewritten = true;
+}
+
+/**
+ * @brief Fill in a new data directive node
+ *
+ * @param prog Program owning the arena
+ * @param node Node to fill in
+ * @param like Node whose line number the new one takes
+ * @param directive Directive mnemonic
+ * @param operand Operand text (copied into the arena)
+ */
+static void make_directive(Program *prog, AstNode *node, const AstNode *like, const char *directive,
+                           const char *operand) {
+    init_ast_node(node, NODE_ASM_LINE, like->line_num);
+    node->opcode = (char *)directive;
+    node->operand = arena_strdup(prog->arena, operand);
+    node->rewritten = true;
+}
+
+/**
+ * @brief Build the trigger and the register reloads of a job
+ *
+ * The trigger stays exactly as written (no_optimize): it writes the
+ * list address with the low byte, which starts the job, last.
+ *
+ * @param prog Program being optimized
+ * @param job Job
+ * @param name Job list label
+ * @param out Receives the nodes
+ * @return Number of nodes stored
+ */
+static int build_trigger(Program *prog, const DmaJob *job, const char *name, AstNode *out) {
+    const AstNode *like = &prog->nodes[job->last];
+    Opcode store = store_of(job->load);
+    char text[DMA_TEXT_SIZE + 8];
+    int n = 0;
+
+    make_instruction(prog, &out[n++], like, job->load, "#$00");
+    make_instruction(prog, &out[n++], like, store, "$D702");
+    make_instruction(prog, &out[n++], like, store, "$D704");
+    snprintf(text, sizeof(text), "#>%s", name);
+    make_instruction(prog, &out[n++], like, job->load, text);
+    make_instruction(prog, &out[n++], like, store, "$D701");
+    snprintf(text, sizeof(text), "#<%s", name);
+    make_instruction(prog, &out[n++], like, job->load, text);
+    make_instruction(prog, &out[n++], like, store, "$D705");
+    for (int k = 0; k < n; k++) out[k].no_optimize = true;
+
+    snprintf(text, sizeof(text), "%s DMA %s, %d bytes", prog->config.comment_char,
+             job->fill ? "fill" : "copy", job->count);
+    out[0].comment = arena_strdup(prog->arena, text);
+
+    make_instruction(prog, &out[n++], like, job->load, job->restore);
+    if (job->loop) {
+        snprintf(text, sizeof(text), "#$%02X", job->final);
+        make_instruction(prog, &out[n++], like, job->counter_load, text);
+        if (job->compare) {
+            make_instruction(prog, &out[n++], like, job->counter_load == OP_LDX ? OP_CPX : OP_CPY, text);
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Build the job list of a job
+ *
+ * Enhanced job options select the F018B list format and megabyte 0 for
+ * the source and destination; the list follows.
+ *
+ * @param prog Program being optimized
+ * @param job Job
+ * @param name Job list label
+ * @param out Receives the nodes
+ * @return Number of nodes stored
+ */
+static int build_list(Program *prog, const DmaJob *job, const char *name, AstNode *out) {
+    const AstNode *like = &prog->nodes[job->last];
+    const char *byte = prog->config.byte_directive;
+    const char *word = prog->config.word_directive;
+    char text[2 * DMA_TEXT_SIZE + 16];
+    int n = 0;
+
+    snprintf(text, sizeof(text), "$0B, $80, $00, $81, $00, $00, $%02X", job->fill ? 0x03 : 0x00);
+    make_directive(prog, &out[n], like, byte, text);
+    out[n].type = NODE_LABEL;
+    out[n++].label = arena_strdup(prog->arena, name);
+    snprintf(text, sizeof(text), "$%04X, %s", job->count & 0xFFFF, job->src);
+    make_directive(prog, &out[n++], like, word, text);
+    make_directive(prog, &out[n++], like, byte, "$00");
+    make_directive(prog, &out[n++], like, word, job->dst);
+    make_directive(prog, &out[n++], like, byte, "$00, $00");
+    make_directive(prog, &out[n++], like, word, "$0000");
+    return n;
+}
+
+/**
+ * @brief Remove the instructions a job replaces
+ *
+ * A label on a replaced straight run stays, on a line of its own; a loop
+ * label goes with its loop, since only the loop's branch used it.
+ * Comment lines stay.
+ *
+ * @param prog Program being optimized
+ * @param job Job
+ * @param new_pos New index of each node, by the index the job was found at
+ */
+static void remove_replaced(Program *prog, const DmaJob *job, const int *new_pos) {
+    for (int k = job->first; k <= job->last; k++) {
+        int i = new_pos[k];
+        AstNode *node = &prog->nodes[i];
+        bool labeled = node->label && node->label[0];
+        if (node_is_dead(prog, i) || (node->op == OP_NONE && !(job->loop && labeled))) continue;
+        if (!job->loop && labeled) {
+            note_node_removed(prog, i);
+            node->op = OP_NONE;
+            node->mode = AM_NONE;
+            node->opcode = NULL;
+            node->operand = NULL;
+            note_node_changed(prog, i);
+        } else {
+            mark_node_dead(prog, i);
+        }
+    }
+}
+
+/**
+ * @brief Rebuild the node array with the jobs in place
+ *
+ * Each job's trigger goes after its last replaced node and its list in
+ * front of its place. Jobs are in source order, and so are their places.
+ * The replaced instructions are removed, and the savings recorded, only
+ * once the new array is in place.
+ *
+ * @param prog Program to rebuild
+ * @param jobs Jobs
+ * @param savings Cycles and bytes each job saves
+ * @param count Number of jobs
+ * @param names Job list label of each job
+ * @return false on allocation failure (prog is unchanged)
+ */
+static bool insert_jobs(Program *prog, const DmaJob *jobs, const CostTotal *savings, int count,
+                        char (*names)[24]) {
+    size_t copies = (size_t)count * DMA_JOB_NODES;
+    AstNode *added = malloc((copies > 0 ? copies : 1) * sizeof(AstNode));
+    int *order = malloc(((size_t)prog->count + copies) * sizeof(int));
+    int *new_pos = malloc((prog->count > 0 ? (size_t)prog->count : 1) * sizeof(int));
+    if (!added || !order || !new_pos) {
+        free(added);
+        free(order);
+        free(new_pos);
+        return false;
+    }
+
+    int n = 0, a = 0, trigger = 0, list = 0;
+    for (int i = 0; i < prog->count; i++) {
+        for (; list < count && jobs[list].place == i; list++) {
+            int built = build_list(prog, &jobs[list], names[list], &added[a]);
+            for (int k = 0; k < built; k++) order[n++] = -1 - a++;
+        }
+
+        new_pos[i] = n;
+        order[n++] = i;
+
+        for (; trigger < count && jobs[trigger].last == i; trigger++) {
+            int built = build_trigger(prog, &jobs[trigger], names[trigger], &added[a]);
+            for (int k = 0; k < built; k++) order[n++] = -1 - a++;
+        }
+    }
+
+    bool rebuilt = program_rebuild_nodes(prog, order, n, added);
+    for (int j = 0; rebuilt && j < count; j++) {
+        // Removal counts the static cost of the replaced nodes; the rest
+        // of the savings is the time the loop no longer runs
+        CostTotal removed = {0, 0};
+        for (int k = jobs[j].first; k <= jobs[j].last; k++) {
+            int i = new_pos[k];
+            if (!node_is_dead(prog, i) && prog->nodes[i].op != OP_NONE) cost_add_node(&removed, prog, i);
+        }
+        remove_replaced(prog, &jobs[j], new_pos);
+        stats_note_change(prog->stats, 0, 1, savings[j].cycles - removed.cycles,
+                          savings[j].bytes - removed.bytes);
+        count_optimization(prog, jobs[j].loop ? "dma.loop" : "dma.run");
+    }
+    free(added);
+    free(order);
+    free(new_pos);
+    return rebuilt;
+}
+
+/**
+ * @brief Lowest job list number not used by a label already
+ *
+ * @param prog Program owning the nodes
+ * @return Number for the first job list label
+ */
+static int first_job_number(const Program *prog) {
+    int next = 1;
+    for (int i = 0; i < prog->count; i++) {
+        const char *label = prog->nodes[i].label;
+        int k;
+        char end;
+        if (label && sscanf(label, "dma_job_%d%c", &k, &end) == 1 && k >= next) next = k + 1;
+    }
+    return next;
+}
+
+/**
+ * @brief Replace block copies and fills with DMA jobs (45GS02, -dma)
+ *
+ * 1. Recognizes counted copy and fill loops among the single-block
+ *    natural loops, and straight runs of byte copies and stores
+ * 2. Keeps those in code optimized for speed (see mode_at()) that the
+ *    cost model says the DMA job is faster for, that have a place for
+ *    their job list and whose trigger and list leave every short branch
+ *    in range
+ * 3. Rebuilds the node array with the triggers and job lists
+ *
+ * The control flow graph and register side table are dropped when
+ * nodes are inserted; the caller rebuilds the graph.
+ *
+ * @param prog Program to optimize (prog->cfg must be built)
+ */
+void optimize_dma_jobs_ast(Program *prog) {
+    const Cfg *cfg = prog->cfg;
+    if (!cfg || !prog->is_45gs02 || !prog->dma_jobs || (prog->mode != OPT_SPEED && !prog->profile)) {
+        return;
+    }
+
+    bool *is_loop = calloc(cfg->block_count > 0 ? cfg->block_count : 1, sizeof(bool));
+    CfgLoops *natural = find_natural_loops(cfg);
+    if (!is_loop || !natural) {
+        free(is_loop);
+        free_natural_loops(natural);
+        return;
+    }
+    for (int l = 0; l < natural->count; l++) {
+        if (natural->loops[l].header == natural->loops[l].latch) {
+            is_loop[natural->loops[l].header] = true;
+        }
+    }
+    free_natural_loops(natural);
+
+    int capacity = 16, count = 0;
+    DmaJob *jobs = malloc(capacity * sizeof(DmaJob));
+    CostTotal *savings = malloc(capacity * sizeof(CostTotal));
+    CodeGrowth *growth = malloc(2 * capacity * sizeof(CodeGrowth));
+    for (int b = 0; jobs && savings && growth && b < cfg->block_count; b++) {
+        const BasicBlock *block = &cfg->blocks[b];
+        if (block->is_data) continue;
+
+        for (int i = block->start; i < block->end; i++) {
+            if (count == capacity) {
+                capacity *= 2;
+                DmaJob *grown = realloc(jobs, capacity * sizeof(DmaJob));
+                CostTotal *grown_savings = grown ? realloc(savings, capacity * sizeof(CostTotal)) : NULL;
+                CodeGrowth *grown_growth =
+                    grown_savings ? realloc(growth, 2 * capacity * sizeof(CodeGrowth)) : NULL;
+                if (grown) jobs = grown;
+                if (grown_savings) savings = grown_savings;
+                if (grown_growth) growth = grown_growth;
+                if (!grown || !grown_savings || !grown_growth) break;
+            }
+
+            DmaJob *job = &jobs[count];
+            CostTotal before;
+            bool found = i == block->start && is_loop[b]
+                ? recognize_loop(prog, b, job, &before)
+                : (!node_is_dead(prog, i) && recognize_run(prog, i, block->end, job, &before));
+            if (!found) {
+                if (i == block->start && is_loop[b]) break;
+                continue;
+            }
+
+            CostTotal after = job_cost(prog, job);
+            job->place = find_list_place(prog, job->last);
+            if (job->place >= 0 && mode_at(prog, job->first, job->last + 1) == OPT_SPEED &&
+                cost_is_better_for(OPT_SPEED, before, after) && job_fits(prog, job, after, growth, count)) {
+                savings[count].cycles = before.cycles - after.cycles;
+                savings[count].bytes = before.bytes - after.bytes;
+                count++;
+                i = job->last;
+            }
+            if (job->loop) break;
+        }
+    }
+    free(is_loop);
+
+    char (*names)[24] = count > 0 ? malloc(count * sizeof(*names)) : NULL;
+    if (names) {
+        int number = first_job_number(prog);
+        for (int j = 0; j < count; j++) snprintf(names[j], sizeof(names[j]), "dma_job_%d", number + j);
+        if (insert_jobs(prog, jobs, savings, count, names)) {
+            free_cfg(prog->cfg);
+            prog->cfg = NULL;
+            free_register_states(prog);
+            if (prog->trace_level > 1) {
+                program_log(prog, "DEBUG dma: %d block copies and fills replaced by DMA jobs\n", count);
+            }
+        }
+    }
+
+    free(names);
+    free(jobs);
+    free(savings);
+    free(growth);
+}
@@ -9,35 +9,63 @@
 #include <string.h>
 
 /**
- * @brief Jump optimization - remove jumps to next instruction
+ * @brief Check whether a label is defined right after a node
  *
- * Detects and removes unnecessary JMP instructions that jump to
- * the immediately following instruction (a branch target).
+ * Looks through the labels between the node and the next instruction or
+ * directive, skipping blank lines, comments and removed nodes.
+ *
+ * @param prog Program owning the nodes
+ * @param index Node index
+ * @param target Label to look for
+ * @return true if execution falling through from the node reaches target
+ */
+static bool label_follows(const Program *prog, int index, const char *target) {
+    for (int i = index + 1; i < prog->count; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i)) continue;
+        if (node->label && node->label[0] && strcmp(node->label, target) == 0) return true;
+        if (node->op != OP_NONE || (node->opcode && node->opcode[0])) return false;
+    }
+    return false;
+}
+
+/**
+ * @brief Jump optimization - remove jumps and branches to the next instruction
+ *
+ * Detects and removes JMP, BRA and branch instructions whose target is
+ * the label of the immediately following instruction.
  *
  * Pattern:
- *   JMP label
+ *   JMP label     (or BNE label, ...)
  * label:        <- next instruction is the target
  *
- * The JMP can be removed as execution will naturally fall through.
+ * The jump can be removed as execution will naturally fall through;
+ * a branch only reads the flags, so it goes too.
  *
  * @param prog Program to optimize
+ * @param start First node index to examine
+ * @param end One past the last node index to examine
  */
-void optimize_jumps_ast(Program *prog) {
-    AstNode *node = prog->root;
-    while (node) {
-        if (node->is_dead || node->no_optimize) {
-            node = node->next;
+void optimize_jumps_ast(Program *prog, int start, int end) {
+    for (int i = start; i < end; i++) {
+        AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i) || node->no_optimize || !node->operand) continue;
+
+        // JMP/BRA to next line (remove)
+        bool jump = ((node->op == OP_JMP || node->op == OP_JML) &&
+                     (node->mode == AM_ABSOLUTE || node->mode == AM_LONG)) ||
+                    node->op == OP_BRA || node->op == OP_BRL;
+        if (jump && label_follows(prog, i, node->operand)) {
+            mark_node_dead(prog, i);
+            count_optimization(prog, "jumps.jump_to_next");
             continue;
         }
 
-        // JMP to next line (remove)
-        if (node->opcode && strcmp(node->opcode, "JMP") == 0 && node->next) {
-            if (node->next->is_branch_target) {
-                node->is_dead = true;
-                prog->optimizations++;
-            }
+        // Branch to next line (remove)
+        if (opcode_info(node->op)->flow == FLOW_BRANCH && node->mode == AM_RELATIVE &&
+            label_follows(prog, i, node->operand)) {
+            mark_node_dead(prog, i);
+            count_optimization(prog, "jumps.branch_to_next");
         }
-
-        node = node->next;
     }
 }
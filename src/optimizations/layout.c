@@ -0,0 +1,447 @@
+/**
+ * @file layout.c
+ * @brief Branch-aware code layout
+ *
+ * Three control flow rewrites that shorten the taken paths of the
+ * program without changing what it computes:
+ *
+ * - Jump threading: a JMP or branch whose target starts with another
+ *   JMP goes straight to that JMP's target.
+ * - Branch inversion: a conditional branch over a JMP becomes the
+ *   opposite branch to the JMP's target.
+ *
+ *     BCC skip                  BCS far
+ *     JMP far        becomes  skip:
+ *   skip:
+ *
+ * - Fall-through ordering: a block entered only by one JMP is moved
+ *   right after that JMP, which then goes away.
+ *
+ *     JMP done                  LDA #$00
+ *     ...            becomes    RTS
+ *   done:                       ...
+ *     LDA #$00
+ *     RTS
+ *
+ * Branches must stay within their -128..127 byte reach, which is
+ * checked from the instruction sizes of the cost model; where a
+ * directive of unknown size is in the way, nothing is rewritten.
+ *
+ * Moving blocks changes the node order, so fall-through ordering runs
+ * once, before the control flow graph the other passes use is rebuilt.
+ * Threading and inversion only retarget or remove nodes and run over
+ * the whole program after every round.
+ */
+
+#include "optimizer.h"
+#include "../analysis/cfg.h"
+#include "../analysis/cost.h"
+#include "../analysis/registers.h"
+#include "../program/stats.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LAYOUT_MAX_HOPS 8       /**< Most JMPs one jump is threaded through */
+#define LAYOUT_MAX_RUN 64       /**< Most nodes in a moved block */
+
+/**
+ * @brief Find the label a node's operand names
+ *
+ * @param prog Program owning the node
+ * @param index Node index
+ * @return Label, or NULL if the operand is not a plain label
+ */
+static const CfgLabel* operand_label(const Program *prog, int index) {
+    const char *operand = prog->nodes[index].operand;
+    if (!operand || !operand[0]) return NULL;
+    return cfg_find_label(prog->cfg, operand, strlen(operand), index);
+}
+
+/**
+ * @brief Check for an assembler directive
+ * @param node Node to check
+ * @return true if the node has a directive, whose size is unknown
+ */
+static bool is_directive(const AstNode *node) {
+    return node->op == OP_NONE && node->opcode && node->opcode[0];
+}
+
+/**
+ * @brief Check for an unconditional absolute JMP
+ * @param node Node to check
+ * @return true for JMP label
+ */
+static bool is_plain_jump(const AstNode *node) {
+    return node->op == OP_JMP && node->mode == AM_ABSOLUTE && !node->no_optimize;
+}
+
+/**
+ * @brief Check for a branch with an 8-bit displacement
+ * @param node Node to check
+ * @return true for Bcc and BRA
+ */
+static bool is_short_branch(const AstNode *node) {
+    return node->mode == AM_RELATIVE &&
+           (opcode_info(node->op)->flow == FLOW_BRANCH || node->op == OP_BRA);
+}
+
+/**
+ * @brief Opposite of a conditional branch
+ * @param op Branch opcode
+ * @return Branch taken exactly when op is not, or OP_NONE
+ */
+static Opcode inverse_branch(Opcode op) {
+    switch (op) {
+        case OP_BCC: return OP_BCS;
+        case OP_BCS: return OP_BCC;
+        case OP_BEQ: return OP_BNE;
+        case OP_BNE: return OP_BEQ;
+        case OP_BMI: return OP_BPL;
+        case OP_BPL: return OP_BMI;
+        case OP_BVC: return OP_BVS;
+        case OP_BVS: return OP_BVC;
+        default:     return OP_NONE;
+    }
+}
+
+/**
+ * @brief Find the first live instruction at or after a label
+ *
+ * @param prog Program owning the nodes
+ * @param index Label node index
+ * @return Instruction node index, or -1 if a directive comes first
+ */
+static int first_instruction(const Program *prog, int index) {
+    for (int i = index; i < prog->count; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i)) continue;
+        if (node->op != OP_NONE) return i;
+        if (is_directive(node)) return -1;
+    }
+    return -1;
+}
+
+/**
+ * @brief Follow the chain of JMPs a jump or branch lands on
+ *
+ * @param prog Program owning the nodes (prog->cfg must be built)
+ * @param index Jump or branch node index
+ * @param saved Receives the cycles of the JMPs skipped
+ * @return Label of the first target that is not a JMP, or NULL if the
+ *         jump does not land on a JMP, the chain loops or the final
+ *         label is not visible from the jump
+ */
+static const CfgLabel* thread_target(const Program *prog, int index, int *saved) {
+    const CfgLabel *start = operand_label(prog, index);
+    const CfgLabel *label = start;
+    *saved = 0;
+
+    for (int hop = 0; label; hop++) {
+        int k = first_instruction(prog, label->node);
+        if (k < 0 || k == index || !is_plain_jump(&prog->nodes[k])) break;
+        if (hop == LAYOUT_MAX_HOPS) return NULL;
+
+        const CfgLabel *next = operand_label(prog, k);
+        if (!next || next == start || next == label) return NULL;
+        *saved += node_cost(prog, k).cycles;
+        label = next;
+    }
+
+    if (label == start || !label) return NULL;
+    if (cfg_find_label(prog->cfg, label->name, strlen(label->name), index) != label) return NULL;
+    return label;
+}
+
+/**
+ * @brief Find the JMP a conditional branch skips over
+ *
+ * @param prog Program owning the nodes
+ * @param index Branch node index
+ * @return JMP node index, or -1 unless the next instruction is an
+ *         unlabeled JMP and the branch target follows it directly
+ */
+static int skipped_jump(const Program *prog, int index) {
+    const CfgLabel *skip = operand_label(prog, index);
+    if (!skip || skip->node <= index) return -1;
+
+    int jump = -1;
+    for (int i = index + 1; i < skip->node; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i)) continue;
+        if (node->op == OP_NONE) {
+            if (is_directive(node) || (node->label && node->label[0])) return -1;
+            continue;
+        }
+        if (jump >= 0 || !is_plain_jump(node) || (node->label && node->label[0])) return -1;
+        jump = i;
+    }
+    if (jump < 0 || first_instruction(prog, skip->node) < 0) return -1;
+    return jump;
+}
+
+/**
+ * @brief Branch-aware layout: jump threading and branch inversion
+ *
+ * 1. Retargets a JMP, branch or BRA landing on a JMP to the end of the
+ *    chain, if a branch still reaches it
+ * 2. Rewrites a conditional branch over a JMP into the opposite branch
+ *    to the JMP's target, if the branch reaches it
+ *
+ * Threading a branch may make its taken path cross a page, but that
+ * costs one cycle where the skipped JMP cost three, so it still pays.
+ *
+ * @param prog Program to optimize (prog->cfg must be built)
+ */
+void optimize_branch_layout_ast(Program *prog) {
+    if (!prog->cfg) return;
+
+    for (int i = 0; i < prog->count; i++) {
+        AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i) || node->no_optimize || !node->operand) continue;
+        bool jump = is_plain_jump(node);
+        if (!jump && !is_short_branch(node)) continue;
+
+        // Jump threading
+        int saved;
+        const CfgLabel *final = thread_target(prog, i, &saved);
+        int offset;
+        if (final && (jump || (branch_offset(prog, i, final->node, &offset) &&
+                               offset >= -128 && offset <= 127))) {
+            if (prog->trace_level > 1) {
+                program_log(prog, "DEBUG layout: Threading %s %s at line %d to %s\n",
+                            node->opcode, node->operand, node->line_num, final->name);
+            }
+            node->operand = arena_strdup(prog->arena, final->name);
+            note_node_changed(prog, i);
+            stats_note_change(prog->stats, 0, 1, saved, 0);
+            count_optimization(prog, jump ? "layout.thread_jump" : "layout.thread_branch");
+            continue;
+        }
+
+        // Branch inversion over a JMP
+        Opcode inverse = inverse_branch(node->op);
+        if (jump || inverse == OP_NONE || node->mode != AM_RELATIVE) continue;
+        int j = skipped_jump(prog, i);
+        if (j < 0 || prog->nodes[j].no_optimize) continue;
+        const CfgLabel *far = operand_label(prog, j);
+        if (!far || cfg_find_label(prog->cfg, far->name, strlen(far->name), i) != far) continue;
+        if (!branch_offset(prog, i, far->node, &offset)) continue;
+        if (far->node > j) offset -= node_cost(prog, j).bytes;
+        if (offset < -128 || offset > 127) continue;
+
+        if (prog->trace_level > 1) {
+            program_log(prog, "DEBUG layout: Inverting %s over JMP %s at line %d\n",
+                        node->opcode, prog->nodes[j].operand, node->line_num);
+        }
+        node->operand = arena_strdup(prog->arena, far->name);
+        rewrite_node_opcode(prog, i, inverse);
+        mark_node_dead(prog, j);
+        count_optimization(prog, "layout.invert_branch");
+    }
+}
+
+/**
+ * @brief A block moved to the JMP that enters it
+ */
+typedef struct {
+    int jump;                   /**< The JMP (old node index) */
+    int first;                  /**< First node of the block */
+    int last;                   /**< Jump, return or stop ending the block */
+} BlockMove;
+
+/**
+ * @brief Check for local labels before the next global label
+ *
+ * @param prog Program owning the nodes
+ * @param from First node index to examine
+ * @return true if a local label would change scope were a global
+ *         label inserted before from
+ */
+static bool locals_follow(const Program *prog, int from) {
+    for (int i = from; i < prog->count; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (node->label && node->label[0]) return node->is_local_label;
+    }
+    return false;
+}
+
+/**
+ * @brief Find the block a JMP can pull in
+ *
+ * The block must start at a label only this JMP mentions, be entered
+ * from nowhere else, and be a straight run of instructions ending in a
+ * jump, return or stop, so that what precedes and follows it at
+ * either place is unaffected.
+ *
+ * @param prog Program owning the nodes (prog->cfg must be built)
+ * @param index JMP node index
+ * @param move Receives the move
+ * @return true if the block can be moved after the JMP
+ */
+static bool find_movable_block(const Program *prog, int index, BlockMove *move) {
+    const Cfg *cfg = prog->cfg;
+    const AstNode *jmp = &prog->nodes[index];
+    if (jmp->label && jmp->label[0]) return false;
+
+    const CfgLabel *label = operand_label(prog, index);
+    if (!label || label->refs != 1 || label->called || label->address_taken || label->ambiguous) {
+        return false;
+    }
+
+    int b = cfg->block_of[label->node];
+    const BasicBlock *block = &cfg->blocks[b];
+    if (block->start != label->node || block->unknown_entry || block->is_data ||
+        block->pred_count != 1 || cfg->preds[block->pred_start] != cfg->block_of[index] ||
+        b == cfg->block_of[index] + 1) {
+        return false;
+    }
+
+    int last = -1;
+    for (int i = label->node; i < prog->count && i - label->node < LAYOUT_MAX_RUN; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (node->no_optimize || is_directive(node)) return false;
+        if (i > label->node && node->label && node->label[0]) return false;
+        if (node_is_dead(prog, i) || node->op == OP_NONE) continue;
+
+        unsigned char flow = opcode_info(node->op)->flow;
+        if (flow == FLOW_BRANCH || node->mode == AM_RELATIVE || node->mode == AM_ZP_RELATIVE) {
+            return false;
+        }
+        if (flow == FLOW_JUMP || flow == FLOW_RETURN || flow == FLOW_STOP) {
+            last = i;
+            break;
+        }
+    }
+    if (last < 0 || (index >= label->node && index <= last)) return false;
+
+    // A global label takes the local labels after it along
+    if (!label->is_local) {
+        if (locals_follow(prog, index + 1) || locals_follow(prog, last + 1)) return false;
+    } else if (cfg->scope_of[label->node] != cfg->scope_of[index]) {
+        return false;
+    }
+
+    move->jump = index;
+    move->first = label->node;
+    move->last = last;
+    return true;
+}
+
+/**
+ * @brief Rebuild the node array with every moved block after its JMP
+ *
+ * @param prog Program to rebuild
+ * @param moves Moves, ordered by JMP
+ * @param count Number of moves
+ * @param new_pos Receives the new index of every old node
+ * @return false on allocation failure (prog is unchanged)
+ */
+static bool apply_moves(Program *prog, const BlockMove *moves, int count, int *new_pos) {
+    size_t alloc = prog->count > 0 ? (size_t)prog->count : 1;
+    int *order = malloc(alloc * sizeof(int));
+    int *move_at = malloc(alloc * sizeof(int));
+    if (!order || !move_at) {
+        free(order);
+        free(move_at);
+        return false;
+    }
+
+    // move_at: -1 in place, -2 inside a moved block, else the move a JMP starts
+    for (int i = 0; i < prog->count; i++) move_at[i] = -1;
+    for (int m = 0; m < count; m++) {
+        for (int i = moves[m].first; i <= moves[m].last; i++) move_at[i] = -2;
+        move_at[moves[m].jump] = m;
+    }
+
+    int n = 0;
+    for (int i = 0; i < prog->count; i++) {
+        if (move_at[i] == -2) continue;
+        int k = i;
+        int stop = move_at[i] >= 0 ? moves[move_at[i]].last : i;
+        while (true) {
+            new_pos[k] = n;
+            order[n++] = k;
+            if (k == stop) break;
+            k = k == i ? moves[move_at[i]].first : k + 1;
+        }
+    }
+
+    bool rebuilt = program_rebuild_nodes(prog, order, n, NULL);
+    free(move_at);
+    free(order);
+    return rebuilt;
+}
+
+/**
+ * @brief Fall-through ordering: move blocks after the JMP entering them
+ *
+ * 1. Finds every JMP whose target block is entered only by that JMP
+ *    and ends in an unconditional jump, return or stop
+ *    (see find_movable_block())
+ * 2. Keeps the moves whose growth at the insertion point leaves every
+ *    branch across it in range; moves checked against overlapping
+ *    branch windows are skipped
+ * 3. Moves the blocks and removes the JMPs
+ *
+ * The control flow graph and register side table are dropped when
+ * blocks are moved; the caller rebuilds the graph.
+ *
+ * @param prog Program to optimize (prog->cfg must be built)
+ */
+void optimize_block_order_ast(Program *prog) {
+    const Cfg *cfg = prog->cfg;
+    if (!cfg || prog->count == 0) return;
+
+    BlockMove *moves = malloc(prog->count * sizeof(BlockMove));
+    unsigned char *claimed = calloc(prog->count, 1);
+    int *new_pos = malloc(prog->count * sizeof(int));
+    int count = 0;
+    int window_end = -1;
+
+    for (int i = 0; moves && claimed && new_pos && i < prog->count; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i) || !is_plain_jump(node) || !node->operand || claimed[i]) continue;
+
+        BlockMove move;
+        if (!find_movable_block(prog, i, &move)) continue;
+        bool free_run = true;
+        for (int k = move.first; k <= move.last && free_run; k++) free_run = !claimed[k];
+        if (!free_run) continue;
+
+        int run_bytes;
+        if (!byte_span(prog, move.first, move.last + 1, &run_bytes)) continue;
+        int growth = run_bytes - node_cost(prog, i).bytes;
+        if (growth > 0) {
+            int lo, hi;
+            if (!branches_reach(prog, i, growth, &lo, &hi) || lo <= window_end) continue;
+            window_end = hi;
+        }
+
+        claimed[i] = 1;
+        for (int k = move.first; k <= move.last; k++) claimed[k] = 1;
+        moves[count++] = move;
+    }
+
+    if (count > 0 && apply_moves(prog, moves, count, new_pos)) {
+        free_cfg(prog->cfg);
+        prog->cfg = NULL;
+        free_register_states(prog);
+
+        for (int m = 0; m < count; m++) {
+            int jump = new_pos[moves[m].jump];
+            if (prog->trace_level > 1) {
+                program_log(prog, "DEBUG layout: Moved block %s after JMP at line %d\n",
+                            prog->nodes[new_pos[moves[m].first]].label, prog->nodes[jump].line_num);
+            }
+            mark_node_dead(prog, jump);
+            count_optimization(prog, "layout.fall_through");
+        }
+    }
+    if (prog->trace_level > 1) {
+        program_log(prog, "DEBUG layout: %d blocks moved to fall through\n", count);
+    }
+
+    free(moves);
+    free(claimed);
+    free(new_pos);
+}
@@ -2,72 +2,665 @@
  * @file optimizer.c
  * @brief Main optimization coordinator implementation
  *
- * Implements the main optimization loop that coordinates all optimization
- * passes. Runs passes iteratively until convergence (no more optimizations)
- * or a maximum iteration count is reached.
+ * Implements a worklist scheduler that coordinates all optimization
+ * passes. The basic blocks of the control flow graph are the unit of
+ * work: every block is optimized once, and afterwards only the blocks
+ * around a killed or rewritten node are queued again. Work therefore
+ * grows with the number of changes rather than with the number of
+ * passes times the program size, and there is no iteration cap.
  */
 
 #include "optimizer.h"
 #include "../analysis/analysis.h"
+#include "../analysis/cfg.h"
 #include "../analysis/registers.h"
+#include "../program/stats.h"
+#include "../program/parallel.h"
+#include "../analysis/cost.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Signature shared by all region-based optimization passes */
+typedef void (*RegionPassFn)(Program *prog, int start, int end);
+
+/** A region pass and the name it is timed and counted under (-stats) */
+typedef struct {
+    const char *name;
+    RegionPassFn run;
+} RegionPass;
+
+/**
+ * @brief Passes applied to each region, in order
+ *
+ * Dead code elimination must stay last so the other passes see the
+ * instructions it would remove.
+ */
+static const RegionPass region_passes[] = {
+    // Rule table (generic and CPU-specific patterns)
+    {"peephole", optimize_peephole_ast},
+
+    // Scanning CPU-specific optimizations
+    {"65c02", optimize_65c02_instructions_ast},
+    {"45gs02", optimize_45gs02_instructions_ast},
+
+    // Control flow
+    {"jumps", optimize_jumps_ast},
+
+    // Must be last
+    {"dead_code", optimize_dead_code_ast},
+};
+
+/** A whole-program pass and the name it is timed and counted under (-stats) */
+typedef struct {
+    const char *name;
+    void (*run)(Program *prog);
+} ProgramPass;
+
+/**
+ * @brief Dataflow passes applied to the whole program after each round
+ */
+static const ProgramPass program_passes[] = {
+    {"constant_propagation", optimize_constant_propagation_ast},
+    {"dead_store", optimize_dead_stores_ast},
+    {"65816", optimize_65816_instructions_ast},
+    {"45gs02_quad", optimize_45gs02_quads_ast},
+    {"superopt", optimize_superopt_ast},
+    {"layout", optimize_branch_layout_ast},
+};
+
+/**
+ * @brief Region worklist state
+ */
+typedef struct {
+    int *region_start;          /**< First node index of each region (+ sentinel) */
+    int *region_of;             /**< Region index of each node */
+    int region_count;           /**< Number of regions */
+    int *queue;                 /**< Circular FIFO of queued regions */
+    int head;                   /**< Next queue slot to pop */
+    int length;                 /**< Number of queued regions */
+    bool *queued;               /**< Whether each region is in the queue */
+} Worklist;
+
+/**
+ * @brief One routine optimized as a unit by the parallel scheduler
+ */
+typedef struct {
+    int start;                  /**< First node index */
+    int end;                    /**< One past the last node index */
+    bool pending;               /**< Needs another sweep */
+    int optimizations;          /**< Optimizations found by the last sweep */
+    int visits;                 /**< Region visits of the last sweep */
+    uint64_t *dead;             /**< Dead bits of the routine after the sweep
+                                     (bit 0 = start), NULL if not swept */
+} RoutineJob;
+
+/**
+ * @brief Shared state of one parallel sweep
+ */
+typedef struct {
+    Program *prog;              /**< Program being optimized */
+    RoutineJob **order;         /**< Pending routines, largest first */
+    Arena **arenas;             /**< Private string arena of every worker */
+    RunStats **stats;           /**< Private statistics of every worker, or NULL */
+} ParallelSweep;
+
+/**
+ * @brief Allocate the arrays of a worklist
+ *
+ * @param wl Worklist to set up
+ * @param n Number of nodes it covers
+ * @return false on allocation failure (wl is freed)
+ */
+static bool worklist_init(Worklist *wl, int n) {
+    int alloc = n > 0 ? n : 1;
+    wl->region_start = malloc((n + 1) * sizeof(int));
+    wl->region_of = malloc(alloc * sizeof(int));
+    wl->queue = malloc(alloc * sizeof(int));
+    wl->queued = calloc(alloc, sizeof(bool));
+    wl->region_count = 0;
+    wl->head = 0;
+    wl->length = 0;
+    if (wl->region_start && wl->region_of && wl->queue && wl->queued) return true;
+
+    free(wl->region_start);
+    free(wl->region_of);
+    free(wl->queue);
+    free(wl->queued);
+    return false;
+}
+
+/**
+ * @brief Free the arrays of a worklist
+ * @param wl Worklist to free
+ */
+static void worklist_free(Worklist *wl) {
+    free(wl->region_start);
+    free(wl->region_of);
+    free(wl->queue);
+    free(wl->queued);
+}
+
+/**
+ * @brief Split the program into regions
+ *
+ * Regions are the basic blocks of the control flow graph. Without a
+ * graph a new region starts at every label, since labels are the only
+ * places control flow can enter mid-program.
+ *
+ * @param prog Program (or routine view) to split
+ * @param cfg Graph of the whole program, or NULL
+ * @param offset Index of prog->nodes[0] in the graph
+ * @param wl Worklist to fill in (arrays must be sized for prog->count)
+ */
+static void build_regions(const Program *prog, const Cfg *cfg, int offset, Worklist *wl) {
+    int regions = 0;
+
+    if (cfg && prog->count > 0) {
+        int first = cfg->block_of[offset];
+        for (int i = 0; i < prog->count; i++) {
+            int region = cfg->block_of[offset + i] - first;
+            if (region == regions) wl->region_start[regions++] = i;
+            wl->region_of[i] = region;
+        }
+    } else {
+        for (int i = 0; i < prog->count; i++) {
+            if (i == 0 || (prog->nodes[i].label && prog->nodes[i].label[0])) {
+                wl->region_start[regions++] = i;
+            }
+            wl->region_of[i] = regions - 1;
+        }
+    }
+    wl->region_start[regions] = prog->count;
+    wl->region_count = regions;
+}
+
+/**
+ * @brief Queue a region unless it is already queued or out of range
+ *
+ * @param wl Worklist
+ * @param region Region index
+ */
+static void enqueue_region(Worklist *wl, int region) {
+    if (region < 0 || region >= wl->region_count || wl->queued[region]) return;
+
+    wl->queue[(wl->head + wl->length) % wl->region_count] = region;
+    wl->length++;
+    wl->queued[region] = true;
+}
+
+/**
+ * @brief Re-queue the neighbourhood of every node changed since last call
+ *
+ * Patterns look a few lines ahead and may span region boundaries, so a
+ * change re-queues the region that contains it and both neighbours.
+ *
+ * @param prog Program whose dirty marks to consume
+ * @param wl Worklist
+ */
+static void requeue_changes(Program *prog, Worklist *wl) {
+    for (int i = prog->dirty_lo; i <= prog->dirty_hi; i++) {
+        if (!prog->dirty[i]) continue;
+        prog->dirty[i] = 0;
+
+        int region = wl->region_of[i];
+        enqueue_region(wl, region - 1);
+        enqueue_region(wl, region);
+        enqueue_region(wl, region + 1);
+    }
+    prog->dirty_lo = prog->count;
+    prog->dirty_hi = -1;
+}
+
+/**
+ * @brief Run the region passes until the worklist drains
+ *
+ * @param prog Program (or routine view) to optimize
+ * @param wl Worklist with the regions to visit queued
+ * @return Number of region visits
+ */
+static int drain_worklist(Program *prog, Worklist *wl) {
+    int visits = 0;
+
+    while (wl->length > 0) {
+        int region = wl->queue[wl->head];
+        wl->head = (wl->head + 1) % wl->region_count;
+        wl->length--;
+        wl->queued[region] = false;
+
+        int start = wl->region_start[region];
+        int end = wl->region_start[region + 1];
+        for (size_t p = 0; p < sizeof(region_passes) / sizeof(region_passes[0]); p++) {
+            if (prog->stats) {
+                double t = stats_now();
+                region_passes[p].run(prog, start, end);
+                stats_add_time(prog->stats, region_passes[p].name, t);
+                stats_claim_pending(prog->stats, region_passes[p].name);
+            } else {
+                region_passes[p].run(prog, start, end);
+            }
+        }
+        visits++;
+
+        requeue_changes(prog, wl);
+    }
+    return visits;
+}
+
+/**
+ * @brief Run the whole-program passes once
+ *
+ * @param prog Program to optimize
+ */
+static void run_program_passes(Program *prog) {
+    for (size_t p = 0; p < sizeof(program_passes) / sizeof(program_passes[0]); p++) {
+        double t = stats_now();
+        program_passes[p].run(prog);
+        stats_add_time(prog->stats, program_passes[p].name, t);
+        stats_claim_pending(prog->stats, program_passes[p].name);
+    }
+}
+
+/**
+ * @brief Sweep one routine on a worker thread
+ *
+ * The routine is optimized through a view of the program that covers
+ * only its nodes, with private dead bits, change marks, optimization
+ * counter, string arena and statistics, so workers never write shared
+ * state.
+ * Patterns cannot look past the end of the routine.
+ *
+ * @param ctx ParallelSweep
+ * @param k Position in the pending order
+ * @param worker Worker number
+ */
+static void sweep_routine(void *ctx, int k, int worker) {
+    ParallelSweep *sweep = ctx;
+    const Program *prog = sweep->prog;
+    RoutineJob *job = sweep->order[k];
+    int n = job->end - job->start;
+
+    Program view = *prog;
+    view.nodes = prog->nodes + job->start;
+    view.count = n;
+    view.capacity = n;
+    view.dead = calloc((n + 63) / 64, sizeof(uint64_t));
+    view.dirty = calloc(n, 1);
+    view.dirty_lo = n;
+    view.dirty_hi = -1;
+    view.cfg = NULL;
+    view.reg_states = NULL;
+    view.reg_state_count = 0;
+    view.stats = sweep->stats ? sweep->stats[worker] : NULL;
+    view.optimizations = 0;
+    view.arena = sweep->arenas[worker];
+
+    Worklist wl;
+    if (!view.dead || !view.dirty || !worklist_init(&wl, n)) {
+        // Leave the routine untouched
+        free(view.dead);
+        free(view.dirty);
+        job->dead = NULL;
+        return;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (node_is_dead(prog, job->start + i)) view.dead[i >> 6] |= (uint64_t)1 << (i & 63);
+    }
+
+    build_regions(&view, prog->cfg, job->start, &wl);
+    for (int r = 0; r < wl.region_count; r++) {
+        enqueue_region(&wl, r);
+    }
+    job->visits = drain_worklist(&view, &wl);
+    job->optimizations = view.optimizations;
+    job->dead = view.dead;
+
+    worklist_free(&wl);
+    free(view.dirty);
+}
+
+/**
+ * @brief Split the program into routines for the parallel scheduler
+ *
+ * @param prog Program with a control flow graph
+ * @param count Where to store the number of routines
+ * @return New array of routines in source order, or NULL on failure
+ */
+static RoutineJob* split_routines(const Program *prog, int *count) {
+    int n = 0;
+    for (int i = 0; i < prog->count; i++) {
+        if (i == 0 || is_routine_start(&prog->nodes[i])) n++;
+    }
+
+    RoutineJob *jobs = calloc(n > 0 ? n : 1, sizeof(RoutineJob));
+    if (!jobs) return NULL;
+
+    int j = -1;
+    for (int i = 0; i < prog->count; i++) {
+        // Routines always start a block; keep blocks whole regardless
+        bool starts = i == 0 || (is_routine_start(&prog->nodes[i]) &&
+                                 prog->cfg->blocks[prog->cfg->block_of[i]].start == i);
+        if (starts) {
+            if (j >= 0) jobs[j].end = i;
+            jobs[++j].start = i;
+            jobs[j].pending = true;
+        }
+    }
+    if (j >= 0) jobs[j].end = prog->count;
+    *count = j + 1;
+    return jobs;
+}
+
+/**
+ * @brief qsort() comparator: larger routines first, then source order
+ *
+ * @param a Pointer to a RoutineJob pointer
+ * @param b Pointer to a RoutineJob pointer
+ * @return Comparison result
+ */
+static int compare_job_size(const void *a, const void *b) {
+    const RoutineJob *ja = *(RoutineJob * const *)a;
+    const RoutineJob *jb = *(RoutineJob * const *)b;
+    int sa = ja->end - ja->start;
+    int sb = jb->end - jb->start;
+    if (sa != sb) return sb - sa;
+    return (ja > jb) - (ja < jb);
+}
+
+/**
+ * @brief Sweep every pending routine on prog->jobs workers
+ *
+ * Results are merged on the calling thread in source order once all
+ * workers are done.
+ *
+ * @param prog Program to optimize
+ * @param jobs Routines
+ * @param count Number of routines
+ * @param arenas Private string arena of every worker
+ * @param order Scratch array of count entries
+ * @return Number of region visits
+ */
+static int sweep_pending_routines(Program *prog, RoutineJob *jobs, int count, Arena **arenas,
+                                  RoutineJob **order) {
+    int pending = 0;
+    for (int j = 0; j < count; j++) {
+        if (jobs[j].pending) order[pending++] = &jobs[j];
+    }
+
+    // Largest routines first, so big ones do not start last
+    qsort(order, pending, sizeof(RoutineJob*), compare_job_size);
+
+    int workers = prog->jobs < pending ? prog->jobs : pending;
+    if (workers > PARALLEL_MAX_WORKERS) workers = PARALLEL_MAX_WORKERS;
+    RunStats **stats = NULL;
+    if (prog->stats && workers > 0) {
+        stats = calloc(workers, sizeof(RunStats*));
+        for (int w = 0; stats && w < workers; w++) {
+            stats[w] = create_run_stats();
+        }
+    }
+
+    ParallelSweep sweep = { prog, order, arenas, stats };
+    parallel_for(pending, prog->jobs, sweep_routine, &sweep);
+
+    for (int w = 0; stats && w < workers; w++) {
+        // Workers without a record of their own only lose their statistics
+        stats_merge(prog->stats, stats[w]);
+        free_run_stats(stats[w]);
+    }
+    free(stats);
+
+    int visits = 0;
+    for (int j = 0; j < count; j++) {
+        RoutineJob *job = &jobs[j];
+        if (!job->pending) continue;
+        job->pending = false;
+        if (!job->dead) continue;
+
+        for (int i = job->start; i < job->end; i++) {
+            int bit = i - job->start;
+            if ((job->dead[bit >> 6] >> (bit & 63)) & 1) {
+                prog->dead[i >> 6] |= (uint64_t)1 << (i & 63);
+            }
+        }
+        prog->optimizations += job->optimizations;
+        visits += job->visits;
+        free(job->dead);
+        job->dead = NULL;
+    }
+    return visits;
+}
+
+/**
+ * @brief Optimize the whole program from one worklist
+ *
+ * @param prog Program to optimize
+ * @param seams Routines swept in parallel, whose boundary regions are
+ *              the only ones queued at first; NULL queues every region
+ * @param seam_count Number of entries in seams
+ * @return Number of region visits
+ */
+static int optimize_regions_serial(Program *prog, const RoutineJob *seams, int seam_count) {
+    int visits = 0;
+    int n = prog->count;
+    Worklist wl;
+    bool ok = worklist_init(&wl, n);
+    prog->dirty = calloc(n > 0 ? n : 1, 1);
+
+    if (!ok || !prog->dirty) {
+        fprintf(stderr, "Error: Out of memory while scheduling optimization passes\n");
+    } else {
+        build_regions(prog, prog->cfg, 0, &wl);
+        if (seams) {
+            for (int j = 1; j < seam_count; j++) {
+                int region = wl.region_of[seams[j].start];
+                enqueue_region(&wl, region - 1);
+                enqueue_region(&wl, region);
+            }
+        } else {
+            for (int r = 0; r < wl.region_count; r++) {
+                enqueue_region(&wl, r);
+            }
+        }
+        prog->dirty_lo = prog->count;
+        prog->dirty_hi = -1;
+
+        for (;;) {
+            int round_start = prog->optimizations;
+            stats_begin_round(prog->stats);
+            int round_visits = drain_worklist(prog, &wl);
+            visits += round_visits;
+
+            // Whole-program dataflow passes; stop once they find nothing new
+            int before = prog->optimizations;
+            run_program_passes(prog);
+            stats_end_round(prog->stats, round_visits, prog->optimizations - round_start);
+            if (prog->optimizations == before) break;
+            requeue_changes(prog, &wl);
+        }
+    }
+
+    free(prog->dirty);
+    prog->dirty = NULL;
+    if (ok) worklist_free(&wl);
+    return visits;
+}
+
+/**
+ * @brief Optimize routines concurrently (-j)
+ *
+ * Every routine is swept on its own, then the dataflow passes run
+ * over the whole program; routines they changed are swept again until it
+ * find nothing new. Finally the serial scheduler visits the regions on
+ * both sides of every routine boundary, for patterns that look past the
+ * end of a routine.
+ *
+ * @param prog Program with a control flow graph
+ * @return Number of region visits, or -1 if the routines could not be
+ *         set up (nothing was changed)
+ */
+static int optimize_routines_parallel(Program *prog) {
+    int count = 0;
+    RoutineJob *jobs = split_routines(prog, &count);
+    RoutineJob **order = malloc((count > 0 ? count : 1) * sizeof(RoutineJob*));
+    int *job_of = malloc((prog->count > 0 ? prog->count : 1) * sizeof(int));
+    int workers = prog->jobs < count ? prog->jobs : count;
+    if (workers > PARALLEL_MAX_WORKERS) workers = PARALLEL_MAX_WORKERS;
+    Arena **arenas = calloc(workers > 0 ? workers : 1, sizeof(Arena*));
+    prog->dirty = calloc(prog->count > 0 ? prog->count : 1, 1);
+
+    bool ok = jobs && order && job_of && arenas && prog->dirty;
+    for (int w = 0; ok && w < workers; w++) {
+        arenas[w] = arena_create(ARENA_DEFAULT_CHUNK);
+        if (!arenas[w]) ok = false;
+    }
+
+    int visits = -1;
+    if (ok) {
+        for (int j = 0; j < count; j++) {
+            for (int i = jobs[j].start; i < jobs[j].end; i++) job_of[i] = j;
+        }
+        prog->dirty_lo = prog->count;
+        prog->dirty_hi = -1;
+
+        visits = 0;
+        for (;;) {
+            int round_start = prog->optimizations;
+            stats_begin_round(prog->stats);
+            double t = stats_now();
+            int round_visits = sweep_pending_routines(prog, jobs, count, arenas, order);
+            visits += round_visits;
+            stats_add_time(prog->stats, "parallel_regions", t);
+
+            // Whole-program dataflow passes; stop once they find nothing new
+            int before = prog->optimizations;
+            run_program_passes(prog);
+            stats_end_round(prog->stats, round_visits, prog->optimizations - round_start);
+            if (prog->optimizations == before) break;
+
+            for (int i = prog->dirty_lo; i <= prog->dirty_hi; i++) {
+                if (!prog->dirty[i]) continue;
+                prog->dirty[i] = 0;
+                jobs[job_of[i]].pending = true;
+            }
+            prog->dirty_lo = prog->count;
+            prog->dirty_hi = -1;
+        }
+    }
+
+    for (int w = 0; arenas && w < workers; w++) {
+        arena_adopt(prog->arena, arenas[w]);
+    }
+    free(arenas);
+    free(prog->dirty);
+    prog->dirty = NULL;
+    if (visits >= 0) visits += optimize_regions_serial(prog, jobs, count);
+    free(job_of);
+    free(order);
+    free(jobs);
+    return visits;
+}
 
 /**
  * @brief Main optimization routine
  *
- * Coordinates all optimization passes in a multi-pass loop:
- * 1. Performs subroutine inlining once (before main loop)
- * 2. Runs optimization passes iteratively until convergence:
- *    - Analysis passes (call flow, branch targets)
- *    - Basic optimizations (peephole, load/store, registers)
- *    - Constant propagation
- *    - CPU-specific optimizations (65C02, 45GS02)
- *    - Control flow (jump optimization)
- *    - Dead code elimination (must be last)
- * 3. Validates register tracking (if trace_level >= 2)
- *
- * Terminates when:
- * - No optimizations found in a pass (convergence)
- * - Maximum of 10 passes reached
+ * Coordinates all optimization passes:
+ * 1. Performs subroutine inlining, DMA job substitution (-dma), loop
+ *    unrolling (speed mode), fall-through block ordering and zero page
+ *    promotion (-zp-free) once
+ * 2. Builds the control flow graph once more; labels never change
+ * 3. Queues every basic block, then repeatedly pops a region and runs all
+ *    region passes over it. Regions around any change are re-queued
+ *    until the worklist drains.
+ * 4. Validates register tracking, if requested (-validate)
+ *
+ * With prog->jobs > 1, step 3 runs per routine on a worker pool
+ * instead (see optimize_routines_parallel()). Tracing keeps the serial
+ * scheduler so trace messages stay in order.
+ *
+ * Every pass only kills nodes or rewrites them into a form it does not
+ * match again, so the worklist always drains.
  *
  * @param prog Program to optimize (modified in place)
  */
 void optimize_program_ast(Program *prog) {
-    int prev_opts;
-    int pass = 0;
+    if (prog->stats) prog->stats->round = 0;
 
     // First perform inlining (only once, at the beginning)
-    printf("Performing subroutine inlining...\n");
+    program_log(prog, "Performing subroutine inlining...\n");
+    double t = stats_now();
     analyze_call_flow_ast(prog);
+    stats_add_time(prog->stats, "cfg", t);
+    t = stats_now();
     optimize_inline_subroutines_ast(prog);
+    stats_add_time(prog->stats, "inline", t);
+    stats_claim_pending(prog->stats, "inline");
 
-    // Multiple passes until no more optimizations found
-    do {
-        prev_opts = prog->optimizations;
-
+    // The structural passes drop the graph when they move or insert nodes
+    if (!prog->cfg) {
+        t = stats_now();
         analyze_call_flow_ast(prog);
+        stats_add_time(prog->stats, "cfg", t);
+    }
+    t = stats_now();
+    optimize_dma_jobs_ast(prog);
+    stats_add_time(prog->stats, "dma", t);
+    stats_claim_pending(prog->stats, "dma");
+    if (!prog->cfg) {
+        t = stats_now();
+        analyze_call_flow_ast(prog);
+        stats_add_time(prog->stats, "cfg", t);
+    }
+    t = stats_now();
+    optimize_unroll_loops_ast(prog);
+    stats_add_time(prog->stats, "unroll", t);
+    stats_claim_pending(prog->stats, "unroll");
+    if (!prog->cfg) {
+        t = stats_now();
+        analyze_call_flow_ast(prog);
+        stats_add_time(prog->stats, "cfg", t);
+    }
+    t = stats_now();
+    optimize_block_order_ast(prog);
+    stats_add_time(prog->stats, "layout", t);
+    stats_claim_pending(prog->stats, "layout");
+    if (!prog->cfg) {
+        t = stats_now();
+        analyze_call_flow_ast(prog);
+        stats_add_time(prog->stats, "cfg", t);
+    }
+    t = stats_now();
+    optimize_zero_page_ast(prog);
+    stats_add_time(prog->stats, "zeropage", t);
+    stats_claim_pending(prog->stats, "zeropage");
+    if (!prog->cfg) {
+        t = stats_now();
+        analyze_call_flow_ast(prog);
+        stats_add_time(prog->stats, "cfg", t);
+    }
+    if (prog->cfg && prog->trace_level >= 2) {
+        print_cfg(prog->cfg, prog);
+    }
 
-        // Basic optimizations
-        optimize_peephole_ast(prog);
-        optimize_load_store_ast(prog);
-        optimize_register_usage_ast(prog);
-        optimize_constant_propagation_ast(prog);
-
-        // Arithmetic and logic
-        optimize_65c02_instructions_ast(prog);
-        optimize_45gs02_instructions_ast(prog);
-
-        // Control flow
-        optimize_jumps_ast(prog);
-
-        // Must be last
-        optimize_dead_code_ast(prog);
-
-        pass++;
-    } while (prog->optimizations > prev_opts && pass < 10);
+    int visits = -1;
+    if (prog->jobs > 1 && prog->cfg && prog->trace_level == 0) {
+        visits = optimize_routines_parallel(prog);
+    }
+    if (visits < 0) {
+        visits = optimize_regions_serial(prog, NULL, 0);
+    }
 
-    printf("Optimization completed in %d passes\n", pass);
+    program_log(prog, "Optimization completed: %d regions, %d region visits\n",
+           prog->cfg ? prog->cfg->block_count : 0, visits);
+    if (prog->stats) {
+        prog->stats->round = 0;
+        stats_note_arena(prog->stats, prog->arena->bytes_reserved);
+    }
 
-    // Validate register and flag tracking
-    validate_register_and_flag_tracking(prog);
+    if (prog->validate) {
+        t = stats_now();
+        validate_register_and_flag_tracking(prog);
+        stats_add_time(prog->stats, "validate", t);
+    }
 }
@@ -10,94 +10,197 @@
 #define OPTIMIZER_H
 
 #include "../types.h"
+#include "../program/program.h"
 
 /**
  * @brief Main optimization routine - coordinates all optimization passes
  *
- * Runs multiple optimization passes over the program in an iterative manner
- * until no more optimizations are found (or a maximum of 10 passes).
+ * Splits the program into basic blocks (see cfg.h) and runs the region
+ * passes over each one from a worklist. After the first sweep only the
+ * blocks around a killed or rewritten node are queued again, until the
+ * worklist is empty.
  *
  * Pass order:
- * 1. Subroutine inlining (once, before iteration)
- * 2. Iterative optimization loop:
- *    - Call flow analysis
- *    - Peephole optimization
- *    - Load/store optimization
- *    - Register usage optimization
- *    - Constant propagation
+ * 1. Subroutine inlining, loop unrolling (speed mode), fall-through
+ *    block ordering, zero page promotion (-zp-free) and call flow
+ *    analysis (once)
+ * 2. Per basic block, from the worklist:
+ *    - Peephole rules (see rules.h)
  *    - CPU-specific optimizations (65C02, 45GS02)
  *    - Jump optimization
  *    - Dead code elimination (must be last)
+ * 3. Constant propagation, dead store elimination, 65816 word copies
+ *    and jump threading over the whole program; if they remove anything, the affected blocks are queued
+ *    and step 2 repeats
  *
- * After optimization, validates register tracking if trace level >= 2.
+ * After optimization, validates register tracking if prog->validate.
  *
  * @param prog Program to optimize
  */
 void optimize_program_ast(Program *prog);
 
-/* Individual optimization passes */
+/*
+ * Individual optimization passes
+ *
+ * Region passes examine the nodes in [start, end) and may look a few
+ * lines past end. They report changes through mark_node_dead() and
+ * rewrite_node_opcode() so the scheduler can re-queue the neighbourhood.
+ */
 
 /**
- * @brief Peephole optimization patterns
- * Detects and optimizes small instruction sequences (2-3 instructions)
+ * @brief Table-driven peephole optimization
+ * Applies the rules of prog->rules (the built-in rules if NULL) in one
+ * scan; see rules.h
  * @param prog Program to optimize
+ * @param start First node index to examine
+ * @param end One past the last node index to examine
  */
-void optimize_peephole_ast(Program *prog);
+void optimize_peephole_ast(Program *prog, int start, int end);
 
 /**
  * @brief Dead code elimination
  * Removes unreachable code after unconditional jumps/returns
  * @param prog Program to optimize
+ * @param start First node index to examine
+ * @param end One past the last node index to examine
  */
-void optimize_dead_code_ast(Program *prog);
+void optimize_dead_code_ast(Program *prog, int start, int end);
 
 /**
  * @brief Jump optimization
  * Removes redundant jumps (e.g., JMP to next instruction)
  * @param prog Program to optimize
+ * @param start First node index to examine
+ * @param end One past the last node index to examine
  */
-void optimize_jumps_ast(Program *prog);
+void optimize_jumps_ast(Program *prog, int start, int end);
 
 /**
- * @brief Load/store optimization
- * Eliminates redundant loads of the same value
+ * @brief Constant propagation
+ * Uses the register dataflow over the CFG to remove redundant immediate
+ * loads, CLC/SEC and compares against zero. Runs over the whole program
+ * after the region passes have converged.
  * @param prog Program to optimize
  */
-void optimize_load_store_ast(Program *prog);
+void optimize_constant_propagation_ast(Program *prog);
 
 /**
- * @brief Register usage optimization
- * Removes useless register transfer sequences (TAX/TXA pairs)
+ * @brief Dead store elimination
+ * Uses the backward register/flag liveness over the CFG (see
+ * liveness.h) to remove loads, transfers, flag operations and register
+ * arithmetic whose results are never read. Runs over the whole program
+ * after constant propagation.
  * @param prog Program to optimize
  */
-void optimize_register_usage_ast(Program *prog);
+void optimize_dead_stores_ast(Program *prog);
 
 /**
- * @brief Constant propagation
- * Tracks and eliminates redundant immediate loads
+ * @brief 65C02-specific optimizations
+ * Converts LDA #$00 / STA sequences to STZ (65C02 instruction)
  * @param prog Program to optimize
+ * @param start First node index to examine
+ * @param end One past the last node index to examine
  */
-void optimize_constant_propagation_ast(Program *prog);
+void optimize_65c02_instructions_ast(Program *prog, int start, int end);
 
 /**
- * @brief 65C02-specific optimizations
- * Converts LDA #$00 / STA sequences to STZ (65C02 instruction)
+ * @brief 65816-specific optimizations
+ * Uses the register widths tracked through REP/SEP to turn byte pair
+ * copies into 16-bit copies and removes SEP/REP pairs that undo each
+ * other. Runs over the whole program after dead store elimination.
  * @param prog Program to optimize
  */
-void optimize_65c02_instructions_ast(Program *prog);
+void optimize_65816_instructions_ast(Program *prog);
 
 /**
  * @brief 45GS02-specific optimizations (MEGA65)
- * Uses Z register for repeated stores, converts to NEG/ASR instructions
+ * Reuses a Z register load for later stores of the same value (the
+ * Z register, NEG and ASR patterns are peephole rules)
  * @param prog Program to optimize
+ * @param start First node index to examine
+ * @param end One past the last node index to examine
  */
-void optimize_45gs02_instructions_ast(Program *prog);
+void optimize_45gs02_instructions_ast(Program *prog, int start, int end);
 
 /**
- * @brief Inline small subroutines
- * Placeholder for future subroutine inlining optimization
+ * @brief 45GS02 32-bit quad fusion (MEGA65)
+ * Turns four byte loads, stores, copies and ADC/SBC/AND/ORA/EOR chains
+ * into Q register instructions where the registers and flags the quad
+ * form changes are dead. Runs over the whole program after the 65816
+ * pass.
+ * @param prog Program to optimize
+ */
+void optimize_45gs02_quads_ast(Program *prog);
+
+/**
+ * @brief Superoptimize short windows of hot code (-superopt)
+ * Searches straight-line windows of up to five instructions in loop
+ * bodies (all code in size mode) for cheaper sequences with the same
+ * effect on live registers, flags and memory, using and extending the
+ * memo opened by -superopt. Runs over the whole program after the quad
+ * pass; does nothing without a memo or on the 65816.
  * @param prog Program to optimize
  */
+void optimize_superopt_ast(Program *prog);
+
+/**
+ * @brief Inline small subroutines
+ * Copies the bodies of leaf subroutines into their JSR call sites when
+ * the cost model says it pays off, and removes routines left without
+ * references. Runs once, before the control flow graph is rebuilt,
+ * since it inserts nodes.
+ * @param prog Program to optimize (prog->cfg must be built)
+ */
 void optimize_inline_subroutines_ast(Program *prog);
 
+/**
+ * @brief Replace block copies and fills with DMA jobs (45GS02, -dma)
+ * Turns counted copy and fill loops and straight runs of byte copies
+ * into a MEGA65 DMA job, where the cost model says the job is faster.
+ * Runs once, before the control flow graph is rebuilt, since it inserts
+ * nodes.
+ * @param prog Program to optimize (prog->cfg must be built)
+ */
+void optimize_dma_jobs_ast(Program *prog);
+
+/**
+ * @brief Unroll counted loops (speed mode)
+ * Copies the body of single-block DEX/DEY/INX/INY + BNE/BPL loops with
+ * an immediate trip count, fully or by a factor, within
+ * prog->unroll_budget bytes per loop. Runs once, before the control
+ * flow graph is rebuilt, since it inserts nodes.
+ * @param prog Program to optimize (prog->cfg must be built)
+ */
+void optimize_unroll_loops_ast(Program *prog);
+
+/**
+ * @brief Branch-aware layout: jump threading and branch inversion
+ * Retargets jumps and branches that land on a JMP to its target, and
+ * turns a conditional branch over a JMP into the opposite branch.
+ * Runs over the whole program after dead store elimination.
+ * @param prog Program to optimize (prog->cfg must be built)
+ */
+void optimize_branch_layout_ast(Program *prog);
+
+/**
+ * @brief Fall-through block ordering
+ * Moves a block entered only by one JMP right after that JMP and
+ * removes the JMP, if every branch stays in range. Runs once, after
+ * unrolling and before the control flow graph is rebuilt, since it
+ * moves nodes.
+ * @param prog Program to optimize (prog->cfg must be built)
+ */
+void optimize_block_order_ast(Program *prog);
+
+/**
+ * @brief Zero page promotion of hot variables
+ * Moves the reserved variables with the most loop-weighted references
+ * into the zero page bytes of prog->zp_free, switching their references
+ * to zero page addressing and replacing their storage by equates at
+ * the top of the file. Runs once, before the control flow graph is
+ * rebuilt, since it moves nodes.
+ * @param prog Program to optimize (prog->cfg must be built)
+ */
+void optimize_zero_page_ast(Program *prog);
+
 #endif // OPTIMIZER_H
@@ -1,49 +1,313 @@
 /**
  * @file peephole.c
- * @brief Peephole optimization patterns
+ * @brief Table-driven peephole optimization
  *
- * Implements small-window pattern matching optimizations that detect
- * and eliminate redundant instruction sequences.
+ * Applies the rules of the program's rule set (see rules.h) in one
+ * left-to-right scan. At each instruction the scan follows the rule trie
+ * along the opcodes of the instructions that come next, so the work per
+ * position depends on the longest pattern, not on the number of rules.
  */
 
 #include "optimizer.h"
+#include "rules.h"
+#include "../analysis/cost.h"
+#include "../analysis/liveness.h"
 #include <string.h>
 
 /**
- * @brief Peephole optimization - redundant load elimination
+ * @brief Check whether a node may be part of a match
  *
- * Detects and removes redundant loads in the pattern:
- *   LDA #value
- *   STA address
- *   LDA #value    <- redundant, remove this
+ * Matches never extend into a branch target, since control can arrive
+ * there from elsewhere.
  *
- * The accumulator still contains the value after STA, so the
- * second LDA is unnecessary.
+ * @param prog Program being optimized
+ * @param index Node index
+ * @param first Node is the first of the match
+ * @return true if the node is a live, optimizable instruction
+ */
+static bool matchable(const Program *prog, int index, bool first) {
+    const AstNode *node = &prog->nodes[index];
+    return node->op != OP_NONE && !node_is_dead(prog, index) && !node->no_optimize &&
+           (first || !node->is_branch_target);
+}
+
+/**
+ * @brief Check a node against an operand template
  *
- * @param prog Program to optimize
+ * @param operand Operand of the node (may be NULL)
+ * @param pattern Operand template
+ * @param bound Operands bound to the capture slots so far (updated)
+ * @return true if the operand fits
+ */
+static bool operand_matches(const char *operand, const RuleOperand *pattern, const char **bound) {
+    switch (pattern->kind) {
+        case RULE_OPERAND_ANY:
+            return true;
+        case RULE_OPERAND_NONE:
+            return !operand || !operand[0];
+        case RULE_OPERAND_CAPTURE:
+            if (!operand) return false;
+            if (!bound[pattern->capture]) {
+                bound[pattern->capture] = operand;
+                return true;
+            }
+            return strcmp(bound[pattern->capture], operand) == 0;
+        case RULE_OPERAND_LITERAL:
+            return operand && strcmp(operand, pattern->text) == 0;
+    }
+    return false;
+}
+
+/**
+ * @brief Operand a rewritten instruction gets
+ *
+ * @param prog Program being optimized
+ * @param index Node index
+ * @param action Replacement
+ * @param bound Operands bound to the capture slots
+ * @return New operand (NULL for none)
+ */
+static const char* new_operand(const Program *prog, int index, const RuleAction *action,
+                               const char **bound) {
+    switch (action->operand.kind) {
+        case RULE_OPERAND_NONE:
+            return NULL;
+        case RULE_OPERAND_CAPTURE:
+            return bound[action->operand.capture];
+        case RULE_OPERAND_LITERAL:
+            return action->operand.text;
+        default:
+            return prog->nodes[index].operand;
+    }
+}
+
+/** Registers a copy can be tracked through, in RegisterCopies order */
+static const unsigned int copy_regs[4] = { RF_A, RF_X, RF_Y, RF_Z };
+
+/**
+ * @brief What an instruction sequence does to the registers
+ *
+ * Follows transfers, so TAX; TXA is known to leave A as it was.
+ */
+typedef struct {
+    int holds[4];               /**< Register (copy_regs index) whose entry value each
+                                     register holds, or -1 */
+    unsigned int writes;        /**< RF_* registers and flags written */
+} RegisterCopies;
+
+/**
+ * @brief Start tracking an empty sequence
+ * @param copies Tracking state
+ */
+static void copies_init(RegisterCopies *copies) {
+    for (int r = 0; r < 4; r++) copies->holds[r] = r;
+    copies->writes = 0;
+}
+
+/**
+ * @brief Add an instruction to a tracked sequence
+ *
+ * @param copies Tracking state
+ * @param op Opcode
+ * @param mode Addressing mode
+ */
+static void copies_step(RegisterCopies *copies, Opcode op, AddrMode mode) {
+    int from = -1, to = -1;
+    switch (op) {
+        case OP_TAX: from = 0; to = 1; break;
+        case OP_TAY: from = 0; to = 2; break;
+        case OP_TAZ: from = 0; to = 3; break;
+        case OP_TXA: from = 1; to = 0; break;
+        case OP_TYA: from = 2; to = 0; break;
+        case OP_TZA: from = 3; to = 0; break;
+        case OP_TXY: from = 1; to = 2; break;
+        case OP_TYX: from = 2; to = 1; break;
+        default: break;
+    }
+
+    unsigned int writes = opcode_writes(op, mode);
+    copies->writes |= writes;
+    for (int r = 0; r < 4; r++) {
+        if (r == to) {
+            copies->holds[r] = copies->holds[from];
+        } else if (writes & copy_regs[r]) {
+            copies->holds[r] = -1;
+        }
+    }
+}
+
+/**
+ * @brief Get the registers a tracked sequence leaves as they were
+ * @param copies Tracking state
+ * @return RF_* mask of registers holding their own entry value
+ */
+static unsigned int copies_preserved(const RegisterCopies *copies) {
+    unsigned int preserved = 0;
+    for (int r = 0; r < 4; r++) {
+        if (copies->holds[r] == r) preserved |= copy_regs[r];
+    }
+    return preserved;
+}
+
+/**
+ * @brief Check whether a rule would assemble two NEGs back to back
+ *
+ * NEG NEG is the 45GS02 prefix that turns the next instruction into
+ * its 32-bit form, so a rewrite may neither create the pair inside
+ * the match nor next to the instructions around it.
+ *
+ * @param prog Program being optimized
+ * @param rule Rule to check
+ * @param start First node of the match
+ * @return true if the result would hold adjacent NEGs
  */
-void optimize_peephole_ast(Program *prog) {
-    AstNode *node = prog->root;
-    while (node) {
-        if (node->is_dead || node->no_optimize) {
-            node = node->next;
-            continue;
+static bool creates_neg_pair(const Program *prog, const Rule *rule, int start) {
+    int prev = adjacent_instruction(prog, start, -1);
+    bool neg = prev >= 0 && prog->nodes[prev].op == OP_NEG;
+    for (int k = 0; k < rule->length; k++) {
+        const RuleAction *action = &rule->replace[k];
+        if (action->kind == RULE_REMOVE) continue;
+        Opcode op = action->kind == RULE_REWRITE ? action->op : prog->nodes[start + k].op;
+        if (neg && op == OP_NEG) return true;
+        neg = op == OP_NEG;
+    }
+    int next = adjacent_instruction(prog, start + rule->length - 1, 1);
+    return neg && next >= 0 && prog->nodes[next].op == OP_NEG;
+}
+
+/**
+ * @brief Check whether a rule applies at a position
+ *
+ * The opcodes already match (the trie was followed to the rule); this
+ * checks the CPU, modes, operands and the cost model, and on the
+ * 45GS02 that no NEG pair is formed. A register or flag that the
+ * pattern writes and the replacement does not, or the other way round,
+ * must be overwritten before it is read again unless both leave it as
+ * it was (TAX; TXA => -; - keeps A but loses X).
+ *
+ * @param prog Program being optimized
+ * @param rule Rule to check
+ * @param start First node of the match
+ * @param cpus CPUM_* mask of the target CPU
+ * @param bound Where to store the operands bound to the capture slots
+ * @return true if the rule applies
+ */
+static bool rule_applies(const Program *prog, const Rule *rule, int start, unsigned int cpus,
+                         const char **bound) {
+    if (!(rule->cpus & cpus)) return false;
+
+    memset(bound, 0, RULE_MAX_CAPTURES * sizeof(bound[0]));
+    for (int k = 0; k < rule->length; k++) {
+        const AstNode *node = &prog->nodes[start + k];
+        const RulePattern *match = &rule->match[k];
+        if (match->mode != AM_NONE && node->mode != match->mode) return false;
+        if (!operand_matches(node->operand, &match->operand, bound)) return false;
+    }
+
+    CostTotal before = {0, 0};
+    CostTotal after = {0, 0};
+    RegisterCopies copies_before, copies_after;
+    copies_init(&copies_before);
+    copies_init(&copies_after);
+    for (int k = 0; k < rule->length; k++) {
+        const RuleAction *action = &rule->replace[k];
+        const AstNode *node = &prog->nodes[start + k];
+        cost_add_node(&before, prog, start + k);
+        copies_step(&copies_before, node->op, node->mode);
+        if (action->kind == RULE_KEEP) {
+            cost_add_node(&after, prog, start + k);
+            copies_step(&copies_after, node->op, node->mode);
+        } else if (action->kind == RULE_REWRITE) {
+            AddrMode mode = classify_operand(action->op, new_operand(prog, start + k, action, bound));
+            InstrCost cost = instruction_cost(action->op, mode, prog->cpu_type);
+            if (!cost.valid) return false;
+            cost_add(&after, cost);
+            copies_step(&copies_after, action->op, mode);
         }
+    }
+    if (!cost_is_better(prog, before, after)) return false;
+    if (prog->is_45gs02 && creates_neg_pair(prog, rule, start)) return false;
+
+    // Registers only one side changes end up different and must be dead
+    unsigned int changed = (copies_before.writes ^ copies_after.writes) &
+                           ~(copies_preserved(&copies_before) & copies_preserved(&copies_after)) &
+                           LIVE_TRACKED;
+    return !changed || registers_dead_after(prog, start + rule->length - 1, prog->count, changed);
+}
+
+/**
+ * @brief Apply a rule at a position
+ *
+ * @param prog Program being optimized
+ * @param rule Rule to apply
+ * @param start First node of the match
+ * @param bound Operands bound to the capture slots
+ */
+static void apply_rule(Program *prog, const Rule *rule, int start, const char **bound) {
+    for (int k = 0; k < rule->length; k++) {
+        const RuleAction *action = &rule->replace[k];
+        int index = start + k;
+        if (action->kind == RULE_REMOVE) {
+            mark_node_dead(prog, index);
+        } else if (action->kind == RULE_REWRITE) {
+            AstNode *node = &prog->nodes[index];
+            const char *operand = new_operand(prog, index, action, bound);
+            if (operand && action->operand.kind == RULE_OPERAND_LITERAL) {
+                operand = arena_strdup(prog->arena, operand);
+            }
+            node->operand = (char *)operand;
+            rewrite_node_opcode(prog, index, action->op);
+        }
+    }
+    count_optimization(prog, rule->name);
+
+    if (prog->trace_level > 1) {
+        program_log(prog, "DEBUG peephole: %s at line %d\n", rule->name,
+                    prog->nodes[start].line_num);
+    }
+}
+
+/**
+ * @brief Table-driven peephole optimization
+ *
+ * At every instruction, follows the trie of the rule set along the
+ * instructions that come next and applies the highest-ranked rule that
+ * matches there, if any.
+ *
+ * @param prog Program to optimize
+ * @param start First node index to examine
+ * @param end One past the last node index to examine
+ */
+void optimize_peephole_ast(Program *prog, int start, int end) {
+    const RuleSet *set = prog->rules ? prog->rules : default_rule_set();
+    if (!set || set->count == 0) return;
+
+    unsigned int cpus = prog->cpu_type == CPU_6502 ? CPUM_6502 :
+                        prog->cpu_type == CPU_65C02 ? CPUM_65C02 :
+                        prog->cpu_type == CPU_65816 ? CPUM_65816 : CPUM_45GS02;
+    const char *bound[RULE_MAX_CAPTURES];
+    const char *best_bound[RULE_MAX_CAPTURES];
+
+    for (int i = start; i < end; i++) {
+        if (!matchable(prog, i, true)) continue;
+
+        int best = -1;
+        int s = 0;
+        for (int k = i; k < prog->count && matchable(prog, k, k == i); k++) {
+            s = set->states[s].next[prog->nodes[k].op];
+            if (s == 0) break;
 
-        // LDA #value followed by STA then LDA #same_value
-        if (node->opcode && strcmp(node->opcode, "LDA") == 0 && node->next) {
-            AstNode *next1 = node->next;
-            if (next1->opcode && strcmp(next1->opcode, "STA") == 0 && next1->next) {
-                AstNode *next2 = next1->next;
-                if (next2->opcode && strcmp(next2->opcode, "LDA") == 0) {
-                    if (node->operand && next2->operand && strcmp(node->operand, next2->operand) == 0) {
-                        next2->is_dead = true;
-                        prog->optimizations++;
-                    }
+            // Rules ending here are in priority order; stop at the first that applies
+            for (int r = set->states[s].rules; r >= 0 && (best < 0 || r < best);
+                 r = set->rules[r].next) {
+                if (rule_applies(prog, &set->rules[r], i, cpus, bound)) {
+                    best = r;
+                    memcpy(best_bound, bound, sizeof(bound));
+                    break;
                 }
             }
         }
 
-        node = node->next;
+        if (best >= 0) apply_rule(prog, &set->rules[best], i, best_bound);
     }
 }
@@ -0,0 +1,522 @@
+/**
+ * @file rules.c
+ * @brief Declarative peephole rule table implementation
+ *
+ * Parses rule text into patterns and replacements and inserts each
+ * pattern's opcode sequence into a trie. The built-in rules below are
+ * parsed the same way as rule files.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "rules.h"
+#include "../program/cache.h"
+#include "../program/source.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/**
+ * @brief Built-in rules, in priority order
+ *
+ * The generic rules rank before the CPU-specific ones, as their passes
+ * used to run first.
+ */
+static const char *const builtin_rules[] = {
+    // The accumulator still holds the value after the store
+    "peephole.repeated_load: LDA {v}; STA; LDA {v} => =; =; -",
+
+    // TAX then TXA leaves A as it was
+    "register_usage.tax_txa: TAX; TXA => -; -",
+
+    // Tail call: the callee's RTS returns to our caller (dead code
+    // elimination then drops the unreachable RTS)
+    "jumps.tail_call: JSR; RTS => JMP; =",
+    "jumps.tail_call_long [65816]: JSL; RTL => JML; =",
+
+    // Repeated stores of one value through Z (STZ stores Z on the 45GS02)
+    "45gs02.ldz_same_value [45gs02]: LDA@imm {v}; STA; LDA@imm {v}; STA => LDZ; STZ; -; STZ",
+
+    // Two's complement negation
+    "45gs02.neg [45gs02]: EOR #$FF; SEC; ADC #$00 => NEG _; -; -",
+
+    // Arithmetic shift right
+    "45gs02.asr [45gs02]: CMP #$80; ROR@acc => ASR _; -",
+};
+
+/** Addressing mode names for @mode guards */
+static const struct {
+    const char *name;
+    AddrMode mode;
+} mode_names[] = {
+    {"imp", AM_IMPLIED}, {"acc", AM_ACCUMULATOR}, {"imm", AM_IMMEDIATE},
+    {"zp", AM_ZEROPAGE}, {"zpx", AM_ZEROPAGE_X}, {"zpy", AM_ZEROPAGE_Y},
+    {"abs", AM_ABSOLUTE}, {"absx", AM_ABSOLUTE_X}, {"absy", AM_ABSOLUTE_Y},
+    {"ind", AM_INDIRECT}, {"indx", AM_INDEXED_INDIRECT}, {"indy", AM_INDIRECT_INDEXED},
+    {"zpind", AM_ZP_INDIRECT}, {"indz", AM_INDIRECT_Z}, {"rel", AM_RELATIVE},
+};
+
+static RuleSet builtin_set;     /**< Compiled built-in rules */
+static bool builtin_ready;      /**< builtin_set has been compiled */
+
+/**
+ * @brief Parser state of one rule
+ */
+typedef struct {
+    const char *origin;         /**< File name for messages */
+    int line_num;               /**< Line number for messages */
+    char *names[RULE_MAX_CAPTURES]; /**< Capture names in slot order */
+    int captures;               /**< Capture slots used */
+} RuleParser;
+
+/**
+ * @brief Report a malformed rule
+ *
+ * @param parser Parser state
+ * @param message What is wrong
+ * @return false, for returning straight from the parser
+ */
+static bool rule_error(const RuleParser *parser, const char *message) {
+    fprintf(stderr, "Error: %s:%d: %s\n", parser->origin, parser->line_num, message);
+    return false;
+}
+
+/**
+ * @brief Copy part of a string
+ *
+ * @param text Start of the text
+ * @param len Length of the text
+ * @return New NUL-terminated copy, or NULL on allocation failure
+ */
+static char* copy_text(const char *text, size_t len) {
+    char *copy = malloc(len + 1);
+    if (copy) {
+        memcpy(copy, text, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+/**
+ * @brief Trim white space from both ends of a slice
+ *
+ * @param start Start of the slice (updated)
+ * @param end End of the slice (updated)
+ */
+static void trim(const char **start, const char **end) {
+    while (*start < *end && isspace((unsigned char)**start)) (*start)++;
+    while (*end > *start && isspace((unsigned char)(*end)[-1])) (*end)--;
+}
+
+/**
+ * @brief Parse an operand template
+ *
+ * @param parser Parser state (capture names are bound here)
+ * @param text Start of the template
+ * @param end End of the template
+ * @param operand Where to store the template
+ * @return false if the template is malformed or memory is short
+ */
+static bool parse_operand(RuleParser *parser, const char *text, const char *end,
+                          RuleOperand *operand) {
+    size_t len = end - text;
+    memset(operand, 0, sizeof(*operand));
+
+    if (len == 0 || (len == 1 && text[0] == '*')) {
+        operand->kind = RULE_OPERAND_ANY;
+    } else if (len == 1 && text[0] == '_') {
+        operand->kind = RULE_OPERAND_NONE;
+    } else if (text[0] == '{' && end[-1] == '}' && len > 2) {
+        operand->kind = RULE_OPERAND_CAPTURE;
+        for (int c = 0; c < parser->captures; c++) {
+            if (strlen(parser->names[c]) == len - 2 &&
+                memcmp(parser->names[c], text + 1, len - 2) == 0) {
+                operand->capture = c;
+                return true;
+            }
+        }
+        if (parser->captures == RULE_MAX_CAPTURES) {
+            return rule_error(parser, "Too many {name} operands");
+        }
+        parser->names[parser->captures] = copy_text(text + 1, len - 2);
+        if (!parser->names[parser->captures]) return rule_error(parser, "Out of memory");
+        operand->capture = parser->captures++;
+    } else {
+        operand->kind = RULE_OPERAND_LITERAL;
+        operand->text = copy_text(text, len);
+        if (!operand->text) return rule_error(parser, "Out of memory");
+    }
+    return true;
+}
+
+/**
+ * @brief Parse an opcode with an optional @mode guard
+ *
+ * @param parser Parser state
+ * @param text Start of the word
+ * @param end End of the word
+ * @param op Where to store the opcode
+ * @param mode Where to store the mode (AM_NONE if there is no guard), or
+ *             NULL if guards are not allowed
+ * @return false if the word is malformed
+ */
+static bool parse_opcode(const RuleParser *parser, const char *text, const char *end,
+                         Opcode *op, AddrMode *mode) {
+    const char *at = memchr(text, '@', end - text);
+    *op = lookup_opcode(text, (at ? at : end) - text);
+    if (*op == OP_NONE) return rule_error(parser, "Unknown opcode");
+    if (!at) {
+        if (mode) *mode = AM_NONE;
+        return true;
+    }
+    if (!mode) return rule_error(parser, "Replacements cannot have an @mode");
+
+    size_t len = end - at - 1;
+    for (size_t m = 0; m < sizeof(mode_names) / sizeof(mode_names[0]); m++) {
+        if (strlen(mode_names[m].name) == len && strncasecmp(mode_names[m].name, at + 1, len) == 0) {
+            *mode = mode_names[m].mode;
+            return true;
+        }
+    }
+    return rule_error(parser, "Unknown addressing mode");
+}
+
+/**
+ * @brief Split the next ';'-separated item off a list
+ *
+ * @param p Current position (advanced past the item and separator)
+ * @param end End of the list
+ * @param start Where to store the start of the item
+ * @param stop Where to store the end of the item
+ * @return false if the list is exhausted
+ */
+static bool next_item(const char **p, const char *end, const char **start, const char **stop) {
+    if (*p > end) return false;
+    const char *sep = memchr(*p, ';', end - *p);
+    *start = *p;
+    *stop = sep ? sep : end;
+    *p = sep ? sep + 1 : end + 1;
+    trim(start, stop);
+    return true;
+}
+
+/**
+ * @brief Split an instruction into its opcode word and operand
+ *
+ * @param start Start of the instruction
+ * @param stop End of the instruction
+ * @param word_end Where to store the end of the opcode word
+ * @param operand Where to store the start of the operand
+ */
+static void split_instruction(const char *start, const char *stop, const char **word_end,
+                              const char **operand) {
+    const char *p = start;
+    while (p < stop && !isspace((unsigned char)*p)) p++;
+    *word_end = p;
+    while (p < stop && isspace((unsigned char)*p)) p++;
+    *operand = p;
+}
+
+/**
+ * @brief Parse the optional [cpus] list of a rule
+ *
+ * @param parser Parser state
+ * @param start Start of the list, without brackets
+ * @param end End of the list
+ * @param cpus Where to store the CPUM_* mask
+ * @return false if a CPU name is unknown
+ */
+static bool parse_cpus(const RuleParser *parser, const char *start, const char *end,
+                       unsigned int *cpus) {
+    *cpus = 0;
+    while (start < end) {
+        const char *comma = memchr(start, ',', end - start);
+        const char *stop = comma ? comma : end;
+        trim(&start, &stop);
+
+        char name[16];
+        CpuType cpu;
+        if (stop - start >= (long)sizeof(name)) return rule_error(parser, "Unknown CPU");
+        memcpy(name, start, stop - start);
+        name[stop - start] = '\0';
+        if (!parse_cpu_type(name, &cpu)) return rule_error(parser, "Unknown CPU");
+
+        *cpus |= cpu == CPU_6502 ? CPUM_6502 : cpu == CPU_65C02 ? CPUM_65C02 :
+                 cpu == CPU_65816 ? CPUM_65816 : CPUM_45GS02;
+        start = comma ? comma + 1 : end;
+    }
+    return true;
+}
+
+/**
+ * @brief Free the strings owned by a rule
+ * @param rule Rule to clear
+ */
+static void free_rule(Rule *rule) {
+    free(rule->name);
+    for (int k = 0; k < rule->length; k++) {
+        free(rule->match[k].operand.text);
+        free(rule->replace[k].operand.text);
+    }
+}
+
+/**
+ * @brief Parse one rule
+ *
+ * @param parser Parser state
+ * @param text Rule text
+ * @param rule Where to store the rule (owns its strings even on failure)
+ * @return false if the rule is malformed or memory is short
+ */
+static bool parse_rule(RuleParser *parser, const char *text, Rule *rule) {
+    memset(rule, 0, sizeof(*rule));
+    rule->cpus = CPUM_ALL;
+    rule->next = -1;
+
+    const char *end = text + strlen(text);
+    const char *colon = strchr(text, ':');
+    const char *arrow = colon ? strstr(colon, "=>") : NULL;
+    if (!colon || !arrow) return rule_error(parser, "Expected 'name: pattern => replacement'");
+
+    // Name and optional CPU list
+    const char *name = text;
+    const char *name_end = colon;
+    const char *bracket = memchr(text, '[', colon - text);
+    if (bracket) {
+        const char *close = memchr(bracket, ']', colon - bracket);
+        if (!close) return rule_error(parser, "Missing ']'");
+        if (!parse_cpus(parser, bracket + 1, close, &rule->cpus)) return false;
+        name_end = bracket;
+    }
+    trim(&name, &name_end);
+    if (name == name_end) return rule_error(parser, "Missing rule name");
+    rule->name = copy_text(name, name_end - name);
+    if (!rule->name) return rule_error(parser, "Out of memory");
+
+    // Pattern
+    const char *p = colon + 1;
+    const char *start, *stop;
+    while (next_item(&p, arrow, &start, &stop)) {
+        if (start == stop) return rule_error(parser, "Empty pattern instruction");
+        if (rule->length == RULE_MAX_LENGTH) return rule_error(parser, "Pattern too long");
+
+        RulePattern *match = &rule->match[rule->length++];
+        const char *word_end, *operand;
+        split_instruction(start, stop, &word_end, &operand);
+        if (!parse_opcode(parser, start, word_end, &match->op, &match->mode)) return false;
+        if (!parse_operand(parser, operand, stop, &match->operand)) return false;
+    }
+    int matched = parser->captures;
+
+    // Replacement, one item per pattern instruction
+    p = arrow + 2;
+    int k = 0;
+    while (next_item(&p, end, &start, &stop)) {
+        if (k == rule->length) return rule_error(parser, "More replacements than pattern instructions");
+
+        RuleAction *action = &rule->replace[k++];
+        if (stop - start == 1 && *start == '=') {
+            action->kind = RULE_KEEP;
+        } else if (stop - start == 1 && *start == '-') {
+            action->kind = RULE_REMOVE;
+        } else {
+            const char *word_end, *operand;
+            split_instruction(start, stop, &word_end, &operand);
+            action->kind = RULE_REWRITE;
+            if (!parse_opcode(parser, start, word_end, &action->op, NULL)) return false;
+            if (!parse_operand(parser, operand, stop, &action->operand)) return false;
+        }
+    }
+    if (k != rule->length) return rule_error(parser, "Need one replacement per pattern instruction");
+    if (parser->captures != matched) return rule_error(parser, "Replacement uses an unbound {name}");
+
+    rule->captures = parser->captures;
+    return true;
+}
+
+/**
+ * @brief Add a trie state
+ *
+ * @param set Rule set
+ * @return Index of the new state, or -1 on allocation failure
+ */
+static int add_state(RuleSet *set) {
+    if (set->state_count == set->state_capacity) {
+        int capacity = set->state_capacity ? set->state_capacity * 2 : 16;
+        RuleState *states = realloc(set->states, capacity * sizeof(RuleState));
+        if (!states) return -1;
+        set->states = states;
+        set->state_capacity = capacity;
+    }
+    RuleState *state = &set->states[set->state_count];
+    memset(state->next, 0, sizeof(state->next));
+    state->rules = -1;
+    return set->state_count++;
+}
+
+/**
+ * @brief Insert the pattern of the last rule into the trie
+ *
+ * @param set Rule set whose last rule to insert
+ * @return false on allocation failure
+ */
+static bool insert_rule(RuleSet *set) {
+    int index = set->count - 1;
+    const Rule *rule = &set->rules[index];
+
+    int s = 0;
+    for (int k = 0; k < rule->length; k++) {
+        int next = set->states[s].next[rule->match[k].op];
+        if (next == 0) {
+            next = add_state(set);
+            if (next < 0) return false;
+            set->states[s].next[rule->match[k].op] = next;
+        }
+        s = next;
+    }
+
+    // Keep the rules of a state in priority order
+    int *link = &set->states[s].rules;
+    while (*link >= 0) link = &set->rules[*link].next;
+    *link = index;
+    return true;
+}
+
+/**
+ * @brief Parse a rule and add it to a rule set
+ *
+ * @param set Rule set to extend
+ * @param text Rule text (one line, see the file comment)
+ * @param origin File name for error messages
+ * @param line_num Line number for error messages
+ * @return false if the rule is malformed or memory is short
+ */
+bool rule_set_add(RuleSet *set, const char *text, const char *origin, int line_num) {
+    if (set->count == set->capacity) {
+        int capacity = set->capacity ? set->capacity * 2 : 16;
+        Rule *rules = realloc(set->rules, capacity * sizeof(Rule));
+        if (!rules) return false;
+        set->rules = rules;
+        set->capacity = capacity;
+    }
+    if (set->state_count == 0 && add_state(set) < 0) return false;
+
+    RuleParser parser = { origin, line_num, {NULL}, 0 };
+    Rule *rule = &set->rules[set->count];
+    bool ok = parse_rule(&parser, text, rule);
+    for (int c = 0; c < parser.captures; c++) {
+        free(parser.names[c]);
+    }
+    if (!ok) {
+        free_rule(rule);
+        return false;
+    }
+
+    set->count++;
+    if (!insert_rule(set)) {
+        free_rule(rule);
+        set->count--;
+        return false;
+    }
+    set->hash = cache_hash(set->hash, text, strlen(text) + 1);
+    return true;
+}
+
+/**
+ * @brief Add the built-in rules to an empty rule set
+ *
+ * @param set Rule set to fill in
+ * @return false on failure
+ */
+static bool add_builtin_rules(RuleSet *set) {
+    opcodes_init();  // Rules name opcodes
+    memset(set, 0, sizeof(*set));
+    set->hash = CACHE_HASH_SEED;
+    for (size_t r = 0; r < sizeof(builtin_rules) / sizeof(builtin_rules[0]); r++) {
+        if (!rule_set_add(set, builtin_rules[r], "built-in rules", (int)r + 1)) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Compile the built-in rule set
+ */
+void rules_init(void) {
+    if (builtin_ready) return;
+    builtin_ready = add_builtin_rules(&builtin_set);
+}
+
+/**
+ * @brief Built-in rule set
+ *
+ * @return Shared read-only rule set, or NULL if rules_init() failed
+ */
+const RuleSet* default_rule_set(void) {
+    return builtin_ready ? &builtin_set : NULL;
+}
+
+/**
+ * @brief Create a rule set holding a copy of the built-in rules
+ *
+ * @return New rule set, or NULL on failure
+ */
+RuleSet* create_rule_set(void) {
+    RuleSet *set = malloc(sizeof(RuleSet));
+    if (set && !add_builtin_rules(set)) {
+        free_rule_set(set);
+        set = NULL;
+    }
+    return set;
+}
+
+/**
+ * @brief Add every rule of a rule file to a rule set
+ *
+ * @param set Rule set to extend
+ * @param path Rule file name
+ * @return false if the file cannot be read or a rule is malformed
+ */
+bool rule_set_load_file(RuleSet *set, const char *path) {
+    SourceBuffer *file = source_open(path);
+    if (!file) {
+        fprintf(stderr, "Error: Cannot open rule file %s\n", path);
+        return false;
+    }
+
+    bool ok = true;
+    const char *p = file->data;
+    const char *end = file->data + file->size;
+    for (int line_num = 1; ok && p < end; line_num++) {
+        const char *eol = memchr(p, '\n', end - p);
+        const char *start = p;
+        const char *stop = eol ? eol : end;
+        trim(&start, &stop);
+
+        if (start < stop && *start != '#') {
+            char *text = copy_text(start, stop - start);
+            ok = text && rule_set_add(set, text, path, line_num);
+            free(text);
+        }
+        p = eol ? eol + 1 : end;
+    }
+
+    source_close(file);
+    return ok;
+}
+
+/**
+ * @brief Free a rule set
+ *
+ * @param set Rule set to free (NULL-safe)
+ */
+void free_rule_set(RuleSet *set) {
+    if (!set) return;
+    for (int r = 0; r < set->count; r++) {
+        free_rule(&set->rules[r]);
+    }
+    free(set->rules);
+    free(set->states);
+    free(set);
+}
@@ -0,0 +1,182 @@
+/**
+ * @file rules.h
+ * @brief Declarative peephole rule table (-rules)
+ *
+ * Peephole rewrites are described as rules rather than code. A rule is a
+ * short sequence of instruction templates and what to replace each
+ * matched instruction with:
+ *
+ * @code
+ *   # name [cpus]: pattern => replacement
+ *   peephole.repeated_load: LDA {v}; STA; LDA {v} => =; =; -
+ *   45gs02.neg [45gs02]: EOR #$FF; SEC; ADC #$00 => NEG _; -; -
+ * @endcode
+ *
+ * Pattern instructions are an opcode, optionally followed by @mode
+ * (imp, acc, imm, zp, zpx, zpy, abs, absx, absy, ind, indx, indy, zpind,
+ * indz, rel), and an operand template:
+ * - nothing or '*': any operand
+ * - '_': no operand
+ * - {name}: any operand; every {name} of the rule must be the same text
+ * - anything else: exactly this operand text
+ *
+ * Replacements, one per pattern instruction:
+ * - '=': keep the instruction
+ * - '-': remove it
+ * - an opcode: rewrite the instruction to it, keeping the operand, or
+ *   with the operand given as '_' (none), {name} or literal text
+ *
+ * The optional CPU list ("6502,65c02,65816,45gs02") limits a rule to
+ * those targets. A rule only applies if the rewritten code is cheaper
+ * under the selected mode (see cost.h), and only if every register or
+ * flag the replacement leaves with a different value is dead afterwards
+ * (see liveness.h). Registers both sides write are assumed to end up
+ * equal. Blank lines and lines starting with '#' are ignored.
+ *
+ * Rules are compiled into a trie over their opcode sequences, so one
+ * left-to-right scan finds every rule that matches at each position,
+ * however many rules there are. Where several match, the one listed
+ * first wins.
+ */
+
+#ifndef RULES_H
+#define RULES_H
+
+#include "../types.h"
+#include <stdint.h>
+
+#define RULE_MAX_LENGTH 8       /**< Most instructions in one pattern */
+#define RULE_MAX_CAPTURES 8     /**< Most distinct {name} operands in one rule */
+
+/**
+ * @brief What an operand template accepts or produces
+ */
+typedef enum {
+    RULE_OPERAND_ANY,           /**< Any operand (replacement: keep it) */
+    RULE_OPERAND_NONE,          /**< No operand */
+    RULE_OPERAND_CAPTURE,       /**< Operand bound by {name} */
+    RULE_OPERAND_LITERAL        /**< Exactly this text */
+} RuleOperandKind;
+
+/**
+ * @brief One operand template
+ */
+typedef struct {
+    RuleOperandKind kind;       /**< Template kind */
+    int capture;                /**< Capture slot (RULE_OPERAND_CAPTURE) */
+    char *text;                 /**< Operand text (RULE_OPERAND_LITERAL) */
+} RuleOperand;
+
+/**
+ * @brief One pattern instruction
+ */
+typedef struct {
+    Opcode op;                  /**< Opcode to match */
+    AddrMode mode;              /**< Addressing mode to match, AM_NONE for any */
+    RuleOperand operand;        /**< Operand to match */
+} RulePattern;
+
+/**
+ * @brief What happens to one matched instruction
+ */
+typedef enum {
+    RULE_KEEP,                  /**< Leave it as it is */
+    RULE_REMOVE,                /**< Mark it dead */
+    RULE_REWRITE                /**< Give it a new opcode and operand */
+} RuleActionKind;
+
+/**
+ * @brief Replacement of one matched instruction
+ */
+typedef struct {
+    RuleActionKind kind;        /**< Action */
+    Opcode op;                  /**< New opcode (RULE_REWRITE) */
+    RuleOperand operand;        /**< New operand (RULE_REWRITE; ANY keeps it) */
+} RuleAction;
+
+/**
+ * @brief One compiled rule
+ */
+typedef struct {
+    char *name;                 /**< Rule name, counted under it by -stats */
+    unsigned int cpus;          /**< CPUM_* mask of the targets it applies to */
+    int length;                 /**< Number of pattern instructions */
+    RulePattern match[RULE_MAX_LENGTH];  /**< Pattern, in order */
+    RuleAction replace[RULE_MAX_LENGTH]; /**< Replacement of each instruction */
+    int captures;               /**< Number of capture slots used */
+    int next;                   /**< Next rule ending at the same trie state, or -1 */
+} Rule;
+
+/**
+ * @brief One trie state: a prefix of one or more patterns
+ */
+typedef struct {
+    int next[OP_COUNT];         /**< State after each opcode, 0 if none */
+    int rules;                  /**< First rule whose pattern ends here, or -1 */
+} RuleState;
+
+/**
+ * @brief A compiled set of rules
+ */
+typedef struct RuleSet {
+    Rule *rules;                /**< Rules in priority order */
+    int count;                  /**< Number of rules */
+    int capacity;               /**< Allocated entries in rules */
+    RuleState *states;          /**< Trie states; state 0 is the root */
+    int state_count;            /**< Number of states */
+    int state_capacity;         /**< Allocated entries in states */
+    uint64_t hash;              /**< Hash of the rule text (part of -cache keys) */
+} RuleSet;
+
+/**
+ * @brief Compile the built-in rule set
+ *
+ * Called by create_program(); later calls do nothing. Like
+ * opcodes_init(), the first call must return before programs are
+ * optimized on other threads.
+ */
+void rules_init(void);
+
+/**
+ * @brief Built-in rule set
+ * @return Shared read-only rule set, or NULL if rules_init() failed
+ */
+const RuleSet* default_rule_set(void);
+
+/**
+ * @brief Create a rule set holding a copy of the built-in rules
+ * @return New rule set, or NULL on failure
+ */
+RuleSet* create_rule_set(void);
+
+/**
+ * @brief Parse a rule and add it to a rule set
+ *
+ * Prints an error naming origin and line_num if the rule is malformed.
+ *
+ * @param set Rule set to extend
+ * @param text Rule text (one line, see the file comment)
+ * @param origin File name for error messages
+ * @param line_num Line number for error messages
+ * @return false if the rule is malformed or memory is short
+ */
+bool rule_set_add(RuleSet *set, const char *text, const char *origin, int line_num);
+
+/**
+ * @brief Add every rule of a rule file to a rule set
+ *
+ * The file's rules rank after those already in the set.
+ *
+ * @param set Rule set to extend
+ * @param path Rule file name
+ * @return false if the file cannot be read or a rule is malformed
+ */
+bool rule_set_load_file(RuleSet *set, const char *path);
+
+/**
+ * @brief Free a rule set
+ * @param set Rule set to free (NULL-safe)
+ */
+void free_rule_set(RuleSet *set);
+
+#endif // RULES_H
@@ -0,0 +1,1249 @@
+/**
+ * @file superopt.c
+ * @brief Bounded superoptimizer for short hot sequences (-superopt)
+ *
+ * Hand-written rules only find the rewrites someone thought of. With
+ * -superopt this pass takes windows of two to SUPEROPT_WINDOW
+ * straight-line instructions from hot blocks (blocks inside a loop, or
+ * those a -profile shows hot, in speed mode; every block in size mode)
+ * and tries every sequence of up to SUPEROPT_MAX_LENGTH instructions,
+ * shortest first, for one that the cost model prefers and that leaves
+ * every live register and flag and every memory operand as the window
+ * does.
+ *
+ * Sequences run on concrete values with the register and flag
+ * semantics of update_register_state(); a memory operand is fed in as
+ * an immediate. A candidate that matches the window on a few test
+ * inputs is then checked on every input either sequence depends on,
+ * which proves it equal; if that is more than SUPEROPT_MAX_INPUT_BITS
+ * bits, the candidate is not used. Instructions the register tracker
+ * does not compute (ADC, SBC, BIT, stack and flow instructions, indexed
+ * and indirect modes) end a window. The 65816 is not searched, since a
+ * window does not know its register widths.
+ *
+ * Windows are canonicalized before the search: memory operands become
+ * numbered slots (z for zero page, m for absolute), immediates stay as
+ * values, and the CPU, mode and live registers and flags after the
+ * window complete the key. Results live in the memo file named by
+ * -superopt (see superopt.h), so each window is searched once, across
+ * runs and projects:
+ *
+ * @code
+ *   # opt6502 superoptimizer memo 1.0
+ *   6502 speed 0300 LDA z0; STA m0; LDA z0 => LDA z0; STA m0
+ *   65c02 size 0107 LDA #$00; STA m0 => STZ m0
+ *   6502 speed 0707 LDA z0; TAX => none
+ * @endcode
+ *
+ * A replacement read from the memo is proven again the first time a run
+ * uses it. Distinct memory operands are assumed to be distinct, ordinary
+ * memory, as the peephole rules assume.
+ */
+
+#include "optimizer.h"
+#include "superopt.h"
+#include "../ast/ast.h"
+#include "../analysis/cfg.h"
+#include "../analysis/cost.h"
+#include "../analysis/liveness.h"
+#include "../analysis/loops.h"
+#include "../analysis/registers.h"
+#include "../program/cache.h"
+#include "../program/profile.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SUPEROPT_WINDOW 5           /**< Most instructions in a searched window */
+#define SUPEROPT_MAX_LENGTH 3       /**< Most instructions in a replacement */
+#define SUPEROPT_MAX_SLOTS 3        /**< Most distinct memory operands in a window */
+#define SUPEROPT_MAX_VALUES 4       /**< Most distinct immediates in a window */
+#define SUPEROPT_MAX_INPUT_BITS 18  /**< Largest input space a proof enumerates */
+#define SUPEROPT_VECTORS 8          /**< Test inputs a candidate must pass first */
+#define SUPEROPT_SEARCH_NODES 50000 /**< Candidate prefixes tried per window */
+#define SUPEROPT_MAX_ALPHABET 160   /**< Most instructions a search draws from */
+#define SUPEROPT_KEY_SIZE 256       /**< Size of a memo key or value */
+#define SUPEROPT_MEMO_MAGIC "# opt6502 superoptimizer memo"
+
+/* ---------------------------------------------------------------------
+ * Memo database
+ * ------------------------------------------------------------------- */
+
+/**
+ * @brief One memo entry
+ */
+typedef struct {
+    char *key;                  /**< CPU, mode, live mask and canonical window */
+    char *value;                /**< Canonical replacement, "-" for none, or "none" */
+    bool proven;                /**< Replacement proven during this run */
+} MemoEntry;
+
+/**
+ * @brief Memo of search results (see superopt.h)
+ */
+struct SuperoptMemo {
+    char *path;                 /**< Memo file */
+    MemoEntry *entries;         /**< Open-addressed table */
+    size_t capacity;            /**< Table size (a power of two) */
+    size_t count;               /**< Entries in use */
+    bool changed;               /**< Entries were added since the file was read */
+    pthread_mutex_t lock;       /**< Protects everything above */
+};
+
+/**
+ * @brief Find the table slot of a key
+ *
+ * @param memo Memo
+ * @param key Key
+ * @return Entry holding the key, or the empty entry where it belongs
+ */
+static MemoEntry* memo_slot(const struct SuperoptMemo *memo, const char *key) {
+    size_t mask = memo->capacity - 1;
+    size_t i = (size_t)cache_hash(CACHE_HASH_SEED, key, strlen(key)) & mask;
+    while (memo->entries[i].key && strcmp(memo->entries[i].key, key) != 0) i = (i + 1) & mask;
+    return &memo->entries[i];
+}
+
+/**
+ * @brief Add or replace an entry (caller holds the lock)
+ *
+ * @param memo Memo
+ * @param key Key
+ * @param value Result
+ * @param proven Result was proven in this run
+ * @return false on allocation failure
+ */
+static bool memo_put(struct SuperoptMemo *memo, const char *key, const char *value, bool proven) {
+    if ((memo->count + 1) * 4 > memo->capacity * 3) {
+        size_t capacity = memo->capacity * 2;
+        MemoEntry *entries = calloc(capacity, sizeof(MemoEntry));
+        if (!entries) return false;
+        MemoEntry *old = memo->entries;
+        size_t old_capacity = memo->capacity;
+        memo->entries = entries;
+        memo->capacity = capacity;
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old[i].key) *memo_slot(memo, old[i].key) = old[i];
+        }
+        free(old);
+    }
+
+    MemoEntry *entry = memo_slot(memo, key);
+    char *copy = malloc(strlen(value) + 1);
+    if (!copy) return false;
+    strcpy(copy, value);
+    if (!entry->key) {
+        entry->key = malloc(strlen(key) + 1);
+        if (!entry->key) {
+            free(copy);
+            return false;
+        }
+        strcpy(entry->key, key);
+        memo->count++;
+    }
+    free(entry->value);
+    entry->value = copy;
+    entry->proven = proven;
+    return true;
+}
+
+/**
+ * @brief Read the entries of a memo file
+ *
+ * @param memo Memo to fill
+ * @param fp Open memo file
+ */
+static void memo_read(struct SuperoptMemo *memo, FILE *fp) {
+    char line[2 * SUPEROPT_KEY_SIZE + 8];
+    char header[64];
+    snprintf(header, sizeof(header), "%s %s", SUPEROPT_MEMO_MAGIC, OPT6502_VERSION);
+
+    bool first = true;
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (first) {
+            first = false;
+            if (strcmp(line, header) != 0) {
+                memo->changed = true;   // Another version: start afresh
+                return;
+            }
+            continue;
+        }
+        char *arrow = strstr(line, " => ");
+        if (line[0] == '#' || !arrow) continue;
+        *arrow = '\0';
+        if (!memo_put(memo, line, arrow + 4, false)) return;
+    }
+}
+
+/**
+ * @brief Open a memo file
+ */
+struct SuperoptMemo* open_superopt_memo(const char *path) {
+    struct SuperoptMemo *memo = calloc(1, sizeof(*memo));
+    if (!memo) return NULL;
+    memo->capacity = 256;
+    memo->entries = calloc(memo->capacity, sizeof(MemoEntry));
+    memo->path = malloc(strlen(path) + 1);
+    if (!memo->entries || !memo->path) {
+        free(memo->entries);
+        free(memo->path);
+        free(memo);
+        return NULL;
+    }
+    strcpy(memo->path, path);
+    pthread_mutex_init(&memo->lock, NULL);
+
+    FILE *fp = fopen(path, "r");
+    if (fp) {
+        memo_read(memo, fp);
+        fclose(fp);
+    }
+    return memo;
+}
+
+/**
+ * @brief Order memo entries by key
+ */
+static int compare_entries(const void *a, const void *b) {
+    return strcmp(((const MemoEntry *)a)->key, ((const MemoEntry *)b)->key);
+}
+
+/**
+ * @brief Write a memo file
+ *
+ * Entries are sorted, so the file only changes where results were added.
+ *
+ * @param memo Memo to write
+ * @return false if the file could not be written
+ */
+static bool memo_write(const struct SuperoptMemo *memo) {
+    MemoEntry *sorted = malloc((memo->count ? memo->count : 1) * sizeof(MemoEntry));
+    size_t len = strlen(memo->path);
+    char *tmp = malloc(len + 5);
+    if (!sorted || !tmp) {
+        free(sorted);
+        free(tmp);
+        return false;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < memo->capacity; i++) {
+        if (memo->entries[i].key) sorted[n++] = memo->entries[i];
+    }
+    qsort(sorted, n, sizeof(MemoEntry), compare_entries);
+
+    snprintf(tmp, len + 5, "%s.tmp", memo->path);
+    FILE *fp = fopen(tmp, "w");
+    bool ok = fp != NULL;
+    if (fp) {
+        fprintf(fp, "%s %s\n", SUPEROPT_MEMO_MAGIC, OPT6502_VERSION);
+        for (size_t i = 0; i < n; i++) fprintf(fp, "%s => %s\n", sorted[i].key, sorted[i].value);
+        if (fclose(fp) != 0) ok = false;
+        if (ok) ok = rename(tmp, memo->path) == 0;
+        if (!ok) remove(tmp);
+    }
+    free(sorted);
+    free(tmp);
+    return ok;
+}
+
+/**
+ * @brief Write a memo back, if it changed, and free it
+ */
+bool close_superopt_memo(struct SuperoptMemo *memo) {
+    if (!memo) return true;
+
+    bool ok = !memo->changed || memo_write(memo);
+    if (!ok) fprintf(stderr, "Error: Cannot write superoptimizer memo %s\n", memo->path);
+
+    for (size_t i = 0; i < memo->capacity; i++) {
+        free(memo->entries[i].key);
+        free(memo->entries[i].value);
+    }
+    pthread_mutex_destroy(&memo->lock);
+    free(memo->entries);
+    free(memo->path);
+    free(memo);
+    return ok;
+}
+
+/* ---------------------------------------------------------------------
+ * Sequences and their execution
+ * ------------------------------------------------------------------- */
+
+/**
+ * @brief One instruction of a canonical sequence
+ */
+typedef struct {
+    Opcode op;                  /**< Opcode */
+    AddrMode mode;              /**< Implied, accumulator, immediate, zero page or absolute */
+    int slot;                   /**< Memory slot (zero page or absolute), else -1 */
+    int value;                  /**< Immediate value, else -1 */
+} SuperInstr;
+
+/**
+ * @brief Registers, flags and memory slots a sequence reads and writes
+ */
+typedef struct {
+    unsigned int exposed;       /**< RF_* read before the sequence writes them */
+    unsigned int writes;        /**< RF_* written */
+    unsigned int slot_exposed;  /**< Slots read before the sequence writes them */
+    unsigned int slot_writes;   /**< Slots written */
+} Effects;
+
+/**
+ * @brief Machine state a sequence runs on
+ */
+typedef struct {
+    RegisterState regs;         /**< Registers and flags, all known */
+    unsigned char mem[SUPEROPT_MAX_SLOTS]; /**< Memory slot contents */
+} Machine;
+
+/**
+ * @brief Check whether an instruction can be executed on concrete values
+ *
+ * @param op Opcode
+ * @param mode Addressing mode
+ * @return true if update_register_state() computes everything it writes
+ */
+static bool modeled(Opcode op, AddrMode mode) {
+    bool mem = mode == AM_ZEROPAGE || mode == AM_ABSOLUTE;
+    switch (op) {
+        case OP_LDA: case OP_LDX: case OP_LDY: case OP_LDZ:
+        case OP_AND: case OP_ORA: case OP_EOR:
+        case OP_CMP: case OP_CPX: case OP_CPY: case OP_CPZ:
+            return mode == AM_IMMEDIATE || mem;
+        case OP_STA: case OP_STX: case OP_STY: case OP_STZ:
+            return mem;
+        case OP_INC: case OP_DEC: case OP_ASL: case OP_LSR: case OP_ROL: case OP_ROR:
+            return mode == AM_ACCUMULATOR || mem;
+        case OP_ASR:
+            return mode == AM_ACCUMULATOR;
+        case OP_NEG:
+            return mode == AM_IMPLIED || mode == AM_ACCUMULATOR;
+        case OP_TAX: case OP_TXA: case OP_TAY: case OP_TYA: case OP_TAZ: case OP_TZA:
+        case OP_INX: case OP_INY: case OP_INZ: case OP_DEX: case OP_DEY: case OP_DEZ:
+        case OP_CLC: case OP_SEC: case OP_CLV:
+            return mode == AM_IMPLIED;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Registers and flags an instruction reads
+ *
+ * @param in Instruction
+ * @param gs02 Target is the 45GS02 (STZ stores the Z register)
+ * @return RF_* mask
+ */
+static unsigned int instr_reads(const SuperInstr *in, bool gs02) {
+    unsigned int reads = opcode_reads(in->op, in->mode) & LIVE_TRACKED;
+    if (in->op == OP_STZ && !gs02) reads &= ~RF_Z;
+    return reads;
+}
+
+/**
+ * @brief Work out what a sequence reads and writes
+ *
+ * @param code Sequence
+ * @param length Instructions in the sequence
+ * @param gs02 Target is the 45GS02
+ * @param e Receives the effects
+ */
+static void sequence_effects(const SuperInstr *code, int length, bool gs02, Effects *e) {
+    memset(e, 0, sizeof(*e));
+    for (int k = 0; k < length; k++) {
+        const SuperInstr *in = &code[k];
+        e->exposed |= instr_reads(in, gs02) & ~e->writes;
+        e->writes |= opcode_writes(in->op, in->mode) & LIVE_TRACKED;
+        if (in->slot < 0) continue;
+        unsigned int bit = 1u << in->slot;
+        if (opcode_reads(in->op, in->mode) & RF_MEM) e->slot_exposed |= bit & ~e->slot_writes;
+        if (opcode_writes(in->op, in->mode) & RF_MEM) e->slot_writes |= bit;
+    }
+}
+
+/**
+ * @brief Write an immediate operand
+ *
+ * @param value Byte value
+ * @param text Receives "#$hh" (5 bytes)
+ * @return text
+ */
+static char* immediate_text(int value, char *text) {
+    static const char hex[] = "0123456789ABCDEF";
+    text[0] = '#';
+    text[1] = '$';
+    text[2] = hex[(value >> 4) & 0x0F];
+    text[3] = hex[value & 0x0F];
+    text[4] = '\0';
+    return text;
+}
+
+/**
+ * @brief Put a known value into a register
+ *
+ * @param state Register state
+ * @param reg 'A', 'X', 'Y' or 'Z'
+ * @param value Byte value
+ */
+static void set_register(RegisterState *state, char reg, int value) {
+    bool *known = reg == 'X' ? &state->x_known : reg == 'Y' ? &state->y_known :
+                  reg == 'Z' ? &state->z_known : &state->a_known;
+    bool *zero = reg == 'X' ? &state->x_zero : reg == 'Y' ? &state->y_zero :
+                 reg == 'Z' ? &state->z_zero : &state->a_zero;
+    short *num = reg == 'X' ? &state->x_num : reg == 'Y' ? &state->y_num :
+                 reg == 'Z' ? &state->z_num : &state->a_num;
+    char *text = reg == 'X' ? state->x_value : reg == 'Y' ? state->y_value :
+                 reg == 'Z' ? state->z_value : state->a_value;
+    *known = true;
+    *zero = value == 0;
+    *num = (short)value;
+    immediate_text(value, text);
+}
+
+/**
+ * @brief Set up a machine
+ *
+ * @param m Machine to set up
+ * @param bytes A, X, Y, Z and the memory slots, in that order
+ * @param flags RF_C, RF_N, RF_ZF and RF_V bits of the flags that are set
+ */
+static void machine_init(Machine *m, const unsigned char *bytes, unsigned int flags) {
+    init_register_state(&m->regs);
+    set_register(&m->regs, 'A', bytes[0]);
+    set_register(&m->regs, 'X', bytes[1]);
+    set_register(&m->regs, 'Y', bytes[2]);
+    set_register(&m->regs, 'Z', bytes[3]);
+    m->regs.c_known = m->regs.n_known = m->regs.z_flag_known = m->regs.v_known = true;
+    m->regs.c_set = (flags & RF_C) != 0;
+    m->regs.n_set = (flags & RF_N) != 0;
+    m->regs.z_flag_set = (flags & RF_ZF) != 0;
+    m->regs.v_set = (flags & RF_V) != 0;
+    memcpy(m->mem, bytes + 4, SUPEROPT_MAX_SLOTS);
+}
+
+/**
+ * @brief Store a register into a memory slot
+ *
+ * @param m Machine
+ * @param slot Slot
+ * @param known Register value is known
+ * @param num Register value (-1 if symbolic)
+ * @return false if the value is not known
+ */
+static bool store_value(Machine *m, int slot, bool known, short num) {
+    if (!known || num < 0) return false;
+    m->mem[slot] = (unsigned char)num;
+    return true;
+}
+
+/**
+ * @brief Execute one instruction
+ *
+ * Memory reads run as the immediate form with the slot's contents;
+ * read-modify-write instructions run as their accumulator form on a
+ * copy of the state holding the slot in A.
+ *
+ * @param m Machine (modified in place)
+ * @param in Instruction
+ * @param gs02 Target is the 45GS02
+ * @return false if the result is not known
+ */
+static bool execute(Machine *m, const SuperInstr *in, bool gs02) {
+    RegisterState *s = &m->regs;
+    char text[5];
+    AstNode node;
+    memset(&node, 0, sizeof(node));
+    node.op = in->op;
+    node.mode = in->mode;
+
+    if (in->slot >= 0) {
+        int value = m->mem[in->slot];
+        switch (in->op) {
+            case OP_STA: return store_value(m, in->slot, s->a_known, s->a_num);
+            case OP_STX: return store_value(m, in->slot, s->x_known, s->x_num);
+            case OP_STY: return store_value(m, in->slot, s->y_known, s->y_num);
+            case OP_STZ:
+                if (gs02) return store_value(m, in->slot, s->z_known, s->z_num);
+                m->mem[in->slot] = 0;
+                return true;
+            case OP_INC: case OP_DEC: case OP_ASL: case OP_LSR: case OP_ROL: case OP_ROR: {
+                RegisterState t = *s;
+                set_register(&t, 'A', value);
+                node.mode = AM_ACCUMULATOR;
+                update_register_state(&node, &t);
+                if (!t.a_known || t.a_num < 0) return false;
+                m->mem[in->slot] = (unsigned char)t.a_num;
+                s->c_known = t.c_known;
+                s->c_set = t.c_set;
+                s->n_known = t.n_known;
+                s->n_set = t.n_set;
+                s->z_flag_known = t.z_flag_known;
+                s->z_flag_set = t.z_flag_set;
+                s->nz_source = 0;
+                return true;
+            }
+            default:
+                node.mode = AM_IMMEDIATE;
+                node.operand = immediate_text(value, text);
+                break;
+        }
+    } else if (in->mode == AM_IMMEDIATE) {
+        node.operand = immediate_text(in->value, text);
+    }
+    update_register_state(&node, s);
+    return true;
+}
+
+/**
+ * @brief Run a sequence
+ *
+ * @param m Machine (modified in place)
+ * @param code Sequence
+ * @param length Instructions in the sequence
+ * @param gs02 Target is the 45GS02
+ * @return false if a result is not known
+ */
+static bool run_sequence(Machine *m, const SuperInstr *code, int length, bool gs02) {
+    for (int k = 0; k < length; k++) {
+        if (!execute(m, &code[k], gs02)) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Compare the live outputs of two runs
+ *
+ * @param a First machine
+ * @param b Second machine
+ * @param live RF_* registers and flags compared
+ * @return true if both hold the same known values there and in memory
+ */
+static bool same_outputs(const Machine *a, const Machine *b, unsigned int live) {
+    const RegisterState *x = &a->regs, *y = &b->regs;
+    if ((live & RF_A) && (!x->a_known || !y->a_known || x->a_num < 0 || x->a_num != y->a_num)) return false;
+    if ((live & RF_X) && (!x->x_known || !y->x_known || x->x_num < 0 || x->x_num != y->x_num)) return false;
+    if ((live & RF_Y) && (!x->y_known || !y->y_known || x->y_num < 0 || x->y_num != y->y_num)) return false;
+    if ((live & RF_Z) && (!x->z_known || !y->z_known || x->z_num < 0 || x->z_num != y->z_num)) return false;
+    if ((live & RF_C) && (!x->c_known || !y->c_known || x->c_set != y->c_set)) return false;
+    if ((live & RF_N) && (!x->n_known || !y->n_known || x->n_set != y->n_set)) return false;
+    if ((live & RF_ZF) && (!x->z_flag_known || !y->z_flag_known || x->z_flag_set != y->z_flag_set)) {
+        return false;
+    }
+    if ((live & RF_V) && (!x->v_known || !y->v_known || x->v_set != y->v_set)) return false;
+    return memcmp(a->mem, b->mem, sizeof(a->mem)) == 0;
+}
+
+/* ---------------------------------------------------------------------
+ * Windows and the search
+ * ------------------------------------------------------------------- */
+
+/**
+ * @brief A canonical window and its context
+ */
+typedef struct {
+    SuperInstr code[SUPEROPT_WINDOW];   /**< Canonical instructions */
+    int nodes[SUPEROPT_WINDOW];         /**< Node of each instruction */
+    int length;                         /**< Instructions in the window */
+    int slots;                          /**< Memory slots used */
+    AddrMode slot_mode[SUPEROPT_MAX_SLOTS]; /**< Zero page or absolute */
+    const char *slot_text[SUPEROPT_MAX_SLOTS]; /**< Operand text of each slot */
+    int values[SUPEROPT_MAX_VALUES];    /**< Distinct immediates */
+    int value_count;                    /**< Number of immediates */
+    unsigned int live;                  /**< RF_* live after the window */
+    Effects effects;                    /**< What the window reads and writes */
+    CostTotal cost;                     /**< Cost of the window */
+} Window;
+
+/**
+ * @brief Search state of one window
+ */
+typedef struct {
+    const Program *prog;                /**< Program being optimized */
+    const Window *win;                  /**< Window searched */
+    bool gs02;                          /**< Target is the 45GS02 */
+    SuperInstr alphabet[SUPEROPT_MAX_ALPHABET]; /**< Instructions to draw from */
+    InstrCost alphabet_cost[SUPEROPT_MAX_ALPHABET]; /**< Cost of each */
+    Effects alphabet_effects[SUPEROPT_MAX_ALPHABET]; /**< What each reads and writes */
+    int alphabet_count;                 /**< Entries in alphabet */
+    Machine input[SUPEROPT_VECTORS];    /**< Test inputs */
+    Machine goal[SUPEROPT_VECTORS];     /**< Window results on the test inputs */
+    Machine stack[SUPEROPT_MAX_LENGTH + 1]; /**< Prefix results on the first input */
+    SuperInstr candidate[SUPEROPT_MAX_LENGTH]; /**< Prefix being tried */
+    int chosen[SUPEROPT_MAX_LENGTH];    /**< Alphabet entry of each prefix instruction */
+    SuperInstr best[SUPEROPT_MAX_LENGTH]; /**< Cheapest proven replacement */
+    int best_length;                    /**< Its length, -1 if none yet */
+    CostTotal best_cost;                /**< Its cost */
+    int limit;                          /**< Length of the candidates tried now */
+    long nodes;                         /**< Prefixes tried so far */
+} Search;
+
+/**
+ * @brief Cost that decides under the selected mode
+ */
+static long primary_cost(const Program *prog, CostTotal cost) {
+    return prog->mode == OPT_SIZE ? cost.bytes : cost.cycles;
+}
+
+/**
+ * @brief Prove a candidate equal to its window
+ *
+ * Runs both on every combination of the inputs that matter: what
+ * either reads before writing it, and the live registers, flags and
+ * memory slots only one of them writes.
+ *
+ * @param prog Program being optimized
+ * @param win Window
+ * @param code Candidate
+ * @param length Instructions in the candidate
+ * @return true if the candidate is equal on every input
+ */
+static bool prove(const Program *prog, const Window *win, const SuperInstr *code, int length) {
+    bool gs02 = prog->is_45gs02;
+    Effects c;
+    sequence_effects(code, length, gs02, &c);
+    const Effects *w = &win->effects;
+
+    // The candidate may not read what the window does not, so liveness
+    // computed before the rewrite stays safe
+    if (c.exposed & ~w->exposed) return false;
+
+    unsigned int regs = w->exposed | c.exposed | (win->live & (w->writes ^ c.writes));
+    unsigned int slots = w->slot_exposed | c.slot_exposed | (w->slot_writes ^ c.slot_writes);
+
+    // Input fields: bytes (index into the machine_init() byte array) and flag bits
+    int byte_field[4 + SUPEROPT_MAX_SLOTS], byte_count = 0;
+    unsigned int flag_field[4], flag_count = 0;
+    static const unsigned int reg_bits[4] = { RF_A, RF_X, RF_Y, RF_Z };
+    static const unsigned int flag_bits[4] = { RF_C, RF_N, RF_ZF, RF_V };
+    for (int r = 0; r < 4; r++) {
+        if (regs & reg_bits[r]) byte_field[byte_count++] = r;
+        if (regs & flag_bits[r]) flag_field[flag_count++] = flag_bits[r];
+    }
+    for (int s = 0; s < win->slots; s++) {
+        if (slots & (1u << s)) byte_field[byte_count++] = 4 + s;
+    }
+    int bits = 8 * byte_count + (int)flag_count;
+    if (bits > SUPEROPT_MAX_INPUT_BITS) return false;
+
+    for (long input = 0; input < (1L << bits); input++) {
+        unsigned char bytes[4 + SUPEROPT_MAX_SLOTS] = { 0 };
+        unsigned int flags = 0;
+        long rest = input;
+        for (int k = 0; k < byte_count; k++, rest >>= 8) bytes[byte_field[k]] = (unsigned char)(rest & 0xFF);
+        for (unsigned int k = 0; k < flag_count; k++, rest >>= 1) {
+            if (rest & 1) flags |= flag_field[k];
+        }
+
+        Machine a, b;
+        machine_init(&a, bytes, flags);
+        b = a;
+        if (!run_sequence(&a, win->code, win->length, gs02) || !run_sequence(&b, code, length, gs02) ||
+            !same_outputs(&a, &b, win->live)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Add an instruction to the search alphabet if the target has it
+ *
+ * Leaves out instructions that write a live register or flag the window
+ * leaves alone, or read one the window does not read.
+ *
+ * @param s Search
+ * @param op Opcode
+ * @param mode Addressing mode
+ * @param slot Memory slot, or -1
+ * @param value Immediate value, or -1
+ */
+static void add_symbol(Search *s, Opcode op, AddrMode mode, int slot, int value) {
+    if (s->alphabet_count == SUPEROPT_MAX_ALPHABET) return;
+    InstrCost cost = instruction_cost(op, mode, s->prog->cpu_type);
+    if (!cost.valid) return;
+
+    SuperInstr in = { op, mode, slot, value };
+    const Window *win = s->win;
+    unsigned int writes = opcode_writes(op, mode) & LIVE_TRACKED;
+    if (writes & win->live & ~win->effects.writes) return;
+    if (instr_reads(&in, s->gs02) & ~(win->effects.exposed | win->effects.writes)) return;
+    if (slot >= 0 && (opcode_writes(op, mode) & RF_MEM) && !(win->effects.slot_writes & (1u << slot))) {
+        return;
+    }
+
+    s->alphabet[s->alphabet_count] = in;
+    sequence_effects(&in, 1, s->gs02, &s->alphabet_effects[s->alphabet_count]);
+    s->alphabet_cost[s->alphabet_count++] = cost;
+}
+
+/**
+ * @brief Build the instructions a search draws from
+ *
+ * Implied and accumulator instructions, immediates the window uses (and
+ * zero), and the window's memory slots.
+ *
+ * @param s Search
+ */
+static void build_alphabet(Search *s) {
+    static const Opcode implied[] = {
+        OP_TAX, OP_TXA, OP_TAY, OP_TYA, OP_TAZ, OP_TZA, OP_INX, OP_INY, OP_INZ,
+        OP_DEX, OP_DEY, OP_DEZ, OP_CLC, OP_SEC, OP_CLV, OP_NEG
+    };
+    static const Opcode accumulator[] = { OP_ASL, OP_LSR, OP_ROL, OP_ROR, OP_INC, OP_DEC, OP_ASR };
+    static const Opcode immediate[] = {
+        OP_LDA, OP_LDX, OP_LDY, OP_LDZ, OP_AND, OP_ORA, OP_EOR, OP_CMP, OP_CPX, OP_CPY, OP_CPZ
+    };
+    static const Opcode memory[] = {
+        OP_LDA, OP_LDX, OP_LDY, OP_LDZ, OP_STA, OP_STX, OP_STY, OP_STZ, OP_AND, OP_ORA, OP_EOR,
+        OP_CMP, OP_CPX, OP_CPY, OP_CPZ, OP_INC, OP_DEC, OP_ASL, OP_LSR, OP_ROL, OP_ROR
+    };
+    const Window *win = s->win;
+    s->alphabet_count = 0;
+
+    for (size_t k = 0; k < sizeof(implied) / sizeof(implied[0]); k++) {
+        add_symbol(s, implied[k], classify_operand(implied[k], NULL), -1, -1);
+    }
+    for (size_t k = 0; k < sizeof(accumulator) / sizeof(accumulator[0]); k++) {
+        add_symbol(s, accumulator[k], AM_ACCUMULATOR, -1, -1);
+    }
+
+    int values[SUPEROPT_MAX_VALUES + 1];
+    int value_count = 0;
+    values[value_count++] = 0;
+    for (int v = 0; v < win->value_count; v++) {
+        if (win->values[v] != 0) values[value_count++] = win->values[v];
+    }
+    for (int v = 0; v < value_count; v++) {
+        for (size_t k = 0; k < sizeof(immediate) / sizeof(immediate[0]); k++) {
+            add_symbol(s, immediate[k], AM_IMMEDIATE, -1, values[v]);
+        }
+    }
+    for (int slot = 0; slot < win->slots; slot++) {
+        for (size_t k = 0; k < sizeof(memory) / sizeof(memory[0]); k++) {
+            add_symbol(s, memory[k], win->slot_mode[slot], slot, -1);
+        }
+    }
+}
+
+/**
+ * @brief Check whether a pair of instructions need not be tried
+ *
+ * The pair is redundant when the second overwrites everything the first
+ * wrote without reading it, so the first is dead, or when the two are
+ * independent and appear in the other order as well.
+ *
+ * @param prev Effects of the earlier instruction
+ * @param prev_index Its alphabet entry
+ * @param next Effects of the later instruction
+ * @param next_index Its alphabet entry
+ * @return true if a sequence holding the pair need not be tried
+ */
+static bool redundant_pair(const Effects *prev, int prev_index, const Effects *next, int next_index) {
+    unsigned int prev_touch = prev->exposed | prev->writes;
+    unsigned int next_touch = next->exposed | next->writes;
+    if (!prev->slot_writes && (prev->writes & ~next->writes) == 0 && !(next->exposed & prev->writes)) {
+        return true;
+    }
+    bool independent = !(prev->writes & next_touch) && !(next->writes & prev_touch) &&
+                       !(prev->slot_writes & (next->slot_exposed | next->slot_writes)) &&
+                       !(next->slot_writes & (prev->slot_exposed | prev->slot_writes));
+    return independent && next_index < prev_index;
+}
+
+/**
+ * @brief Try every extension of the current prefix up to the length limit
+ *
+ * A prefix of the limit length is tried as a complete candidate. Prefixes
+ * run on the first test input only; a candidate that matches there is
+ * run on the others, so most candidates cost one execution. Every
+ * instruction costs at least one cycle and byte, so a prefix that
+ * already costs as much as the best sequence so far is not extended.
+ *
+ * @param s Search
+ * @param depth Instructions in the prefix
+ * @param cost Cost of the prefix
+ */
+static void search_from(Search *s, int depth, CostTotal cost) {
+    const Program *prog = s->prog;
+    CostTotal bound = s->best_length >= 0 ? s->best_cost : s->win->cost;
+
+    if (depth == s->limit) {
+        if (!cost_is_better(prog, bound, cost)) return;
+        bool match = same_outputs(&s->stack[depth], &s->goal[0], s->win->live);
+        for (int v = 1; v < SUPEROPT_VECTORS && match; v++) {
+            Machine m = s->input[v];
+            match = run_sequence(&m, s->candidate, depth, s->gs02) &&
+                    same_outputs(&m, &s->goal[v], s->win->live);
+        }
+        if (match && prove(prog, s->win, s->candidate, depth)) {
+            memcpy(s->best, s->candidate, depth * sizeof(SuperInstr));
+            s->best_length = depth;
+            s->best_cost = cost;
+        }
+        return;
+    }
+
+    if (primary_cost(prog, cost) >= primary_cost(prog, bound)) return;
+    for (int a = 0; a < s->alphabet_count; a++) {
+        if (depth > 0 && redundant_pair(&s->alphabet_effects[s->chosen[depth - 1]], s->chosen[depth - 1],
+                                        &s->alphabet_effects[a], a)) {
+            continue;
+        }
+        if (++s->nodes > SUPEROPT_SEARCH_NODES) return;
+        CostTotal next = cost;
+        cost_add(&next, s->alphabet_cost[a]);
+        bound = s->best_length >= 0 ? s->best_cost : s->win->cost;
+        if (primary_cost(prog, next) > primary_cost(prog, bound)) continue;
+
+        s->stack[depth + 1] = s->stack[depth];
+        if (!execute(&s->stack[depth + 1], &s->alphabet[a], s->gs02)) continue;
+        s->candidate[depth] = s->alphabet[a];
+        s->chosen[depth] = a;
+        search_from(s, depth + 1, next);
+    }
+}
+
+/**
+ * @brief Search for the cheapest replacement of a window
+ *
+ * @param prog Program being optimized
+ * @param win Window
+ * @param out Receives the replacement
+ * @return Instructions in the replacement, or -1 if none is cheaper
+ */
+static int search_window(const Program *prog, const Window *win, SuperInstr *out) {
+    Search *s = malloc(sizeof(Search));
+    if (!s) return -1;
+    s->prog = prog;
+    s->win = win;
+    s->gs02 = prog->is_45gs02;
+    s->best_length = -1;
+    s->nodes = 0;
+
+    // Test inputs: all zeros, all ones, then a fixed pseudo-random series
+    unsigned int seed = 0x6502u;
+    for (int v = 0; v < SUPEROPT_VECTORS; v++) {
+        unsigned char bytes[4 + SUPEROPT_MAX_SLOTS];
+        unsigned int flags = 0;
+        for (size_t k = 0; k < sizeof(bytes); k++) {
+            seed = seed * 1103515245u + 12345u;
+            bytes[k] = v == 0 ? 0x00 : v == 1 ? 0xFF : (unsigned char)(seed >> 16);
+        }
+        seed = seed * 1103515245u + 12345u;
+        flags = v == 0 ? 0 : v == 1 ? (RF_C | RF_N | RF_ZF | RF_V) : ((seed >> 16) & LIVE_TRACKED);
+        machine_init(&s->input[v], bytes, flags);
+        s->goal[v] = s->input[v];
+        if (!run_sequence(&s->goal[v], win->code, win->length, s->gs02) ||
+            !same_outputs(&s->goal[v], &s->goal[v], win->live)) {
+            free(s);
+            return -1;
+        }
+    }
+
+    s->stack[0] = s->input[0];
+    build_alphabet(s);
+    // Shorter replacements first, so the node budget is not spent on
+    // long ones before a short one is found
+    int longest = win->length < SUPEROPT_MAX_LENGTH ? win->length : SUPEROPT_MAX_LENGTH;
+    for (s->limit = 0; s->limit <= longest && s->nodes <= SUPEROPT_SEARCH_NODES; s->limit++) {
+        search_from(s, 0, (CostTotal){0, 0});
+    }
+
+    int length = s->best_length;
+    if (length > 0) memcpy(out, s->best, length * sizeof(SuperInstr));
+    free(s);
+    return length;
+}
+
+/**
+ * @brief Turn a window of the program into its canonical form
+ *
+ * @param prog Program being optimized
+ * @param nodes Instruction nodes of the window
+ * @param length Instructions in the window
+ * @param live RF_* live after the window
+ * @param win Receives the window
+ * @return false if the window has symbolic immediates or too many
+ *         operands
+ */
+static bool canonical_window(const Program *prog, const int *nodes, int length, unsigned int live,
+                             Window *win) {
+    memset(win, 0, sizeof(*win));
+    win->length = length;
+    win->live = live & LIVE_TRACKED;
+    for (int k = 0; k < length; k++) {
+        const AstNode *node = &prog->nodes[nodes[k]];
+        SuperInstr *in = &win->code[k];
+        win->nodes[k] = nodes[k];
+        in->op = node->op;
+        in->mode = node->mode;
+        in->slot = -1;
+        in->value = -1;
+        cost_add_node(&win->cost, prog, nodes[k]);
+
+        if (node->mode == AM_IMMEDIATE) {
+            in->value = parse_immediate_value(node->operand);
+            if (in->value < 0) return false;
+            int v = 0;
+            while (v < win->value_count && win->values[v] != in->value) v++;
+            if (v == win->value_count) {
+                if (v == SUPEROPT_MAX_VALUES) return false;
+                win->values[win->value_count++] = in->value;
+            }
+        } else if (node->mode == AM_ZEROPAGE || node->mode == AM_ABSOLUTE) {
+            int s = 0;
+            while (s < win->slots && strcmp(win->slot_text[s], node->operand) != 0) s++;
+            if (s == win->slots) {
+                if (s == SUPEROPT_MAX_SLOTS) return false;
+                win->slot_text[s] = node->operand;
+                win->slot_mode[s] = node->mode;
+                win->slots++;
+            } else if (win->slot_mode[s] != node->mode) {
+                return false;
+            }
+            in->slot = s;
+        }
+    }
+    sequence_effects(win->code, length, prog->is_45gs02, &win->effects);
+    return true;
+}
+
+/**
+ * @brief Write a canonical sequence
+ *
+ * @param code Sequence
+ * @param length Instructions in the sequence
+ * @param slot_mode Mode of each memory slot
+ * @param out Receives the text
+ * @param size Size of out
+ * @return false if the text does not fit
+ */
+static bool format_sequence(const SuperInstr *code, int length, char *out, size_t size) {
+    size_t n = 0;
+    out[0] = '\0';
+    for (int k = 0; k < length; k++) {
+        const SuperInstr *in = &code[k];
+        int w;
+        if (in->slot >= 0) {
+            w = snprintf(out + n, size - n, "%s%s %c%d", k ? "; " : "", opcode_name(in->op),
+                         in->mode == AM_ZEROPAGE ? 'z' : 'm', in->slot);
+        } else if (in->mode == AM_IMMEDIATE) {
+            w = snprintf(out + n, size - n, "%s%s #$%02X", k ? "; " : "", opcode_name(in->op), in->value);
+        } else {
+            w = snprintf(out + n, size - n, "%s%s%s", k ? "; " : "", opcode_name(in->op),
+                         in->mode == AM_ACCUMULATOR ? " A" : "");
+        }
+        if (w < 0 || (size_t)w >= size - n) return false;
+        n += (size_t)w;
+    }
+    return true;
+}
+
+/**
+ * @brief Read a canonical replacement back
+ *
+ * @param text Replacement ("-" for none)
+ * @param win Window it replaces
+ * @param cpu Target CPU
+ * @param code Receives the instructions
+ * @return Instructions read, or -1 if the text is malformed
+ */
+static int parse_sequence(const char *text, const Window *win, CpuType cpu, SuperInstr *code) {
+    if (strcmp(text, "-") == 0) return 0;
+
+    int length = 0;
+    const char *p = text;
+    while (*p) {
+        if (length == SUPEROPT_MAX_LENGTH) return -1;
+        const char *end = strstr(p, "; ");
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        const char *space = memchr(p, ' ', len);
+        size_t name_len = space ? (size_t)(space - p) : len;
+
+        SuperInstr *in = &code[length++];
+        in->op = lookup_opcode(p, name_len);
+        in->slot = -1;
+        in->value = -1;
+        if (!space) {
+            in->mode = classify_operand(in->op, NULL);
+        } else if (space[1] == 'A' && len == name_len + 2) {
+            in->mode = AM_ACCUMULATOR;
+        } else if (space[1] == '#') {
+            unsigned int value;
+            if (sscanf(space + 1, "#$%2x", &value) != 1) return -1;
+            in->mode = AM_IMMEDIATE;
+            in->value = (int)value;
+        } else if (space[1] == 'z' || space[1] == 'm') {
+            in->slot = space[2] - '0';
+            in->mode = space[1] == 'z' ? AM_ZEROPAGE : AM_ABSOLUTE;
+            if (in->slot < 0 || in->slot >= win->slots || win->slot_mode[in->slot] != in->mode) return -1;
+        } else {
+            return -1;
+        }
+        if (in->op == OP_NONE || !modeled(in->op, in->mode) ||
+            !instruction_cost(in->op, in->mode, cpu).valid) {
+            return -1;
+        }
+        p = end ? end + 2 : p + len;
+    }
+    return length;
+}
+
+/**
+ * @brief Name of the target CPU in memo keys
+ */
+static const char* cpu_key(CpuType cpu) {
+    return cpu == CPU_6502 ? "6502" : cpu == CPU_65C02 ? "65c02" : "45gs02";
+}
+
+/**
+ * @brief Find the cheapest replacement of a window, through the memo
+ *
+ * @param prog Program being optimized
+ * @param win Window
+ * @param code Receives the replacement
+ * @return Instructions in the replacement, or -1 if none is cheaper
+ */
+static int find_replacement(Program *prog, const Window *win, SuperInstr *code) {
+    struct SuperoptMemo *memo = prog->superopt;
+    char tokens[SUPEROPT_KEY_SIZE], key[SUPEROPT_KEY_SIZE + 32], value[SUPEROPT_KEY_SIZE];
+    if (!format_sequence(win->code, win->length, tokens, sizeof(tokens))) return -1;
+    snprintf(key, sizeof(key), "%s %s %04x %s", cpu_key(prog->cpu_type),
+             prog->mode == OPT_SIZE ? "size" : "speed", win->live, tokens);
+
+    pthread_mutex_lock(&memo->lock);
+    MemoEntry *entry = memo_slot(memo, key);
+    bool known = entry->key != NULL;
+    bool proven = known && entry->proven;
+    if (known) snprintf(value, sizeof(value), "%s", entry->value);
+    pthread_mutex_unlock(&memo->lock);
+
+    if (known && strcmp(value, "none") == 0) return -1;
+    if (known) {
+        int length = parse_sequence(value, win, prog->cpu_type, code);
+        if (length >= 0 && (proven || prove(prog, win, code, length))) {
+            if (!proven) {
+                pthread_mutex_lock(&memo->lock);
+                memo_slot(memo, key)->proven = true;
+                pthread_mutex_unlock(&memo->lock);
+            }
+            return length;
+        }
+    }
+
+    // Not in the memo, or the memo entry does not hold up: search
+    int length = search_window(prog, win, code);
+    if (length < 0) {
+        snprintf(value, sizeof(value), "none");
+    } else if (length == 0) {
+        snprintf(value, sizeof(value), "-");
+    } else if (!format_sequence(code, length, value, sizeof(value))) {
+        return -1;
+    }
+    pthread_mutex_lock(&memo->lock);
+    if (memo_put(memo, key, value, length >= 0)) memo->changed = true;
+    pthread_mutex_unlock(&memo->lock);
+    return length;
+}
+
+/**
+ * @brief Check whether a replacement would assemble two NEGs back to back
+ *
+ * NEG NEG is the 45GS02 prefix of the 32-bit instructions, so the
+ * replacement may not form the pair with the instructions around the
+ * window either.
+ *
+ * @param prog Program being optimized
+ * @param win Window
+ * @param code Replacement
+ * @param length Instructions in the replacement
+ * @return true if the result would hold adjacent NEGs
+ */
+static bool creates_neg_pair(const Program *prog, const Window *win, const SuperInstr *code, int length) {
+    int prev = adjacent_instruction(prog, win->nodes[0], -1);
+    bool neg = prev >= 0 && prog->nodes[prev].op == OP_NEG;
+    for (int k = 0; k < length; k++) {
+        if (neg && code[k].op == OP_NEG) return true;
+        neg = code[k].op == OP_NEG;
+    }
+    int next = adjacent_instruction(prog, win->nodes[win->length - 1], 1);
+    return neg && next >= 0 && prog->nodes[next].op == OP_NEG;
+}
+
+/**
+ * @brief Replace a window with a cheaper sequence
+ *
+ * The first instructions of the window become the replacement (the
+ * first keeps its label), the rest are removed. Memory operands keep
+ * their text; immediates reuse the window's spelling of the value.
+ * On the 45GS02 a replacement that would put NEG next to NEG is
+ * refused.
+ *
+ * @param prog Program being optimized
+ * @param win Window
+ * @param code Replacement
+ * @param length Instructions in the replacement
+ * @return true if the window was rewritten
+ */
+static bool apply_replacement(Program *prog, const Window *win, const SuperInstr *code, int length) {
+    if (prog->is_45gs02 && creates_neg_pair(prog, win, code, length)) return false;
+
+    const char *accumulator = "A";
+    for (int k = 0; k < win->length; k++) {
+        const AstNode *node = &prog->nodes[win->nodes[k]];
+        if (node->mode == AM_ACCUMULATOR) accumulator = node->operand;
+    }
+
+    for (int k = 0; k < length; k++) {
+        const SuperInstr *in = &code[k];
+        const SuperInstr *old = &win->code[k];
+        if (in->op == old->op && in->mode == old->mode && in->slot == old->slot && in->value == old->value) {
+            continue;   // Unchanged instruction
+        }
+        AstNode *node = &prog->nodes[win->nodes[k]];
+        const char *operand = NULL;
+        if (in->slot >= 0) {
+            operand = win->slot_text[in->slot];
+        } else if (in->mode == AM_IMMEDIATE) {
+            for (int j = 0; j < win->length && !operand; j++) {
+                if (win->code[j].mode == AM_IMMEDIATE && win->code[j].value == in->value) {
+                    operand = prog->nodes[win->nodes[j]].operand;
+                }
+            }
+            if (!operand) {
+                char text[5];
+                operand = arena_strdup(prog->arena, immediate_text(in->value, text));
+            }
+        } else if (in->mode == AM_ACCUMULATOR) {
+            operand = accumulator;
+        }
+        node->operand = (char *)operand;
+        rewrite_node_opcode(prog, win->nodes[k], in->op);
+    }
+    for (int k = length; k < win->length; k++) mark_node_dead(prog, win->nodes[k]);
+    count_optimization(prog, "superopt.rewrite");
+
+    if (prog->trace_level > 1) {
+        char before[SUPEROPT_KEY_SIZE], after[SUPEROPT_KEY_SIZE];
+        format_sequence(win->code, win->length, before, sizeof(before));
+        if (!format_sequence(code, length, after, sizeof(after)) || length == 0) {
+            snprintf(after, sizeof(after), "-");
+        }
+        program_log(prog, "DEBUG superopt: %s => %s at line %d\n", before, after,
+                    prog->nodes[win->nodes[0]].line_num);
+    }
+    return true;
+}
+
+/**
+ * @brief Collect the straight-line instructions a window may start with
+ *
+ * @param prog Program being optimized
+ * @param first First node
+ * @param end One past the last node of the block
+ * @param nodes Receives the instruction nodes
+ * @return Number of instructions (at most SUPEROPT_WINDOW)
+ */
+static int collect_window(const Program *prog, int first, int end, int *nodes) {
+    int n = 0;
+    for (int i = first; i < end && n < SUPEROPT_WINDOW; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i)) continue;
+        if (i != first && node->label && node->label[0]) break;
+        if (node->op == OP_NONE) {
+            if (node->opcode && node->opcode[0]) break;
+            continue;
+        }
+        if (node->no_optimize || !modeled(node->op, node->mode)) break;
+        nodes[n++] = i;
+    }
+    return n;
+}
+
+/**
+ * @brief Superoptimize short windows of hot code (-superopt)
+ *
+ * 1. Picks the hot blocks: in speed mode those a profile (-profile)
+ *    shows hot or, without one, those inside a natural loop; all of
+ *    them in size mode
+ * 2. At every instruction, tries the longest window first, down to two
+ *    instructions, looking each up in the memo and searching on a miss
+ * 3. Rewrites the window when a cheaper equivalent exists and moves on
+ *    past it
+ *
+ * @param prog Program to optimize (prog->cfg must be built)
+ */
+void optimize_superopt_ast(Program *prog) {
+    const Cfg *cfg = prog->cfg;
+    if (!cfg || !prog->superopt || prog->cpu_type == CPU_65816 || cfg->block_count == 0) return;
+
+    bool *hot = calloc(cfg->block_count, sizeof(bool));
+    unsigned int *after = malloc(prog->count * sizeof(unsigned int));
+    Liveness *lv = solve_liveness(prog);
+    bool by_loops = prog->mode != OPT_SIZE && !prog->profile;
+    CfgLoops *loops = by_loops ? find_natural_loops(cfg) : NULL;
+    if (!hot || !after || !lv || (by_loops && !loops)) {
+        free(hot);
+        free(after);
+        free_liveness(lv);
+        free_natural_loops(loops);
+        return;
+    }
+    for (int b = 0; b < cfg->block_count; b++) {
+        hot[b] = prog->mode == OPT_SIZE ||
+                 (prog->profile && mode_at(prog, cfg->blocks[b].start, cfg->blocks[b].end) == OPT_SPEED);
+    }
+    for (int l = 0; loops && l < loops->count; l++) {
+        const CfgLoop *loop = &loops->loops[l];
+        for (int k = 0; k < loop->body_count; k++) hot[loops->body[loop->body_start + k]] = true;
+    }
+    free_natural_loops(loops);
+
+    int rewrites = 0;
+    for (int b = 0; b < cfg->block_count; b++) {
+        const BasicBlock *block = &cfg->blocks[b];
+        if (!hot[b] || block->is_data) continue;
+
+        unsigned int live = lv->block_out[b];
+        for (int i = block->end - 1; i >= block->start; i--) {
+            after[i] = live;
+            if (!node_is_dead(prog, i) && prog->nodes[i].op != OP_NONE) live = live_before(prog, i, live);
+        }
+
+        for (int i = block->start; i < block->end; i++) {
+            if (node_is_dead(prog, i) || prog->nodes[i].op == OP_NONE) continue;
+            int nodes[SUPEROPT_WINDOW];
+            int n = collect_window(prog, i, block->end, nodes);
+            for (int length = n; length >= 2; length--) {
+                Window win;
+                SuperInstr code[SUPEROPT_MAX_LENGTH];
+                if (!canonical_window(prog, nodes, length, after[nodes[length - 1]], &win)) continue;
+                int found = find_replacement(prog, &win, code);
+                if (found < 0) continue;
+
+                CostTotal cost = {0, 0};
+                for (int k = 0; k < found; k++) cost_add(&cost, instruction_cost(code[k].op, code[k].mode,
+                                                                                 prog->cpu_type));
+                const AstNode *head = &prog->nodes[nodes[0]];
+                if (!cost_is_better(prog, win.cost, cost) || (found == 0 && head->label && head->label[0])) {
+                    continue;
+                }
+                if (!apply_replacement(prog, &win, code, found)) continue;
+                rewrites++;
+                i = nodes[length - 1];
+                break;
+            }
+        }
+    }
+
+    if (prog->trace_level > 1 && rewrites > 0) {
+        program_log(prog, "DEBUG superopt: %d windows rewritten\n", rewrites);
+    }
+    free(hot);
+    free(after);
+    free_liveness(lv);
+}
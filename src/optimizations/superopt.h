@@ -0,0 +1,44 @@
+/**
+ * @file superopt.h
+ * @brief Superoptimizer memo database (-superopt)
+ *
+ * The superoptimizer (see superopt.c) searches short windows of hot
+ * code for cheaper equivalent sequences. Every result, including "no
+ * cheaper sequence", is kept in a memo keyed by the canonical window, so
+ * the search for a window is paid once. The memo is a text file, one
+ * result per line, loaded when -superopt opens it and written back when
+ * the run ends.
+ *
+ * One memo may be shared by the programs of a -batch run; lookups and
+ * updates are serialized by a lock.
+ */
+
+#ifndef SUPEROPT_H
+#define SUPEROPT_H
+
+#include "../types.h"
+
+/**
+ * @brief Open a memo file
+ *
+ * A file that does not exist yet starts an empty memo. A memo written
+ * by another optimizer version is discarded, since its cost model may
+ * differ.
+ *
+ * @param path Memo file name
+ * @return New memo, or NULL on allocation failure
+ */
+struct SuperoptMemo* open_superopt_memo(const char *path);
+
+/**
+ * @brief Write a memo back, if it changed, and free it
+ *
+ * The file is replaced atomically: a concurrent run sees either the old
+ * or the new memo.
+ *
+ * @param memo Memo to close (NULL-safe)
+ * @return false if the memo could not be written
+ */
+bool close_superopt_memo(struct SuperoptMemo *memo);
+
+#endif // SUPEROPT_H
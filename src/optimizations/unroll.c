@@ -0,0 +1,599 @@
+/**
+ * @file unroll.c
+ * @brief Counted loop unrolling (speed mode)
+ *
+ * Finds natural loops of a single basic block that count an index
+ * register from an immediate start value with DEX/DEY/INX/INY and
+ * branch back with BNE or BPL, and copies their body so the decrement
+ * and the taken branch (5 cycles per iteration on the 6502) run fewer
+ * times or not at all:
+ *
+ *   LDX #$03                          LDX #$03
+ * loop:                             loop:
+ *   LDA src,X                         LDA src+3
+ *   STA dst,X          becomes        STA dst+3
+ *   DEX                               LDA src+2
+ *   BPL loop                          ...
+ *                                     STA dst
+ *                                     LDX #$FF
+ *
+ * If the loop reads the counter only as an index of absolute or zero
+ * page operands, a full unroll folds the index into the operands and
+ * sets the counter to its final value once at the end (dead store
+ * elimination removes that load when nothing reads it). Otherwise each
+ * copy keeps its decrement. Loops too large for the -unroll-budget byte
+ * budget are unrolled partially by a factor that divides the trip
+ * count, which keeps one taken branch per copy group.
+ *
+ * With a profile (-profile), hot loops are unrolled whatever the mode
+ * and cold ones are not.
+ *
+ * Unrolling inserts nodes, so it runs once, before the control flow
+ * graph the other passes use is rebuilt.
+ */
+
+#include "optimizer.h"
+#include "../ast/ast.h"
+#include "../analysis/cfg.h"
+#include "../analysis/cost.h"
+#include "../analysis/loops.h"
+#include "../analysis/registers.h"
+#include "../program/profile.h"
+#include "../program/stats.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UNROLL_MAX_BODY 32          /**< Most instructions in an unrolled loop body */
+#define UNROLL_OPERAND_SIZE 96      /**< Longest folded operand */
+
+/**
+ * @brief A counted loop and how it is unrolled
+ */
+typedef struct {
+    int header;                 /**< First node of the loop block (holds the label) */
+    int step;                   /**< DEX, DEY, INX or INY updating the counter */
+    int branch;                 /**< BNE or BPL back to the header */
+    Opcode load;                /**< LDX or LDY loading the counter */
+    unsigned int counter;       /**< RF_X or RF_Y */
+    int first;                  /**< Counter value in the first iteration */
+    int delta;                  /**< Counter change per iteration (+1 or -1) */
+    int trips;                  /**< Iterations */
+    int final;                  /**< Counter value after the loop */
+    int length;                 /**< Instructions in the body, step excluded */
+    bool foldable;              /**< Counter only read as an abs/zp index, step flags unread */
+    CostTotal body;             /**< Cost of the body, step excluded */
+    int copies;                 /**< Copies inserted; trips - 1 when fully unrolled */
+    bool full;                  /**< Loop is unrolled completely */
+} CountedLoop;
+
+/**
+ * @brief Index register a counting instruction updates
+ *
+ * @param op Opcode
+ * @param delta Where to store the change (+1 or -1)
+ * @return RF_X or RF_Y, or 0 if op is not DEX/DEY/INX/INY
+ */
+static unsigned int step_counter(Opcode op, int *delta) {
+    switch (op) {
+        case OP_DEX: *delta = -1; return RF_X;
+        case OP_DEY: *delta = -1; return RF_Y;
+        case OP_INX: *delta = 1; return RF_X;
+        case OP_INY: *delta = 1; return RF_Y;
+        default: return 0;
+    }
+}
+
+/**
+ * @brief Check whether an operand base is a plain identifier
+ *
+ * Only identifiers are extended with "+offset", so the result can not
+ * change meaning through operator precedence.
+ *
+ * @param base Base text
+ * @param len Length of the base
+ * @return true for letters, digits, '_' and '.', starting with a letter or '_'
+ */
+static bool is_plain_symbol(const char *base, size_t len) {
+    if (len == 0 || !(isalpha((unsigned char)base[0]) || base[0] == '_')) return false;
+    for (size_t i = 1; i < len; i++) {
+        if (!isalnum((unsigned char)base[i]) && base[i] != '_' && base[i] != '.') return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Fold a known index into an indexed operand
+ *
+ * "dst,X" with X = 3 becomes "dst+3", "$0400,X" becomes "$0403" and
+ * "$10,X" becomes "$13". Zero page operands are only folded while the
+ * sum stays in zero page, since zp,X wraps around.
+ *
+ * @param prog Program owning the node
+ * @param node Instruction reading the counter
+ * @param counter RF_X or RF_Y
+ * @param value Counter value
+ * @param out Buffer for the folded operand
+ * @param size Size of out
+ * @return Addressing mode of the folded operand, or AM_NONE if the
+ *         operand cannot be folded
+ */
+static AddrMode fold_index(const Program *prog, const AstNode *node, unsigned int counter,
+                           int value, char *out, size_t size) {
+    bool zero_page;
+    switch (node->mode) {
+        case AM_ZEROPAGE_X: zero_page = true; if (counter != RF_X) return AM_NONE; break;
+        case AM_ABSOLUTE_X: zero_page = false; if (counter != RF_X) return AM_NONE; break;
+        case AM_ZEROPAGE_Y: zero_page = true; if (counter != RF_Y) return AM_NONE; break;
+        case AM_ABSOLUTE_Y: zero_page = false; if (counter != RF_Y) return AM_NONE; break;
+        default: return AM_NONE;
+    }
+
+    const char *operand = node->operand;
+    const char *comma = operand ? strrchr(operand, ',') : NULL;
+    if (!comma) return AM_NONE;
+    size_t len = (size_t)(comma - operand);
+    while (len > 0 && isspace((unsigned char)operand[len - 1])) len--;
+
+    char *end = NULL;
+    long base = -1;
+    if (len > 1 && operand[0] == '$') {
+        base = strtol(operand + 1, &end, 16);
+    } else if (len > 0 && isdigit((unsigned char)operand[0])) {
+        base = strtol(operand, &end, 10);
+    }
+
+    int n;
+    if (end == operand + len) {
+        long sum = base + value;
+        if (sum > (zero_page ? 0xFF : 0xFFFF)) return AM_NONE;
+        n = snprintf(out, size, zero_page ? "$%02lX" : "$%04lX", sum);
+    } else if (!zero_page && is_plain_symbol(operand, len)) {
+        n = value ? snprintf(out, size, "%.*s+%d", (int)len, operand, value)
+                  : snprintf(out, size, "%.*s", (int)len, operand);
+    } else {
+        return AM_NONE;
+    }
+    if (n < 0 || (size_t)n >= size) return AM_NONE;
+
+    AddrMode mode = classify_operand(node->op, out);
+    return instruction_cost(node->op, mode, prog->cpu_type).valid ? mode : AM_NONE;
+}
+
+/**
+ * @brief Counter value in a given iteration
+ *
+ * @param loop Loop
+ * @param iteration Iteration number, 0 for the first
+ * @return Counter value while the body runs
+ */
+static int counter_value(const CountedLoop *loop, int iteration) {
+    return (loop->first + loop->delta * iteration) & 0xFF;
+}
+
+/**
+ * @brief Find the immediate load that starts the counter
+ *
+ * Scans back from the loop through the block that falls into it. Any
+ * label, directive or flow instruction on the way ends the search,
+ * since the counter could then hold another value.
+ *
+ * @param prog Program owning the nodes
+ * @param from Index of the first block node before the loop
+ * @param stop Index of the first node of that block
+ * @param loop Loop with the counter set; load and first are filled in
+ * @return true if the counter is loaded from a numeric immediate
+ */
+static bool find_counter_load(const Program *prog, int from, int stop, CountedLoop *loop) {
+    for (int i = from; i >= stop; i--) {
+        const AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i)) continue;
+        bool labeled = node->label && node->label[0];
+
+        if (node->op == OP_NONE) {
+            if (labeled || (node->opcode && node->opcode[0])) return false;
+            continue;
+        }
+        if (opcode_writes(node->op, node->mode) & loop->counter) {
+            Opcode load = loop->counter == RF_X ? OP_LDX : OP_LDY;
+            if (node->op != load || node->mode != AM_IMMEDIATE) return false;
+            loop->load = load;
+            loop->first = parse_immediate_value(node->operand);
+            return loop->first >= 0;
+        }
+        if (labeled || opcode_info(node->op)->flow != FLOW_NONE) return false;
+    }
+    return false;
+}
+
+/**
+ * @brief Work out the trip count of a counted loop
+ *
+ * @param prog Program being optimized
+ * @param loop Loop with counter, step and start value set
+ * @param branch BNE or BPL
+ * @return false if the count is not known
+ */
+static bool count_trips(const Program *prog, CountedLoop *loop, Opcode branch) {
+    int n = loop->first;
+
+    // With 16-bit index registers only counting down to zero is the same
+    if (prog->cpu_type == CPU_65816 && (branch != OP_BNE || loop->delta > 0 || n == 0)) {
+        return false;
+    }
+
+    if (branch == OP_BNE) {
+        loop->trips = loop->delta < 0 ? (n ? n : 256) : 256 - n;
+        loop->final = 0;
+    } else {
+        if (n > 0x7F) return false;
+        loop->trips = loop->delta < 0 ? n + 1 : 0x80 - n;
+        loop->final = loop->delta < 0 ? 0xFF : 0x80;
+    }
+    return true;
+}
+
+/**
+ * @brief Recognize a counted loop in a single-block natural loop
+ *
+ * The block must start with a label only its own branch refers to, be
+ * entered only by falling in from the block before it, and hold no
+ * labels, directives, calls or no_optimize lines in its body, which
+ * must not write the counter. The body folds only if it reads the
+ * counter as an abs/zp index alone and never reads the N or Z flag the
+ * step set.
+ *
+ * @param prog Program owning the nodes
+ * @param b Loop block
+ * @param loop Where to store the loop
+ * @return true if the block is a counted loop
+ */
+static bool recognize_loop(const Program *prog, int b, CountedLoop *loop) {
+    const Cfg *cfg = prog->cfg;
+    const BasicBlock *block = &cfg->blocks[b];
+    if (b == 0 || block->unknown_entry || block->is_data || block->pred_count != 2) return false;
+    for (int p = 0; p < block->pred_count; p++) {
+        int pred = cfg->preds[block->pred_start + p];
+        if (pred != b && pred != b - 1) return false;
+    }
+
+    const AstNode *head = &prog->nodes[block->start];
+    if (!head->label || !head->label[0]) return false;
+    const CfgLabel *label = cfg_find_label(cfg, head->label, strlen(head->label), block->start);
+    if (!label || label->node != block->start || label->refs != 1 || label->called ||
+        label->address_taken || label->ambiguous) {
+        return false;
+    }
+
+    // Branch and step, from the end of the block
+    int branch = -1, step = -1;
+    for (int i = block->end - 1; i >= block->start && step < 0; i--) {
+        const AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i)) continue;
+        if (node->op == OP_NONE) {
+            if (node->opcode && node->opcode[0]) return false;
+            continue;
+        }
+        if (node->no_optimize) return false;
+        if (branch < 0) branch = i; else step = i;
+    }
+    if (step < 0) return false;
+
+    const AstNode *br = &prog->nodes[branch];
+    if ((br->op != OP_BNE && br->op != OP_BPL) || !br->operand ||
+        cfg_find_label(cfg, br->operand, strlen(br->operand), branch) != label) {
+        return false;
+    }
+    loop->counter = step_counter(prog->nodes[step].op, &loop->delta);
+    if (!loop->counter) return false;
+
+    loop->header = block->start;
+    loop->step = step;
+    loop->branch = branch;
+    loop->length = 0;
+    loop->foldable = true;
+    loop->body.cycles = loop->body.bytes = 0;
+
+    // Folding drops the step, so the body may not see the N and Z it sets
+    bool reads = false;
+    unsigned int step_flags = RF_NZ;
+    for (int i = block->start; i < step; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i) || node->no_optimize) return false;
+        if (i != block->start && node->label && node->label[0]) return false;
+        if (node->op == OP_NONE) {
+            if (node->opcode && node->opcode[0]) return false;
+            continue;
+        }
+
+        if (opcode_info(node->op)->flow != FLOW_NONE) return false;
+        if (opcode_writes(node->op, node->mode) & loop->counter) return false;
+        if (opcode_reads(node->op, node->mode) & step_flags) loop->foldable = false;
+        step_flags &= ~opcode_writes(node->op, node->mode);
+        if (opcode_reads(node->op, node->mode) & loop->counter) {
+            reads = true;
+            AddrMode mode = node->mode;
+            if (mode != AM_ABSOLUTE_X && mode != AM_ABSOLUTE_Y &&
+                mode != AM_ZEROPAGE_X && mode != AM_ZEROPAGE_Y) {
+                loop->foldable = false;
+            }
+        }
+        if (++loop->length > UNROLL_MAX_BODY) return false;
+        cost_add_node(&loop->body, prog, i);
+    }
+
+    // Delay loops are kept: their point is the time they take
+    if (loop->length == 0) return false;
+    if (!find_counter_load(prog, block->start - 1, cfg->blocks[b - 1].start, loop) ||
+        !count_trips(prog, loop, br->op)) {
+        return false;
+    }
+
+    // Every iteration must fold; the largest index is the one that may not
+    int largest = 0;
+    for (int k = 0; k < loop->trips; k++) {
+        if (counter_value(loop, k) > largest) largest = counter_value(loop, k);
+    }
+    char text[UNROLL_OPERAND_SIZE];
+    for (int i = block->start; reads && loop->foldable && i < step; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (node->op == OP_NONE || !(opcode_reads(node->op, node->mode) & loop->counter)) continue;
+        if (fold_index(prog, node, loop->counter, largest, text, sizeof(text)) == AM_NONE) {
+            loop->foldable = false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Check that the branches around a loop reach once it grows
+ *
+ * @param prog Program being optimized
+ * @param index Node the copies go after; the branch when it is removed
+ * @param bytes Bytes the unrolling adds
+ * @param grown Growth of the loops already chosen; entry count
+ *        receives this one
+ * @param count Number of chosen loops
+ * @return true if every branch across the copies stays in range
+ */
+static bool loop_fits(const Program *prog, int index, int bytes, CodeGrowth *grown, int count) {
+    grown[count].index = index;
+    grown[count].bytes = bytes;
+    return growth_fits(prog, &grown[count], grown, count);
+}
+
+/**
+ * @brief Decide how far to unroll a loop within the byte budget
+ *
+ * The copies may not push a short branch across them, the loop's own
+ * included when it stays, out of range.
+ *
+ * @param prog Program being optimized
+ * @param loop Recognized loop
+ * @param grown Growth of the loops already chosen; entry count
+ *        receives this one
+ * @param count Number of chosen loops
+ * @return true if the loop is unrolled at all
+ */
+static bool decide_unrolling(const Program *prog, CountedLoop *loop, CodeGrowth *grown, int count) {
+    int step = node_cost(prog, loop->step).bytes;
+    int branch = node_cost(prog, loop->branch).bytes;
+    int body = loop->body.bytes;
+    int budget = prog->unroll_budget;
+
+    // Full unroll: the branch goes, the steps go too if the body folds
+    int growth = loop->foldable
+        ? loop->trips * body + instruction_cost(loop->load, AM_IMMEDIATE, prog->cpu_type).bytes
+        : loop->trips * (body + step);
+    growth -= body + step + branch;
+    if (growth <= budget && loop_fits(prog, loop->branch, growth, grown, count)) {
+        loop->full = true;
+        loop->copies = loop->trips - 1;
+        return true;
+    }
+
+    // Partial unroll by the largest factor dividing the trip count
+    loop->full = false;
+    loop->foldable = false;
+    for (int factor = loop->trips / 2; factor >= 2; factor--) {
+        if (loop->trips % factor == 0 && (factor - 1) * (body + step) <= budget &&
+            loop_fits(prog, loop->step, (factor - 1) * (body + step), grown, count)) {
+            loop->copies = factor - 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Copy one iteration of a loop into the new node array
+ *
+ * @param prog Program owning the nodes
+ * @param loop Loop
+ * @param iteration Iteration the copy runs (used when folding)
+ * @param out Where to store the copied nodes
+ * @return Number of nodes stored
+ */
+static int copy_iteration(Program *prog, const CountedLoop *loop, int iteration, AstNode *out) {
+    int last = loop->foldable ? loop->step : loop->step + 1;
+    int n = 0;
+
+    for (int i = loop->header; i < last; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (node->op == OP_NONE) continue;
+
+        AstNode *copy = &out[n++];
+        *copy = *node;
+        copy->label = NULL;
+        copy->is_local_label = false;
+        copy->is_branch_target = false;
+        copy->comment = NULL;
+        copy->rewritten = true;
+        copy->optimization_count = 0;
+
+        if (loop->foldable && (opcode_reads(node->op, node->mode) & loop->counter)) {
+            char text[UNROLL_OPERAND_SIZE];
+            copy->mode = fold_index(prog, node, loop->counter, counter_value(loop, iteration),
+                                    text, sizeof(text));
+            copy->operand = arena_strdup(prog->arena, text);
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Rebuild the node array with the loop copies in place
+ *
+ * Folded copies go before the step of a loop, others after it. The
+ * original nodes keep their positions relative to each other.
+ *
+ * @param prog Program to rebuild
+ * @param loops Loops to unroll, in source order
+ * @param count Number of loops
+ * @param new_pos Receives the new index of every old node
+ * @return false on allocation failure (prog is unchanged)
+ */
+static bool insert_copies(Program *prog, const CountedLoop *loops, int count, int *new_pos) {
+    size_t copies = 0;
+    for (int l = 0; l < count; l++) {
+        copies += (size_t)loops[l].copies * (loops[l].length + (loops[l].foldable ? 0 : 1));
+    }
+
+    AstNode *added = malloc((copies > 0 ? copies : 1) * sizeof(AstNode));
+    int *order = malloc(((size_t)prog->count + copies) * sizeof(int));
+    if (!added || !order) {
+        free(added);
+        free(order);
+        return false;
+    }
+
+    int n = 0, a = 0, l = 0;
+    for (int i = 0; i < prog->count; i++) {
+        const CountedLoop *loop = l < count ? &loops[l] : NULL;
+        if (loop && i == (loop->foldable ? loop->step : loop->branch)) {
+            for (int k = 1; k <= loop->copies; k++) {
+                int copied = copy_iteration(prog, loop, k, &added[a]);
+                for (int c = 0; c < copied; c++) order[n++] = -1 - a++;
+            }
+            l++;
+        }
+
+        new_pos[i] = n;
+        order[n++] = i;
+    }
+
+    bool rebuilt = program_rebuild_nodes(prog, order, n, added);
+    free(added);
+    free(order);
+    return rebuilt;
+}
+
+/**
+ * @brief Finish a fully unrolled loop in the rebuilt node array
+ *
+ * Folds the index into the first iteration, turns a folded step into
+ * the load of the final counter value and removes the branch.
+ *
+ * @param prog Rebuilt program
+ * @param loop Loop (old node indices)
+ * @param new_pos New index of every old node
+ */
+static void finish_full_unroll(Program *prog, const CountedLoop *loop, const int *new_pos) {
+    if (loop->foldable) {
+        char text[UNROLL_OPERAND_SIZE];
+        for (int i = loop->header; i < loop->step; i++) {
+            AstNode *node = &prog->nodes[new_pos[i]];
+            if (node->op == OP_NONE || !(opcode_reads(node->op, node->mode) & loop->counter)) continue;
+            node->mode = fold_index(prog, node, loop->counter, loop->first, text, sizeof(text));
+            node->operand = arena_strdup(prog->arena, text);
+            note_node_changed(prog, new_pos[i]);
+        }
+
+        snprintf(text, sizeof(text), "#$%02X", loop->final);
+        AstNode *step = &prog->nodes[new_pos[loop->step]];
+        step->operand = arena_strdup(prog->arena, text);
+        set_node_opcode(prog->arena, step, loop->load);
+        note_node_changed(prog, new_pos[loop->step]);
+    }
+    mark_node_dead(prog, new_pos[loop->branch]);
+}
+
+/**
+ * @brief Unroll counted loops (speed mode)
+ *
+ * 1. Finds the natural loops of the control flow graph
+ * 2. Recognizes single-block loops counting an index register from an
+ *    immediate value down to zero or across the sign bit (see
+ *    recognize_loop())
+ * 3. Unrolls each that is optimized for speed (see mode_at()) fully if
+ *    that adds at most prog->unroll_budget bytes, otherwise by the
+ *    largest factor of the trip count that fits
+ *
+ * The control flow graph and register side table are dropped when
+ * nodes are inserted; the caller rebuilds the graph.
+ *
+ * @param prog Program to optimize (prog->cfg must be built)
+ */
+void optimize_unroll_loops_ast(Program *prog) {
+    const Cfg *cfg = prog->cfg;
+    if (!cfg || (prog->mode != OPT_SPEED && !prog->profile) || prog->unroll_budget <= 0) return;
+
+    CfgLoops *natural = find_natural_loops(cfg);
+    if (!natural) return;
+
+    CountedLoop *loops = malloc((natural->count > 0 ? natural->count : 1) * sizeof(CountedLoop));
+    CodeGrowth *grown = malloc((natural->count > 0 ? natural->count : 1) * sizeof(CodeGrowth));
+    int *new_pos = malloc((prog->count > 0 ? prog->count : 1) * sizeof(int));
+    int count = 0;
+    for (int l = 0; loops && grown && l < natural->count; l++) {
+        const CfgLoop *loop = &natural->loops[l];
+        const BasicBlock *block = &cfg->blocks[loop->header];
+        if (loop->header != loop->latch || mode_at(prog, block->start, block->end) != OPT_SPEED) continue;
+        if (recognize_loop(prog, loop->header, &loops[count]) &&
+            decide_unrolling(prog, &loops[count], grown, count)) {
+            count++;
+        }
+    }
+    if (prog->trace_level > 1) {
+        program_log(prog, "DEBUG unroll: %d natural loops, %d unrolled\n", natural->count, count);
+    }
+    free_natural_loops(natural);
+
+    if (count > 0 && new_pos && insert_copies(prog, loops, count, new_pos)) {
+        free_cfg(prog->cfg);
+        prog->cfg = NULL;
+        free_register_states(prog);
+
+        for (int l = 0; l < count; l++) {
+            const CountedLoop *loop = &loops[l];
+            InstrCost step = node_cost(prog, new_pos[loop->step]);
+            InstrCost branch = node_cost(prog, new_pos[loop->branch]);
+
+            // Savings per run of the loop: the taken branches and, when
+            // folded, the steps that go (removing the branch node itself
+            // is counted by mark_node_dead())
+            int groups = loop->trips / (loop->copies + 1);
+            int cycles = (loop->trips - groups) * (branch.cycles + branch.branch_taken);
+            int bytes = -loop->copies * (loop->body.bytes + (loop->foldable ? 0 : step.bytes));
+            if (loop->full && loop->foldable) {
+                InstrCost load = instruction_cost(loop->load, AM_IMMEDIATE, prog->cpu_type);
+                cycles += (loop->trips - 1) * step.cycles;
+                bytes -= load.bytes - step.bytes;
+            }
+            if (loop->full) finish_full_unroll(prog, loop, new_pos);
+
+            stats_note_change(prog->stats, 0, 1, cycles, bytes);
+            count_optimization(prog, loop->full ? "unroll.full" : "unroll.partial");
+            if (prog->trace_level > 1) {
+                program_log(prog, "DEBUG unroll: %s unrolled loop %s at line %d (%d iterations)\n",
+                            loop->full ? "Fully" : "Partially", prog->nodes[new_pos[loop->header]].label,
+                            prog->nodes[new_pos[loop->header]].line_num, loop->trips);
+            }
+        }
+    }
+
+    free(loops);
+    free(grown);
+    free(new_pos);
+}
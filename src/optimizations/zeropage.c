@@ -0,0 +1,566 @@
+/**
+ * @file zeropage.c
+ * @brief Zero page promotion of hot variables (-zp-free)
+ *
+ * A zero page operand is one byte shorter and usually one cycle faster
+ * than an absolute one. Given the zero page bytes the user declares
+ * free, this pass moves the hottest variables there:
+ *
+ *   LDA counter                   counter = $FB
+ *   ...                           ...
+ * counter: .res 1      becomes    LDA counter      (now zero page)
+ *
+ * Variables are global labels of uninitialized storage (.res, .ds,
+ * .dsb, .blkb, .skip) in this file; equates are left alone since they
+ * may name hardware registers. Every instruction operand of the form
+ * name, name+k, name,X or name+k,Y counts as a reference, weighted by
+ * the loop nesting of its block (see loop_weight()), at what switching
+ * it to zero page addressing saves under the cost model. Variables are
+ * ranked by weighted cycles in speed mode and by bytes in size mode.
+ * With a profile (-profile), references in hot code are weighted by
+ * their execution counts and the rest count as zero, and variables are
+ * ranked by those cycles and then by bytes: speed where the code is hot,
+ * size everywhere else.
+ *
+ * A storage area is skipped from the first label used any other way
+ * (as an immediate, a pointer, in data or in an expression) to its end,
+ * since code may then walk from that variable into the next ones. A promoted
+ * variable keeps its name: its storage is replaced by an equate at the
+ * top of the file, so the assembler picks zero page addressing for
+ * every use. Its initial contents are not loaded with the program any
+ * more, which is why only reserved storage qualifies.
+ *
+ * Promotion moves nodes, so it runs once, before the control flow
+ * graph the other passes use is rebuilt.
+ */
+
+#include "optimizer.h"
+#include "../analysis/cfg.h"
+#include "../analysis/cost.h"
+#include "../analysis/registers.h"
+#include "../program/profile.h"
+#include "../program/stats.h"
+#include <ctype.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ZP_DEFINITION_SIZE 160      /**< Size of a rewritten definition line */
+
+/**
+ * @brief A variable that may move to zero page
+ */
+typedef struct {
+    int label;                  /**< Node defining the label */
+    int storage;                /**< Reserve directive (label or the next node) */
+    int size;                   /**< Reserved bytes */
+    int area;                   /**< Storage area index */
+    int refs;                   /**< Instruction operands referring to it */
+    int cycles;                 /**< Static cycles saved in zero page */
+    int bytes;                  /**< Bytes saved in zero page */
+    long weighted;              /**< Loop-weighted (or profiled) cycles saved */
+    long rank[2];               /**< Savings compared first and second under the mode */
+    int address;                /**< Assigned zero page address, or -1 */
+} ZpVariable;
+
+/**
+ * @brief Analysis state of the pass
+ */
+typedef struct {
+    ZpVariable *vars;           /**< Candidate variables */
+    int count;                  /**< Number of candidates */
+    int *var_of;                /**< Candidate of every label table slot, or -1 */
+    int *area_of;               /**< Storage area of every label table slot, or -1 */
+    int *size_of;               /**< Bytes after every label table slot's label, or -1 */
+    int *unsafe_from;           /**< First label node of every area used another way, or INT_MAX */
+    int areas;                  /**< Number of storage areas */
+} ZpState;
+
+/**
+ * @brief Zero page form of an absolute addressing mode
+ * @param mode Addressing mode
+ * @return Zero page mode, or AM_NONE if there is none
+ */
+static AddrMode zero_page_mode(AddrMode mode) {
+    switch (mode) {
+        case AM_ABSOLUTE:   return AM_ZEROPAGE;
+        case AM_ABSOLUTE_X: return AM_ZEROPAGE_X;
+        case AM_ABSOLUTE_Y: return AM_ZEROPAGE_Y;
+        default:            return AM_NONE;
+    }
+}
+
+/**
+ * @brief Find the storage directive a label names
+ *
+ * @param prog Program owning the nodes
+ * @param index Label node index
+ * @return The label's own node if it holds a directive, else the next
+ *         directive after blank lines and comments, or -1
+ */
+static int storage_of(const Program *prog, int index) {
+    for (int i = index; i < prog->count; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (node->op != OP_NONE) return -1;
+        if (node->opcode && node->opcode[0]) return i;
+        if (i > index && node->label && node->label[0]) return -1;
+    }
+    return -1;
+}
+
+/**
+ * @brief Split the data of the program into storage areas
+ *
+ * An area is a run of data directives and the labels between them,
+ * ended by an instruction or a directive of unknown size. Every label
+ * on data gets its area and the bytes up to the next label.
+ *
+ * @param prog Program to scan (prog->cfg must be built)
+ * @param state State to fill in (area_of, size_of, areas)
+ */
+static void find_storage_areas(const Program *prog, ZpState *state) {
+    const Cfg *cfg = prog->cfg;
+    int area = -1;
+    int label = -1;             // label table slot collecting bytes
+
+    for (int i = 0; i < prog->count; i++) {
+        const AstNode *node = &prog->nodes[i];
+        long bytes = node->op == OP_NONE ? directive_bytes(node) : -1;
+        if (bytes < 0) {
+            area = -1;
+            label = -1;
+            continue;
+        }
+
+        if (node->label && node->label[0]) {
+            int storage = storage_of(prog, i);
+            const CfgLabel *def = cfg_find_label(cfg, node->label, strlen(node->label), i);
+            label = -1;
+            if (storage >= 0 && def && def->node == i && directive_bytes(&prog->nodes[storage]) > 0) {
+                if (area < 0) area = state->areas++;
+                label = (int)(def - cfg->labels);
+                state->area_of[label] = area;
+                state->size_of[label] = 0;
+            }
+        }
+        if (bytes > 0) {
+            if (area < 0) area = state->areas++;
+            if (label >= 0) state->size_of[label] += (int)bytes;
+        }
+    }
+}
+
+/**
+ * @brief Find the variables that may move to zero page
+ *
+ * @param prog Program to scan (prog->cfg must be built)
+ * @param state State with the storage areas; vars and var_of are filled in
+ */
+static void find_variables(const Program *prog, ZpState *state) {
+    const Cfg *cfg = prog->cfg;
+    for (int i = 0; i < prog->count; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (!node->label || !node->label[0] || node->is_local_label || node->no_optimize) continue;
+
+        const CfgLabel *def = cfg_find_label(cfg, node->label, strlen(node->label), i);
+        if (!def || def->node != i || def->ambiguous) continue;
+        int slot = (int)(def - cfg->labels);
+        int storage = storage_of(prog, i);
+        if (state->area_of[slot] < 0 || storage < 0 || prog->nodes[storage].no_optimize ||
+            !is_reserve_directive(&prog->nodes[storage])) {
+            continue;
+        }
+        int size = state->size_of[slot];
+        if (size < 1 || size > 256 || size != directive_bytes(&prog->nodes[storage])) continue;
+
+        ZpVariable *var = &state->vars[state->count];
+        memset(var, 0, sizeof(*var));
+        var->label = i;
+        var->storage = storage;
+        var->size = size;
+        var->area = state->area_of[slot];
+        var->address = -1;
+        state->var_of[slot] = state->count++;
+    }
+}
+
+/**
+ * @brief Parse an operand of the form name, name+k, name,X or name+k,Y
+ *
+ * @param operand Operand text
+ * @param name Start of the symbol in the operand
+ * @param len Length of the symbol
+ * @return Offset k, or -1 if the operand has any other form
+ */
+static int plain_offset(const char *operand, const char *name, size_t len) {
+    if (name != operand) return -1;
+    const char *p = operand + len;
+    int offset = 0;
+    if (*p == '+') {
+        p++;
+        bool hex = *p == '$';
+        const char *digits = hex ? p + 1 : p;
+        char *end;
+        long k = strtol(digits, &end, hex ? 16 : 10);
+        if (end == digits || !(hex ? isxdigit((unsigned char)*digits) : isdigit((unsigned char)*digits)) ||
+            k > 255) {
+            return -1;
+        }
+        offset = (int)k;
+        p = end;
+    }
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p == ',') {
+        p++;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p != 'X' && *p != 'x' && *p != 'Y' && *p != 'y') return -1;
+        p++;
+    }
+    while (*p == ' ' || *p == '\t') p++;
+    return *p ? -1 : offset;
+}
+
+/**
+ * @brief Classify the storage labels a node mentions
+ *
+ * @param prog Program owning the node (prog->cfg must be built)
+ * @param state Analysis state; areas used another way are marked unsafe
+ *              from the label on
+ * @param index Node index
+ * @return Candidate the node refers to in one of the plain forms, or -1
+ */
+static int classify_mentions(const Program *prog, ZpState *state, int index) {
+    const Cfg *cfg = prog->cfg;
+    const AstNode *node = &prog->nodes[index];
+    if (!node->operand || !node->operand[0]) return -1;
+
+    bool instruction = node->op != OP_NONE && opcode_info(node->op)->flow == FLOW_NONE &&
+                       zero_page_mode(node->mode) != AM_NONE;
+    int var = -1;
+    size_t pos = 0, len = 0;
+    const char *sym;
+    while ((sym = next_operand_symbol(node->operand, &pos, &prog->config, &len)) != NULL) {
+        const CfgLabel *label = cfg_find_label(cfg, sym, len, index);
+        if (!label) continue;
+        int slot = (int)(label - cfg->labels);
+        int area = state->area_of[slot];
+        if (area < 0) continue;
+
+        int offset = instruction ? plain_offset(node->operand, sym, len) : -1;
+        bool indexed = node->mode != AM_ABSOLUTE;
+        if (offset < 0 || offset >= state->size_of[slot] || (indexed && state->size_of[slot] == 1)) {
+            if (label->node < state->unsafe_from[area]) state->unsafe_from[area] = label->node;
+        } else {
+            var = state->var_of[slot];
+        }
+    }
+    return var;
+}
+
+/**
+ * @brief Cycles and bytes a reference saves in zero page
+ *
+ * @param prog Program owning the node
+ * @param index Referencing node index
+ * @param cycles Receives the cycles saved
+ * @param bytes Receives the bytes saved
+ * @return Zero page mode of the node, or AM_NONE if the CPU has none
+ */
+static AddrMode reference_saving(const Program *prog, int index, int *cycles, int *bytes) {
+    const AstNode *node = &prog->nodes[index];
+    AddrMode mode = zero_page_mode(node->mode);
+    InstrCost before = instruction_cost(node->op, node->mode, prog->cpu_type);
+    InstrCost after = instruction_cost(node->op, mode, prog->cpu_type);
+    *cycles = *bytes = 0;
+    if (!before.valid || !after.valid) return AM_NONE;
+
+    *cycles = before.cycles - after.cycles;
+    *bytes = before.bytes - after.bytes;
+    return mode;
+}
+
+/**
+ * @brief Mark the zero page bytes the program already uses
+ *
+ * Covers equates to zero page addresses and literal zero page operands,
+ * so declaring a byte free that the program uses does no harm.
+ *
+ * @param prog Program to scan
+ * @param used 256 flags to set
+ */
+static void find_used_zero_page(const Program *prog, bool *used) {
+    for (int i = 0; i < prog->count; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (!node->operand) continue;
+        bool equate = node->op == OP_NONE && node->opcode && strcmp(node->opcode, "=") == 0;
+        bool literal = node->op != OP_NONE && node->mode != AM_IMMEDIATE &&
+                       node->mode != AM_RELATIVE && node->mode != AM_STACK_RELATIVE &&
+                       node->mode != AM_STACK_INDIRECT_Y;
+        if (!equate && !literal) continue;
+
+        // Indirect operands start with a bracket: ($FB),Y or [$FB],Z
+        const char *text = node->operand + strspn(node->operand, " \t");
+        if (*text == '(' || *text == '[') text += 1 + strspn(text + 1, " \t");
+        if (*text != '$') continue;
+        size_t len = strspn(text + 1, "0123456789abcdefABCDEF");
+        if (len == 0 || len > 2) continue;
+        int value = (int)strtol(text + 1, NULL, 16);
+
+        // Indirect modes read a pointer of two, three or four bytes
+        int width = 1;
+        switch (node->mode) {
+            case AM_INDIRECT_INDEXED: case AM_INDEXED_INDIRECT:
+            case AM_ZP_INDIRECT: case AM_INDIRECT_Z:
+                width = 2;
+                break;
+            case AM_INDIRECT_LONG: case AM_INDIRECT_LONG_Y:
+                width = 3;
+                break;
+            case AM_FLAT_INDIRECT_Z:
+                width = 4;
+                break;
+            default:
+                break;
+        }
+        for (int k = 0; k < width; k++) used[(value + k) & 0xFF] = true;
+    }
+}
+
+/**
+ * @brief qsort() comparator: best savings first, then source order
+ *
+ * @param a Pointer to a ZpVariable pointer
+ * @param b Pointer to a ZpVariable pointer
+ * @return Comparison result
+ */
+static int compare_savings(const void *a, const void *b) {
+    const ZpVariable *va = *(ZpVariable * const *)a;
+    const ZpVariable *vb = *(ZpVariable * const *)b;
+    for (int k = 0; k < 2; k++) {
+        if (va->rank[k] != vb->rank[k]) return va->rank[k] < vb->rank[k] ? 1 : -1;
+    }
+    return va->label - vb->label;
+}
+
+/**
+ * @brief Give the best variables zero page addresses
+ *
+ * Each variable takes the first run of free bytes it fits in.
+ *
+ * @param prog Program being optimized
+ * @param state Analysis state with the savings of every candidate
+ * @return Number of variables promoted
+ */
+static int assign_addresses(const Program *prog, ZpState *state) {
+    bool used[256];
+    memset(used, 0, sizeof(used));
+    find_used_zero_page(prog, used);
+
+    ZpVariable **order = malloc((state->count > 0 ? state->count : 1) * sizeof(ZpVariable*));
+    if (!order) return 0;
+    int ranked = 0;
+    for (int v = 0; v < state->count; v++) {
+        ZpVariable *var = &state->vars[v];
+        if (var->label < state->unsafe_from[var->area] && var->refs > 0 && (var->cycles > 0 || var->bytes > 0)) {
+            bool size = prog->mode == OPT_SIZE && !prog->profile;
+            var->rank[0] = size ? var->bytes : var->weighted;
+            var->rank[1] = size ? var->weighted : var->bytes;
+            order[ranked++] = var;
+        }
+    }
+    qsort(order, ranked, sizeof(order[0]), compare_savings);
+
+    int promoted = 0;
+    for (int r = 0; r < ranked; r++) {
+        ZpVariable *var = order[r];
+        for (int start = 0; start + var->size <= 256 && var->address < 0; start++) {
+            int n = 0;
+            while (n < var->size && prog->zp_free[start + n] && !used[start + n]) n++;
+            if (n < var->size) continue;
+            var->address = start;
+            for (int k = 0; k < var->size; k++) used[start + k] = true;
+            promoted++;
+        }
+    }
+    free(order);
+    return promoted;
+}
+
+/**
+ * @brief Turn a variable's label node into its zero page equate
+ *
+ * The line is written verbatim, so it is built here in the syntax of
+ * the assembler.
+ *
+ * @param prog Program owning the node
+ * @param var Promoted variable
+ */
+static void write_definition(Program *prog, const ZpVariable *var) {
+    AstNode *node = &prog->nodes[var->label];
+    char operand[8];
+    char line[ZP_DEFINITION_SIZE];
+    snprintf(operand, sizeof(operand), "$%02X", var->address);
+
+    const char *format = "%s = %s";
+    if (prog->config.type == ASM_KICK) format = ".label %s = %s";
+    if (prog->config.type == ASM_MERLIN || prog->config.type == ASM_LISA) format = "%s EQU %s";
+    int n = snprintf(line, sizeof(line), format, node->label, operand);
+    if (n > 0 && n < (int)sizeof(line)) {
+        snprintf(line + n, sizeof(line) - n, "\t%s zero page: %d references, %d cycles saved",
+                 prog->config.comment_char, var->refs, var->cycles);
+    }
+
+    node->opcode = arena_strdup(prog->arena, "=");
+    node->op = OP_NONE;
+    node->mode = AM_NONE;
+    node->operand = arena_strdup(prog->arena, operand);
+    node->comment = NULL;
+    node->source = arena_strdup(prog->arena, line);
+    node->source_len = node->source ? (int)strlen(node->source) : 0;
+    node->rewritten = false;
+}
+
+/**
+ * @brief Rebuild the node array with the promoted definitions first
+ *
+ * @param prog Program to rebuild
+ * @param state Analysis state with the promoted variables
+ * @return false on allocation failure (prog is unchanged)
+ */
+static bool move_definitions(Program *prog, const ZpState *state) {
+    size_t alloc = prog->count > 0 ? (size_t)prog->count : 1;
+    int *order = malloc(alloc * sizeof(int));
+    bool *first = calloc(alloc, sizeof(bool));
+    if (!order || !first) {
+        free(order);
+        free(first);
+        return false;
+    }
+    for (int v = 0; v < state->count; v++) {
+        if (state->vars[v].address >= 0) first[state->vars[v].label] = true;
+    }
+
+    int n = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < prog->count; i++) {
+            if (first[i] == (pass == 0)) order[n++] = i;
+        }
+    }
+
+    bool rebuilt = program_rebuild_nodes(prog, order, n, NULL);
+    free(first);
+    free(order);
+    return rebuilt;
+}
+
+/**
+ * @brief Zero page promotion of hot variables (-zp-free)
+ *
+ * 1. Splits the data into storage areas and finds the reserved
+ *    variables among them
+ * 2. Sums the loop-weighted (or profiled) savings of every reference and
+ *    marks where the areas are used other than as plain operands
+ * 3. Assigns the free zero page bytes to the best variables
+ * 4. Switches their references to zero page addressing and replaces
+ *    their storage by equates at the top of the file
+ *
+ * Only whole files are promoted: a streaming window cannot see every
+ * reference. The control flow graph and register side table are
+ * dropped when variables move; the caller rebuilds the graph.
+ *
+ * @param prog Program to optimize (prog->cfg must be built)
+ */
+void optimize_zero_page_ast(Program *prog) {
+    const Cfg *cfg = prog->cfg;
+    if (!prog->zp_free || !cfg || prog->source_scope != SOURCE_WHOLE || prog->count == 0) return;
+
+    ZpState state;
+    memset(&state, 0, sizeof(state));
+    size_t slots = cfg->label_capacity > 0 ? (size_t)cfg->label_capacity : 1;
+    state.vars = malloc(prog->count * sizeof(ZpVariable));
+    state.var_of = malloc(slots * sizeof(int));
+    state.area_of = malloc(slots * sizeof(int));
+    state.size_of = malloc(slots * sizeof(int));
+    state.unsafe_from = malloc(prog->count * sizeof(int));
+    int *depth = cfg_loop_depths(cfg);
+    int *var_at = malloc(prog->count * sizeof(int));
+
+    if (state.vars && state.var_of && state.area_of && state.size_of && state.unsafe_from &&
+        depth && var_at) {
+        for (size_t s = 0; s < slots; s++) {
+            state.var_of[s] = state.area_of[s] = state.size_of[s] = -1;
+        }
+        for (int a = 0; a < prog->count; a++) state.unsafe_from[a] = INT_MAX;
+        find_storage_areas(prog, &state);
+        find_variables(prog, &state);
+
+        for (int i = 0; i < prog->count; i++) {
+            var_at[i] = node_is_dead(prog, i) ? -1 : classify_mentions(prog, &state, i);
+            if (var_at[i] < 0) continue;
+
+            int cycles, bytes;
+            reference_saving(prog, i, &cycles, &bytes);
+            int b = i < cfg->node_count ? cfg->block_of[i] : -1;
+            ZpVariable *var = &state.vars[var_at[i]];
+            var->refs++;
+            var->cycles += cycles;
+            var->bytes += bytes;
+            if (!prog->profile) {
+                var->weighted += cycles * loop_weight(b >= 0 ? depth[b] : 0);
+            } else if (mode_at(prog, i, i + 1) == OPT_SPEED) {
+                var->weighted += cycles * profile_count(prog, i);
+            }
+        }
+
+        int promoted = state.count > 0 ? assign_addresses(prog, &state) : 0;
+        if (prog->trace_level > 1) {
+            program_log(prog, "DEBUG zeropage: %d variables, %d promoted\n", state.count, promoted);
+        }
+
+        if (promoted > 0) {
+            int cycles = 0, bytes = 0;
+            long weighted = 0;
+            const char *weighting = prog->profile ? "profiled" : "loop-weighted";
+            for (int i = 0; i < prog->count; i++) {
+                if (var_at[i] < 0 || state.vars[var_at[i]].address < 0) continue;
+                int c, s;
+                AddrMode mode = reference_saving(prog, i, &c, &s);
+                if (mode == AM_NONE) continue;
+                prog->nodes[i].mode = mode;
+                stats_note_change(prog->stats, 0, 1, c, s);
+            }
+            for (int v = 0; v < state.count; v++) {
+                ZpVariable *var = &state.vars[v];
+                if (var->address < 0) continue;
+                if (var->storage != var->label) mark_node_dead(prog, var->storage);
+                write_definition(prog, var);
+                count_optimization(prog, "zeropage.promote");
+                program_log(prog, "Zero page: %s -> $%02X (%d references, %d cycles and "
+                            "%d bytes saved, %ld %s cycles)\n",
+                            prog->nodes[var->label].label, var->address, var->refs,
+                            var->cycles, var->bytes, var->weighted, weighting);
+                cycles += var->cycles;
+                bytes += var->bytes;
+                weighted += var->weighted;
+            }
+            program_log(prog, "Zero page: promoted %d of %d variables, %d cycles and %d bytes "
+                        "saved (%ld %s cycles)\n",
+                        promoted, state.count, cycles, bytes, weighted, weighting);
+
+            if (move_definitions(prog, &state)) {
+                free_cfg(prog->cfg);
+                prog->cfg = NULL;
+                free_register_states(prog);
+            }
+        }
+    }
+
+    free(state.vars);
+    free(state.var_of);
+    free(state.area_of);
+    free(state.size_of);
+    free(state.unsafe_from);
+    free(depth);
+    free(var_at);
+}
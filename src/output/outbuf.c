@@ -0,0 +1,184 @@
+/**
+ * @file outbuf.c
+ * @brief Buffered output writer implementation
+ *
+ * Appends are plain memcpy()s into one buffer. File writers pass the
+ * buffer to fwrite() whenever it holds OUTBUF_CHUNK bytes, so the stdio
+ * layer (and its locking) is entered once per chunk rather than once per
+ * field.
+ */
+
+#include "outbuf.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Make room for more bytes
+ *
+ * @param out Writer
+ * @param need Bytes about to be appended
+ * @return false on allocation failure
+ */
+static bool reserve(OutBuf *out, size_t need) {
+    if (out->cap - out->len >= need) return true;
+
+    size_t cap = out->cap ? out->cap : OUTBUF_CHUNK;
+    while (cap - out->len < need) cap *= 2;
+    char *data = realloc(out->data, cap);
+    if (!data) {
+        out->failed = true;
+        return false;
+    }
+    out->data = data;
+    out->cap = cap;
+    return true;
+}
+
+/**
+ * @brief Start a writer that flushes to a stream
+ *
+ * @param out Writer to initialize
+ * @param fp Destination stream (not closed by the writer)
+ */
+void outbuf_init_file(OutBuf *out, FILE *fp) {
+    out->data = NULL;
+    out->len = 0;
+    out->cap = 0;
+    out->fp = fp;
+    out->failed = false;
+}
+
+/**
+ * @brief Start a writer that collects everything in memory
+ * @param out Writer to initialize
+ */
+void outbuf_init_memory(OutBuf *out) {
+    outbuf_init_file(out, NULL);
+}
+
+/**
+ * @brief Append bytes
+ *
+ * Bulk appends larger than a chunk go straight to the stream of a file
+ * writer once the pending bytes are out.
+ *
+ * @param out Writer
+ * @param data Bytes to append
+ * @param len Number of bytes
+ */
+void outbuf_write(OutBuf *out, const char *data, size_t len) {
+    if (out->fp && out->len + len > OUTBUF_CHUNK) {
+        outbuf_flush(out);
+        if (len >= OUTBUF_CHUNK) {
+            if (fwrite(data, 1, len, out->fp) != len) out->failed = true;
+            return;
+        }
+    }
+    if (!reserve(out, len)) return;
+    memcpy(out->data + out->len, data, len);
+    out->len += len;
+}
+
+/**
+ * @brief Append a NUL-terminated string
+ *
+ * @param out Writer
+ * @param str String to append
+ */
+void outbuf_puts(OutBuf *out, const char *str) {
+    outbuf_write(out, str, strlen(str));
+}
+
+/**
+ * @brief Append one character
+ *
+ * @param out Writer
+ * @param c Character to append
+ */
+void outbuf_putc(OutBuf *out, char c) {
+    if (out->len < out->cap && !(out->fp && out->len >= OUTBUF_CHUNK)) {
+        out->data[out->len++] = c;
+        return;
+    }
+    outbuf_write(out, &c, 1);
+}
+
+/**
+ * @brief Append formatted text
+ *
+ * @param out Writer
+ * @param format printf() format
+ */
+void outbuf_printf(OutBuf *out, const char *format, ...) {
+    char small[256];
+    va_list args;
+
+    va_start(args, format);
+    int len = vsnprintf(small, sizeof(small), format, args);
+    va_end(args);
+    if (len < 0) {
+        out->failed = true;
+        return;
+    }
+    if ((size_t)len < sizeof(small)) {
+        outbuf_write(out, small, (size_t)len);
+        return;
+    }
+
+    // Too long for the stack buffer: format straight into the writer
+    if (!reserve(out, (size_t)len + 1)) return;
+    va_start(args, format);
+    vsnprintf(out->data + out->len, (size_t)len + 1, format, args);
+    va_end(args);
+    out->len += (size_t)len;
+}
+
+/**
+ * @brief Write pending bytes of a file writer to its stream
+ *
+ * @param out Writer
+ * @return false if any write or allocation has failed
+ */
+bool outbuf_flush(OutBuf *out) {
+    if (out->fp && out->len > 0) {
+        if (fwrite(out->data, 1, out->len, out->fp) != out->len) out->failed = true;
+        out->len = 0;
+        if (fflush(out->fp) != 0) out->failed = true;
+    }
+    return !out->failed;
+}
+
+/**
+ * @brief Take the collected output of a memory writer
+ *
+ * @param out Memory writer
+ * @param len Where to store the output length (may be NULL)
+ * @return NUL-terminated output (caller frees), or NULL on failure
+ */
+char* outbuf_take(OutBuf *out, size_t *len) {
+    if (out->failed || !reserve(out, 1)) return NULL;
+
+    char *data = out->data;
+    data[out->len] = '\0';
+    if (len) *len = out->len;
+    out->data = NULL;
+    out->len = 0;
+    out->cap = 0;
+    return data;
+}
+
+/**
+ * @brief Flush and release a writer
+ *
+ * @param out Writer
+ * @return false if any write or allocation has failed
+ */
+bool outbuf_close(OutBuf *out) {
+    bool ok = outbuf_flush(out);
+    free(out->data);
+    out->data = NULL;
+    out->len = 0;
+    out->cap = 0;
+    return ok;
+}
@@ -0,0 +1,110 @@
+/**
+ * @file outbuf.h
+ * @brief Buffered output writer
+ *
+ * Collects output text in a large user-space buffer. A file writer
+ * hands the buffer to the stream in OUTBUF_CHUNK-sized bulk writes; a
+ * memory writer just keeps growing it, so library callers can take the
+ * whole output as one string.
+ */
+
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define OUTBUF_CHUNK (64 * 1024)   /**< Bytes collected before a file writer flushes */
+
+/**
+ * @brief Output buffer writing to a stream or to memory
+ */
+typedef struct OutBuf {
+    char *data;                 /**< Pending (file) or complete (memory) output */
+    size_t len;                 /**< Bytes used in data */
+    size_t cap;                 /**< Bytes allocated for data */
+    FILE *fp;                   /**< Stream to flush to, or NULL for a memory writer */
+    bool failed;                /**< An allocation or write failed */
+} OutBuf;
+
+/**
+ * @brief Start a writer that flushes to a stream
+ *
+ * @param out Writer to initialize
+ * @param fp Destination stream (not closed by the writer)
+ */
+void outbuf_init_file(OutBuf *out, FILE *fp);
+
+/**
+ * @brief Start a writer that collects everything in memory
+ * @param out Writer to initialize
+ */
+void outbuf_init_memory(OutBuf *out);
+
+/**
+ * @brief Append bytes
+ *
+ * @param out Writer
+ * @param data Bytes to append
+ * @param len Number of bytes
+ */
+void outbuf_write(OutBuf *out, const char *data, size_t len);
+
+/**
+ * @brief Append a NUL-terminated string
+ *
+ * @param out Writer
+ * @param str String to append
+ */
+void outbuf_puts(OutBuf *out, const char *str);
+
+/**
+ * @brief Append one character
+ *
+ * @param out Writer
+ * @param c Character to append
+ */
+void outbuf_putc(OutBuf *out, char c);
+
+/**
+ * @brief Append formatted text
+ *
+ * Meant for headers and footers; per-line output should use the
+ * unformatted calls.
+ *
+ * @param out Writer
+ * @param format printf() format
+ */
+void outbuf_printf(OutBuf *out, const char *format, ...);
+
+/**
+ * @brief Write pending bytes of a file writer to its stream
+ *
+ * Does nothing for memory writers.
+ *
+ * @param out Writer
+ * @return false if any write or allocation has failed
+ */
+bool outbuf_flush(OutBuf *out);
+
+/**
+ * @brief Take the collected output of a memory writer
+ *
+ * The writer is left empty and may be reused.
+ *
+ * @param out Memory writer
+ * @param len Where to store the output length (may be NULL)
+ * @return NUL-terminated output (caller frees), or NULL on failure
+ */
+char* outbuf_take(OutBuf *out, size_t *len);
+
+/**
+ * @brief Flush and release a writer
+ *
+ * @param out Writer
+ * @return false if any write or allocation has failed
+ */
+bool outbuf_close(OutBuf *out);
+
+#endif // OUTBUF_H
@@ -4,13 +4,154 @@
  *
  * Implements writing of optimized AST back to assembly source format.
  * Handles proper formatting for different assembler syntaxes and
- * includes optional optimization trace information.
+ * includes optional optimization trace information. All text goes
+ * through an OutBuf (outbuf.h), so each line costs a few memcpy()s
+ * rather than several formatted stdio calls.
  */
 
 #include "output.h"
+#include "../program/program.h"
 #include <stdio.h>
 #include <stdbool.h>
 
+/**
+ * @brief Rebuild the source line of a node from its fields
+ *
+ * @param out Output writer
+ * @param prog Program owning the node
+ * @param node Node to write
+ */
+static void write_node_line(OutBuf *out, const Program *prog, const AstNode *node) {
+    bool has_opcode = node->opcode && node->opcode[0] != '\0';
+
+    if (node->label) {
+        outbuf_puts(out, node->label);
+        if (prog->config.supports_colon_labels) {
+            outbuf_putc(out, ':');
+        }
+        // Label with opcode on same line, or label only
+        outbuf_putc(out, has_opcode ? '\t' : '\n');
+    } else if (has_opcode) {
+        // No label, add indentation for opcode
+        outbuf_write(out, "    ", 4);
+    }
+
+    if (has_opcode) {
+        outbuf_puts(out, node->opcode);
+        if (node->operand && node->operand[0] != '\0') {
+            outbuf_putc(out, ' ');
+            outbuf_puts(out, node->operand);
+        }
+        // Add comment if present
+        if (node->comment && node->comment[0] != '\0') {
+            outbuf_putc(out, '\t');
+            outbuf_puts(out, node->comment);
+        }
+        outbuf_putc(out, '\n');
+    }
+}
+
+/**
+ * @brief Write the output file header
+ *
+ * @param prog Program being written
+ * @param out Output writer
+ * @param with_total Include the total optimization count (streaming
+ *                   output writes it in the footer instead)
+ */
+void write_output_header(const Program *prog, OutBuf *out, bool with_total) {
+    // Use the appropriate comment style for the assembler
+    const char *cmt = prog->config.comment_char;
+
+    outbuf_printf(out, "%s Optimized for %s\n", cmt,
+                  prog->mode == OPT_SPEED ? "speed" : "size");
+    outbuf_printf(out, "%s Assembler: %s\n", cmt, prog->config.name);
+    outbuf_printf(out, "%s Target CPU: %s\n", cmt,
+                  prog->cpu_type == CPU_6502 ? "6502" :
+                  prog->cpu_type == CPU_65C02 ? "65C02" :
+                  prog->cpu_type == CPU_65816 ? "65816" : "45GS02");
+    if (with_total) {
+        outbuf_printf(out, "%s Total optimizations: %d\n", cmt, prog->optimizations);
+    }
+    outbuf_putc(out, '\n');
+
+    if (prog->trace_level > 0) {
+        outbuf_printf(out, "%s Optimization trace enabled (Level %d)\n", cmt, prog->trace_level);
+        outbuf_printf(out, "%s Lines marked with %s OPT: show applied optimizations\n\n",
+                      cmt, cmt);
+    }
+}
+
+/**
+ * @brief Write the lines of an optimized program
+ *
+ * Lines no pass changed are copied verbatim from the input; rewritten
+ * lines are rebuilt from their fields. Dead nodes are omitted, or noted
+ * in a comment when tracing.
+ *
+ * @param prog Program to write
+ * @param out Output writer
+ */
+void write_output_body(const Program *prog, OutBuf *out) {
+    const char *cmt = prog->config.comment_char;
+
+    for (int i = 0; i < prog->count; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i)) {
+            if (prog->trace_level > 0) {
+                outbuf_puts(out, cmt);
+                outbuf_puts(out, " OPT: Removed - ");
+                outbuf_puts(out, node->label ? node->label : "unknown");
+                outbuf_putc(out, '\n');
+            }
+        } else if (node->source && !node->rewritten) {
+            outbuf_write(out, node->source, (size_t)node->source_len);
+            outbuf_putc(out, '\n');
+        } else {
+            write_node_line(out, prog, node);
+        }
+    }
+}
+
+/**
+ * @brief Write the footer of streamed output
+ *
+ * @param prog Settings program holding the running optimization count
+ * @param out Output writer
+ */
+void write_output_footer(const Program *prog, OutBuf *out) {
+    outbuf_printf(out, "\n%s Total optimizations: %d\n", prog->config.comment_char,
+                  prog->optimizations);
+}
+
+/**
+ * @brief Write optimized program to an output writer
+ *
+ * @param prog Program containing optimized AST and configuration
+ * @param out Output writer (file or memory)
+ */
+void write_program_ast(const Program *prog, OutBuf *out) {
+    write_output_header(prog, out, true);
+    write_output_body(prog, out);
+}
+
+/**
+ * @brief Write optimized program to a memory buffer
+ *
+ * @param prog Program containing optimized AST and configuration
+ * @param len Where to store the output length (may be NULL)
+ * @return NUL-terminated output (caller frees), or NULL on allocation
+ *         failure
+ */
+char* write_program_to_memory(const Program *prog, size_t *len) {
+    OutBuf out;
+    outbuf_init_memory(&out);
+    write_program_ast(prog, &out);
+    char *text = outbuf_take(&out, len);
+    outbuf_close(&out);
+    return text;
+}
+
 /**
  * @brief Write optimized program to assembly file
  *
@@ -25,18 +166,21 @@
  * - Trace information (if enabled)
  *
  * Body:
+ * - Lines no pass touched, copied byte for byte from the input
  * - Labels (with or without colons based on assembler)
  * - Opcodes with operands
  * - Original comments
  * - Optional optimization trace comments
  *
- * Format rules:
+ * Format rules for rewritten lines:
  * - Labels at start of line, followed by colon if supported
  * - Opcodes indented (4 spaces if no label on line)
  * - Operands separated by space
  * - Comments preserved or added for trace
  * - Dead code omitted (or commented if trace_level > 0)
  *
+ * Lines are assembled in an OutBuf and reach the file in bulk writes.
+ *
  * @param prog Program containing optimized AST and configuration
  * @param filename Output file path
  */
@@ -47,63 +191,44 @@ void write_output_ast(Program *prog, const char *filename) {
         return;
     }
 
-    // Use the appropriate comment style for the assembler
-    const char *cmt = prog->config.comment_char;
+    OutBuf out;
+    outbuf_init_file(&out, fp);
+    write_program_ast(prog, &out);
+    if (!outbuf_close(&out)) {
+        fprintf(stderr, "Error: Cannot write to %s\n", filename);
+    }
+    fclose(fp);
+}
 
-    fprintf(fp, "%s Optimized for %s\n", cmt,
-            prog->mode == OPT_SPEED ? "speed" : "size");
-    fprintf(fp, "%s Assembler: %s\n", cmt, prog->config.name);
-    fprintf(fp, "%s Target CPU: %s\n", cmt,
-            prog->cpu_type == CPU_6502 ? "6502" :
-            prog->cpu_type == CPU_65C02 ? "65C02" :
-            prog->cpu_type == CPU_65816 ? "65816" : "45GS02");
-    fprintf(fp, "%s Total optimizations: %d\n\n", cmt, prog->optimizations);
+/**
+ * @brief Print estimated cycles and bytes saved by optimization
+ *
+ * Both summaries come from the same program, so their routines line up
+ * entry by entry.
+ *
+ * @param prog Optimized program
+ * @param before Summary measured before optimization
+ * @param after Summary measured after optimization
+ */
+void print_cost_savings(const Program *prog, const CostSummary *before, const CostSummary *after) {
+    if (!before || !after) return;
 
-    if (prog->trace_level > 0) {
-        fprintf(fp, "%s Optimization trace enabled (Level %d)\n", cmt, prog->trace_level);
-        fprintf(fp, "%s Lines marked with %s OPT: show applied optimizations\n\n",
-                cmt, cmt);
-    }
+    program_log(prog, "Estimated cost: %d -> %d cycles, %d -> %d bytes (saved %d cycles, %d bytes)\n",
+           before->total.cycles, after->total.cycles,
+           before->total.bytes, after->total.bytes,
+           before->total.cycles - after->total.cycles,
+           before->total.bytes - after->total.bytes);
 
-    AstNode *node = prog->root;
-    while (node) {
-        if (!node->is_dead) {
-            // Reconstruct line from AST node
-            bool has_opcode = node->opcode && node->opcode[0] != '\0';
-
-            if (node->label) {
-                fprintf(fp, "%s", node->label);
-                if (prog->config.supports_colon_labels) {
-                    fprintf(fp, ":");
-                }
-                if (has_opcode) {
-                    // Label with opcode on same line
-                    fprintf(fp, "\t");
-                } else {
-                    // Label only, newline
-                    fprintf(fp, "\n");
-                }
-            } else if (has_opcode) {
-                // No label, add indentation for opcode
-                fprintf(fp, "    ");
-            }
+    if (prog->trace_level < 1 || before->count != after->count) return;
 
-            if (has_opcode) {
-                fprintf(fp, "%s", node->opcode);
-                if (node->operand && node->operand[0] != '\0') {
-                    fprintf(fp, " %s", node->operand);
-                }
-                // Add comment if present
-                if (node->comment && node->comment[0] != '\0') {
-                    fprintf(fp, "\t%s", node->comment);
-                }
-                fprintf(fp, "\n");
-            }
-        } else if (prog->trace_level > 0) {
-            fprintf(fp, "%s OPT: Removed - %s\n", cmt, node->label ? node->label : "unknown");
-        }
-        node = node->next;
-    }
+    for (int r = 0; r < after->count; r++) {
+        const RoutineCost *old = &before->routines[r];
+        const RoutineCost *now = &after->routines[r];
+        if (old->cost.cycles == now->cost.cycles && old->cost.bytes == now->cost.bytes) continue;
 
-    fclose(fp);
+        const AstNode *node = &prog->nodes[now->node];
+        program_log(prog, "  %-24s saved %d cycles, %d bytes\n",
+               node->label && node->label[0] ? node->label : "(start)",
+               old->cost.cycles - now->cost.cycles, old->cost.bytes - now->cost.bytes);
+    }
 }
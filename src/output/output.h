@@ -10,12 +10,73 @@
 #define OUTPUT_H
 
 #include "../types.h"
+#include "../analysis/cost.h"
+#include "outbuf.h"
+
+/**
+ * @brief Write the output file header
+ *
+ * Emits the optimization mode, assembler, target CPU, the total
+ * optimization count (unless with_total is false) and, when tracing,
+ * a note about trace comments.
+ *
+ * @param prog Program being written
+ * @param out Output writer
+ * @param with_total Include the total optimization count
+ */
+void write_output_header(const Program *prog, OutBuf *out, bool with_total);
+
+/**
+ * @brief Write the lines of an optimized program
+ *
+ * Unmodified lines are copied verbatim, rewritten lines are rebuilt
+ * and dead lines are omitted (or noted when tracing).
+ *
+ * @param prog Program to write
+ * @param out Output writer
+ */
+void write_output_body(const Program *prog, OutBuf *out);
+
+/**
+ * @brief Write the footer of streamed output
+ *
+ * Streaming output cannot know the total optimization count when the
+ * header is written, so it is appended at the end instead.
+ *
+ * @param prog Program holding the running optimization count
+ * @param out Output writer
+ */
+void write_output_footer(const Program *prog, OutBuf *out);
+
+/**
+ * @brief Write optimized program to an output writer
+ *
+ * Same output as write_output_ast(), for callers that write to their
+ * own stream (e.g. standard output) or to memory.
+ *
+ * @param prog Program to write
+ * @param out Output writer
+ */
+void write_program_ast(const Program *prog, OutBuf *out);
+
+/**
+ * @brief Write optimized program to a memory buffer
+ *
+ * For library callers that want the optimized source as a string.
+ *
+ * @param prog Program to write
+ * @param len Where to store the output length (may be NULL)
+ * @return NUL-terminated output (caller frees), or NULL on allocation
+ *         failure
+ */
+char* write_program_to_memory(const Program *prog, size_t *len);
 
 /**
  * @brief Write optimized program to assembly file
  *
- * Writes the optimized AST to an assembly file, reconstructing
- * the assembly source from the AST nodes. Includes:
+ * Writes the optimized AST to an assembly file. Lines no pass changed
+ * are copied verbatim from the input; rewritten lines are reconstructed
+ * from their AST nodes. Includes:
  * - File header with optimization statistics
  * - Assembler and CPU target information
  * - Properly formatted labels, opcodes, operands, and comments
@@ -35,4 +96,18 @@
  */
 void write_output_ast(Program *prog, const char *filename);
 
+/**
+ * @brief Print estimated cycles and bytes saved by optimization
+ *
+ * Prints the program totals before and after optimization. At trace
+ * level 1 and above, also prints one line for every routine whose cost
+ * changed. Cycle counts are static sums of base cycles: every
+ * instruction is counted once, ignoring loops and taken branches.
+ *
+ * @param prog Optimized program
+ * @param before Summary measured before optimization
+ * @param after Summary measured after optimization
+ */
+void print_cost_savings(const Program *prog, const CostSummary *before, const CostSummary *after);
+
 #endif // OUTPUT_H
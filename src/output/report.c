@@ -0,0 +1,336 @@
+/**
+ * @file report.c
+ * @brief Machine-readable static cost report implementation
+ *
+ * Sums the per-node costs recorded before optimization and the current
+ * costs after optimization over the blocks of the final control flow
+ * graph and over routines, then writes one JSON object or one CSV table.
+ */
+
+#include "report.h"
+#include "../analysis/cfg.h"
+#include "../program/program.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/**
+ * @brief Input and output estimates of one report row
+ */
+typedef struct {
+    long cycles;        /**< Base cycles, once per known loop trip */
+    long bytes;         /**< Sum of encoded sizes */
+    long weighted;      /**< Cycles weighted by trip count or loop nesting */
+} ReportCost;
+
+/**
+ * @brief One row of the report (total, routine or block)
+ */
+typedef struct {
+    const char *name;   /**< Label of the first node, or NULL */
+    int node;           /**< First node index */
+    int loop_depth;     /**< Loop nesting depth (blocks only) */
+    ReportCost input;   /**< Estimates for the original code */
+    ReportCost output;  /**< Estimates for the optimized code */
+    int page_crossings; /**< Output branches whose taken path crosses a page */
+} ReportRow;
+
+/**
+ * @brief Parse a report format name
+ *
+ * @param name "json" or "csv" (case-insensitive)
+ * @param format Where to store the parsed format
+ * @return true if the name was recognized
+ */
+bool parse_report_format(const char *name, ReportFormat *format) {
+    if (strcasecmp(name, "json") == 0) {
+        *format = REPORT_JSON;
+    } else if (strcasecmp(name, "csv") == 0) {
+        *format = REPORT_CSV;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Pick a report format from a file name
+ *
+ * @param filename Report path
+ * @return REPORT_CSV for names ending in .csv, REPORT_JSON otherwise
+ */
+ReportFormat report_format_for_file(const char *filename) {
+    size_t len = strlen(filename);
+    if (len >= 4 && strcasecmp(filename + len - 4, ".csv") == 0) return REPORT_CSV;
+    return REPORT_JSON;
+}
+
+/**
+ * @brief Add one node to a row
+ *
+ * @param row Row to update
+ * @param before Cost and executions of the node before optimization
+ * @param after Cost and executions of the node after optimization
+ */
+static void row_add(ReportRow *row, const NodeCost *before, const NodeCost *after) {
+    if (before->cost.valid) {
+        row->input.cycles += before->cost.cycles * before->runs;
+        row->input.bytes += before->cost.bytes;
+        row->input.weighted += before->cost.cycles * before->weight;
+    }
+    if (after->cost.valid) {
+        row->output.cycles += after->cost.cycles * after->runs;
+        row->output.bytes += after->cost.bytes;
+        row->output.weighted += after->cost.cycles * after->weight;
+    }
+}
+
+/**
+ * @brief Write a string as a JSON string literal
+ * @param fp Output file
+ * @param str String to write (NULL writes null)
+ */
+static void json_string(FILE *fp, const char *str) {
+    if (!str) {
+        fputs("null", fp);
+        return;
+    }
+    fputc('"', fp);
+    for (const char *p = str; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(fp, "\\%c", *p);
+        } else if ((unsigned char)*p < 0x20) {
+            fprintf(fp, "\\u%04x", (unsigned char)*p);
+        } else {
+            fputc(*p, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+/**
+ * @brief Write the input and output estimates of a row as JSON members
+ * @param fp Output file
+ * @param row Row to write
+ */
+static void json_costs(FILE *fp, const ReportRow *row) {
+    fprintf(fp, "\"input\": {\"cycles\": %ld, \"bytes\": %ld, \"weighted_cycles\": %ld}, ",
+            row->input.cycles, row->input.bytes, row->input.weighted);
+    fprintf(fp, "\"output\": {\"cycles\": %ld, \"bytes\": %ld, \"weighted_cycles\": %ld}, ",
+            row->output.cycles, row->output.bytes, row->output.weighted);
+    fprintf(fp, "\"page_crossing_branches\": %d", row->page_crossings);
+}
+
+/**
+ * @brief Write the report as one JSON object
+ *
+ * @param fp Output file
+ * @param prog Optimized program
+ * @param source Input file name
+ * @param total Program totals
+ * @param routines Routine rows
+ * @param routine_count Number of routine rows
+ * @param blocks Block rows
+ * @param block_count Number of block rows
+ */
+static void write_json(FILE *fp, const Program *prog, const char *source, const ReportRow *total,
+                       const ReportRow *routines, int routine_count,
+                       const ReportRow *blocks, int block_count) {
+    fprintf(fp, "{\n  \"source\": ");
+    json_string(fp, source);
+    fprintf(fp, ",\n  \"cpu\": \"%s\",\n  \"mode\": \"%s\",\n  \"loop_weight\": %d,\n",
+            prog->cpu_type == CPU_6502 ? "6502" :
+            prog->cpu_type == CPU_65C02 ? "65C02" :
+            prog->cpu_type == CPU_65816 ? "65816" : "45GS02",
+            prog->mode == OPT_SPEED ? "speed" : "size", COST_LOOP_WEIGHT);
+
+    fprintf(fp, "  \"total\": {");
+    json_costs(fp, total);
+    fprintf(fp, "},\n  \"routines\": [");
+    for (int r = 0; r < routine_count; r++) {
+        fprintf(fp, "%s\n    {\"name\": ", r ? "," : "");
+        json_string(fp, routines[r].name);
+        fprintf(fp, ", \"line\": %d, ", prog->nodes[routines[r].node].line_num + 1);
+        json_costs(fp, &routines[r]);
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "\n  ],\n  \"blocks\": [");
+    for (int b = 0; b < block_count; b++) {
+        fprintf(fp, "%s\n    {\"index\": %d, \"label\": ", b ? "," : "", b);
+        json_string(fp, blocks[b].name);
+        fprintf(fp, ", \"line\": %d, \"loop_depth\": %d, ",
+                prog->nodes[blocks[b].node].line_num + 1, blocks[b].loop_depth);
+        json_costs(fp, &blocks[b]);
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "\n  ]\n}\n");
+}
+
+/**
+ * @brief Write one CSV row
+ *
+ * @param fp Output file
+ * @param prog Optimized program
+ * @param kind Row kind ("total", "routine" or "block")
+ * @param index Row index within its kind
+ * @param row Row to write
+ */
+static void csv_row(FILE *fp, const Program *prog, const char *kind, int index, const ReportRow *row) {
+    fprintf(fp, "%s,%d,", kind, index);
+    if (row->name) fprintf(fp, "\"%s\"", row->name);
+    fprintf(fp, ",%d,%d,%ld,%ld,%ld,%ld,%ld,%ld,%d\n",
+            row->node >= 0 ? prog->nodes[row->node].line_num + 1 : 0, row->loop_depth,
+            row->input.cycles, row->input.bytes, row->input.weighted,
+            row->output.cycles, row->output.bytes, row->output.weighted, row->page_crossings);
+}
+
+/**
+ * @brief Write the report as one CSV table
+ *
+ * @param fp Output file
+ * @param prog Optimized program
+ * @param total Program totals
+ * @param routines Routine rows
+ * @param routine_count Number of routine rows
+ * @param blocks Block rows
+ * @param block_count Number of block rows
+ */
+static void write_csv(FILE *fp, const Program *prog, const ReportRow *total,
+                      const ReportRow *routines, int routine_count,
+                      const ReportRow *blocks, int block_count) {
+    fprintf(fp, "kind,index,name,line,loop_depth,input_cycles,input_bytes,input_weighted_cycles,"
+                "output_cycles,output_bytes,output_weighted_cycles,page_crossing_branches\n");
+    csv_row(fp, prog, "total", 0, total);
+    for (int r = 0; r < routine_count; r++) csv_row(fp, prog, "routine", r, &routines[r]);
+    for (int b = 0; b < block_count; b++) csv_row(fp, prog, "block", b, &blocks[b]);
+}
+
+/**
+ * @brief Charge every node to its block, its routine and the total
+ *
+ * @param prog Optimized program
+ * @param cfg Control flow graph of the program
+ * @param depth Loop nesting depth of every block
+ * @param runs Executions of every node (see estimate_node_runs())
+ * @param weights Loop-weighted executions of every node
+ * @param input_costs Node costs recorded before optimization
+ * @param address Estimated output address of every node, or NULL
+ * @param total Total row to fill
+ * @param routines Routine rows to fill
+ * @param blocks Block rows to fill
+ */
+static void collect_rows(const Program *prog, const Cfg *cfg, const int *depth, const long *runs,
+                         const long *weights, const NodeCost *input_costs, const long *address,
+                         ReportRow *total, ReportRow *routines, ReportRow *blocks) {
+    memset(total, 0, sizeof(*total));
+    total->node = -1;
+
+    for (int b = 0; b < cfg->block_count; b++) {
+        const AstNode *first = &prog->nodes[cfg->blocks[b].start];
+        blocks[b].node = cfg->blocks[b].start;
+        blocks[b].name = first->label && first->label[0] ? first->label : NULL;
+        blocks[b].loop_depth = depth[b];
+    }
+
+    int r = -1;
+    for (int i = 0; i < prog->count; i++) {
+        const AstNode *node = &prog->nodes[i];
+        if (i == 0 || is_routine_start(node)) {
+            r++;
+            routines[r].node = i;
+            routines[r].name = node->label && node->label[0] ? node->label : NULL;
+        }
+
+        int b = i < cfg->node_count ? cfg->block_of[i] : -1;
+        if (b < 0) continue;
+        NodeCost after = { node_cost(prog, i), runs[i], weights[i] };
+        int origin = prog->input_index ? prog->input_index[i] : i;
+        NodeCost before = { {0, 0, 0, 0, false}, 0, 0 };
+        if (origin >= 0) before = input_costs[origin];
+        row_add(&blocks[b], &before, &after);
+        row_add(&routines[r], &before, &after);
+        row_add(total, &before, &after);
+
+        if (after.cost.valid && after.cost.page_penalty && node->mode == AM_RELATIVE && node->operand) {
+            const CfgLabel *target = cfg_find_label(cfg, node->operand, strlen(node->operand), i);
+            if (target && branch_crosses_page(prog, address, i, target->node)) {
+                blocks[b].page_crossings++;
+                routines[r].page_crossings++;
+                total->page_crossings++;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Write the static cost report of an optimized program
+ *
+ * Every node is charged to its block and its routine, once per
+ * execution where its loop's trip count is known and with the loop
+ * weight of its block for the weighted cycles; the input side keeps
+ * the executions of the input, so an unrolled loop is charged its
+ * original trips there and its reduced ones in the output. Removed
+ * nodes only count on the input side,
+ * nodes inlining inserted only on the output side. Taken branches
+ * that cross a page in the output (see branch_crosses_page()) are
+ * counted where the origin of the code is known.
+ *
+ * @param prog Optimized program
+ * @param input_costs Node costs recorded before optimization
+ * @param source Input file name recorded in the report
+ * @param filename Report file to write
+ * @param format Report format
+ * @return true on success, false if the report could not be written
+ */
+bool write_cost_report(const Program *prog, const NodeCost *input_costs, const char *source,
+                       const char *filename, ReportFormat format) {
+    Cfg *own_cfg = NULL;
+    const Cfg *cfg = prog->cfg;
+    if (!cfg) cfg = own_cfg = build_cfg(prog);
+    if (!cfg) {
+        fprintf(stderr, "Error: Out of memory while building cost report\n");
+        return false;
+    }
+
+    int routine_count = 0;
+    for (int i = 0; i < prog->count; i++) {
+        if (i == 0 || is_routine_start(&prog->nodes[i])) routine_count++;
+    }
+
+    int *depth = cfg_loop_depths(cfg);
+    long *runs = estimate_node_runs(prog, cfg, false);
+    long *weights = estimate_node_runs(prog, cfg, true);
+    long *address = estimate_node_addresses(prog);
+    ReportRow *blocks = calloc(cfg->block_count > 0 ? cfg->block_count : 1, sizeof(ReportRow));
+    ReportRow *routines = calloc(routine_count > 0 ? routine_count : 1, sizeof(ReportRow));
+    bool ok = false;
+
+    if (!depth || !runs || !weights || !address || !blocks || !routines) {
+        fprintf(stderr, "Error: Out of memory while building cost report\n");
+    } else {
+        ReportRow total;
+        collect_rows(prog, cfg, depth, runs, weights, input_costs, address, &total, routines, blocks);
+
+        FILE *fp = fopen(filename, "w");
+        if (!fp) {
+            fprintf(stderr, "Error: Cannot write to %s\n", filename);
+        } else {
+            if (format == REPORT_CSV) {
+                write_csv(fp, prog, &total, routines, routine_count, blocks, cfg->block_count);
+            } else {
+                write_json(fp, prog, source, &total, routines, routine_count, blocks, cfg->block_count);
+            }
+            ok = fclose(fp) == 0;
+        }
+    }
+
+    free(depth);
+    free(runs);
+    free(weights);
+    free(address);
+    free(blocks);
+    free(routines);
+    free_cfg(own_cfg);
+    return ok;
+}
@@ -0,0 +1,62 @@
+/**
+ * @file report.h
+ * @brief Machine-readable static cost report
+ *
+ * Writes the cycle and byte estimates of the cost model (cost.h) for the
+ * input and the optimized output, per routine and per basic block, as
+ * JSON or CSV. Counted loops are charged once per trip; other loops
+ * are also weighted by their nesting depth to give a hot-path estimate,
+ * so CI can flag regressions without running the code in an emulator.
+ * Taken branches that cross a page, one extra cycle each on the 6502,
+ * are counted per row where the origin of the code is known.
+ */
+
+#ifndef REPORT_H
+#define REPORT_H
+
+#include "../types.h"
+#include "../analysis/cost.h"
+
+
+/**
+ * @brief Report file format
+ */
+typedef enum {
+    REPORT_JSON,    /**< One JSON object */
+    REPORT_CSV      /**< One row per total, routine and block */
+} ReportFormat;
+
+/**
+ * @brief Parse a report format name
+ *
+ * @param name "json" or "csv" (case-insensitive)
+ * @param format Where to store the parsed format
+ * @return true if the name was recognized
+ */
+bool parse_report_format(const char *name, ReportFormat *format);
+
+/**
+ * @brief Pick a report format from a file name
+ * @param filename Report path
+ * @return REPORT_CSV for names ending in .csv, REPORT_JSON otherwise
+ */
+ReportFormat report_format_for_file(const char *filename);
+
+/**
+ * @brief Write the static cost report of an optimized program
+ *
+ * Uses the program's final control flow graph for block boundaries and
+ * loop weights, so input and output are compared block for block.
+ *
+ * @param prog Optimized program
+ * @param input_costs Node costs recorded before optimization
+ *                    (see measure_node_costs())
+ * @param source Input file name recorded in the report
+ * @param filename Report file to write
+ * @param format Report format
+ * @return true on success, false if the report could not be written
+ */
+bool write_cost_report(const Program *prog, const NodeCost *input_costs, const char *source,
+                       const char *filename, ReportFormat format);
+
+#endif // REPORT_H
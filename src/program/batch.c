@@ -0,0 +1,298 @@
+/**
+ * @file batch.c
+ * @brief Multi-file batch optimization implementation
+ *
+ * Every file is a job of parallel_for(). Jobs only touch their own
+ * BatchFile entry and their own program, so workers share nothing but
+ * the read-only settings and opcode tables.
+ */
+
+#include "batch.h"
+#include "cache.h"
+#include "parallel.h"
+#include "program.h"
+#include "source.h"
+#include "../optimizations/optimizer.h"
+#include "../output/output.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Batch settings shared by all jobs
+ */
+typedef struct {
+    const Program *settings;    /**< Settings of the run */
+    Batch *batch;               /**< Files being optimized */
+    int jobs_per_file;          /**< Worker threads each file may use */
+    const char *cache_dir;      /**< Result cache directory, or NULL */
+} BatchRun;
+
+/**
+ * @brief Copy part of a string
+ *
+ * @param str Source text
+ * @param len Number of bytes to copy
+ * @return New NUL-terminated copy, or NULL on allocation failure
+ */
+static char* copy_string(const char *str, size_t len) {
+    char *copy = malloc(len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+/**
+ * @brief Build the output name of an input file
+ *
+ * @param input Input file name
+ * @return New name with BATCH_SUFFIX before the extension, or NULL on
+ *         allocation failure
+ */
+static char* output_name(const char *input) {
+    size_t len = strlen(input);
+    const char *base = input;
+    for (const char *p = input; *p; p++) {
+        if (*p == '/' || *p == '\\') base = p + 1;
+    }
+    const char *dot = strrchr(base, '.');
+    size_t stem = dot && dot != base ? (size_t)(dot - input) : len;
+
+    char *name = malloc(len + strlen(BATCH_SUFFIX) + 1);
+    if (!name) return NULL;
+    memcpy(name, input, stem);
+    strcpy(name + stem, BATCH_SUFFIX);
+    strcat(name, input + stem);
+    return name;
+}
+
+/**
+ * @brief Add a file to a batch
+ *
+ * @param batch Batch to extend
+ * @param input Input file name
+ * @return false on allocation failure
+ */
+bool batch_add_file(Batch *batch, const char *input) {
+    if (batch->count == batch->capacity) {
+        int capacity = batch->capacity ? batch->capacity * 2 : 16;
+        BatchFile *files = realloc(batch->files, capacity * sizeof(BatchFile));
+        if (!files) return false;
+        batch->files = files;
+        batch->capacity = capacity;
+    }
+
+    BatchFile *file = &batch->files[batch->count];
+    memset(file, 0, sizeof(*file));
+    file->input = copy_string(input, strlen(input));
+    file->output = output_name(input);
+    if (!file->input || !file->output) {
+        free(file->input);
+        free(file->output);
+        return false;
+    }
+    batch->count++;
+    return true;
+}
+
+/**
+ * @brief Add every file named in a response file
+ *
+ * @param batch Batch to extend
+ * @param path Response file name
+ * @return false if the response file cannot be read
+ */
+bool batch_add_list(Batch *batch, const char *path) {
+    SourceBuffer *list = source_open(path);
+    if (!list) return false;
+
+    bool ok = true;
+    const char *p = list->data;
+    const char *end = list->data + list->size;
+    while (ok && p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+
+        const char *start = p;
+        const char *stop = eol;
+        while (start < stop && isspace((unsigned char)*start)) start++;
+        while (stop > start && isspace((unsigned char)stop[-1])) stop--;
+        if (start < stop && *start != '#') {
+            char *name = copy_string(start, stop - start);
+            ok = name && batch_add_file(batch, name);
+            free(name);
+        }
+        p = eol + 1;
+    }
+
+    source_close(list);
+    return ok;
+}
+
+/**
+ * @brief Create an empty program with the settings of the run
+ *
+ * @param run Batch settings
+ * @return New program, or NULL on allocation failure
+ */
+static Program* create_file_program(const BatchRun *run) {
+    const Program *settings = run->settings;
+    Program *prog = create_program(settings->mode, settings->config.type);
+    if (!prog) return NULL;
+
+    prog->cpu_type = settings->cpu_type;
+    prog->allow_65c02 = settings->allow_65c02;
+    prog->allow_undocumented = settings->allow_undocumented;
+    prog->is_45gs02 = settings->is_45gs02;
+    prog->trace_level = settings->trace_level;
+    prog->jobs = run->jobs_per_file;
+    prog->unroll_budget = settings->unroll_budget;
+    prog->zp_free = settings->zp_free;
+    prog->dma_jobs = settings->dma_jobs;
+    prog->superopt = settings->superopt;
+    prog->rules = settings->rules;
+    prog->log = NULL;
+    return prog;
+}
+
+/**
+ * @brief Write finished output text to the output file of a batch file
+ *
+ * @param file Batch file
+ * @param text Output text
+ * @param len Output length
+ */
+static void write_file_text(BatchFile *file, const char *text, size_t len) {
+    FILE *fp = fopen(file->output, "w");
+    file->ok = fp && fwrite(text, 1, len, fp) == len;
+    if (fp && fclose(fp) != 0) file->ok = false;
+}
+
+/**
+ * @brief Use the cached result of a batch file, if there is one
+ *
+ * @param file Batch file
+ * @param dir Cache directory
+ * @param key Key of the input
+ * @return true if the file is done (written or failed to write)
+ */
+static bool use_cached(BatchFile *file, const char *dir, CacheKey key) {
+    size_t len = 0;
+    CacheStats summary;
+    char *text = cache_lookup(dir, key, &len, &summary);
+    if (!text) return false;
+
+    write_file_text(file, text, len);
+    free(text);
+    if (!file->ok) {
+        snprintf(file->error, sizeof(file->error), "Cannot write to %s", file->output);
+    }
+    file->cached = true;
+    file->lines = summary.lines;
+    file->optimizations = summary.optimizations;
+    file->removed = summary.removed;
+    return true;
+}
+
+/**
+ * @brief Optimize one file of the batch
+ *
+ * @param ctx BatchRun
+ * @param job File index
+ * @param worker Worker number (unused)
+ */
+static void optimize_file(void *ctx, int job, int worker) {
+    (void)worker;
+    const BatchRun *run = ctx;
+    BatchFile *file = &run->batch->files[job];
+
+    SourceBuffer *source = source_open(file->input);
+    if (!source) {
+        snprintf(file->error, sizeof(file->error), "Cannot open %s", file->input);
+        return;
+    }
+    Program *prog = create_file_program(run);
+    if (!prog) {
+        source_close(source);
+        snprintf(file->error, sizeof(file->error), "Out of memory optimizing %s", file->input);
+        return;
+    }
+
+    CacheKey key = { 0, 0 };
+    if (run->cache_dir) {
+        key = cache_key(prog, source->data, source->size);
+        if (use_cached(file, run->cache_dir, key)) {
+            source_close(source);
+            free_program_ast(prog);
+            return;
+        }
+    }
+
+    load_program_source(prog, source);
+    optimize_program_ast(prog);
+
+    file->lines = prog->count;
+    file->optimizations = prog->optimizations;
+    for (int i = 0; i < prog->count; i++) {
+        if (node_is_dead(prog, i)) file->removed++;
+    }
+
+    if (run->cache_dir) {
+        size_t len = 0;
+        char *text = write_program_to_memory(prog, &len);
+        if (text) {
+            write_file_text(file, text, len);
+            CacheStats summary = { file->lines, file->optimizations, file->removed };
+            if (file->ok) cache_store(run->cache_dir, key, text, len, &summary, job);
+            free(text);
+        }
+    } else {
+        FILE *fp = fopen(file->output, "w");
+        if (fp) {
+            OutBuf out;
+            outbuf_init_file(&out, fp);
+            write_program_ast(prog, &out);
+            file->ok = outbuf_close(&out);
+            if (fclose(fp) != 0) file->ok = false;
+        }
+    }
+    if (!file->ok) {
+        snprintf(file->error, sizeof(file->error), "Cannot write to %s", file->output);
+    }
+    free_program_ast(prog);
+}
+
+/**
+ * @brief Optimize every file of a batch
+ *
+ * @param settings Empty program holding the settings
+ * @param batch Files to optimize; outcomes are stored in each entry
+ * @param cache_dir Result cache directory, or NULL
+ * @return Number of files that failed
+ */
+int optimize_batch(const Program *settings, Batch *batch, const char *cache_dir) {
+    BatchRun run = { settings, batch, batch->count == 1 ? settings->jobs : 1, cache_dir };
+    parallel_for(batch->count, settings->jobs, optimize_file, &run);
+
+    int failed = 0;
+    for (int i = 0; i < batch->count; i++) {
+        if (!batch->files[i].ok) failed++;
+    }
+    return failed;
+}
+
+/**
+ * @brief Free the file names of a batch
+ * @param batch Batch to free (the struct itself is not freed)
+ */
+void free_batch(Batch *batch) {
+    for (int i = 0; i < batch->count; i++) {
+        free(batch->files[i].input);
+        free(batch->files[i].output);
+    }
+    free(batch->files);
+    batch->files = NULL;
+    batch->count = 0;
+    batch->capacity = 0;
+}
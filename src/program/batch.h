@@ -0,0 +1,88 @@
+/**
+ * @file batch.h
+ * @brief Multi-file batch optimization (-batch, @list)
+ *
+ * Optimizes many files in one process. Files are spread over the worker
+ * pool (see parallel.h), each optimized as an independent program with
+ * the settings of the run, and each output is written next to its
+ * input. A file that fails does not stop the others; its error is kept
+ * with the file for the caller to report.
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "../types.h"
+
+#define BATCH_SUFFIX ".opt"         /**< Inserted before the extension of output names */
+#define BATCH_ERROR_SIZE 256        /**< Size of a per-file error message */
+
+/**
+ * @brief One file of a batch and its outcome
+ */
+typedef struct {
+    char *input;                    /**< Input file name */
+    char *output;                   /**< Output file name (input with BATCH_SUFFIX) */
+    bool ok;                        /**< Optimized and written */
+    char error[BATCH_ERROR_SIZE];   /**< Why the file failed (empty if ok) */
+    int lines;                      /**< Input lines */
+    int optimizations;              /**< Optimizations applied */
+    int removed;                    /**< Lines removed */
+    bool cached;                    /**< Output came from the result cache */
+} BatchFile;
+
+/**
+ * @brief Files of a batch in command line order
+ */
+typedef struct {
+    BatchFile *files;               /**< File array */
+    int count;                      /**< Files in use */
+    int capacity;                   /**< Allocated entries in files */
+} Batch;
+
+/**
+ * @brief Add a file to a batch
+ *
+ * The output name is the input name with BATCH_SUFFIX inserted before
+ * its extension (game.s becomes game.opt.s).
+ *
+ * @param batch Batch to extend
+ * @param input Input file name
+ * @return false on allocation failure
+ */
+bool batch_add_file(Batch *batch, const char *input);
+
+/**
+ * @brief Add every file named in a response file
+ *
+ * The response file lists one file name per line. Blank lines and lines
+ * starting with '#' are skipped, as is surrounding whitespace.
+ *
+ * @param batch Batch to extend
+ * @param path Response file name
+ * @return false if the response file cannot be read
+ */
+bool batch_add_list(Batch *batch, const char *path);
+
+/**
+ * @brief Optimize every file of a batch
+ *
+ * Uses settings->jobs workers, one file at a time each; a batch of a
+ * single file gives all workers to that file instead. Progress
+ * messages of the individual files are silenced. The settings program
+ * must be created on the calling thread before the call.
+ *
+ * @param settings Empty program holding the settings
+ * @param batch Files to optimize; outcomes are stored in each entry
+ * @param cache_dir Result cache directory (see cache.h), or NULL
+ * @return Number of files that failed
+ */
+int optimize_batch(const Program *settings, Batch *batch, const char *cache_dir);
+
+/**
+ * @brief Free the file names of a batch
+ * @param batch Batch to free (the struct itself is not freed)
+ */
+void free_batch(Batch *batch);
+
+#endif // BATCH_H
@@ -0,0 +1,179 @@
+/**
+ * @file cache.c
+ * @brief Content-addressed optimization result cache implementation
+ *
+ * An entry is <dir>/<hash>.asm: one header line with the key and the
+ * summary of the run, followed by the optimized output byte for byte.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "cache.h"
+#include "source.h"
+#include "profile.h"
+#include "../optimizations/rules.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define make_dir(path) _mkdir(path)
+#define process_id() _getpid()
+#else
+#include <unistd.h>
+#define make_dir(path) mkdir(path, 0777)
+#define process_id() getpid()
+#endif
+
+#define CACHE_MAGIC "opt6502-cache"     /**< First word of every entry */
+#define FNV_PRIME 1099511628211ULL
+
+/**
+ * @brief Fold bytes into an FNV-1a hash
+ *
+ * @param hash Hash so far (CACHE_HASH_SEED to start)
+ * @param data Bytes to add
+ * @param len Number of bytes
+ * @return Updated hash
+ */
+uint64_t cache_hash(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * @brief Compute the cache key of an input
+ *
+ * The optimizer build date is part of the key, so a rebuilt optimizer
+ * never returns results of an older one; so is the text of any -rules
+ * file or -profile.
+ *
+ * @param settings Program holding the settings of the run
+ * @param input Input bytes
+ * @param len Input length
+ * @return Key of the input under these settings
+ */
+CacheKey cache_key(const Program *settings, const char *input, size_t len) {
+    char text[192];
+    int n = snprintf(text, sizeof(text), "%s %s %s|%d|%d|%d|%d|%d|%d|%d|%d|%d|%d|%016llx",
+                     OPT6502_VERSION, __DATE__, __TIME__,
+                     (int)settings->mode, (int)settings->config.type, (int)settings->cpu_type,
+                     settings->allow_65c02, settings->allow_undocumented,
+                     settings->is_45gs02, settings->trace_level, settings->unroll_budget,
+                     settings->dma_jobs, settings->superopt != NULL,
+                     settings->rules ? (unsigned long long)settings->rules->hash : 0ULL);
+
+    CacheKey key;
+    key.hash = cache_hash(CACHE_HASH_SEED, text, n > 0 ? (size_t)n : 0);
+    if (settings->zp_free) key.hash = cache_hash(key.hash, settings->zp_free, 256);
+    if (settings->profile) {
+        key.hash = cache_hash(key.hash, &settings->profile->hash, sizeof(settings->profile->hash));
+    }
+    key.hash = cache_hash(key.hash, input, len);
+    key.input_size = len;
+    return key;
+}
+
+/**
+ * @brief Build the path of an entry
+ *
+ * @param dir Cache directory
+ * @param key Key of the entry
+ * @param suffix File name suffix
+ * @return New path (caller frees), or NULL on allocation failure
+ */
+static char* entry_path(const char *dir, CacheKey key, const char *suffix) {
+    size_t size = strlen(dir) + strlen(suffix) + 20;
+    char *path = malloc(size);
+    if (path) snprintf(path, size, "%s/%016llx%s", dir, (unsigned long long)key.hash, suffix);
+    return path;
+}
+
+/**
+ * @brief Look up a cached result
+ *
+ * @param dir Cache directory
+ * @param key Key of the input
+ * @param len Where to store the output length
+ * @param stats Where to store the summary of the cached run
+ * @return Cached output (caller frees), or NULL if there is no usable
+ *         entry
+ */
+char* cache_lookup(const char *dir, CacheKey key, size_t *len, CacheStats *stats) {
+    char *path = entry_path(dir, key, ".asm");
+    SourceBuffer *entry = path ? source_open(path) : NULL;
+    free(path);
+    if (!entry) return NULL;
+
+    char *output = NULL;
+    const char *eol = memchr(entry->data, '\n', entry->size);
+    if (eol && eol - entry->data < 128) {
+        char header[128];
+        memcpy(header, entry->data, eol - entry->data);
+        header[eol - entry->data] = '\0';
+
+        unsigned long long hash = 0;
+        unsigned long long input_size = 0;
+        CacheStats found;
+        if (sscanf(header, CACHE_MAGIC " %llx %llu %d %d %d", &hash, &input_size,
+                   &found.lines, &found.optimizations, &found.removed) == 5 &&
+            hash == key.hash && input_size == key.input_size) {
+            size_t size = entry->size - (eol + 1 - entry->data);
+            output = malloc(size + 1);
+            if (output) {
+                memcpy(output, eol + 1, size);
+                output[size] = '\0';
+                *len = size;
+                *stats = found;
+            }
+        }
+    }
+
+    source_close(entry);
+    return output;
+}
+
+/**
+ * @brief Store a result
+ *
+ * @param dir Cache directory
+ * @param key Key of the input
+ * @param output Optimized output
+ * @param len Output length
+ * @param stats Summary of the run
+ * @param unique Number that tells concurrent stores of this process apart
+ * @return false if the entry could not be written
+ */
+bool cache_store(const char *dir, CacheKey key, const char *output, size_t len,
+                 const CacheStats *stats, int unique) {
+    make_dir(dir);  // Usually exists already
+
+    char suffix[48];
+    snprintf(suffix, sizeof(suffix), ".%ld-%d.tmp", (long)process_id(), unique);
+    char *tmp = entry_path(dir, key, suffix);
+    char *path = entry_path(dir, key, ".asm");
+    FILE *fp = tmp && path ? fopen(tmp, "wb") : NULL;
+
+    bool ok = false;
+    if (fp) {
+        fprintf(fp, CACHE_MAGIC " %016llx %llu %d %d %d\n", (unsigned long long)key.hash,
+                (unsigned long long)key.input_size, stats->lines, stats->optimizations,
+                stats->removed);
+        ok = fwrite(output, 1, len, fp) == len;
+        if (fclose(fp) != 0) ok = false;
+        // Another run may have stored the same entry first; either copy will do
+        if (ok) ok = rename(tmp, path) == 0;
+        if (!ok) remove(tmp);
+    }
+
+    free(tmp);
+    free(path);
+    return ok;
+}
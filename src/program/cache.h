@@ -0,0 +1,96 @@
+/**
+ * @file cache.h
+ * @brief Content-addressed optimization result cache (-cache)
+ *
+ * Optimized output is stored in a cache directory under a 64-bit FNV-1a
+ * hash of the input bytes and every setting that affects the output
+ * (mode, assembler, CPU, trace level, unroll budget, free zero page
+ * bytes, DMA jobs, the superoptimizer, peephole rules, the execution
+ * profile and the optimizer build). Running the same input with the
+ * same settings again returns the stored output without parsing or
+ * optimizing, much like ccache does for compilers.
+ *
+ * Entries are whole files: the control flow graph and constant
+ * propagation span routines, so the result for one routine is not a
+ * function of its text alone. Entries are written to a temporary file
+ * and renamed into place, so concurrent runs sharing a directory never
+ * see a partial entry.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "../types.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define CACHE_HASH_SEED 14695981039346656037ULL   /**< FNV-1a offset basis */
+
+/**
+ * @brief Cache key of one input
+ */
+typedef struct {
+    uint64_t hash;              /**< Hash of the input and the settings */
+    size_t input_size;          /**< Input length, checked on lookup */
+} CacheKey;
+
+/**
+ * @brief Summary of the run that produced a cache entry
+ */
+typedef struct {
+    int lines;                  /**< Input lines */
+    int optimizations;          /**< Optimizations applied */
+    int removed;                /**< Lines removed */
+} CacheStats;
+
+/**
+ * @brief Fold bytes into a 64-bit FNV-1a hash
+ *
+ * @param hash Hash so far (CACHE_HASH_SEED to start)
+ * @param data Bytes to add
+ * @param len Number of bytes
+ * @return Updated hash
+ */
+uint64_t cache_hash(uint64_t hash, const void *data, size_t len);
+
+/**
+ * @brief Compute the cache key of an input
+ *
+ * @param settings Program holding the settings of the run
+ * @param input Input bytes
+ * @param len Input length
+ * @return Key of the input under these settings
+ */
+CacheKey cache_key(const Program *settings, const char *input, size_t len);
+
+/**
+ * @brief Look up a cached result
+ *
+ * @param dir Cache directory
+ * @param key Key of the input
+ * @param len Where to store the output length
+ * @param stats Where to store the summary of the cached run
+ * @return Cached output (caller frees), or NULL if there is no usable
+ *         entry
+ */
+char* cache_lookup(const char *dir, CacheKey key, size_t *len, CacheStats *stats);
+
+/**
+ * @brief Store a result
+ *
+ * Creates the cache directory if it does not exist. Failures only mean
+ * the next run misses, so callers may ignore them.
+ *
+ * @param dir Cache directory
+ * @param key Key of the input
+ * @param output Optimized output
+ * @param len Output length
+ * @param stats Summary of the run
+ * @param unique Number that tells concurrent stores of this process
+ *               apart (for example the batch file index)
+ * @return false if the entry could not be written
+ */
+bool cache_store(const char *dir, CacheKey key, const char *output, size_t len,
+                 const CacheStats *stats, int unique);
+
+#endif // CACHE_H
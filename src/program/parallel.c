@@ -0,0 +1,106 @@
+/**
+ * @file parallel.c
+ * @brief Minimal worker pool implementation
+ *
+ * Workers claim job numbers from a shared counter under a mutex. The
+ * calling thread acts as worker 0, so N workers need N - 1 new threads.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "parallel.h"
+#include <pthread.h>
+#include <unistd.h>
+
+/**
+ * @brief State shared by the workers of one parallel_for() call
+ */
+typedef struct {
+    ParallelFn fn;              /**< Job function */
+    void *ctx;                  /**< Caller context */
+    int count;                  /**< Number of jobs */
+    int next;                   /**< Next unclaimed job */
+    pthread_mutex_t lock;       /**< Protects next */
+} ParallelPool;
+
+/**
+ * @brief Per-thread start argument
+ */
+typedef struct {
+    ParallelPool *pool;         /**< Shared pool */
+    int worker;                 /**< Worker number */
+} ParallelWorker;
+
+/**
+ * @brief Claim the next job
+ *
+ * @param pool Shared pool
+ * @return Job number, or -1 when all jobs are claimed
+ */
+static int claim_job(ParallelPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    int job = pool->next < pool->count ? pool->next++ : -1;
+    pthread_mutex_unlock(&pool->lock);
+    return job;
+}
+
+/**
+ * @brief Worker loop: run jobs until none are left
+ *
+ * @param arg ParallelWorker of this thread
+ * @return NULL
+ */
+static void* worker_main(void *arg) {
+    ParallelWorker *self = arg;
+    for (int job = claim_job(self->pool); job >= 0; job = claim_job(self->pool)) {
+        self->pool->fn(self->pool->ctx, job, self->worker);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Run every job on a pool of worker threads
+ *
+ * @param count Number of jobs
+ * @param workers Number of worker threads
+ * @param fn Job function
+ * @param ctx Caller context
+ */
+void parallel_for(int count, int workers, ParallelFn fn, void *ctx) {
+    if (workers > count) workers = count;
+    if (workers > PARALLEL_MAX_WORKERS) workers = PARALLEL_MAX_WORKERS;
+    if (workers <= 1) {
+        for (int job = 0; job < count; job++) fn(ctx, job, 0);
+        return;
+    }
+
+    ParallelPool pool = { fn, ctx, count, 0, PTHREAD_MUTEX_INITIALIZER };
+    ParallelWorker args[PARALLEL_MAX_WORKERS];
+    pthread_t threads[PARALLEL_MAX_WORKERS];
+    int started = 0;
+
+    for (int w = 1; w < workers; w++) {
+        args[w].pool = &pool;
+        args[w].worker = w;
+        if (pthread_create(&threads[w], NULL, worker_main, &args[w]) != 0) break;
+        started = w;
+    }
+
+    args[0].pool = &pool;
+    args[0].worker = 0;
+    worker_main(&args[0]);
+
+    for (int w = 1; w <= started; w++) {
+        pthread_join(threads[w], NULL);
+    }
+    pthread_mutex_destroy(&pool.lock);
+}
+
+/**
+ * @brief Number of online processors
+ * @return Processor count, at least 1
+ */
+int parallel_cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
@@ -0,0 +1,49 @@
+/**
+ * @file parallel.h
+ * @brief Minimal worker pool for independent jobs (-j)
+ *
+ * Runs a function over a numbered set of jobs on a fixed number of
+ * worker threads. Idle workers take the next unclaimed job, so a few
+ * large jobs do not leave the other workers waiting behind them; list
+ * the largest jobs first for the best balance. Jobs must not share
+ * mutable state, and callers merge their results afterwards in job
+ * order, so the outcome does not depend on the number of workers.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdbool.h>
+
+#define PARALLEL_MAX_WORKERS 256   /**< Upper bound on -j */
+
+/**
+ * @brief Job function
+ *
+ * @param ctx Caller context shared by all jobs
+ * @param job Job number (0 to count - 1)
+ * @param worker Worker number (0 to workers - 1), for per-worker scratch
+ */
+typedef void (*ParallelFn)(void *ctx, int job, int worker);
+
+/**
+ * @brief Run every job on a pool of worker threads
+ *
+ * With one worker (or one job) everything runs on the calling thread.
+ * If threads cannot be started, the remaining jobs also run on the
+ * calling thread, so every job always runs exactly once.
+ *
+ * @param count Number of jobs
+ * @param workers Number of worker threads
+ * @param fn Job function
+ * @param ctx Caller context
+ */
+void parallel_for(int count, int workers, ParallelFn fn, void *ctx);
+
+/**
+ * @brief Number of online processors
+ * @return Processor count, at least 1
+ */
+int parallel_cpu_count(void);
+
+#endif // PARALLEL_H
@@ -0,0 +1,283 @@
+/**
+ * @file profile.c
+ * @brief Execution count profiles (-profile)
+ *
+ * Reads the counts, moves address counts to source lines once the
+ * program is parsed, and finds the hot lines: counts are sorted and
+ * taken from the top until they cover PROFILE_HOT_PERMILLE of all
+ * executions, and the last count taken is the hot threshold.
+ */
+
+#include "profile.h"
+#include "cache.h"
+#include "../analysis/cost.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Parse one profile line
+ *
+ * @param line Line text (NUL-terminated, end of line removed)
+ * @param entry Receives the count
+ * @return 1 for a count, 0 for a blank or comment line, -1 if malformed
+ */
+static int parse_profile_line(const char *line, ProfileEntry *entry) {
+    const char *p = line;
+    while (isspace((unsigned char)*p)) p++;
+    if (*p == '\0' || *p == '#') return 0;
+
+    char *end;
+    entry->address = *p == '$' || (p[0] == '0' && (p[1] == 'x' || p[1] == 'X'));
+    if (entry->address) {
+        p += *p == '$' ? 1 : 2;
+        if (!isxdigit((unsigned char)*p)) return -1;
+        entry->key = strtol(p, &end, 16);
+    } else {
+        if (!isdigit((unsigned char)*p)) return -1;
+        entry->key = strtol(p, &end, 10);
+    }
+    if (end == p || !isspace((unsigned char)*end)) return -1;
+
+    p = end;
+    while (isspace((unsigned char)*p)) p++;
+    if (!isdigit((unsigned char)*p)) return -1;
+    entry->count = strtol(p, &end, 10);
+    while (isspace((unsigned char)*end)) end++;
+    return *end == '\0' && entry->count >= 0 && entry->key >= 0 ? 1 : -1;
+}
+
+/**
+ * @brief Read a profile file
+ */
+Profile* load_profile(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "Error: Cannot open profile %s\n", path);
+        return NULL;
+    }
+
+    Profile *profile = calloc(1, sizeof(Profile));
+    int capacity = 256;
+    if (profile) profile->entries = malloc(capacity * sizeof(ProfileEntry));
+    if (!profile || !profile->entries) {
+        fprintf(stderr, "Error: Out of memory\n");
+        free_profile(profile);
+        fclose(fp);
+        return NULL;
+    }
+    profile->hash = CACHE_HASH_SEED;
+
+    char line[256];
+    int line_num = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        line_num++;
+        line[strcspn(line, "\r\n")] = '\0';
+        profile->hash = cache_hash(profile->hash, line, strlen(line) + 1);
+
+        ProfileEntry entry;
+        int kind = parse_profile_line(line, &entry);
+        if (kind == 0) continue;
+        if (kind < 0) {
+            fprintf(stderr, "Error: %s:%d: Expected '<line> <count>' or '$<address> <count>'\n",
+                    path, line_num);
+            free_profile(profile);
+            fclose(fp);
+            return NULL;
+        }
+        if (!entry.address && entry.key == 0) {
+            fprintf(stderr, "Error: %s:%d: Source lines are numbered from 1\n", path, line_num);
+            free_profile(profile);
+            fclose(fp);
+            return NULL;
+        }
+        if (profile->entry_count == capacity) {
+            capacity *= 2;
+            ProfileEntry *grown = realloc(profile->entries, capacity * sizeof(ProfileEntry));
+            if (!grown) {
+                fprintf(stderr, "Error: Out of memory\n");
+                free_profile(profile);
+                fclose(fp);
+                return NULL;
+            }
+            profile->entries = grown;
+        }
+        profile->entries[profile->entry_count++] = entry;
+    }
+    fclose(fp);
+    return profile;
+}
+
+/**
+ * @brief Order counts from the highest down
+ */
+static int compare_counts(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+/**
+ * @brief Find the fewest executions of a hot line
+ *
+ * @param profile Profile with line_counts filled in
+ * @return Hot threshold, or 0 if nothing ran
+ */
+static long find_hot_count(const Profile *profile) {
+    int n = 0;
+    long total = 0;
+    for (int l = 0; l < profile->line_limit; l++) {
+        if (profile->line_counts[l] > 0) {
+            n++;
+            total += profile->line_counts[l];
+        }
+    }
+    if (total == 0) return 0;
+
+    long *sorted = malloc(n * sizeof(long));
+    if (!sorted) return 0;
+    n = 0;
+    for (int l = 0; l < profile->line_limit; l++) {
+        if (profile->line_counts[l] > 0) sorted[n++] = profile->line_counts[l];
+    }
+    qsort(sorted, n, sizeof(long), compare_counts);
+
+    long covered = 0, hot = sorted[0];
+    for (int k = 0; k < n && covered * 1000 < total * PROFILE_HOT_PERMILLE; k++) {
+        covered += sorted[k];
+        hot = sorted[k];
+    }
+    free(sorted);
+    return hot;
+}
+
+/**
+ * @brief An instruction and its estimated address
+ */
+typedef struct {
+    long address;               /**< Estimated address */
+    int node;                   /**< Node index */
+} AddressedNode;
+
+/**
+ * @brief Order instructions by address, then by node
+ */
+static int compare_addresses(const void *a, const void *b) {
+    const AddressedNode *x = a, *y = b;
+    if (x->address != y->address) return x->address < y->address ? -1 : 1;
+    return x->node - y->node;
+}
+
+/**
+ * @brief Find the instruction at an address
+ *
+ * Where origins overlap, the first instruction in the source wins.
+ *
+ * @param nodes Instructions sorted by compare_addresses()
+ * @param count Number of instructions
+ * @param address Address to look up
+ * @return Node index, or -1 if no instruction starts there
+ */
+static int node_at_address(const AddressedNode *nodes, int count, long address) {
+    int lo = 0, hi = count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (nodes[mid].address < address) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < count && nodes[lo].address == address ? nodes[lo].node : -1;
+}
+
+/**
+ * @brief Map a profile onto a parsed program
+ */
+bool apply_profile(const Program *prog, Profile *profile) {
+    int line_limit = 1;
+    for (int i = 0; i < prog->count; i++) {
+        if (prog->nodes[i].line_num >= line_limit) line_limit = prog->nodes[i].line_num + 1;
+    }
+    long *counts = calloc(line_limit, sizeof(long));
+    if (!counts) return false;
+
+    // Addresses of the instructions, sorted for lookup
+    AddressedNode *by_address = NULL;
+    int instructions = 0;
+    for (int e = 0; e < profile->entry_count && !by_address; e++) {
+        if (!profile->entries[e].address) continue;
+        long *address = estimate_node_addresses(prog);
+        by_address = malloc((prog->count > 0 ? prog->count : 1) * sizeof(AddressedNode));
+        if (!address || !by_address) {
+            free(address);
+            free(by_address);
+            free(counts);
+            return false;
+        }
+        for (int i = 0; i < prog->count; i++) {
+            if (prog->nodes[i].op == OP_NONE || address[i] < 0) continue;
+            by_address[instructions].address = address[i];
+            by_address[instructions++].node = i;
+        }
+        free(address);
+        qsort(by_address, instructions, sizeof(AddressedNode), compare_addresses);
+    }
+
+    profile->unmatched = 0;
+    for (int e = 0; e < profile->entry_count; e++) {
+        const ProfileEntry *entry = &profile->entries[e];
+        int line = -1;
+        if (!entry->address) {
+            // Profiles number lines from 1, the parser from 0
+            line = entry->key <= line_limit ? (int)entry->key - 1 : -1;
+        } else {
+            int node = node_at_address(by_address, instructions, entry->key);
+            if (node >= 0) line = prog->nodes[node].line_num;
+        }
+        if (line >= 0) {
+            counts[line] += entry->count;
+        } else {
+            profile->unmatched++;
+        }
+    }
+    free(by_address);
+
+    free(profile->line_counts);
+    profile->line_counts = counts;
+    profile->line_limit = line_limit;
+    profile->hot_count = find_hot_count(profile);
+    return true;
+}
+
+/**
+ * @brief Release a profile
+ */
+void free_profile(Profile *profile) {
+    if (!profile) return;
+    free(profile->entries);
+    free(profile->line_counts);
+    free(profile);
+}
+
+/**
+ * @brief Executions of a node
+ */
+long profile_count(const Program *prog, int index) {
+    const Profile *profile = prog->profile;
+    if (!profile || !profile->line_counts) return 0;
+    int line = prog->nodes[index].line_num;
+    return line >= 0 && line < profile->line_limit ? profile->line_counts[line] : 0;
+}
+
+/**
+ * @brief Optimization mode of a run of nodes
+ */
+OptMode mode_at(const Program *prog, int start, int end) {
+    if (!prog->profile) return prog->mode;
+    long hot = prog->profile->hot_count;
+    for (int i = start; i < end && hot > 0; i++) {
+        if (prog->nodes[i].op != OP_NONE && profile_count(prog, i) >= hot) return OPT_SPEED;
+    }
+    return OPT_SIZE;
+}
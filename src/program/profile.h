@@ -0,0 +1,109 @@
+/**
+ * @file profile.h
+ * @brief Execution count profiles (-profile)
+ *
+ * A profile says how often each instruction ran, as measured by an
+ * emulator, and lets the structural passes choose per block between
+ * speed and size: code the profile shows hot is optimized for speed,
+ * everything else for size. A profile is a text file with one count per
+ * line, either per source line or per address of the assembled input:
+ *
+ * @code
+ *   # Comments and blank lines are skipped
+ *   12 4096          line 12 of the input (from 1) ran 4096 times
+ *   $0812 4096       the instruction at $0812 ran 4096 times
+ * @endcode
+ *
+ * Addresses are matched to instructions with estimate_node_addresses(),
+ * so they need an origin directive and instructions of known size; see
+ * tests/semantic/run_semantic_tests.py --profile for a py65 profile.
+ * Counts for the same line or address add up.
+ *
+ * Hot lines are the most executed ones that together account for
+ * PROFILE_HOT_PERMILLE of all counted executions, the working set of
+ * the run.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "../types.h"
+#include <stdint.h>
+
+#define PROFILE_HOT_PERMILLE 990   /**< Share of executions the hot lines cover */
+
+/**
+ * @brief One count read from a profile
+ */
+typedef struct {
+    long key;                   /**< Source line or address */
+    long count;                 /**< Executions */
+    bool address;               /**< key is an address rather than a line */
+} ProfileEntry;
+
+/**
+ * @brief Execution counts of one input
+ */
+typedef struct Profile {
+    ProfileEntry *entries;      /**< Counts as read */
+    int entry_count;            /**< Number of entries */
+    long *line_counts;          /**< Executions per source line, once applied */
+    int line_limit;             /**< Entries in line_counts */
+    long hot_count;             /**< Fewest executions of a hot line (0: none hot) */
+    int unmatched;              /**< Entries that matched no line or instruction */
+    uint64_t hash;              /**< Hash of the profile text (for -cache) */
+} Profile;
+
+/**
+ * @brief Read a profile file
+ *
+ * Reports the first malformed line on stderr.
+ *
+ * @param path Profile file
+ * @return New profile, or NULL if the file cannot be read or is malformed
+ */
+Profile* load_profile(const char *path);
+
+/**
+ * @brief Map a profile onto a parsed program
+ *
+ * Runs before any optimization, while the nodes still match the code
+ * that was profiled: address entries are moved to the line of the
+ * instruction at that address, and the hot threshold is computed.
+ *
+ * @param prog Parsed program
+ * @param profile Profile to apply
+ * @return false on allocation failure
+ */
+bool apply_profile(const Program *prog, Profile *profile);
+
+/**
+ * @brief Release a profile
+ * @param profile Profile to release (NULL-safe)
+ */
+void free_profile(Profile *profile);
+
+/**
+ * @brief Executions of a node
+ *
+ * Nodes copied by a pass keep the line they came from, so a copy counts
+ * with its original.
+ *
+ * @param prog Program with a profile applied
+ * @param index Node index
+ * @return Executions of the node's source line, 0 if none or no profile
+ */
+long profile_count(const Program *prog, int index);
+
+/**
+ * @brief Optimization mode of a run of nodes
+ *
+ * @param prog Program being optimized
+ * @param start First node index
+ * @param end One past the last node index
+ * @return prog->mode without a profile; with one, OPT_SPEED if an
+ *         instruction in the run is hot and OPT_SIZE otherwise
+ */
+OptMode mode_at(const Program *prog, int start, int end);
+
+#endif // PROFILE_H
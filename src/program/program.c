@@ -7,8 +7,16 @@
  */
 
 #include "program.h"
+#include "profile.h"
+#include "source.h"
 #include "../ast/ast.h"
 #include "../ast/parser.h"
+#include "../analysis/cfg.h"
+#include "../analysis/cost.h"
+#include "../analysis/registers.h"
+#include "stats.h"
+#include "../optimizations/rules.h"
+#include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -21,17 +29,31 @@
  * - Assembler configuration
  * - Optimization settings
  * - CPU type and features
- * - AST pointers
+ * - An empty node array and the arena that owns node strings
  *
  * @param mode Optimization mode (speed or size)
  * @param asm_type Assembler type for syntax rules
  * @return Pointer to initialized program structure
  */
 Program* create_program(OptMode mode, AsmType asm_type) {
+    opcodes_init();
+    rules_init();
+
     Program *prog = malloc(sizeof(Program));
-    prog->root = NULL;
-    prog->current_node = NULL;
+    prog->nodes = NULL;
     prog->count = 0;
+    prog->capacity = 0;
+    prog->dead = NULL;
+    prog->arena = arena_create(ARENA_DEFAULT_CHUNK);
+    prog->source = NULL;
+    prog->source_scope = SOURCE_WHOLE;
+    prog->cfg = NULL;
+    prog->dirty = NULL;
+    prog->dirty_lo = 0;
+    prog->dirty_hi = -1;
+    prog->reg_states = NULL;
+    prog->reg_state_count = 0;
+    prog->input_index = NULL;
     prog->mode = mode;
     prog->optimizations = 0;
     prog->opt_enabled = true;
@@ -41,31 +63,206 @@ Program* create_program(OptMode mode, AsmType asm_type) {
     prog->allow_undocumented = false;
     prog->is_45gs02 = false;
     prog->trace_level = 0;
+    prog->validate = false;
+    prog->stats = NULL;
+    prog->jobs = 1;
+    prog->unroll_budget = UNROLL_DEFAULT_BUDGET;
+    prog->dma_jobs = false;
+    prog->superopt = NULL;
+    prog->profile = NULL;
+    prog->rules = NULL;
+    prog->log = stdout;
     return prog;
 }
 
 /**
- * @brief Add a line of assembly code to the program AST
+ * @brief Select the target CPU of a program
  *
- * Processes a line of assembly code:
- * 1. Checks for optimizer directives (#NOOPT, #OPT)
- * 2. Creates a new AST node
- * 3. Parses the line into the node
- * 4. Links the node into the program's AST
+ * @param prog Program to configure
+ * @param cpu Target CPU
+ */
+void set_program_cpu(Program *prog, CpuType cpu) {
+    prog->cpu_type = cpu;
+    prog->allow_65c02 = cpu == CPU_65C02 || cpu == CPU_65816 || cpu == CPU_45GS02;
+    prog->is_45gs02 = cpu == CPU_45GS02;
+}
+
+/**
+ * @brief Print a progress or trace message to the program log
+ *
+ * @param prog Program the message is about
+ * @param format printf() format
+ */
+void program_log(const Program *prog, const char *format, ...) {
+    if (!prog->log) return;
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(prog->log, format, args);
+    va_end(args);
+}
+
+/**
+ * @brief Append a new node to the program
+ *
+ * Doubles the node array (and the matching dead-code bitset) when it
+ * is full, so appending is amortized O(1).
+ *
+ * @param prog Program to append to
+ * @param type The type of node to create
+ * @param line_num Line number in source file
+ * @return Pointer to the new node, or NULL on allocation failure
+ */
+AstNode* program_append_node(Program *prog, NodeType type, int line_num) {
+    if (prog->count == prog->capacity) {
+        int capacity = prog->capacity ? prog->capacity * 2 : 1024;
+
+        AstNode *nodes = realloc(prog->nodes, capacity * sizeof(AstNode));
+        if (!nodes) return NULL;
+        prog->nodes = nodes;
+
+        size_t old_words = (prog->capacity + 63) / 64;
+        size_t words = (capacity + 63) / 64;
+        uint64_t *dead = realloc(prog->dead, words * sizeof(uint64_t));
+        if (!dead) return NULL;
+        memset(dead + old_words, 0, (words - old_words) * sizeof(uint64_t));
+        prog->dead = dead;
+
+        prog->capacity = capacity;
+    }
+
+    AstNode *node = &prog->nodes[prog->count];
+    init_ast_node(node, type, line_num);
+    node->index = prog->count;
+    prog->count++;
+    return node;
+}
+
+/**
+ * @brief Replace the opcode of a program node
+ *
+ * @param prog Program owning the node
+ * @param index Node index
+ * @param op New opcode
+ */
+void rewrite_node_opcode(Program *prog, int index, Opcode op) {
+    if (!prog->stats) {
+        set_node_opcode(prog->arena, &prog->nodes[index], op);
+        note_node_changed(prog, index);
+        return;
+    }
+
+    CostTotal before = { 0, 0 };
+    CostTotal after = { 0, 0 };
+    cost_add_node(&before, prog, index);
+    set_node_opcode(prog->arena, &prog->nodes[index], op);
+    note_node_changed(prog, index);
+    cost_add_node(&after, prog, index);
+    stats_note_change(prog->stats, 0, 1, before.cycles - after.cycles, before.bytes - after.bytes);
+}
+
+/**
+ * @brief Replace the node array by a reordered and extended one
+ *
+ * @param prog Program to rebuild
+ * @param order Origin of each new node
+ * @param n Number of nodes in the new array
+ * @param added Nodes to insert
+ * @return false on allocation failure
+ */
+bool program_rebuild_nodes(Program *prog, const int *order, int n, const AstNode *added) {
+    size_t alloc = n > 0 ? (size_t)n : 1;
+    AstNode *nodes = malloc(alloc * sizeof(AstNode));
+    uint64_t *dead = calloc((alloc + 63) / 64, sizeof(uint64_t));
+    int *input_index = malloc(alloc * sizeof(int));
+    if (!nodes || !dead || !input_index) {
+        free(nodes);
+        free(dead);
+        free(input_index);
+        return false;
+    }
+
+    for (int k = 0; k < n; k++) {
+        int from = order[k];
+        if (from >= 0) {
+            nodes[k] = prog->nodes[from];
+            if (node_is_dead(prog, from)) dead[k >> 6] |= (uint64_t)1 << (k & 63);
+            input_index[k] = prog->input_index ? prog->input_index[from] : from;
+        } else {
+            nodes[k] = added[-1 - from];
+            input_index[k] = -1;
+        }
+        nodes[k].index = k;
+    }
+
+    free(prog->nodes);
+    free(prog->dead);
+    free(prog->input_index);
+    prog->nodes = nodes;
+    prog->dead = dead;
+    prog->input_index = input_index;
+    prog->count = prog->capacity = n;
+    return true;
+}
+
+/**
+ * @brief Find the instruction assembled next to a node
+ *
+ * @param prog Program owning the nodes
+ * @param index Node to start from
+ * @param step -1 to look backwards, 1 to look forwards
+ * @return Index of the neighbouring instruction, or -1
+ */
+int adjacent_instruction(const Program *prog, int index, int step) {
+    for (int i = index + step; i >= 0 && i < prog->count; i += step) {
+        const AstNode *node = &prog->nodes[i];
+        if (node_is_dead(prog, i)) continue;
+        if (node->op != OP_NONE) return i;
+        if (node->opcode && node->opcode[0]) return -1;
+    }
+    return -1;
+}
+
+/**
+ * @brief Record the cost of a node about to be removed (-stats)
+ *
+ * Nodes that are already dead are not counted again.
+ *
+ * @param prog Program owning the node
+ * @param index Node index
+ */
+void note_node_removed(Program *prog, int index) {
+    if (node_is_dead(prog, index)) return;
+
+    CostTotal saved = { 0, 0 };
+    cost_add_node(&saved, prog, index);
+    stats_note_change(prog->stats, 1, 0, saved.cycles, saved.bytes);
+}
+
+/**
+ * @brief Count one application of a rewrite rule
+ *
+ * @param prog Program being optimized
+ * @param rule Rule name, "<pass>.<rule>" (string literal)
+ */
+void count_optimization(Program *prog, const char *rule) {
+    prog->optimizations++;
+    stats_rule_hit(prog->stats, rule);
+}
+
+/**
+ * @brief Check a line for optimizer directives
  *
  * Optimizer directives in comments control whether optimization
  * is enabled for subsequent lines.
  *
- * @param prog Program to add line to
- * @param line Assembly source line
+ * @param prog Program whose opt_enabled flag is updated
+ * @param line NUL-terminated source line
  * @param line_num Line number in source file
  */
-void add_line_ast(Program *prog, const char *line, int line_num) {
-    AstNode *node = create_ast_node(NODE_ASM_LINE, line_num);
-
-    // Check for optimizer directives in comments
+static void check_optimizer_directive(Program *prog, const char *line, int line_num) {
     const char *trimmed = line;
-    while (*trimmed && isspace(*trimmed)) trimmed++;
+    while (*trimmed && isspace((unsigned char)*trimmed)) trimmed++;
 
     // Check for directive after comment character
     if (is_comment_start(trimmed, &prog->config)) {
@@ -78,43 +275,115 @@ void add_line_ast(Program *prog, const char *line, int line_num) {
         }
 
         // Skip whitespace after comment
-        while (*comment_content && isspace(*comment_content)) comment_content++;
+        while (*comment_content && isspace((unsigned char)*comment_content)) comment_content++;
 
         if (strncmp(comment_content, "#NOOPT", 6) == 0) {
             prog->opt_enabled = false;
-            printf("Optimization disabled at line %d\n", line_num);
+            program_log(prog, "Optimization disabled at line %d\n", line_num);
         } else if (strncmp(comment_content, "#OPT", 4) == 0) {
             prog->opt_enabled = true;
-            printf("Optimization enabled at line %d\n", line_num);
+            program_log(prog, "Optimization enabled at line %d\n", line_num);
         }
     }
+}
 
-    parse_line_ast(node, line, line_num, &prog->config);
+/**
+ * @brief Add a slice of source text to the program AST
+ *
+ * Processes a line of assembly code:
+ * 1. Copies the line once into the arena
+ * 2. Checks for optimizer directives (#NOOPT, #OPT)
+ * 3. Appends a new node to the program's node array
+ * 4. Splits the copy into the node's fields
+ *
+ * The node remembers the original slice so an unmodified line can be
+ * written back exactly as it was read.
+ *
+ * @param prog Program to add line to
+ * @param line Start of the line (need not be NUL-terminated)
+ * @param len Length of the line without its line terminator
+ * @param line_num Line number in source file
+ */
+void add_line_slice_ast(Program *prog, const char *line, size_t len, int line_num) {
+    char *text = arena_strndup(prog->arena, line, len);
+    if (!text) return;
+
+    check_optimizer_directive(prog, text, line_num);
+
+    AstNode *node = program_append_node(prog, NODE_ASM_LINE, line_num);
+    if (!node) return;
+
+    node->source = line;
+    node->source_len = (int)len;
+    parse_line_ast(prog->arena, node, text, line_num, &prog->config);
     node->no_optimize = !prog->opt_enabled;
+}
 
-    // Add to AST
-    if (prog->root == NULL) {
-        prog->root = node;
-        prog->current_node = node;
-    } else {
-        prog->current_node->next = node;
-        prog->current_node = node;
-    }
+/**
+ * @brief Add a line of assembly code to the program AST
+ *
+ * Keeps a private copy of the original text, then parses it with
+ * add_line_slice_ast().
+ *
+ * @param prog Program to add line to
+ * @param line Assembly source line
+ * @param line_num Line number in source file
+ */
+void add_line_ast(Program *prog, const char *line, int line_num) {
+    size_t len = strlen(line);
+    const char *source = arena_strndup(prog->arena, line, len);
+    if (!source) return;
+    add_line_slice_ast(prog, source, len, line_num);
+}
 
-    prog->count++;
+/**
+ * @brief Parse a whole loaded source file into the program
+ *
+ * Splits the buffer at '\n', drops a '\r' before it, and adds every
+ * line with add_line_slice_ast(). A final line without a terminator is
+ * kept; the empty piece after a trailing newline is not.
+ *
+ * @param prog Program to fill
+ * @param source Loaded file (ownership passes to the program)
+ */
+void load_program_source(Program *prog, SourceBuffer *source) {
+    prog->source = source;
+
+    const char *p = source->data;
+    const char *end = source->data + source->size;
+    int line_num = 0;
+
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        const char *line_end = nl ? nl : end;
+        size_t len = (size_t)(line_end - p);
+        if (len > 0 && p[len - 1] == '\r') len--;
+
+        add_line_slice_ast(prog, p, len, line_num++);
+        p = nl ? nl + 1 : end;
+    }
 }
 
 /**
  * @brief Free program and all associated memory
  *
- * Frees the program structure and recursively frees the entire AST
- * including all nodes and their strings.
+ * Frees the program structure, the node array and dead-code bitset, the
+ * input position map, the control flow graph, the optional register state side table, the
+ * arena and the loaded source file. Every node string lives in the
+ * arena, so they are released in one call.
  *
  * @param prog Program to free (NULL-safe)
  */
 void free_program_ast(Program *prog) {
     if (!prog) return;
 
-    free_ast_node(prog->root);
+    free(prog->nodes);
+    free(prog->dead);
+    free(prog->input_index);
+    free_cfg(prog->cfg);
+    free_register_states(prog);
+    arena_destroy(prog->arena);
+    source_close(prog->source);
+    free_profile(prog->profile);
     free(prog);
 }
@@ -10,6 +10,7 @@
 #define PROGRAM_H
 
 #include "../types.h"
+#include "source.h"
 
 /**
  * @brief Create a new program structure
@@ -23,12 +24,35 @@
  */
 Program* create_program(OptMode mode, AsmType asm_type);
 
+/**
+ * @brief Select the target CPU of a program
+ *
+ * Sets the CPU type and the instruction set flags that follow from it.
+ * The 45GS02 runs 65C02 code, but its STZ stores the Z register.
+ *
+ * @param prog Program to configure
+ * @param cpu Target CPU
+ */
+void set_program_cpu(Program *prog, CpuType cpu);
+
+/**
+ * @brief Print a progress or trace message
+ *
+ * Goes to prog->log; does nothing when the log is NULL, so callers that
+ * run several programs at once (batch mode, the library) can silence
+ * them.
+ *
+ * @param prog Program the message is about
+ * @param format printf() format
+ */
+void program_log(const Program *prog, const char *format, ...);
+
 /**
  * @brief Add a line of assembly code to the program
  *
  * Parses a line of assembly code and adds it to the program's AST.
  * Handles optimizer directives (#NOOPT, #OPT) embedded in comments.
- * Creates a new AST node and links it to the program.
+ * Appends a new node to the program's node array.
  *
  * @param prog Program to add line to
  * @param line Assembly source line
@@ -36,6 +60,151 @@ Program* create_program(OptMode mode, AsmType asm_type);
  */
 void add_line_ast(Program *prog, const char *line, int line_num);
 
+/**
+ * @brief Add a slice of source text to the program
+ *
+ * Like add_line_ast(), but the line need not be NUL-terminated and is
+ * not copied for the node's source slice, so it must outlive the
+ * program. Lines may be of any length.
+ *
+ * @param prog Program to add line to
+ * @param line Start of the line
+ * @param len Length of the line without its line terminator
+ * @param line_num Line number in source file
+ */
+void add_line_slice_ast(Program *prog, const char *line, size_t len, int line_num);
+
+/**
+ * @brief Parse a whole loaded source file into the program
+ *
+ * Adds one node per line ('\n' or "\r\n" terminated). Node source
+ * slices point into the buffer, which the program now owns and frees
+ * in free_program_ast().
+ *
+ * @param prog Program to fill
+ * @param source File loaded with source_open()
+ */
+void load_program_source(Program *prog, SourceBuffer *source);
+
+/**
+ * @brief Append a new node to the program
+ *
+ * Grows the node array and dead-code bitset as needed and returns a
+ * freshly initialized node whose index is its position in the array.
+ * The returned pointer is only valid until the next append; keep
+ * indices rather than pointers across calls.
+ *
+ * @param prog Program to append to
+ * @param type The type of node to create
+ * @param line_num Line number in source file
+ * @return Pointer to the new node, or NULL on allocation failure
+ */
+AstNode* program_append_node(Program *prog, NodeType type, int line_num);
+
+/**
+ * @brief Replace the node array by a reordered and extended one
+ *
+ * For passes that move or insert nodes. order[k] gives node k of the new
+ * array: a node of the program (order[k] >= 0), which keeps its dead
+ * flag and input line, or the new node added[-1 - order[k]], which is
+ * live and maps to no input line. Old nodes not listed are dropped.
+ *
+ * @param prog Program to rebuild
+ * @param order Origin of each new node
+ * @param n Number of nodes in the new array
+ * @param added Nodes to insert (may be NULL if order holds none)
+ * @return false on allocation failure (prog is unchanged)
+ */
+bool program_rebuild_nodes(Program *prog, const int *order, int n, const AstNode *added);
+
+/**
+ * @brief Record that a node was killed or rewritten
+ *
+ * Flags the node so the output rebuilds its line, and lets the pass
+ * scheduler re-queue only the neighbourhood of a change.
+ *
+ * @param prog Program owning the node
+ * @param index Node index
+ */
+static inline void note_node_changed(Program *prog, int index) {
+    prog->nodes[index].rewritten = true;
+    if (!prog->dirty) return;
+    prog->dirty[index] = 1;
+    if (index < prog->dirty_lo) prog->dirty_lo = index;
+    if (index > prog->dirty_hi) prog->dirty_hi = index;
+}
+
+/**
+ * @brief Check whether a node is marked dead
+ * @param prog Program owning the node
+ * @param index Node index
+ * @return true if the node will be omitted from the output
+ */
+static inline bool node_is_dead(const Program *prog, int index) {
+    return (prog->dead[index >> 6] >> (index & 63)) & 1;
+}
+
+/**
+ * @brief Record the cost of a node about to be removed (-stats)
+ *
+ * Called by mark_node_dead() only when statistics are collected.
+ *
+ * @param prog Program owning the node
+ * @param index Node index
+ */
+void note_node_removed(Program *prog, int index);
+
+/**
+ * @brief Mark a node dead so it is omitted from the output
+ * @param prog Program owning the node
+ * @param index Node index
+ */
+static inline void mark_node_dead(Program *prog, int index) {
+    if (prog->stats) note_node_removed(prog, index);
+    prog->dead[index >> 6] |= (uint64_t)1 << (index & 63);
+    note_node_changed(prog, index);
+}
+
+/**
+ * @brief Replace the opcode of a program node
+ *
+ * Wraps set_node_opcode() and records the change for the pass
+ * scheduler. Optimization passes should use this rather than
+ * set_node_opcode() directly.
+ *
+ * @param prog Program owning the node
+ * @param index Node index
+ * @param op New opcode
+ */
+void rewrite_node_opcode(Program *prog, int index, Opcode op);
+
+/**
+ * @brief Find the instruction assembled next to a node
+ *
+ * Skips dead nodes and lines that emit nothing (blank, comment or
+ * label-only lines), so it finds the instruction whose bytes directly
+ * precede or follow the node's in the output.
+ *
+ * @param prog Program owning the nodes
+ * @param index Node to start from
+ * @param step -1 to look backwards, 1 to look forwards
+ * @return Index of the neighbouring instruction, or -1 if a directive
+ *         or the end of the program comes first
+ */
+int adjacent_instruction(const Program *prog, int index, int step);
+
+/**
+ * @brief Count one application of a rewrite rule
+ *
+ * Passes call this once per optimization they apply, after killing or
+ * rewriting its nodes. With -stats the changes since the last hit are
+ * credited to the rule.
+ *
+ * @param prog Program being optimized
+ * @param rule Rule name, "<pass>.<rule>" (string literal)
+ */
+void count_optimization(Program *prog, const char *rule);
+
 /**
  * @brief Free program and all associated memory
  *
@@ -0,0 +1,457 @@
+/**
+ * @file server.c
+ * @brief Persistent optimization server implementation
+ *
+ * One session is a pair of streams: standard input and output, or the
+ * two directions of an accepted socket connection. Requests are served
+ * one at a time in arrival order.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "server.h"
+#include "cache.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#define SERVER_LINE 512          /**< Longest request header line */
+#define SERVER_KEY 96            /**< Longest canonical option set */
+
+/**
+ * @brief Warm optimizer handle for one option set
+ */
+typedef struct {
+    char key[SERVER_KEY];       /**< Canonical option set */
+    Opt6502 *opt;               /**< Handle */
+} ServerHandle;
+
+/**
+ * @brief Result kept in memory
+ */
+typedef struct {
+    uint64_t hash;              /**< Hash of key and input */
+    char key[SERVER_KEY];       /**< Canonical option set */
+    char *input;                /**< Source the result is for (NULL if unused) */
+    size_t input_len;           /**< Length of input */
+    char *output;               /**< Optimized source */
+    size_t output_len;          /**< Length of output */
+    Opt6502Stats stats;         /**< Statistics of the run */
+} ServerEntry;
+
+/**
+ * @brief State kept between requests
+ */
+typedef struct {
+    Opt6502Options defaults;                     /**< Settings of the command line */
+    ServerHandle handles[SERVER_MAX_HANDLES];    /**< Warm handles */
+    int handle_count;                            /**< Handles in use */
+    ServerEntry entries[SERVER_CACHE_ENTRIES];   /**< Recent results */
+    int next_entry;                              /**< Entry replaced next (round robin) */
+} Server;
+
+/**
+ * @brief Outcome of one session
+ */
+typedef enum {
+    SESSION_EOF,                /**< Input ended or QUIT */
+    SESSION_SHUTDOWN            /**< SHUTDOWN request */
+} SessionEnd;
+
+/**
+ * @brief Write an ERROR response
+ *
+ * @param out Response stream
+ * @param message Error message
+ */
+static void send_error(FILE *out, const char *message) {
+    fprintf(out, "ERROR %zu\n%s", strlen(message), message);
+    fflush(out);
+}
+
+/**
+ * @brief Copy a setting value in lower case
+ *
+ * @param dst Destination buffer
+ * @param size Size of dst
+ * @param src Value
+ * @return false if the value does not fit
+ */
+static bool copy_lower(char *dst, size_t size, const char *src) {
+    size_t len = strlen(src);
+    if (len >= size) return false;
+    for (size_t i = 0; i <= len; i++) dst[i] = (char)tolower((unsigned char)src[i]);
+    return true;
+}
+
+/**
+ * @brief Find or create the warm handle for an option set
+ *
+ * When all slots are taken the oldest handle is replaced.
+ *
+ * @param server Server state
+ * @param options Settings of the request
+ * @param key Canonical option set
+ * @return Handle, or NULL if a setting is unknown
+ */
+static Opt6502* get_handle(Server *server, const Opt6502Options *options, const char *key) {
+    for (int i = 0; i < server->handle_count; i++) {
+        if (strcmp(server->handles[i].key, key) == 0) return server->handles[i].opt;
+    }
+
+    Opt6502 *opt = opt6502_create(options);
+    if (!opt) return NULL;
+
+    if (server->handle_count == SERVER_MAX_HANDLES) {
+        opt6502_destroy(server->handles[0].opt);
+        memmove(&server->handles[0], &server->handles[1],
+                (SERVER_MAX_HANDLES - 1) * sizeof(ServerHandle));
+        server->handle_count--;
+    }
+    ServerHandle *slot = &server->handles[server->handle_count++];
+    strcpy(slot->key, key);
+    slot->opt = opt;
+    return opt;
+}
+
+/**
+ * @brief Find a result kept in memory
+ *
+ * @param server Server state
+ * @param hash Hash of key and input
+ * @param key Canonical option set
+ * @param input Source
+ * @param len Length of the source
+ * @return Entry, or NULL on a miss
+ */
+static const ServerEntry* find_entry(const Server *server, uint64_t hash, const char *key,
+                                     const char *input, size_t len) {
+    for (int i = 0; i < SERVER_CACHE_ENTRIES; i++) {
+        const ServerEntry *entry = &server->entries[i];
+        if (entry->input && entry->hash == hash && entry->input_len == len &&
+            strcmp(entry->key, key) == 0 && memcmp(entry->input, input, len) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Keep a result in memory, replacing the oldest one
+ *
+ * @param server Server state
+ * @param hash Hash of key and input
+ * @param key Canonical option set
+ * @param input Source (ownership passes to the server)
+ * @param len Length of the source
+ * @param opt Handle holding the result
+ */
+static void keep_entry(Server *server, uint64_t hash, const char *key, char *input, size_t len,
+                       const Opt6502 *opt) {
+    size_t output_len = 0;
+    const char *output = opt6502_output(opt, &output_len);
+    char *copy = malloc(output_len + 1);
+    if (!copy) {
+        free(input);
+        return;
+    }
+    memcpy(copy, output, output_len + 1);
+
+    ServerEntry *entry = &server->entries[server->next_entry];
+    server->next_entry = (server->next_entry + 1) % SERVER_CACHE_ENTRIES;
+    free(entry->input);
+    free(entry->output);
+    entry->hash = hash;
+    strcpy(entry->key, key);
+    entry->input = input;
+    entry->input_len = len;
+    entry->output = copy;
+    entry->output_len = output_len;
+    entry->stats = *opt6502_stats(opt);
+}
+
+/**
+ * @brief Write an OK response
+ *
+ * @param out Response stream
+ * @param output Optimized source
+ * @param len Length of output
+ * @param stats Statistics of the run
+ * @param cached Result came from memory
+ */
+static void send_result(FILE *out, const char *output, size_t len, const Opt6502Stats *stats,
+                        bool cached) {
+    fprintf(out, "OK %zu %d %d %d %d %d %d %d %d\n", len, stats->lines, stats->optimizations,
+            stats->removed, stats->cycles_before, stats->cycles_after, stats->bytes_before,
+            stats->bytes_after, cached ? 1 : 0);
+    fwrite(output, 1, len, out);
+    fflush(out);
+}
+
+/**
+ * @brief Parse the settings of an OPTIMIZE request
+ *
+ * @param args Text after the length
+ * @param options Settings to update (strings point into values)
+ * @param values Storage for the string settings (2 x SERVER_KEY)
+ * @return Error message, or NULL if every setting was understood
+ */
+static const char* parse_settings(char *args, Opt6502Options *options,
+                                  char values[2][SERVER_KEY]) {
+    char *p = args;
+    while (*p) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (!*p) break;
+        char *word = p;
+        while (*p && *p != ' ' && *p != '\t') p++;
+        if (*p) *p++ = '\0';
+
+        char *value = strchr(word, '=');
+        if (!value) return "Malformed setting (expected name=value)";
+        *value++ = '\0';
+
+        if (strcmp(word, "cpu") == 0) {
+            if (!copy_lower(values[0], SERVER_KEY / 2, value)) return "CPU name too long";
+            options->cpu = values[0];
+        } else if (strcmp(word, "asm") == 0) {
+            if (!copy_lower(values[1], SERVER_KEY / 2, value)) return "Assembler name too long";
+            options->assembler = values[1];
+        } else if (strcmp(word, "mode") == 0) {
+            if (strcmp(value, "speed") == 0) options->mode = OPT6502_SPEED;
+            else if (strcmp(value, "size") == 0) options->mode = OPT6502_SIZE;
+            else return "Unknown mode (use speed or size)";
+        } else if (strcmp(word, "trace") == 0) {
+            if (!isdigit((unsigned char)value[0])) return "Trace level must be a number";
+            options->trace_level = atoi(value);
+        } else {
+            return "Unknown setting";
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Serve one OPTIMIZE request
+ *
+ * @param server Server state
+ * @param args Text after "OPTIMIZE "
+ * @param in Request stream (positioned at the source)
+ * @param out Response stream
+ * @return false if the source could not be read (session is over)
+ */
+static bool serve_optimize(Server *server, char *args, FILE *in, FILE *out) {
+    char *end = NULL;
+    long len = strtol(args, &end, 10);
+    if (end == args || len < 0) {
+        send_error(out, "Missing source length");
+        return false;  // Cannot find the next request
+    }
+    if (len > SERVER_MAX_REQUEST) {
+        send_error(out, "Source too large");
+        return false;
+    }
+
+    char *input = malloc((size_t)len + 1);
+    if (!input) {
+        send_error(out, "Out of memory");
+        return false;
+    }
+    if (fread(input, 1, (size_t)len, in) != (size_t)len) {
+        free(input);
+        return false;
+    }
+
+    Opt6502Options options = server->defaults;
+    char values[2][SERVER_KEY];
+    const char *error = parse_settings(end, &options, values);
+    if (error) {
+        free(input);
+        send_error(out, error);
+        return true;
+    }
+
+    char key[SERVER_KEY];
+    snprintf(key, sizeof(key), "%s|%s|%d|%d", options.cpu, options.assembler,
+             (int)options.mode, options.trace_level);
+    uint64_t hash = cache_hash(cache_hash(CACHE_HASH_SEED, key, strlen(key) + 1),
+                               input, (size_t)len);
+
+    const ServerEntry *entry = find_entry(server, hash, key, input, (size_t)len);
+    if (entry) {
+        free(input);
+        send_result(out, entry->output, entry->output_len, &entry->stats, true);
+        return true;
+    }
+
+    Opt6502 *opt = get_handle(server, &options, key);
+    if (!opt) {
+        free(input);
+        send_error(out, "Unknown CPU or assembler");
+        return true;
+    }
+    if (!opt6502_run(opt, input, (size_t)len)) {
+        free(input);
+        send_error(out, "Out of memory");
+        return true;
+    }
+
+    size_t output_len = 0;
+    const char *output = opt6502_output(opt, &output_len);
+    send_result(out, output, output_len, opt6502_stats(opt), false);
+    keep_entry(server, hash, key, input, (size_t)len, opt);
+    return true;
+}
+
+/**
+ * @brief Serve requests from one pair of streams
+ *
+ * @param server Server state
+ * @param in Request stream
+ * @param out Response stream
+ * @return How the session ended
+ */
+static SessionEnd serve_session(Server *server, FILE *in, FILE *out) {
+    char line[SERVER_LINE];
+
+    while (fgets(line, sizeof(line), in)) {
+        size_t n = strlen(line);
+        if (n == sizeof(line) - 1 && line[n - 1] != '\n') {
+            send_error(out, "Request line too long");
+            return SESSION_EOF;
+        }
+        while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) line[--n] = '\0';
+        if (n == 0) continue;
+
+        if (strncmp(line, "OPTIMIZE ", 9) == 0) {
+            if (!serve_optimize(server, line + 9, in, out)) return SESSION_EOF;
+        } else if (strcmp(line, "QUIT") == 0) {
+            return SESSION_EOF;
+        } else if (strcmp(line, "SHUTDOWN") == 0) {
+            return SESSION_SHUTDOWN;
+        } else {
+            send_error(out, "Unknown request");
+        }
+    }
+    return SESSION_EOF;
+}
+
+/**
+ * @brief Free everything the server keeps between requests
+ * @param server Server state
+ */
+static void free_server(Server *server) {
+    for (int i = 0; i < server->handle_count; i++) {
+        opt6502_destroy(server->handles[i].opt);
+    }
+    for (int i = 0; i < SERVER_CACHE_ENTRIES; i++) {
+        free(server->entries[i].input);
+        free(server->entries[i].output);
+    }
+    free(server);
+}
+
+#ifndef _WIN32
+/**
+ * @brief Listen on a Unix domain socket and serve its connections
+ *
+ * @param server Server state
+ * @param path Socket path
+ * @return 0 on a clean shutdown, 1 if the socket could not be set up
+ */
+static int serve_socket(Server *server, const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: Socket path too long: %s\n", path);
+        return 1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Cannot create socket\n");
+        return 1;
+    }
+    unlink(path);  // Stale socket of an earlier server
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+        fprintf(stderr, "Error: Cannot listen on %s\n", path);
+        close(fd);
+        return 1;
+    }
+
+    // A client that goes away mid-response must not stop the server
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "Listening on %s\n", path);
+
+    SessionEnd end = SESSION_EOF;
+    while (end != SESSION_SHUTDOWN) {
+        int conn = accept(fd, NULL, NULL);
+        if (conn < 0) continue;
+
+        int conn_out = dup(conn);
+        FILE *in = fdopen(conn, "r");
+        FILE *out = conn_out >= 0 ? fdopen(conn_out, "w") : NULL;
+        if (in && out) end = serve_session(server, in, out);
+
+        if (in) fclose(in);
+        else close(conn);
+        if (out) fclose(out);
+        else if (conn_out >= 0) close(conn_out);
+    }
+
+    close(fd);
+    unlink(path);
+    return 0;
+}
+#endif
+
+/**
+ * @brief Serve requests until QUIT, SHUTDOWN or end of input
+ *
+ * @param defaults Settings for requests that do not give their own
+ * @param socket_path Unix domain socket to listen on, or NULL for
+ *                    standard input and output
+ * @return 0 on a clean shutdown, 1 if the server could not start
+ */
+int run_server(const Opt6502Options *defaults, const char *socket_path) {
+    Server *server = calloc(1, sizeof(Server));
+    if (!server) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 1;
+    }
+    server->defaults = *defaults;
+
+    // Checks the defaults and sets up the shared tables before any request
+    char key[SERVER_KEY];
+    snprintf(key, sizeof(key), "%s|%s|%d|%d", defaults->cpu, defaults->assembler,
+             (int)defaults->mode, defaults->trace_level);
+    if (!get_handle(server, defaults, key)) {
+        fprintf(stderr, "Error: Unknown CPU or assembler\n");
+        free_server(server);
+        return 1;
+    }
+
+    int status = 0;
+    if (socket_path) {
+#ifdef _WIN32
+        fprintf(stderr, "Error: -socket is not supported on Windows\n");
+        status = 1;
+#else
+        status = serve_socket(server, socket_path);
+#endif
+    } else {
+        serve_session(server, stdin, stdout);
+    }
+
+    free_server(server);
+    return status;
+}
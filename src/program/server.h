@@ -0,0 +1,58 @@
+/**
+ * @file server.h
+ * @brief Persistent optimization server (-server)
+ *
+ * Serves optimization requests over standard input and output, or over
+ * a Unix domain socket, from one long-lived process. Optimizer handles
+ * (see opt6502.h) stay alive between requests, one per option set, and
+ * recent results are kept in memory, so a request costs only its own
+ * optimization, or nothing when the same source comes back unchanged.
+ *
+ * Protocol (all header lines end in '\n', numbers are decimal):
+ *
+ *   OPTIMIZE <length> [cpu=<cpu>] [asm=<assembler>] [mode=speed|size] [trace=<level>]
+ *       followed by <length> bytes of source. Settings not given default
+ *       to those on the server command line.
+ *   QUIT
+ *       ends the session (standard input mode: stops the server).
+ *   SHUTDOWN
+ *       stops the server.
+ *
+ * Every OPTIMIZE request gets one response:
+ *
+ *   OK <length> <lines> <optimizations> <removed> <cycles_before> <cycles_after>
+ *      <bytes_before> <bytes_after> <cached>
+ *       (on one line) followed by <length> bytes of optimized source;
+ *       <cached> is 1 if the result came from memory.
+ *   ERROR <length>
+ *       followed by a <length> byte message.
+ *
+ * Responses are flushed as soon as they are complete. Blank lines between
+ * requests are ignored.
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "../lib/opt6502.h"
+
+#define SERVER_MAX_HANDLES 16            /**< Warm optimizer handles (option sets) */
+#define SERVER_CACHE_ENTRIES 64          /**< Results kept in memory */
+#define SERVER_MAX_REQUEST (64L << 20)   /**< Largest accepted source in bytes */
+
+/**
+ * @brief Serve requests until QUIT, SHUTDOWN or end of input
+ *
+ * With a socket path the server listens on a Unix domain socket at that
+ * path, replacing any stale socket file, and serves one connection at a
+ * time until a SHUTDOWN request. Without one it serves standard input
+ * and output. Nothing but responses is written to standard output.
+ *
+ * @param defaults Settings for requests that do not give their own
+ * @param socket_path Unix domain socket to listen on, or NULL for
+ *                    standard input and output
+ * @return 0 on a clean shutdown, 1 if the server could not start
+ */
+int run_server(const Opt6502Options *defaults, const char *socket_path);
+
+#endif // SERVER_H
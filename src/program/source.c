@@ -0,0 +1,164 @@
+/**
+ * @file source.c
+ * @brief Whole-file source input implementation
+ *
+ * Regular files are mapped read-only with mmap(). Anything that cannot be
+ * mapped (empty files, pipes, character devices, platforms without mmap)
+ * is read into a heap buffer that grows geometrically.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "source.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Read a stream to its end into a heap buffer
+ *
+ * @param fp Stream to read
+ * @param source Buffer to fill
+ * @return true on success
+ */
+static bool read_stream(FILE *fp, SourceBuffer *source) {
+    size_t capacity = 0;
+    size_t size = 0;
+    char *data = NULL;
+
+    for (;;) {
+        if (capacity - size < SOURCE_READ_CHUNK) {
+            size_t grown = capacity ? capacity * 2 : SOURCE_READ_CHUNK;
+            char *bigger = realloc(data, grown);
+            if (!bigger) {
+                free(data);
+                return false;
+            }
+            data = bigger;
+            capacity = grown;
+        }
+
+        size_t n = fread(data + size, 1, capacity - size, fp);
+        size += n;
+        if (n == 0) break;
+    }
+
+    if (ferror(fp)) {
+        free(data);
+        return false;
+    }
+
+    source->data = data;
+    source->size = size;
+    source->mapped = false;
+    return true;
+}
+
+/**
+ * @brief Load a whole file
+ *
+ * @param path File to load
+ * @return New buffer, or NULL if the file cannot be opened or read
+ */
+SourceBuffer* source_open(const char *path) {
+    SourceBuffer *source = calloc(1, sizeof(SourceBuffer));
+    if (!source) return NULL;
+
+    FILE *fp = NULL;
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        free(source);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            close(fd);
+            source->data = map;
+            source->size = (size_t)st.st_size;
+            source->mapped = true;
+            return source;
+        }
+    }
+
+    fp = fdopen(fd, "rb");
+    if (!fp) close(fd);
+#else
+    fp = fopen(path, "rb");
+#endif
+
+    if (!fp || !read_stream(fp, source)) {
+        if (fp) fclose(fp);
+        free(source);
+        return NULL;
+    }
+    fclose(fp);
+    return source;
+}
+
+/**
+ * @brief Read an open stream to its end
+ *
+ * @param fp Stream to read (left open)
+ * @return New buffer, or NULL on read or allocation failure
+ */
+SourceBuffer* source_read(FILE *fp) {
+    SourceBuffer *source = calloc(1, sizeof(SourceBuffer));
+    if (!source) return NULL;
+    if (!read_stream(fp, source)) {
+        free(source);
+        return NULL;
+    }
+    return source;
+}
+
+/**
+ * @brief Copy text that is already in memory
+ *
+ * @param data Text to copy
+ * @param len Length of the text
+ * @return New buffer, or NULL on allocation failure
+ */
+SourceBuffer* source_copy(const char *data, size_t len) {
+    SourceBuffer *source = calloc(1, sizeof(SourceBuffer));
+    char *copy = malloc(len > 0 ? len : 1);
+    if (!source || !copy) {
+        free(source);
+        free(copy);
+        return NULL;
+    }
+
+    if (len > 0) memcpy(copy, data, len);
+    source->data = copy;
+    source->size = len;
+    source->mapped = false;
+    return source;
+}
+
+/**
+ * @brief Release a loaded file
+ *
+ * @param source Buffer to release (NULL-safe)
+ */
+void source_close(SourceBuffer *source) {
+    if (!source) return;
+
+#ifndef _WIN32
+    if (source->mapped) {
+        munmap((void *)source->data, source->size);
+        free(source);
+        return;
+    }
+#endif
+    free((void *)source->data);
+    free(source);
+}
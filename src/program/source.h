@@ -0,0 +1,64 @@
+/**
+ * @file source.h
+ * @brief Whole-file source input
+ *
+ * Loads an input file into one read-only buffer, memory-mapped where the
+ * platform and file allow it and read in large chunks otherwise (pipes,
+ * Windows). Nodes keep slices into this buffer so unmodified lines can
+ * be written back byte for byte.
+ */
+
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define SOURCE_READ_CHUNK (1024 * 1024)  /**< Read size when the file cannot be mapped */
+
+/**
+ * @brief Contents of one input file
+ */
+typedef struct SourceBuffer {
+    const char *data;           /**< File contents (not NUL-terminated) */
+    size_t size;                /**< Length of data in bytes */
+    bool mapped;                /**< data is an mmap() mapping rather than heap memory */
+} SourceBuffer;
+
+/**
+ * @brief Load a whole file
+ *
+ * @param path File to load
+ * @return New buffer, or NULL if the file cannot be opened or read
+ */
+SourceBuffer* source_open(const char *path);
+
+/**
+ * @brief Read an open stream to its end
+ *
+ * Used for standard input and other streams that have no path.
+ *
+ * @param fp Stream to read (left open)
+ * @return New buffer, or NULL on read or allocation failure
+ */
+SourceBuffer* source_read(FILE *fp);
+
+/**
+ * @brief Copy text that is already in memory
+ *
+ * Used by the library API, whose callers keep their own buffer.
+ *
+ * @param data Text to copy
+ * @param len Length of the text
+ * @return New buffer, or NULL on allocation failure
+ */
+SourceBuffer* source_copy(const char *data, size_t len);
+
+/**
+ * @brief Release a loaded file
+ * @param source Buffer to release (NULL-safe)
+ */
+void source_close(SourceBuffer *source);
+
+#endif // SOURCE_H
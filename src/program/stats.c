@@ -0,0 +1,420 @@
+/**
+ * @file stats.c
+ * @brief Phase timing and resource statistics implementation
+ *
+ * Uses the POSIX monotonic clock for timing, and /proc or getrusage()
+ * for peak memory. On platforms with neither the peak RSS reads as 0.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "stats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+/**
+ * @brief Create an empty statistics record and start the run clock
+ *
+ * @return New record, or NULL on allocation failure
+ */
+RunStats* create_run_stats(void) {
+    RunStats *stats = calloc(1, sizeof(RunStats));
+    if (stats) stats->start = stats_now();
+    return stats;
+}
+
+/**
+ * @brief Free a statistics record
+ *
+ * @param stats Record to free (NULL-safe)
+ */
+void free_run_stats(RunStats *stats) {
+    free(stats);
+}
+
+/**
+ * @brief Read the monotonic clock
+ *
+ * @return Seconds since an arbitrary fixed point
+ */
+double stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Find or create a phase timer
+ *
+ * Phase names are compared by pointer first, since callers pass string
+ * literals, and by content as a fallback.
+ *
+ * @param stats Record to search
+ * @param name Phase name (must outlive the record)
+ * @return Timer index, or -1 if all STATS_MAX_TIMERS are in use
+ */
+static int find_timer(RunStats *stats, const char *name) {
+    for (int t = 0; t < stats->timer_count; t++) {
+        const char *other = stats->timers[t].name;
+        if (other == name || strcmp(other, name) == 0) return t;
+    }
+
+    if (stats->timer_count == STATS_MAX_TIMERS) return -1;
+    StatTimer *timer = &stats->timers[stats->timer_count];
+    timer->name = name;
+    timer->seconds = 0.0;
+    timer->calls = 0;
+    return stats->timer_count++;
+}
+
+/**
+ * @brief Add time to a phase, overall and in the current round
+ *
+ * @param stats Record to update
+ * @param name Phase name
+ * @param seconds Time to add
+ * @param calls Timed intervals to add
+ */
+static void add_phase_time(RunStats *stats, const char *name, double seconds, long calls) {
+    int t = find_timer(stats, name);
+    if (t < 0) return;
+
+    stats->timers[t].seconds += seconds;
+    stats->timers[t].calls += calls;
+    if (stats->round > 0) {
+        int r = stats->round < STATS_MAX_ROUNDS ? stats->round : STATS_MAX_ROUNDS;
+        stats->rounds[r - 1].seconds[t] += seconds;
+    }
+}
+
+/**
+ * @brief Add an interval to a phase timer
+ *
+ * @param stats Record to update (NULL-safe: does nothing)
+ * @param name Phase name (must outlive the record)
+ * @param started Value of stats_now() when the interval began
+ */
+void stats_add_time(RunStats *stats, const char *name, double started) {
+    if (!stats) return;
+    add_phase_time(stats, name, stats_now() - started, 1);
+}
+
+/**
+ * @brief Start the next scheduler round
+ *
+ * @param stats Record to update (NULL-safe: does nothing)
+ */
+void stats_begin_round(RunStats *stats) {
+    if (!stats) return;
+    stats->round++;
+    int r = stats->round < STATS_MAX_ROUNDS ? stats->round : STATS_MAX_ROUNDS;
+    if (r > stats->round_count) stats->round_count = r;
+}
+
+/**
+ * @brief Finish the current scheduler round
+ *
+ * @param stats Record to update (NULL-safe: does nothing)
+ * @param visits Region visits of the round
+ * @param optimizations Optimizations applied in the round
+ */
+void stats_end_round(RunStats *stats, long visits, long optimizations) {
+    if (!stats || stats->round == 0) return;
+    int r = stats->round < STATS_MAX_ROUNDS ? stats->round : STATS_MAX_ROUNDS;
+    stats->rounds[r - 1].visits += visits;
+    stats->rounds[r - 1].optimizations += optimizations;
+}
+
+/**
+ * @brief Record a node change for the next rule hit
+ *
+ * @param stats Record to update (NULL-safe: does nothing)
+ * @param killed 1 if the node was removed
+ * @param rewritten 1 if the node got a new opcode
+ * @param cycles Cycles saved by the change
+ * @param bytes Bytes saved by the change
+ */
+void stats_note_change(RunStats *stats, int killed, int rewritten, int cycles, int bytes) {
+    if (!stats) return;
+    stats->pending.killed += killed;
+    stats->pending.rewritten += rewritten;
+    stats->pending.cycles_saved += cycles;
+    stats->pending.bytes_saved += bytes;
+}
+
+/**
+ * @brief Find or create a rule counter
+ *
+ * @param stats Record to search
+ * @param name Rule name (must outlive the record)
+ * @return Rule counter, or NULL if all STATS_MAX_RULES are in use
+ */
+static StatRule* find_rule(RunStats *stats, const char *name) {
+    for (int r = 0; r < stats->rule_count; r++) {
+        StatRule *rule = &stats->rules[r];
+        if (rule->name == name || strcmp(rule->name, name) == 0) return rule;
+    }
+
+    if (stats->rule_count == STATS_MAX_RULES) return NULL;
+    StatRule *rule = &stats->rules[stats->rule_count++];
+    memset(rule, 0, sizeof(*rule));
+    rule->name = name;
+    return rule;
+}
+
+/**
+ * @brief Add the counts of one rule record to another
+ *
+ * @param rule Record to update
+ * @param other Counts to add
+ */
+static void add_rule_counts(StatRule *rule, const StatRule *other) {
+    rule->hits += other->hits;
+    rule->killed += other->killed;
+    rule->rewritten += other->rewritten;
+    rule->cycles_saved += other->cycles_saved;
+    rule->bytes_saved += other->bytes_saved;
+}
+
+/**
+ * @brief Move the pending changes to a rule
+ *
+ * @param stats Record to update
+ * @param name Rule name
+ * @param hits Hits to count
+ */
+static void claim_pending(RunStats *stats, const char *name, long hits) {
+    StatRule *rule = find_rule(stats, name);
+    if (rule) {
+        stats->pending.hits = hits;
+        add_rule_counts(rule, &stats->pending);
+    }
+    memset(&stats->pending, 0, sizeof(stats->pending));
+}
+
+/**
+ * @brief Count a hit of a rewrite rule
+ *
+ * @param stats Record to update (NULL-safe: does nothing)
+ * @param rule Rule name (must outlive the record)
+ */
+void stats_rule_hit(RunStats *stats, const char *rule) {
+    if (!stats) return;
+    claim_pending(stats, rule, 1);
+}
+
+/**
+ * @brief Assign pending changes that no rule hit claimed
+ *
+ * @param stats Record to update (NULL-safe: does nothing)
+ * @param rule Rule name (must outlive the record)
+ */
+void stats_claim_pending(RunStats *stats, const char *rule) {
+    if (!stats) return;
+    if (stats->pending.killed == 0 && stats->pending.rewritten == 0) return;
+    claim_pending(stats, rule, 0);
+}
+
+/**
+ * @brief Record the size of a string arena
+ *
+ * @param stats Record to update (NULL-safe: does nothing)
+ * @param bytes Bytes the arena has reserved
+ */
+void stats_note_arena(RunStats *stats, size_t bytes) {
+    if (stats && bytes > stats->arena_peak) stats->arena_peak = bytes;
+}
+
+/**
+ * @brief Add the timers and rules of another record
+ *
+ * @param stats Record to update
+ * @param other Record to add (NULL-safe: does nothing)
+ */
+void stats_merge(RunStats *stats, const RunStats *other) {
+    if (!other) return;
+
+    for (int t = 0; t < other->timer_count; t++) {
+        add_phase_time(stats, other->timers[t].name, other->timers[t].seconds,
+                       other->timers[t].calls);
+    }
+    for (int r = 0; r < other->rule_count; r++) {
+        StatRule *rule = find_rule(stats, other->rules[r].name);
+        if (rule) add_rule_counts(rule, &other->rules[r]);
+    }
+    if (other->arena_peak > stats->arena_peak) stats->arena_peak = other->arena_peak;
+}
+
+/**
+ * @brief Peak resident set size of the process
+ *
+ * On Linux, getrusage() keeps the high-water mark of the process image
+ * that exec'd us (for example a benchmark script), so the per-image
+ * VmHWM from /proc is preferred there.
+ *
+ * @return Peak RSS in kilobytes, or 0 if the platform cannot report it
+ */
+long stats_peak_rss_kb(void) {
+#ifdef __linux__
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (fp) {
+        char line[128];
+        long kb = 0;
+        while (fgets(line, sizeof(line), fp)) {
+            if (strncmp(line, "VmHWM:", 6) == 0) {
+                kb = strtol(line + 6, NULL, 10);
+                break;
+            }
+        }
+        fclose(fp);
+        if (kb > 0) return kb;
+    }
+#endif
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        return usage.ru_maxrss / 1024;  // Bytes on macOS
+#else
+        return usage.ru_maxrss;         // Kilobytes on Linux and BSD
+#endif
+    }
+#endif
+    return 0;
+}
+
+/**
+ * @brief qsort() comparator: most hits first, then by name
+ *
+ * @param a Pointer to a StatRule pointer
+ * @param b Pointer to a StatRule pointer
+ * @return Comparison result
+ */
+static int compare_rule_hits(const void *a, const void *b) {
+    const StatRule *ra = *(const StatRule * const *)a;
+    const StatRule *rb = *(const StatRule * const *)b;
+    if (ra->hits != rb->hits) return ra->hits < rb->hits ? 1 : -1;
+    return strcmp(ra->name, rb->name);
+}
+
+/**
+ * @brief List the rules in print order
+ *
+ * Workers create rules in scheduling order, so the order of first use
+ * is not reproducible under -j; the printed order is.
+ *
+ * @param stats Record to list
+ * @param rules Array of STATS_MAX_RULES entries to fill in
+ */
+static void sort_rules(const RunStats *stats, const StatRule **rules) {
+    for (int r = 0; r < stats->rule_count; r++) {
+        rules[r] = &stats->rules[r];
+    }
+    qsort(rules, stats->rule_count, sizeof(rules[0]), compare_rule_hits);
+}
+
+/**
+ * @brief Print the statistics as one JSON object
+ *
+ * @param stats Record to print
+ * @param fp Output stream
+ * @param total Wall-clock time of the run so far
+ */
+static void print_run_stats_json(const RunStats *stats, FILE *fp, double total) {
+    fprintf(fp, "{\n  \"lines\": %ld,\n  \"total_ms\": %.3f,\n", stats->lines, total * 1000.0);
+    fprintf(fp, "  \"peak_rss_kb\": %ld,\n  \"arena_peak_bytes\": %zu,\n",
+            stats_peak_rss_kb(), stats->arena_peak);
+
+    fprintf(fp, "  \"phases\": [");
+    for (int t = 0; t < stats->timer_count; t++) {
+        const StatTimer *timer = &stats->timers[t];
+        fprintf(fp, "%s\n    {\"name\": \"%s\", \"ms\": %.3f, \"calls\": %ld}",
+                t ? "," : "", timer->name, timer->seconds * 1000.0, timer->calls);
+    }
+    fprintf(fp, "\n  ],\n");
+
+    fprintf(fp, "  \"rounds\": [");
+    for (int r = 0; r < stats->round_count; r++) {
+        const StatRound *round = &stats->rounds[r];
+        fprintf(fp, "%s\n    {\"round\": %d, \"visits\": %ld, \"optimizations\": %ld, \"ms\": {",
+                r ? "," : "", r + 1, round->visits, round->optimizations);
+        bool first = true;
+        for (int t = 0; t < stats->timer_count; t++) {
+            if (round->seconds[t] == 0.0) continue;
+            fprintf(fp, "%s\"%s\": %.3f", first ? "" : ", ", stats->timers[t].name,
+                    round->seconds[t] * 1000.0);
+            first = false;
+        }
+        fprintf(fp, "}}");
+    }
+    fprintf(fp, "\n  ],\n");
+
+    const StatRule *rules[STATS_MAX_RULES];
+    sort_rules(stats, rules);
+    fprintf(fp, "  \"rules\": [");
+    for (int r = 0; r < stats->rule_count; r++) {
+        fprintf(fp, "%s\n    {\"name\": \"%s\", \"hits\": %ld, \"killed\": %ld, \"rewritten\": %ld, "
+                "\"cycles_saved\": %ld, \"bytes_saved\": %ld}",
+                r ? "," : "", rules[r]->name, rules[r]->hits, rules[r]->killed,
+                rules[r]->rewritten, rules[r]->cycles_saved, rules[r]->bytes_saved);
+    }
+    fprintf(fp, "\n  ]\n}\n");
+}
+
+/**
+ * @brief Print the timing table, throughput and peak RSS
+ *
+ * Throughput is input lines divided by each phase's total time, so a
+ * pass that scales badly stands out as the input grows. The round and
+ * rule tables follow when the optimizer ran.
+ *
+ * @param stats Record to print
+ * @param fp Output stream
+ */
+void print_run_stats(const RunStats *stats, FILE *fp) {
+    double total = stats_now() - stats->start;
+    if (stats->json) {
+        print_run_stats_json(stats, fp, total);
+        return;
+    }
+
+    fprintf(fp, "\n=== Statistics ===\n");
+    fprintf(fp, "%-24s %10s %8s %14s\n", "Phase", "ms", "calls", "lines/sec");
+    for (int t = 0; t < stats->timer_count; t++) {
+        const StatTimer *timer = &stats->timers[t];
+        fprintf(fp, "%-24s %10.3f %8ld %14.0f\n", timer->name, timer->seconds * 1000.0,
+                timer->calls, timer->seconds > 0 ? stats->lines / timer->seconds : 0.0);
+    }
+    fprintf(fp, "%-24s %10.3f %8s %14.0f\n", "total", total * 1000.0, "",
+            total > 0 ? stats->lines / total : 0.0);
+
+    for (int r = 0; r < stats->round_count; r++) {
+        const StatRound *round = &stats->rounds[r];
+        fprintf(fp, "\nRound %d%s: %ld region visits, %ld optimizations\n", r + 1,
+                r + 1 == STATS_MAX_ROUNDS ? "+" : "", round->visits, round->optimizations);
+        for (int t = 0; t < stats->timer_count; t++) {
+            if (round->seconds[t] == 0.0) continue;
+            fprintf(fp, "  %-22s %10.3f\n", stats->timers[t].name, round->seconds[t] * 1000.0);
+        }
+    }
+
+    if (stats->rule_count > 0) {
+        const StatRule *rules[STATS_MAX_RULES];
+        sort_rules(stats, rules);
+        fprintf(fp, "\n%-32s %8s %8s %9s %8s %8s\n", "Rule", "hits", "killed", "rewritten",
+                "cycles", "bytes");
+        for (int r = 0; r < stats->rule_count; r++) {
+            fprintf(fp, "%-32s %8ld %8ld %9ld %8ld %8ld\n", rules[r]->name, rules[r]->hits,
+                    rules[r]->killed, rules[r]->rewritten, rules[r]->cycles_saved,
+                    rules[r]->bytes_saved);
+        }
+    }
+
+    fprintf(fp, "\nLines: %ld\n", stats->lines);
+    fprintf(fp, "Peak arena: %zu KB\n", (stats->arena_peak + 1023) / 1024);
+    fprintf(fp, "Peak RSS: %ld KB\n", stats_peak_rss_kb());
+}
@@ -0,0 +1,201 @@
+/**
+ * @file stats.h
+ * @brief Phase timing and resource statistics (-stats)
+ *
+ * Collects wall-clock time per phase (parse, each optimization pass,
+ * output), overall and per scheduler round, how often each rewrite rule
+ * fired with the nodes it killed or rewrote and the cycles and bytes it
+ * saved by the cost model, and the peak string arena and resident set
+ * size. Prints them as a table with throughput in lines per second, or
+ * as JSON (-stats=json). Collection is off unless the program's stats
+ * pointer is set, so normal runs pay nothing for it.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define STATS_MAX_TIMERS 32     /**< Distinct phases that can be timed */
+#define STATS_MAX_RULES 64      /**< Distinct rewrite rules that can be counted */
+#define STATS_MAX_ROUNDS 16     /**< Rounds kept apart; later ones add to the last */
+
+/**
+ * @brief Accumulated time of one phase
+ */
+typedef struct {
+    const char *name;           /**< Phase name (static string) */
+    double seconds;             /**< Total wall-clock time */
+    long calls;                 /**< Number of timed intervals */
+} StatTimer;
+
+/**
+ * @brief Effect of one rewrite rule
+ *
+ * Cycles and bytes are base costs from the cost model; a rule that makes
+ * code bigger to make it faster has negative bytes saved.
+ */
+typedef struct {
+    const char *name;           /**< Rule name, "<pass>.<rule>" (static string) */
+    long hits;                  /**< Times the rule fired */
+    long killed;                /**< Nodes it removed */
+    long rewritten;             /**< Nodes it gave a new opcode */
+    long cycles_saved;          /**< Estimated cycles saved */
+    long bytes_saved;           /**< Estimated bytes saved */
+} StatRule;
+
+/**
+ * @brief One round of the pass scheduler
+ *
+ * A round drains the region worklist and then runs the whole-program
+ * dataflow passes; the scheduler starts another round while those find
+ * something new.
+ */
+typedef struct {
+    double seconds[STATS_MAX_TIMERS]; /**< Time per phase (index into timers) */
+    long visits;                /**< Region visits */
+    long optimizations;         /**< Optimizations applied */
+} StatRound;
+
+/**
+ * @brief Statistics of one optimizer run
+ */
+typedef struct RunStats {
+    StatTimer timers[STATS_MAX_TIMERS]; /**< Phases in first-use order */
+    int timer_count;            /**< Number of phases used */
+    StatRule rules[STATS_MAX_RULES]; /**< Rewrite rules in first-use order */
+    int rule_count;             /**< Number of rules used */
+    StatRule pending;           /**< Changes not yet claimed by a rule */
+    StatRound rounds[STATS_MAX_ROUNDS]; /**< Scheduler rounds */
+    int round_count;            /**< Number of rounds used */
+    int round;                  /**< Current round (1-based), 0 outside the scheduler */
+    size_t arena_peak;          /**< Largest string arena seen, in bytes reserved */
+    long lines;                 /**< Input lines processed */
+    double start;               /**< Time the run started (stats_now()) */
+    bool json;                  /**< Print as JSON (-stats=json) */
+} RunStats;
+
+/**
+ * @brief Create an empty statistics record and start the run clock
+ * @return New record, or NULL on allocation failure
+ */
+RunStats* create_run_stats(void);
+
+/**
+ * @brief Free a statistics record
+ * @param stats Record to free (NULL-safe)
+ */
+void free_run_stats(RunStats *stats);
+
+/**
+ * @brief Read the monotonic clock
+ * @return Seconds since an arbitrary fixed point
+ */
+double stats_now(void);
+
+/**
+ * @brief Add an interval to a phase timer
+ *
+ * Phases are created on first use. Intervals beyond STATS_MAX_TIMERS
+ * distinct phases are dropped.
+ *
+ * @param stats Record to update (NULL-safe: does nothing)
+ * @param name Phase name (must outlive the record)
+ * @param started Value of stats_now() when the interval began
+ */
+void stats_add_time(RunStats *stats, const char *name, double started);
+
+/**
+ * @brief Start the next scheduler round
+ *
+ * Round numbers restart with every optimizer run (set stats->round to
+ * 0); in -stream mode round k of every window adds to the same record.
+ *
+ * @param stats Record to update (NULL-safe: does nothing)
+ */
+void stats_begin_round(RunStats *stats);
+
+/**
+ * @brief Finish the current scheduler round
+ *
+ * @param stats Record to update (NULL-safe: does nothing)
+ * @param visits Region visits of the round
+ * @param optimizations Optimizations applied in the round
+ */
+void stats_end_round(RunStats *stats, long visits, long optimizations);
+
+/**
+ * @brief Record a node change for the next rule hit
+ *
+ * The change is held as pending until stats_rule_hit() or
+ * stats_claim_pending() assigns it to a rule.
+ *
+ * @param stats Record to update (NULL-safe: does nothing)
+ * @param killed 1 if the node was removed
+ * @param rewritten 1 if the node got a new opcode
+ * @param cycles Cycles saved by the change
+ * @param bytes Bytes saved by the change
+ */
+void stats_note_change(RunStats *stats, int killed, int rewritten, int cycles, int bytes);
+
+/**
+ * @brief Count a hit of a rewrite rule
+ *
+ * Assigns the pending changes to the rule. Rules are created on first
+ * use; hits beyond STATS_MAX_RULES distinct rules are dropped.
+ *
+ * @param stats Record to update (NULL-safe: does nothing)
+ * @param rule Rule name (must outlive the record)
+ */
+void stats_rule_hit(RunStats *stats, const char *rule);
+
+/**
+ * @brief Assign pending changes that no rule hit claimed
+ *
+ * A pass may change nodes before or after the hit it counts them
+ * under; the leftovers go to a rule named after the pass, without a hit.
+ *
+ * @param stats Record to update (NULL-safe: does nothing)
+ * @param rule Rule name (must outlive the record)
+ */
+void stats_claim_pending(RunStats *stats, const char *rule);
+
+/**
+ * @brief Record the size of a string arena
+ *
+ * @param stats Record to update (NULL-safe: does nothing)
+ * @param bytes Bytes the arena has reserved
+ */
+void stats_note_arena(RunStats *stats, size_t bytes);
+
+/**
+ * @brief Add the timers and rules of another record
+ *
+ * Used for the private records of worker threads. Their time is added
+ * to the current round of stats, so round times of parallel passes are
+ * summed over workers.
+ *
+ * @param stats Record to update
+ * @param other Record to add (NULL-safe: does nothing)
+ */
+void stats_merge(RunStats *stats, const RunStats *other);
+
+/**
+ * @brief Peak resident set size of the process
+ * @return Peak RSS in kilobytes, or 0 if the platform cannot report it
+ */
+long stats_peak_rss_kb(void);
+
+/**
+ * @brief Print the timing table, throughput and peak RSS
+ *
+ * Prints JSON instead when stats->json is set.
+ *
+ * @param stats Record to print
+ * @param fp Output stream
+ */
+void print_run_stats(const RunStats *stats, FILE *fp);
+
+#endif // STATS_H
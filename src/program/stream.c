@@ -0,0 +1,192 @@
+/**
+ * @file stream.c
+ * @brief Streaming bounded-memory optimization implementation
+ *
+ * Lines are appended to the current window until it is large enough and
+ * a boundary line arrives; that line is taken back out and starts the
+ * next window. Each finished window is optimized, written, flushed and
+ * freed before reading on.
+ */
+
+#include "stream.h"
+#include "program.h"
+#include "stats.h"
+#include "../optimizations/optimizer.h"
+#include "../output/output.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/**
+ * @brief Read one line of any length
+ *
+ * @param in Input stream
+ * @param buf Line buffer (grown as needed, caller frees)
+ * @param cap Allocated size of buf
+ * @return false at end of input or on allocation failure
+ */
+static bool read_line(FILE *in, char **buf, size_t *cap) {
+    size_t len = 0;
+
+    for (;;) {
+        if (*cap - len < 2) {
+            size_t grown = *cap ? *cap * 2 : 256;
+            char *bigger = realloc(*buf, grown);
+            if (!bigger) return false;
+            *buf = bigger;
+            *cap = grown;
+        }
+
+        size_t room = *cap - len;
+        if (room > INT_MAX) room = INT_MAX;
+        if (!fgets(*buf + len, (int)room, in)) break;
+        len += strlen(*buf + len);
+        if (len > 0 && (*buf)[len - 1] == '\n') break;
+    }
+    if (len == 0) return false;
+
+    (*buf)[strcspn(*buf, "\r\n")] = '\0';
+    return true;
+}
+
+/**
+ * @brief Check whether a node starts a new segment
+ *
+ * @param node Node to check
+ * @return true for .segment/.org directives and '*=' assignments
+ */
+static bool starts_segment(const AstNode *node) {
+    if (node->label && node->label[0] == '*') return true;
+    if (!node->opcode || node->op != OP_NONE) return false;
+
+    const char *name = node->opcode[0] == '.' ? node->opcode + 1 : node->opcode;
+    return strcasecmp(name, "segment") == 0 || strcasecmp(name, "org") == 0 ||
+           strcmp(name, "*=") == 0;
+}
+
+/**
+ * @brief Create an empty window with the settings of the run
+ *
+ * @param settings Program holding the settings
+ * @return New program
+ */
+static Program* create_window(const Program *settings) {
+    Program *win = create_program(settings->mode, settings->config.type);
+    win->cpu_type = settings->cpu_type;
+    win->allow_65c02 = settings->allow_65c02;
+    win->allow_undocumented = settings->allow_undocumented;
+    win->is_45gs02 = settings->is_45gs02;
+    win->trace_level = settings->trace_level;
+    win->validate = settings->validate;
+    win->opt_enabled = settings->opt_enabled;
+    win->stats = settings->stats;
+    win->jobs = settings->jobs;
+    win->unroll_budget = settings->unroll_budget;
+    win->dma_jobs = settings->dma_jobs;
+    win->superopt = settings->superopt;
+    win->rules = settings->rules;
+    win->log = settings->log;
+    win->source_scope = SOURCE_WINDOW;
+    return win;
+}
+
+/**
+ * @brief Optimize, write and free one window
+ *
+ * @param settings Program holding the settings and running totals
+ * @param win Window to finish (freed)
+ * @param fragment The window starts or ends inside a label scope
+ * @param out Output writer (flushed after the window)
+ * @param result Run totals to update
+ */
+static void finish_window(Program *settings, Program *win, bool fragment, OutBuf *out,
+                          StreamResult *result) {
+    if (fragment) win->source_scope = SOURCE_FRAGMENT;
+
+    CostSummary *before = measure_program_cost(win);
+    optimize_program_ast(win);
+    CostSummary *after = measure_program_cost(win);
+    if (before && after) {
+        result->before.cycles += before->total.cycles;
+        result->before.bytes += before->total.bytes;
+        result->after.cycles += after->total.cycles;
+        result->after.bytes += after->total.bytes;
+    }
+    free_cost_summary(before);
+    free_cost_summary(after);
+
+    double t = stats_now();
+    write_output_body(win, out);
+    outbuf_flush(out);
+    stats_add_time(settings->stats, "output", t);
+
+    for (int i = 0; i < win->count; i++) {
+        if (node_is_dead(win, i)) result->removed++;
+    }
+    result->windows++;
+    settings->optimizations += win->optimizations;
+    settings->opt_enabled = win->opt_enabled;
+
+    win->stats = NULL;  // Owned by the caller
+    free_program_ast(win);
+}
+
+/**
+ * @brief Optimize a stream one window at a time
+ *
+ * @param settings Empty program holding the settings
+ * @param in Input stream
+ * @param out Output writer
+ * @param window_lines Minimum lines per window
+ * @param result Where to store the run totals
+ * @return false on a read or allocation failure
+ */
+bool optimize_stream(Program *settings, FILE *in, OutBuf *out, int window_lines,
+                     StreamResult *result) {
+    memset(result, 0, sizeof(*result));
+
+    char *line = NULL;
+    size_t cap = 0;
+    bool fragment = false;
+    Program *win = create_window(settings);
+    double t = stats_now();
+
+    while (read_line(in, &line, &cap)) {
+        int line_num = (int)result->lines++;
+        add_line_ast(win, line, line_num);
+
+        int last = win->count - 1;
+        if (last >= window_lines &&
+            (is_routine_start(&win->nodes[last]) || starts_segment(&win->nodes[last]))) {
+            // Hand the boundary line to the next window
+            win->count--;
+            stats_add_time(settings->stats, "parse", t);
+            finish_window(settings, win, fragment, out, result);
+            win = create_window(settings);
+            fragment = false;
+            t = stats_now();
+            add_line_ast(win, line, line_num);
+        } else if (win->count >= window_lines + STREAM_LOOKAHEAD_LINES) {
+            // No boundary within the lookahead: cut inside the scope
+            stats_add_time(settings->stats, "parse", t);
+            finish_window(settings, win, true, out, result);
+            win = create_window(settings);
+            fragment = true;
+            t = stats_now();
+        }
+    }
+    stats_add_time(settings->stats, "parse", t);
+
+    bool ok = !ferror(in);
+    if (!ok) fprintf(stderr, "Error: Failed reading input\n");
+    if (result->windows == 0) win->source_scope = SOURCE_WHOLE;  // Never cut
+    if (win->count > 0) {
+        finish_window(settings, win, fragment, out, result);
+    } else {
+        free_program_ast(win);
+    }
+
+    free(line);
+    return ok;
+}
@@ -0,0 +1,59 @@
+/**
+ * @file stream.h
+ * @brief Streaming bounded-memory optimization (-stream)
+ *
+ * Reads the input line by line and optimizes it one window at a time,
+ * writing each window as soon as it is done. A window closes before the
+ * first routine label or segment directive (.segment, .org, *=) after
+ * it holds a minimum number of lines. If no such boundary shows up
+ * within a fixed lookahead, the window is cut where it stands. Memory
+ * use therefore depends on the window size, not on the input size, and
+ * output starts before the input ends, so opt6502 can sit in a pipe.
+ *
+ * Windows are optimized as if code in other windows could jump to their
+ * global labels (or to any label, for windows cut inside a scope), so no
+ * rewrite depends on code outside the window.
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "../types.h"
+#include "../analysis/cost.h"
+#include "../output/outbuf.h"
+#include <stdio.h>
+
+#define STREAM_WINDOW_LINES 4096     /**< Default minimum lines per window */
+#define STREAM_LOOKAHEAD_LINES 4096  /**< Extra lines read while looking for a boundary */
+
+/**
+ * @brief Totals of a streamed run
+ */
+typedef struct {
+    long lines;                 /**< Input lines read */
+    long removed;               /**< Lines removed by optimization */
+    int windows;                /**< Windows optimized */
+    CostTotal before;           /**< Estimated cost of the input */
+    CostTotal after;            /**< Estimated cost of the output */
+} StreamResult;
+
+/**
+ * @brief Optimize a stream one window at a time
+ *
+ * Every window is a fresh program with the settings (mode, assembler,
+ * CPU, tracing, statistics) of the given program. Optimizer directives
+ * (#NOOPT/#OPT) carry over from one window to the next. Only the body of
+ * each window is written; the caller writes the header and footer.
+ *
+ * @param settings Empty program holding the settings; its optimization
+ *                 count is increased by every window
+ * @param in Input stream
+ * @param out Output writer, flushed after every window
+ * @param window_lines Minimum lines per window
+ * @param result Where to store the run totals
+ * @return false on a read or allocation failure
+ */
+bool optimize_stream(Program *settings, FILE *in, OutBuf *out, int window_lines,
+                     StreamResult *result);
+
+#endif // STREAM_H
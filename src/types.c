@@ -24,16 +24,16 @@
  */
 AsmConfig get_asm_config(AsmType type) {
     AsmConfig configs[] = {
-        {ASM_GENERIC, "Generic", ";", true, false, "@", false},
-        {ASM_CA65, "ca65", ";", true, false, "@", false},
-        {ASM_KICK, "Kick Assembler", "//", true, true, "!", true},
-        {ASM_ACME, "ACME", ";", true, false, ".", false},
-        {ASM_DASM, "DASM", ";", true, false, ".", true},
-        {ASM_TASS, "Turbo Assembler", ";", true, false, "@", false},
-        {ASM_64TASS, "64tass", ";", true, true, "", false},
-        {ASM_BUDDY, "Buddy Assembler", "//", true, false, "@", false},
-        {ASM_MERLIN, "Merlin", ";", false, false, ":", false},
-        {ASM_LISA, "LISA", ";", true, false, ".", false}
+        {ASM_GENERIC, "Generic", ";", true, false, "@", false, ".byte", ".word"},
+        {ASM_CA65, "ca65", ";", true, false, "@", false, ".byte", ".word"},
+        {ASM_KICK, "Kick Assembler", "//", true, true, "!", true, ".byte", ".word"},
+        {ASM_ACME, "ACME", ";", true, false, ".", false, "!byte", "!word"},
+        {ASM_DASM, "DASM", ";", true, false, ".", true, ".byte", ".word"},
+        {ASM_TASS, "Turbo Assembler", ";", true, false, "@", false, ".byte", ".word"},
+        {ASM_64TASS, "64tass", ";", true, true, "", false, ".byte", ".word"},
+        {ASM_BUDDY, "Buddy Assembler", "//", true, false, "@", false, ".byte", ".word"},
+        {ASM_MERLIN, "Merlin", ";", false, false, ":", false, "DFB", "DA"},
+        {ASM_LISA, "LISA", ";", true, false, ".", false, "BYT", "ADR"}
     };
 
     size_t config_count = sizeof(configs) / sizeof(AsmConfig);
@@ -69,6 +69,24 @@ AsmType parse_asm_type(const char *type_str) {
     return ASM_GENERIC;
 }
 
+/**
+ * @brief Parse CPU type from string name
+ *
+ * Case-insensitive, like parse_asm_type().
+ *
+ * @param type_str String name of CPU (6502, 65c02, 65816 or 45gs02)
+ * @param cpu Where to store the CPU type
+ * @return false if the name is unknown (cpu is unchanged)
+ */
+bool parse_cpu_type(const char *type_str, CpuType *cpu) {
+    if (strcasecmp(type_str, "6502") == 0) *cpu = CPU_6502;
+    else if (strcasecmp(type_str, "65c02") == 0) *cpu = CPU_65C02;
+    else if (strcasecmp(type_str, "65816") == 0) *cpu = CPU_65816;
+    else if (strcasecmp(type_str, "45gs02") == 0) *cpu = CPU_45GS02;
+    else return false;
+    return true;
+}
+
 /**
  * @brief Check if string position starts a comment
  *
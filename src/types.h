@@ -10,12 +10,17 @@
 #define TYPES_H
 
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "ast/arena.h"
+#include "ast/opcodes.h"
+
+#define OPT6502_VERSION "1.0"   /**< Optimizer version */
 
 /* Configuration constants */
-#define MAX_LINE 256      /**< Maximum length of an assembly line */
-#define MAX_LINES 10000   /**< Maximum number of lines in a program */
 #define MAX_LABELS 1000   /**< Maximum number of labels */
 #define MAX_REFS 100      /**< Maximum number of references */
+#define UNROLL_DEFAULT_BUDGET 64  /**< Default bytes loop unrolling may add per loop */
 
 /**
  * @brief Optimization mode selection
@@ -74,6 +79,8 @@ typedef enum {
  *
  * Tracks the known state of CPU registers and flags during optimization.
  * Used for constant propagation and detecting redundant operations.
+ * On the 65816 the widths of the registers are tracked through REP and
+ * SEP too; values are only computed while a register is 8 bits wide.
  */
 typedef struct {
     /* Register value tracking */
@@ -92,6 +99,11 @@ typedef struct {
     char y_value[32];   /**< Known Y register value string */
     char z_value[32];   /**< Known Z register value string (45GS02 only) */
 
+    short a_num;        /**< Known accumulator value as a byte (-1 if symbolic) */
+    short x_num;        /**< Known X register value as a byte (-1 if symbolic) */
+    short y_num;        /**< Known Y register value as a byte (-1 if symbolic) */
+    short z_num;        /**< Known Z register value as a byte (-1 if symbolic) */
+
     /* Modification tracking */
     bool a_modified;    /**< Whether accumulator was modified in current scope */
     bool x_modified;    /**< Whether X register was modified in current scope */
@@ -108,30 +120,41 @@ typedef struct {
     bool n_set;         /**< Negative flag value (if known) */
     bool z_flag_set;    /**< Zero flag value (if known) */
     bool v_set;         /**< Overflow flag value (if known) */
+
+    char nz_source;     /**< Register ('A', 'X', 'Y', 'Z') that N and Z currently
+                             reflect, or 0 if they came from something else */
+
+    /* 65816 register widths (M and X flags) */
+    bool wide_capable;  /**< Registers may be 16 bits wide (65816 target) */
+    unsigned char m_width; /**< Accumulator width in bits (8 or 16), 0 if unknown */
+    unsigned char x_width; /**< X and Y width in bits (8 or 16), 0 if unknown */
 } RegisterState;
 
 /**
  * @brief Abstract Syntax Tree node for assembly code
  *
- * Represents a single line or element of assembly code. Nodes are linked
- * together to form the complete program AST.
+ * Represents a single line or element of assembly code. Nodes are stored
+ * by value in the program's contiguous node array, so a node's index is
+ * stable for the lifetime of the program and neighbouring lines are
+ * simply index offsets.
  */
 typedef struct AstNode {
     NodeType type;              /**< Type of AST node */
     int line_num;               /**< Original line number in source */
+    int index;                  /**< Position of this node in Program::nodes */
     char* label;                /**< Label text (if present) */
-    char* opcode;               /**< Instruction opcode */
+    const char* opcode;         /**< Instruction opcode text as written */
+    Opcode op;                  /**< Interned opcode (OP_NONE for directives) */
+    AddrMode mode;              /**< Addressing mode of the operand */
     char* operand;              /**< Instruction operand */
     char* comment;              /**< Line comment (if present) */
-    struct AstNode* next;       /**< Next node in sequence */
-    struct AstNode* child;      /**< First child node */
-    struct AstNode* sibling;    /**< Next sibling node */
-    bool is_dead;               /**< Marked for removal (dead code) */
     bool no_optimize;           /**< Optimization disabled for this line */
     bool is_local_label;        /**< Label is local scope */
     bool is_branch_target;      /**< Label can be jumped/branched to */
     int optimization_count;     /**< Number of optimizations applied */
-    RegisterState reg_state;    /**< Register state at this node */
+    const char* source;         /**< Original line text (not NUL-terminated, no newline) */
+    int source_len;             /**< Length of source in bytes */
+    bool rewritten;             /**< Changed by a pass; output rebuilds the line */
 } AstNode;
 
 /**
@@ -147,18 +170,60 @@ typedef struct {
     bool case_sensitive;            /**< Whether opcodes are case-sensitive */
     const char *local_label_prefix; /**< Prefix for local labels (@ ! . :) */
     bool local_labels_numeric;      /**< Supports numeric local labels (1, 2, 3...) */
+    const char *byte_directive;     /**< Directive emitting bytes (e.g., ".byte") */
+    const char *word_directive;     /**< Directive emitting little-endian words (e.g., ".word") */
 } AsmConfig;
 
+/**
+ * @brief How much of the source a program holds
+ *
+ * Decides which labels the control flow graph must treat as entry
+ * points reachable from code it cannot see.
+ */
+typedef enum {
+    SOURCE_WHOLE,       /**< Whole file: labels referenced in it are only entered from it */
+    SOURCE_WINDOW,      /**< Streaming window cut at global labels: any global label
+                             may be entered from another window */
+    SOURCE_FRAGMENT     /**< Streaming window cut inside a label scope: any label
+                             may be entered from another window */
+} SourceScope;
+
+struct Cfg;
+struct RunStats;
+struct SourceBuffer;
+struct SuperoptMemo;
+struct Profile;
+
 /**
  * @brief Complete program state and configuration
  *
  * Contains the AST, optimization settings, and all state needed for
  * parsing, optimizing, and outputting assembly code.
+ *
+ * The AST is a flat array of nodes in source order. Dead-marking is kept
+ * in a separate bitset (see node_is_dead()/mark_node_dead()) so passes
+ * that only test liveness touch one bit per line.
  */
 typedef struct {
-    AstNode *root;              /**< Root of the AST */
-    AstNode *current_node;      /**< Current node during parsing */
-    int count;                  /**< Total line count */
+    AstNode *nodes;             /**< Contiguous node array in source order */
+    int count;                  /**< Total line count (nodes in use) */
+    int capacity;               /**< Allocated entries in nodes */
+    uint64_t *dead;             /**< Dead-code bitset, one bit per node */
+    Arena *arena;               /**< Owns the strings referenced by nodes */
+    struct SourceBuffer *source;/**< Input file that node source slices point into
+                                     (NULL for programs built line by line) */
+    SourceScope source_scope;   /**< Whole file or one streaming window */
+    unsigned char *dirty;       /**< Per-node change marks while the pass scheduler
+                                     runs (NULL otherwise) */
+    int dirty_lo;               /**< Lowest index marked in dirty */
+    int dirty_hi;               /**< Highest index marked in dirty (-1 if none) */
+    struct Cfg *cfg;            /**< Control flow graph (NULL until analyzed) */
+    RegisterState *reg_states;  /**< Per-node register state side table, indexed by
+                                     AstNode::index (NULL until requested) */
+    int reg_state_count;        /**< Number of entries in reg_states */
+    int *input_index;           /**< Input position of every node (-1 for nodes inlining
+                                     or unrolling inserted), NULL while nodes are in
+                                     input order */
     OptMode mode;               /**< Optimization mode (speed/size) */
     int optimizations;          /**< Number of optimizations applied */
     bool opt_enabled;           /**< Whether optimizations are currently enabled */
@@ -168,6 +233,22 @@ typedef struct {
     bool allow_undocumented;    /**< Allow undocumented opcodes */
     bool is_45gs02;             /**< Special 45GS02 mode (STZ stores Z register) */
     int trace_level;            /**< Optimization trace level (0=off, 1=basic, 2=verbose) */
+    bool validate;              /**< Print the register tracking report (-validate) */
+    struct RunStats *stats;     /**< Phase timings (NULL unless -stats) */
+    int jobs;                   /**< Worker threads for routine optimization (-j) */
+    int unroll_budget;          /**< Bytes loop unrolling may add per loop in speed
+                                     mode (-unroll-budget, 0 disables unrolling) */
+    const unsigned char *zp_free;/**< 256 flags marking the zero page bytes declared
+                                     free (-zp-free), NULL disables zero page promotion */
+    bool dma_jobs;              /**< Replace block copies and fills with DMA jobs in
+                                     45GS02 speed mode (-dma) */
+    struct SuperoptMemo *superopt;/**< Superoptimizer memo (-superopt), NULL disables
+                                     the superoptimizer */
+    struct Profile *profile;    /**< Execution counts (-profile) choosing speed or size
+                                     per block, NULL for none; freed with the program */
+    const struct RuleSet *rules;/**< Peephole rules (-rules), NULL for the built-in set */
+    FILE *log;                  /**< Progress and trace messages (stdout by default,
+                                     NULL silences them) */
 } Program;
 
 /* Assembler configuration functions */
@@ -186,6 +267,14 @@ AsmConfig get_asm_config(AsmType type);
  */
 AsmType parse_asm_type(const char *type_str);
 
+/**
+ * @brief Parse CPU type from string name
+ * @param type_str String name of CPU (6502, 65c02, 65816 or 45gs02)
+ * @param cpu Where to store the CPU type
+ * @return false if the name is unknown (cpu is unchanged)
+ */
+bool parse_cpu_type(const char *type_str, CpuType *cpu);
+
 /**
  * @brief Check if string position starts a comment
  * @param p Pointer to string position to check
@@ -0,0 +1,19 @@
+; Optimized for speed
+; Assembler: Generic
+; Target CPU: 45GS02
+; Total optimizations: 1
+
+; Negating twice must not assemble as NEG NEG, the 32-bit prefix
+Negate:
+    LDA value
+    NEG
+    EOR #$FF
+    SEC
+    ADC #$00
+    STA $20
+    NEG
+    EOR #$FF
+    SEC
+    ADC #$00
+    STA $21
+    RTS
@@ -0,0 +1,18 @@
+; Optimized for speed
+; Assembler: Generic
+; Target CPU: 45GS02
+; Total optimizations: 3
+
+; 32-bit copies and additions through the Q register
+AddScore:
+    LDQ score
+    STQ backup
+    CLC
+    LDQ score
+    ADCQ bonus
+    STQ score
+    LDA #$00
+    LDX #$00
+    LDY #$00
+    LDZ #$00
+    RTS
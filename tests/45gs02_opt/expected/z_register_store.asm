@@ -1,10 +1,10 @@
 ; Optimized for speed
 ; Assembler: Generic
 ; Target CPU: 45GS02
-; Total optimizations: 4
+; Total optimizations: 2
 
 FillScreen:
-    LDZ #$20
-    STZ $0400
-    STZ $0401
-    STZ $0402
+    LDA #$20
+    STA $0400
+    STA $0401
+    STA $0402
@@ -0,0 +1,16 @@
+; Negating twice must not assemble as NEG NEG, the 32-bit prefix
+Negate:
+    LDA value
+    EOR #$FF
+    SEC
+    ADC #$00
+    EOR #$FF
+    SEC
+    ADC #$00
+    STA $20
+    NEG
+    EOR #$FF
+    SEC
+    ADC #$00
+    STA $21
+    RTS
@@ -0,0 +1,28 @@
+; 32-bit copies and additions through the Q register
+AddScore:
+    LDA score
+    LDX score+1
+    LDY score+2
+    LDZ score+3
+    STA backup
+    STX backup+1
+    STY backup+2
+    STZ backup+3
+    CLC
+    LDA score
+    ADC bonus
+    STA score
+    LDA score+1
+    ADC bonus+1
+    STA score+1
+    LDA score+2
+    ADC bonus+2
+    STA score+2
+    LDA score+3
+    ADC bonus+3
+    STA score+3
+    LDA #$00
+    LDX #$00
+    LDY #$00
+    LDZ #$00
+    RTS
@@ -0,0 +1,25 @@
+; Optimized for speed
+; Assembler: Generic
+; Target CPU: 6502
+; Total optimizations: 5
+
+; Leaf helpers called with JSR are inlined; JSR/RTS becomes JMP
+Frame:
+    LDA #$01
+    STA $D020
+    STA $D021
+    LDA #$02
+    STA $D020
+    STA $D021
+
+; Small helper with two callers: removed once inlined
+
+; Loop: not a leaf body, so it stays a subroutine
+Scroll:
+    LDX width
+@shift:
+    LDA $0401,X
+    STA $0400,X
+    DEX
+    BPL @shift
+    RTS
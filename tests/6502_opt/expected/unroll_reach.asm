@@ -0,0 +1,59 @@
+; Optimized for speed
+; Assembler: Generic
+; Target CPU: 6502
+; Total optimizations: 1
+
+; Unrolling may not push a branch across the loop out of range: the
+; BEQ skips about 100 bytes, so the 41 bytes of a full unroll do not fit
+; and the loop is unrolled by a factor of 4 instead
+Main:
+    LDA $FB
+    BEQ done
+    LDA #$20
+    LDX #$08
+@fill:
+    STA $0400,X
+    STA $0500,X
+    DEX
+    STA $0400,X
+    STA $0500,X
+    DEX
+    STA $0400,X
+    STA $0500,X
+    DEX
+    STA $0400,X
+    STA $0500,X
+    DEX
+    BNE @fill
+    STA $D000
+    STA $D001
+    STA $D002
+    STA $D003
+    STA $D004
+    STA $D005
+    STA $D006
+    STA $D007
+    STA $D008
+    STA $D009
+    STA $D00A
+    STA $D00B
+    STA $D00C
+    STA $D00D
+    STA $D00E
+    STA $D00F
+    STA $D010
+    STA $D011
+    STA $D012
+    STA $D013
+    STA $D014
+    STA $D015
+    STA $D016
+    STA $D017
+    STA $D018
+    STA $D019
+    STA $D01A
+    STA $D01B
+    STA $D01C
+    STA $D01D
+done:
+    RTS
@@ -0,0 +1,24 @@
+; Leaf helpers called with JSR are inlined; JSR/RTS becomes JMP
+Frame:
+    LDA #$01
+    JSR SetBorder
+    LDA #$02
+    JSR SetBorder
+    JSR Scroll
+    RTS
+
+; Small helper with two callers: removed once inlined
+SetBorder:
+    STA $D020
+    STA $D021
+    RTS
+
+; Loop: not a leaf body, so it stays a subroutine
+Scroll:
+    LDX width
+@shift:
+    LDA $0401,X
+    STA $0400,X
+    DEX
+    BPL @shift
+    RTS
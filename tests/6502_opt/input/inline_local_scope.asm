@@ -0,0 +1,15 @@
+; Foo's @tbl means another table inside Main: Foo stays a subroutine
+Main:
+    JSR Foo
+    LDA @tbl
+    STA $D021
+    RTS
+@tbl:
+    .byte 7
+
+Foo:
+    LDA @tbl
+    STA $D020
+    RTS
+@tbl:
+    .byte 1
@@ -0,0 +1,55 @@
+; The body of Flash is 5 bytes longer than its JSR, which would put the
+; BEQ over the call out of range, so the call and the routine stay
+Main:
+    LDA $FB
+    BEQ done
+    JSR Flash
+    STA $C000
+    STA $C003
+    STA $C006
+    STA $C009
+    STA $C00C
+    STA $C00F
+    STA $C012
+    STA $C015
+    STA $C018
+    STA $C01B
+    STA $C01E
+    STA $C021
+    STA $C024
+    STA $C027
+    STA $C02A
+    STA $C02D
+    STA $C030
+    STA $C033
+    STA $C036
+    STA $C039
+    STA $C03C
+    STA $C03F
+    STA $C042
+    STA $C045
+    STA $C048
+    STA $C04B
+    STA $C04E
+    STA $C051
+    STA $C054
+    STA $C057
+    STA $C05A
+    STA $C05D
+    STA $C060
+    STA $C063
+    STA $C066
+    STA $C069
+    STA $C06C
+    STA $C06F
+    STA $C072
+    STA $C075
+    STA $C078
+done:
+    RTS
+
+Flash:
+    LDA #$01
+    STA $D020
+    STA $D021
+    RTS
@@ -0,0 +1,40 @@
+; Branch-aware layout: threading, inversion and fall-through ordering
+
+; The BEQ lands on a JMP: it is threaded to the final target
+Poll:
+    LDA $DC01
+    CMP #$EF
+    BEQ @fire
+    AND #$10
+    BNE Poll
+    RTS
+@fire:
+    JMP Fire
+
+; A branch over a JMP becomes the opposite branch
+Check:
+    LDA $D012
+    CMP #$80
+    BCC @low
+    JMP Fire
+@low:
+    STA $D020
+    RTS
+
+; A block entered by one JMP moves up to fall through
+Step:
+    LDA $FB
+    BMI @negative
+    INC $FB
+    JMP @done
+@negative:
+    DEC $FB
+    RTS
+@done:
+    LDA #$00
+    STA $D021
+    RTS
+
+Fire:
+    INC $D020
+    RTS
@@ -0,0 +1,15 @@
+Fill:
+    LDX #$00
+    LDA #$20
+    CLC
+@loop:
+    STA $0400,X
+    LDA #$20        ; Redundant, A survives the back-edge
+    CLC             ; Redundant, carry still clear
+    STA $0500,X
+    INX
+    BNE @loop
+    LDA #$20        ; Redundant after the loop
+    STA $D020
+    LDY #$01
+    RTS
@@ -0,0 +1,56 @@
+; Counted loops are unrolled in speed mode within the byte budget
+
+; Fully unrolled: the index folds into the operands
+CopyName:
+    LDX #$07
+@copy:
+    LDA name,X
+    STA $0400,X
+    DEX
+    BPL @copy
+    RTS
+
+; Too large for the budget: unrolled by a factor of 4
+ClearScreen:
+    LDA #$20
+    LDX #$00
+@fill:
+    STA $0400,X
+    STA $0500,X
+    STA $0600,X
+    STA $0700,X
+    INX
+    BNE @fill
+    RTS
+
+; (zp),Y cannot fold: each copy keeps its DEY
+Flash:
+    LDY #$03
+@flash:
+    LDA ($FB),Y
+    STA $D020
+    DEY
+    BNE @flash
+    RTS
+
+; PHP reads the Z that DEX sets: each copy keeps its DEX
+SaveFlags:
+    LDX #$02
+@save:
+    PHP
+    PLA
+    STA $0700,X
+    LDA #$00
+    DEX
+    BNE @save
+    RTS
+
+; Delay loops keep their timing
+Delay:
+    LDX #$10
+@wait:
+    DEX
+    BNE @wait
+    RTS
+
+name: .byte "OPT6502!"
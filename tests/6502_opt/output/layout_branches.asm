@@ -0,0 +1,43 @@
+; Optimized for speed
+; Assembler: Generic
+; Target CPU: 6502
+; Total optimizations: 3
+
+; Branch-aware layout: threading, inversion and fall-through ordering
+
+; The BEQ lands on a JMP: it is threaded to the final target
+Poll:
+    LDA $DC01
+    CMP #$EF
+    BEQ Fire
+    AND #$10
+    BNE Poll
+    RTS
+@fire:
+    JMP Fire
+
+; A branch over a JMP becomes the opposite branch
+Check:
+    LDA $D012
+    CMP #$80
+    BCS Fire
+@low:
+    STA $D020
+    RTS
+
+; A block entered by one JMP moves up to fall through
+Step:
+    LDA $FB
+    BMI @negative
+    INC $FB
+@done:
+    LDA #$00
+    STA $D021
+    RTS
+@negative:
+    DEC $FB
+    RTS
+
+Fire:
+    INC $D020
+    RTS
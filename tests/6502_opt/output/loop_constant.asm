@@ -0,0 +1,26 @@
+; Optimized for speed
+; Assembler: Generic
+; Target CPU: 6502
+; Total optimizations: 10
+
+Fill:
+    LDX #$00
+    LDA #$20
+    CLC
+@loop:
+    STA $0400,X
+    STA $0500,X
+    INX
+    STA $0400,X
+    STA $0500,X
+    INX
+    STA $0400,X
+    STA $0500,X
+    INX
+    STA $0400,X
+    STA $0500,X
+    INX
+    BNE @loop
+    STA $D020
+    LDY #$01
+    RTS
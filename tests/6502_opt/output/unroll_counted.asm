@@ -0,0 +1,96 @@
+; Optimized for speed
+; Assembler: Generic
+; Target CPU: 6502
+; Total optimizations: 6
+
+; Counted loops are unrolled in speed mode within the byte budget
+
+; Fully unrolled: the index folds into the operands
+CopyName:
+@copy:
+    LDA name+7
+    STA $0407
+    LDA name+6
+    STA $0406
+    LDA name+5
+    STA $0405
+    LDA name+4
+    STA $0404
+    LDA name+3
+    STA $0403
+    LDA name+2
+    STA $0402
+    LDA name+1
+    STA $0401
+    LDA name
+    STA $0400
+    LDX #$FF
+    RTS
+
+; Too large for the budget: unrolled by a factor of 4
+ClearScreen:
+    LDA #$20
+    LDX #$00
+@fill:
+    STA $0400,X
+    STA $0500,X
+    STA $0600,X
+    STA $0700,X
+    INX
+    STA $0400,X
+    STA $0500,X
+    STA $0600,X
+    STA $0700,X
+    INX
+    STA $0400,X
+    STA $0500,X
+    STA $0600,X
+    STA $0700,X
+    INX
+    STA $0400,X
+    STA $0500,X
+    STA $0600,X
+    STA $0700,X
+    INX
+    BNE @fill
+    RTS
+
+; (zp),Y cannot fold: each copy keeps its DEY
+Flash:
+    LDY #$03
+@flash:
+    LDA ($FB),Y
+    STA $D020
+    DEY
+    LDA ($FB),Y
+    STA $D020
+    DEY
+    LDA ($FB),Y
+    STA $D020
+    DEY
+    RTS
+
+; PHP reads the Z that DEX sets: each copy keeps its DEX
+SaveFlags:
+    LDX #$02
+@save:
+    PHP
+    PLA
+    STA $0700,X
+    DEX
+    PHP
+    PLA
+    STA $0700,X
+    LDA #$00
+    DEX
+    RTS
+
+; Delay loops keep their timing
+Delay:
+    LDX #$10
+@wait:
+    DEX
+    BNE @wait
+    RTS
+
+name: .byte "OPT6502!"
@@ -0,0 +1,26 @@
+; Optimized for speed
+; Assembler: Generic
+; Target CPU: 65816
+; Total optimizations: 2
+
+; 65816: byte pair copies with 8-bit registers become 16-bit copies
+Main:
+    SEP #$30
+    REP #$10
+    LDX src
+    STX dst
+    LDX #handler
+    STX vec
+    SEP #$10
+    LDA #$05
+    STA count
+    LDX #$06
+    STX count+1
+    RTS
+
+src:    .byte $00, $00
+dst:    .byte $00, $00
+vec:    .byte $00, $00
+count:  .byte $00, $00
+handler:
+    RTS
@@ -0,0 +1,25 @@
+; 65816: byte pair copies with 8-bit registers become 16-bit copies
+Main:
+    SEP #$30
+    LDA src
+    STA dst
+    LDA src+1
+    STA dst+1
+    LDA #<handler
+    STA vec
+    LDA #>handler
+    STA vec+1
+    LDA #$05
+    REP #$20
+    SEP #$20
+    STA count
+    LDX #$06
+    STX count+1
+    RTS
+
+src:    .byte $00, $00
+dst:    .byte $00, $00
+vec:    .byte $00, $00
+count:  .byte $00, $00
+handler:
+    RTS
@@ -0,0 +1,10 @@
+; Optimized for speed
+; Assembler: Generic
+; Target CPU: 65C02
+; Total optimizations: 2
+
+Clear_Screen:
+    STZ $D020
+@unused:
+    STZ $D021
+    RTS
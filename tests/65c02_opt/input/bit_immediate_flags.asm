@@ -0,0 +1,9 @@
+; BIT #imm only sets Z on the 65C02: the CLV still feeds the BVC
+Test:
+    LDA $10
+    CLV
+    BIT #$01
+    BVC Skip
+    INC $20
+Skip:
+    RTS
@@ -0,0 +1,5 @@
+ClearColumn:
+    LDA #$00
+    STA $1000,Y
+    STA $1100,X
+    RTS
@@ -0,0 +1,6 @@
+Clear_Screen:
+    LDA #$00
+    STA $D020
+@unused:
+    STA $D021
+    RTS
@@ -0,0 +1,10 @@
+; Optimized for speed
+; Assembler: Generic
+; Target CPU: 65C02
+; Total optimizations: 0
+
+ClearColumn:
+    LDA #$00
+    STA $1000,Y
+    STA $1100,X
+    RTS
@@ -0,0 +1,197 @@
+#!/usr/bin/env python3
+"""
+Benchmark runner for opt6502
+
+Generates synthetic corpora (see gen_corpus.py), runs the optimizer with
+-stats on each, and prints the time of every phase, throughput in
+lines/sec and peak RSS. Each run is appended to history.csv together
+with the current git commit, so timings can be compared across commits.
+
+A phase whose time per line grows by more than --max-growth between the
+smallest and the largest corpus is reported as superlinear; with
+--check the runner then exits non-zero. This catches a pattern that
+makes a pass quadratic long before it shows up on real sources.
+
+Usage:
+    python3 bench.py [--sizes 1000,10000,100000] [--full] [--check]
+                     [--max-growth 4.0] [--no-history]
+
+    By default runs every CPU with the generic dialect and every dialect
+    on the 6502. --full runs the complete dialect x CPU matrix.
+"""
+
+import argparse
+import csv
+import datetime
+import re
+import subprocess
+import sys
+from pathlib import Path
+
+from gen_corpus import CPUS, DIALECTS, generate
+
+BENCH_DIR = Path(__file__).parent.resolve()
+ROOT_DIR = BENCH_DIR.parent.parent
+OPT6502 = ROOT_DIR / 'opt6502'
+CORPUS_DIR = BENCH_DIR / 'corpus'
+HISTORY = BENCH_DIR / 'history.csv'
+
+STAT_ROW = re.compile(r'^(\S+)\s+([\d.]+)\s+(\d+)?\s*([\d.]+)$')
+
+
+def git_commit():
+    """Short hash of HEAD, with a + suffix for a dirty tree"""
+    try:
+        commit = subprocess.run(['git', 'rev-parse', '--short', 'HEAD'], cwd=ROOT_DIR,
+                                capture_output=True, text=True).stdout.strip()
+        dirty = subprocess.run(['git', 'diff', '--quiet', '--', 'src'], cwd=ROOT_DIR).returncode
+        return commit + ('+' if dirty else '') if commit else 'unknown'
+    except OSError:
+        return 'unknown'
+
+
+def corpus(lines, dialect, cpu):
+    """Path of a generated corpus, creating it on first use"""
+    CORPUS_DIR.mkdir(exist_ok=True)
+    path = CORPUS_DIR / f'{dialect}_{cpu}_{lines}.asm'
+    if not path.exists():
+        path.write_text(generate(lines, dialect, cpu, 6502))
+    return path
+
+
+def run_one(lines, dialect, cpu, stream=False):
+    """Optimize one corpus and parse the -stats table"""
+    source = corpus(lines, dialect, cpu)
+    output = CORPUS_DIR / f'{source.stem}_opt.asm'
+    result = subprocess.run(
+        [str(OPT6502), '-speed', '-asm', dialect, '-cpu', cpu, '-stats'] +
+        (['-stream'] if stream else []) + [str(source), str(output)],
+        capture_output=True, text=True
+    )
+    if result.returncode != 0:
+        print(f"✗ {source.name}: opt6502 exited with {result.returncode}")
+        return None
+
+    phases = {}
+    rss = 0
+    in_stats = False
+    for line in result.stdout.splitlines():
+        if line.startswith('=== Statistics ==='):
+            in_stats = True
+            continue
+        if not in_stats:
+            continue
+        if line.startswith('Peak RSS:'):
+            rss = int(line.split()[2])
+            continue
+        match = STAT_ROW.match(line)
+        if match:
+            phases[match.group(1)] = float(match.group(2))
+
+    if stream:
+        dialect += '+stream'
+    return {'lines': lines, 'dialect': dialect, 'cpu': cpu, 'phases': phases, 'rss_kb': rss}
+
+
+def append_history(runs, commit):
+    """Append runs to history.csv, one row per run and phase"""
+    new_file = not HISTORY.exists()
+    stamp = datetime.datetime.now().isoformat(timespec='seconds')
+    with open(HISTORY, 'a', newline='') as f:
+        writer = csv.writer(f)
+        if new_file:
+            writer.writerow(['date', 'commit', 'dialect', 'cpu', 'lines', 'phase', 'ms',
+                             'lines_per_sec', 'peak_rss_kb'])
+        for run in runs:
+            for phase, ms in run['phases'].items():
+                rate = run['lines'] / (ms / 1000.0) if ms > 0 else 0
+                writer.writerow([stamp, commit, run['dialect'], run['cpu'], run['lines'],
+                                 phase, f'{ms:.3f}', f'{rate:.0f}', run['rss_kb']])
+
+
+def find_superlinear(runs, max_growth):
+    """Phases whose time per line grows too much with corpus size"""
+    problems = []
+    groups = {}
+    for run in runs:
+        groups.setdefault((run['dialect'], run['cpu']), []).append(run)
+
+    for (dialect, cpu), group in sorted(groups.items()):
+        group.sort(key=lambda r: r['lines'])
+        small, large = group[0], group[-1]
+        if large['lines'] < 10 * small['lines']:
+            continue
+        for phase, large_ms in large['phases'].items():
+            small_ms = small['phases'].get(phase, 0)
+            # Ignore phases too fast to time reliably on the small corpus
+            if small_ms < 0.05:
+                continue
+            growth = (large_ms / large['lines']) / (small_ms / small['lines'])
+            if growth > max_growth:
+                problems.append(
+                    f"{dialect}/{cpu} {phase}: {growth:.1f}x time per line "
+                    f"from {small['lines']} to {large['lines']} lines")
+    return problems
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('--sizes', default='1000,10000,100000',
+                        help='comma-separated corpus sizes in lines')
+    parser.add_argument('--full', action='store_true', help='run every dialect on every CPU')
+    parser.add_argument('--check', action='store_true', help='fail on superlinear phases')
+    parser.add_argument('--max-growth', type=float, default=4.0,
+                        help='allowed growth of time per line (default 4.0)')
+    parser.add_argument('--no-history', action='store_true', help='do not append to history.csv')
+    parser.add_argument('--stream', action='store_true',
+                        help='run opt6502 -stream (peak RSS should stay flat)')
+    args = parser.parse_args()
+
+    if not OPT6502.exists():
+        print(f"Error: opt6502 not found at {OPT6502} (run make first)")
+        return 1
+
+    sizes = [int(s) for s in args.sizes.split(',') if s]
+    if args.full:
+        matrix = [(d, c) for d in sorted(DIALECTS) for c in CPUS]
+    else:
+        matrix = [('generic', c) for c in CPUS] + \
+                 [(d, '6502') for d in sorted(DIALECTS) if d != 'generic']
+
+    print("=" * 70)
+    print(f"opt6502 Benchmark ({git_commit()})")
+    print("=" * 70)
+    print(f"{'corpus':<28} {'lines':>8} {'total ms':>10} {'lines/sec':>12} {'RSS KB':>8}")
+
+    runs = []
+    for dialect, cpu in matrix:
+        for lines in sizes:
+            run = run_one(lines, dialect, cpu, args.stream)
+            if not run:
+                return 1
+            runs.append(run)
+            total = run['phases'].get('total', 0)
+            rate = lines / (total / 1000.0) if total > 0 else 0
+            print(f"{run['dialect'] + '/' + cpu:<28} {lines:>8} {total:>10.2f} {rate:>12.0f} "
+                  f"{run['rss_kb']:>8}")
+
+    # Slowest phases of the largest run, where regressions show first
+    largest = max(runs, key=lambda r: r['lines'])
+    print()
+    print(f"Phases for {largest['dialect']}/{largest['cpu']} at {largest['lines']} lines:")
+    for phase, ms in sorted(largest['phases'].items(), key=lambda p: -p[1]):
+        if phase != 'total':
+            print(f"  {phase:<24} {ms:>10.2f} ms")
+
+    if not args.no_history:
+        append_history(runs, git_commit())
+        print(f"\nAppended {len(runs)} runs to {HISTORY.relative_to(ROOT_DIR)}")
+
+    problems = find_superlinear(runs, args.max_growth)
+    for problem in problems:
+        print(f"⚠ superlinear: {problem}")
+    return 1 if problems and args.check else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
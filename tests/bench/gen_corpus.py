@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+"""
+Synthetic corpus generator for opt6502 benchmarks
+
+Writes an assembly file of roughly the requested number of lines, built
+from routines that mix the patterns the optimizer looks for (redundant
+loads, store chains, compare-with-zero, jumps to the next line, loops,
+subroutine calls) with plain code it must leave alone. Output is
+deterministic for a given seed, dialect and CPU, so timings are
+comparable across commits.
+
+Usage:
+    python3 gen_corpus.py [--asm DIALECT] [--cpu CPU] [--seed N] LINES OUTPUT
+"""
+
+import argparse
+import random
+import sys
+
+# comment, local label prefix, colon after labels (mirrors get_asm_config())
+DIALECTS = {
+    'generic': (';', '@', True),
+    'ca65':    (';', '@', True),
+    'kick':    ('//', '!', True),
+    'acme':    (';', '.', True),
+    'dasm':    (';', '.', True),
+    'tass':    (';', '@', True),
+    '64tass':  (';', '_', True),
+    'buddy':   ('//', '@', True),
+    'merlin':  (';', ':', False),
+    'lisa':    (';', '.', True),
+}
+
+CPUS = ('6502', '65c02', '65816', '45gs02')
+
+
+class Writer:
+    """Collects lines in the syntax of one dialect"""
+
+    def __init__(self, dialect):
+        self.comment, self.local, self.colon = DIALECTS[dialect]
+        self.lines = []
+
+    def label(self, name):
+        self.lines.append(name + (':' if self.colon else ''))
+
+    def op(self, text, note=None):
+        line = '    ' + text
+        if note:
+            line += '        ' + self.comment + ' ' + note
+        self.lines.append(line)
+
+    def remark(self, text):
+        self.lines.append(self.comment + ' ' + text)
+
+    def blank(self):
+        self.lines.append('')
+
+
+def routine(w, rng, index, cpu, callees):
+    """Emit one routine built from randomly chosen fragments"""
+    name = f'Routine{index}'
+    loop = f'{w.local}loop{index}' if w.local else f'Loop{index}'
+    skip = f'{w.local}skip{index}' if w.local else f'Skip{index}'
+
+    w.remark(f'Routine {index}')
+    w.label(name)
+
+    for _ in range(rng.randint(2, 6)):
+        kind = rng.randrange(8)
+        addr = 0x0400 + rng.randrange(0x400)
+        value = rng.randrange(256)
+
+        if kind == 0:
+            w.op(f'LDA #${value:02X}')
+            w.op(f'STA ${addr:04X}')
+            w.op(f'LDA #${value:02X}', 'redundant')
+            w.op(f'STA ${addr + 1:04X}')
+        elif kind == 1:
+            w.op('LDA #$00')
+            w.op(f'STA ${addr:04X}')
+            w.op(f'STA ${addr + 1:04X}')
+        elif kind == 2:
+            w.op(f'LDX #${rng.randrange(1, 32):02X}')
+            w.label(loop)
+            w.op(f'LDA ${addr:04X},X')
+            w.op(f'STA ${addr + 0x100:04X},X')
+            w.op('DEX')
+            w.op(f'BNE {loop}')
+            loop += 'b'
+        elif kind == 3:
+            w.op(f'LDA ${rng.randrange(256):02X}')
+            w.op('CMP #$00', 'flags already set')
+            w.op(f'BEQ {skip}')
+            w.op(f'INC ${addr:04X}')
+            w.label(skip)
+            skip += 'b'
+        elif kind == 4:
+            w.op('CLC')
+            w.op(f'LDA ${addr:04X}')
+            w.op(f'ADC #${value:02X}')
+            w.op(f'STA ${addr:04X}')
+            w.op('CLC')
+        elif kind == 5 and callees:
+            w.op(f'JSR {rng.choice(callees)}')
+        elif kind == 6:
+            w.op('TAX')
+            w.op('TXA', 'round trip')
+            w.op(f'STA ${addr:04X}')
+        else:
+            if cpu == '45gs02':
+                w.op(f'LDZ #${value:02X}')
+                w.op(f'STZ ${addr:04X}')
+            elif cpu in ('65c02', '65816'):
+                w.op(f'STZ ${addr:04X}')
+            else:
+                w.op(f'LDY #${value:02X}')
+                w.op(f'STY ${addr:04X}')
+
+    w.op('RTS')
+    w.blank()
+    return name
+
+
+def generate(lines, dialect, cpu, seed):
+    """Generate a corpus of at least the requested number of lines"""
+    rng = random.Random(f'{seed}-{dialect}-{cpu}')
+    w = Writer(dialect)
+    w.remark(f'Synthetic benchmark corpus: {lines} lines, {dialect}, {cpu}')
+    w.blank()
+
+    callees = []
+    index = 0
+    while len(w.lines) < lines:
+        callees.append(routine(w, rng, index, cpu, callees[-8:]))
+        index += 1
+
+    return '\n'.join(w.lines[:max(lines, 1)]) + '\n'
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('lines', type=int, help='approximate number of lines')
+    parser.add_argument('output', help='file to write')
+    parser.add_argument('--asm', default='generic', choices=sorted(DIALECTS))
+    parser.add_argument('--cpu', default='6502', choices=CPUS)
+    parser.add_argument('--seed', type=int, default=6502)
+    args = parser.parse_args()
+
+    with open(args.output, 'w') as f:
+        f.write(generate(args.lines, args.asm, args.cpu, args.seed))
+
+
+if __name__ == '__main__':
+    sys.exit(main())
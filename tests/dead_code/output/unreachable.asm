@@ -1,10 +1,9 @@
 ; Optimized for speed
 ; Assembler: Generic
 ; Target CPU: 6502
-; Total optimizations: 20
+; Total optimizations: 3
 
 Start:
     LDA #$01
-    JMP End
 End:
     RTS
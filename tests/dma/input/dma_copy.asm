@@ -0,0 +1,48 @@
+; Block copies and fills replaced by DMA jobs (-dma)
+CopyCharset:
+    LDX #$00
+copy:
+    LDA charset,X
+    STA chars,X
+    INX
+    BNE copy
+    RTS
+
+ClearLine:
+    LDA #$20
+    LDX #$27
+clear:
+    STA $0400,X
+    DEX
+    BPL clear
+    RTS
+
+SetColors:
+    LDY palette
+    STY $C000
+    LDY palette+1
+    STY $C001
+    LDY palette+2
+    STY $C002
+    LDY palette+3
+    STY $C003
+    LDY palette+4
+    STY $C004
+    LDY palette+5
+    STY $C005
+    LDY palette+6
+    STY $C006
+    LDY palette+7
+    STY $C007
+    LDY palette+8
+    STY $C008
+    LDY palette+9
+    STY $C009
+    LDY palette+10
+    STY $C00A
+    LDY palette+11
+    STY $C00B
+    RTS
+
+Done:
+    RTS
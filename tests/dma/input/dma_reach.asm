@@ -0,0 +1,54 @@
+; The trigger is 12 bytes larger than the loop it replaces, which would
+; put the BEQ over it out of range, so no job replaces the loop (which
+; is still unrolled by 2, 7 bytes that do fit)
+Main:
+    LDA $FB
+    BEQ done
+    LDX #$00
+copy:
+    LDA charset,X
+    STA chars,X
+    INX
+    BNE copy
+    STA $C000
+    STA $C002
+    STA $C004
+    STA $C006
+    STA $C008
+    STA $C00A
+    STA $C00C
+    STA $C00E
+    STA $C010
+    STA $C012
+    STA $C014
+    STA $C016
+    STA $C018
+    STA $C01A
+    STA $C01C
+    STA $C01E
+    STA $C020
+    STA $C022
+    STA $C024
+    STA $C026
+    STA $C028
+    STA $C02A
+    STA $C02C
+    STA $C02E
+    STA $C030
+    STA $C032
+    STA $C034
+    STA $C036
+    STA $C038
+    STA $C03A
+    STA $C03C
+    STA $C03E
+    STA $C040
+    STA $C042
+    STA $C044
+    STA $C046
+done:
+    RTS
+
+chars = $2000
+charset:
+    .res 256
@@ -0,0 +1,61 @@
+; Optimized for speed
+; Assembler: Generic
+; Target CPU: 45GS02
+; Total optimizations: 6
+
+; Block copies and fills replaced by DMA jobs (-dma)
+CopyCharset:
+    LDA #$00	; DMA copy, 256 bytes
+    STA $D702
+    STA $D704
+    LDA #>dma_job_1
+    STA $D701
+    LDA #<dma_job_1
+    STA $D705
+    LDA charset+255
+    LDX #$00
+    RTS
+dma_job_1:	.byte $0B, $80, $00, $81, $00, $00, $00
+    .word $0100, charset
+    .byte $00
+    .word chars
+    .byte $00, $00
+    .word $0000
+
+ClearLine:
+    LDA #$00	; DMA fill, 40 bytes
+    STA $D702
+    STA $D704
+    LDA #>dma_job_2
+    STA $D701
+    LDA #<dma_job_2
+    STA $D705
+    LDA #$20
+    LDX #$FF
+    RTS
+dma_job_2:	.byte $0B, $80, $00, $81, $00, $00, $03
+    .word $0028, $20
+    .byte $00
+    .word $0400
+    .byte $00, $00
+    .word $0000
+
+SetColors:
+    LDY #$00	; DMA copy, 12 bytes
+    STY $D702
+    STY $D704
+    LDY #>dma_job_3
+    STY $D701
+    LDY #<dma_job_3
+    STY $D705
+    LDY palette+11
+    RTS
+dma_job_3:	.byte $0B, $80, $00, $81, $00, $00, $00
+    .word $000C, palette
+    .byte $00
+    .word $C000
+    .byte $00, $00
+    .word $0000
+
+Done:
+    RTS
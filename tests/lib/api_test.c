@@ -0,0 +1,89 @@
+/**
+ * @file api_test.c
+ * @brief libopt6502 API test
+ *
+ * Optimizes a golden-file input through the library and compares the
+ * result with the expected output of the command line tool. The input
+ * is run twice on one handle to check that handles can be reused.
+ *
+ * Usage: api_test <cpu> input.asm expected.asm
+ */
+
+#include "../../src/lib/opt6502.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Read a whole file
+ *
+ * @param path File to read
+ * @param len Where to store the length
+ * @return File contents (caller frees), or NULL on failure
+ */
+static char* read_file(const char *path, size_t *len) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return NULL;
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *data = size >= 0 ? malloc((size_t)size + 1) : NULL;
+    if (data && fread(data, 1, (size_t)size, fp) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+    if (data) *len = (size_t)size;
+    return data;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 4) {
+        fprintf(stderr, "Usage: %s <cpu> input.asm expected.asm\n", argv[0]);
+        return 2;
+    }
+
+    size_t input_len = 0;
+    size_t expected_len = 0;
+    char *input = read_file(argv[2], &input_len);
+    char *expected = read_file(argv[3], &expected_len);
+    if (!input || !expected) {
+        fprintf(stderr, "Error: Cannot read %s or %s\n", argv[2], argv[3]);
+        return 2;
+    }
+
+    Opt6502Options options;
+    opt6502_default_options(&options);
+    options.cpu = "z80";
+    if (opt6502_create(&options)) {
+        fprintf(stderr, "Error: Unknown CPU was accepted\n");
+        return 1;
+    }
+    options.cpu = argv[1];
+
+    Opt6502 *opt = opt6502_create(&options);
+    if (!opt) {
+        fprintf(stderr, "Error: Cannot create optimizer for %s\n", argv[1]);
+        return 1;
+    }
+
+    int status = 0;
+    for (int run = 0; run < 2 && status == 0; run++) {
+        size_t len = 0;
+        const char *output = opt6502_run(opt, input, input_len) ? opt6502_output(opt, &len) : NULL;
+        if (!output || len != expected_len || memcmp(output, expected, len) != 0) {
+            fprintf(stderr, "Error: Run %d of %s does not match %s\n", run + 1, argv[2], argv[3]);
+            status = 1;
+        }
+    }
+    if (status == 0 && opt6502_stats(opt)->lines <= 0) {
+        fprintf(stderr, "Error: No statistics for %s\n", argv[2]);
+        status = 1;
+    }
+
+    opt6502_destroy(opt);
+    free(input);
+    free(expected);
+    return status;
+}
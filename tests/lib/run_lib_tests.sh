@@ -0,0 +1,52 @@
+#!/bin/bash
+# Library API tests - the golden files optimized through libopt6502
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+cd "$SCRIPT_DIR/../.."
+
+make -s lib-test
+
+for cpu in 6502 65c02 45gs02 65816; do
+    testdir="tests/${cpu}_opt"
+    for testfile in "$testdir"/input/*.asm; do
+        [ -f "$testfile" ] || continue
+        testname=$(basename "$testfile" .asm)
+        if ./tests/lib/api_test "$cpu" "$testfile" "$testdir/expected/$testname.asm"; then
+            echo "✓ $testname (library, $cpu) passed"
+        else
+            echo "✗ $testname (library, $cpu) failed"
+            exit 1
+        fi
+    done
+done
+
+# Server protocol: every 6502 golden file in one session, then QUIT
+[ -f ./opt6502 ] || make -s
+request=$(mktemp)
+response=$(mktemp)
+for testfile in tests/6502_opt/input/*.asm; do
+    printf 'OPTIMIZE %d cpu=6502\n' "$(wc -c < "$testfile")" >> "$request"
+    cat "$testfile" >> "$request"
+done
+echo QUIT >> "$request"
+./opt6502 -server < "$request" > "$response"
+
+offset=0
+for testfile in tests/6502_opt/input/*.asm; do
+    testname=$(basename "$testfile" .asm)
+    expected="tests/6502_opt/expected/$testname.asm"
+    header=$(tail -c +$((offset + 1)) "$response" | head -n 1)
+    length=$(echo "$header" | cut -d' ' -f2)
+    offset=$((offset + ${#header} + 1))
+    if [ "${header%% *}" = "OK" ] &&
+       tail -c +$((offset + 1)) "$response" | head -c "$length" | cmp -s - "$expected"; then
+        echo "✓ $testname (server) passed"
+    else
+        echo "✗ $testname (server) failed: $header"
+        rm -f "$request" "$response"
+        exit 1
+    fi
+    offset=$((offset + length))
+done
+rm -f "$request" "$response"
@@ -0,0 +1,20 @@
+; Optimized for speed
+; Assembler: Generic
+; Target CPU: 6502
+; Total optimizations: 3
+
+AddBytes:
+    CLC
+    LDA $10
+    ADC $11
+    STA $12
+    LDX #$08
+    STX $13
+    LDX $14
+    INX
+    DEX             ; X is stored next, so the pair stays
+    STX $15
+@next:
+    DEX
+    BNE @next
+    RTS
@@ -0,0 +1,19 @@
+AddBytes:
+    CLC
+    CLC             ; Redundant
+    LDA $10
+    ADC $11
+    STA $12
+    LDX #$08
+    STX $13
+    LDX #$08        ; Redundant
+    INX
+    DEX             ; Cancels the INX, and X is reloaded next
+    LDX $14
+    INX
+    DEX             ; X is stored next, so the pair stays
+    STX $15
+@next:
+    DEX
+    BNE @next
+    RTS
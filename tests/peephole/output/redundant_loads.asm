@@ -1,13 +1,12 @@
 ; Optimized for speed
 ; Assembler: Generic
 ; Target CPU: 6502
-; Total optimizations: 20
+; Total optimizations: 2
 
 ClearScreen:
     LDA #$00
     STA $D020
     STA $D021
-    LDA #$00	; Redundant
     TAX
 @loop:
     STA $0400,X
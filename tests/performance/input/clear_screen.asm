@@ -0,0 +1,12 @@
+ClearScreen:
+    LDA #$20
+    LDX #$00
+@loop:
+    STA $0400,X
+    LDA #$20
+    STA $0500,X
+    LDA #$20
+    STA $0600,X
+    INX
+    BNE @loop
+    RTS
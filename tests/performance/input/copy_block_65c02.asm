@@ -0,0 +1,11 @@
+CopyBlock:
+    LDY #$00
+@copy:
+    LDA ($FB),Y
+    STA ($FD),Y
+    INY
+    BNE @copy
+    LDA #$00
+    STA $D020
+    STA $D021
+    RTS
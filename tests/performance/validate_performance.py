@@ -0,0 +1,206 @@
+#!/usr/bin/env python3
+"""
+Performance Validation Test Runner for opt6502
+
+Runs the optimizer with -report on every input in input/ and checks the
+static cycle and byte estimates of the cost model:
+
+  - Speed mode: loop-weighted cycles must not increase
+  - Size mode: code size must not increase
+  - Neither mode may increase both cycles AND size of any routine
+
+If metrics/<test>_baseline.txt exists, the optimized figures must also
+be no worse than the recorded baseline, so CI fails on regressions.
+
+Usage:
+    python3 validate_performance.py [--update] [test_name]
+
+    --update writes the current figures as the new baselines.
+    If test_name is provided, runs only that test.
+"""
+
+import json
+import subprocess
+import sys
+from pathlib import Path
+
+
+def cpu_for_test(test_name):
+    """Pick the target CPU from the test name, like run_tests.sh does"""
+    for cpu in ('45gs02', '65816', '65c02'):
+        if cpu in test_name:
+            return cpu
+    return '6502'
+
+
+def run_report(opt6502, input_asm, output_dir, mode, cpu):
+    """Optimize one file and return the parsed JSON report"""
+    output_asm = output_dir / f'{input_asm.stem}_{mode}.asm'
+    report_file = output_dir / f'{input_asm.stem}_{mode}.json'
+
+    result = subprocess.run(
+        [str(opt6502), f'-{mode}', '-cpu', cpu, '-report', str(report_file),
+         str(input_asm), str(output_asm)],
+        capture_output=True,
+        text=True
+    )
+    if result.returncode != 0 or not report_file.exists():
+        print(f"  opt6502 failed: {result.stderr.strip()}")
+        return None
+
+    with open(report_file) as f:
+        return json.load(f)
+
+
+def load_baseline(baseline_file):
+    """Load a key=value baseline file"""
+    baseline = {}
+    with open(baseline_file) as f:
+        for line in f:
+            line = line.strip()
+            if not line or line.startswith('#') or '=' not in line:
+                continue
+            key, value = line.split('=', 1)
+            baseline[key.strip()] = value.strip()
+    return baseline
+
+
+def write_baseline(baseline_file, test_name, speed, size):
+    """Record the current figures as the baseline of a test"""
+    def improvement(before, after):
+        return 100.0 * (before - after) / before if before else 0.0
+
+    total = speed['total']
+    with open(baseline_file, 'w') as f:
+        f.write(f"# metrics/{baseline_file.name}\n")
+        f.write(f"cycles_original={total['input']['cycles']}\n")
+        f.write(f"bytes_original={total['input']['bytes']}\n")
+        f.write(f"cycles_optimized={total['output']['cycles']}\n")
+        f.write(f"bytes_optimized={size['total']['output']['bytes']}\n")
+        f.write(f"weighted_cycles_optimized={total['output']['weighted_cycles']}\n")
+        f.write(f"improvement_cycles={improvement(total['input']['cycles'], total['output']['cycles']):.1f}%\n")
+        f.write(f"improvement_size={improvement(size['total']['input']['bytes'], size['total']['output']['bytes']):.1f}%\n")
+
+
+def check_report(report, mode):
+    """Check one report against the expected outcomes of its mode"""
+    problems = []
+    total = report['total']
+
+    if mode == 'speed' and total['output']['weighted_cycles'] > total['input']['weighted_cycles']:
+        problems.append(
+            f"speed: weighted cycles increased "
+            f"{total['input']['weighted_cycles']} -> {total['output']['weighted_cycles']}")
+    if mode == 'size' and total['output']['bytes'] > total['input']['bytes']:
+        problems.append(
+            f"size: bytes increased {total['input']['bytes']} -> {total['output']['bytes']}")
+
+    for routine in report['routines']:
+        before, after = routine['input'], routine['output']
+        if after['cycles'] > before['cycles'] and after['bytes'] > before['bytes']:
+            problems.append(
+                f"{mode}: routine {routine['name']} got slower and larger")
+
+    return problems
+
+
+def check_baseline(baseline, speed, size):
+    """Check the optimized figures against a recorded baseline"""
+    problems = []
+    limits = [
+        ('cycles_optimized', speed['total']['output']['cycles']),
+        ('weighted_cycles_optimized', speed['total']['output']['weighted_cycles']),
+        ('bytes_optimized', size['total']['output']['bytes']),
+    ]
+    for key, value in limits:
+        if key in baseline and value > int(baseline[key]):
+            problems.append(f"regression: {key}={value}, baseline {baseline[key]}")
+    return problems
+
+
+def run_performance_test(test_name, test_dir, opt6502, update):
+    """Run both modes on one input and validate the reports"""
+    input_asm = test_dir / 'input' / f'{test_name}.asm'
+    if not input_asm.exists():
+        print(f"✗ {test_name} - Input file not found: {input_asm}")
+        return False
+
+    output_dir = test_dir / 'output'
+    output_dir.mkdir(exist_ok=True)
+    cpu = cpu_for_test(test_name)
+
+    speed = run_report(opt6502, input_asm, output_dir, 'speed', cpu)
+    size = run_report(opt6502, input_asm, output_dir, 'size', cpu)
+    if not speed or not size:
+        print(f"✗ {test_name} FAILED - No report")
+        return False
+
+    problems = check_report(speed, 'speed') + check_report(size, 'size')
+
+    baseline_file = test_dir / 'metrics' / f'{test_name}_baseline.txt'
+    if update:
+        baseline_file.parent.mkdir(exist_ok=True)
+        write_baseline(baseline_file, test_name, speed, size)
+    elif baseline_file.exists():
+        problems += check_baseline(load_baseline(baseline_file), speed, size)
+
+    total = speed['total']
+    summary = (f"cycles {total['input']['cycles']} -> {total['output']['cycles']}, "
+               f"weighted {total['input']['weighted_cycles']} -> {total['output']['weighted_cycles']}, "
+               f"bytes {size['total']['input']['bytes']} -> {size['total']['output']['bytes']}")
+
+    if problems:
+        print(f"✗ {test_name} FAILED ({summary})")
+        for problem in problems:
+            print(f"  {problem}")
+        return False
+
+    print(f"✓ {test_name} PASSED ({summary})")
+    return True
+
+
+def main():
+    test_dir = Path(__file__).parent.resolve()
+    opt6502 = test_dir.parent.parent / 'opt6502'
+    if not opt6502.exists():
+        print(f"Error: opt6502 not found at {opt6502} (run make first)")
+        sys.exit(1)
+
+    args = sys.argv[1:]
+    update = '--update' in args
+    args = [a for a in args if a != '--update']
+
+    input_dir = test_dir / 'input'
+    if args:
+        test_cases = [args[0]]
+    else:
+        test_cases = sorted([f.stem for f in input_dir.glob('*.asm')])
+
+    if not test_cases:
+        print("No test cases found in input/")
+        sys.exit(0)
+
+    print("="*70)
+    print("Performance Validation Tests")
+    print("="*70)
+    print()
+
+    passed = 0
+    failed = 0
+
+    for test_case in test_cases:
+        if run_performance_test(test_case, test_dir, opt6502, update):
+            passed += 1
+        else:
+            failed += 1
+
+    print()
+    print("="*70)
+    print(f"Results: {passed} passed, {failed} failed")
+    print("="*70)
+
+    sys.exit(0 if failed == 0 else 1)
+
+
+if __name__ == '__main__':
+    main()
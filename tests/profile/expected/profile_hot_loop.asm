@@ -0,0 +1,64 @@
+; Optimized for speed
+; Assembler: Generic
+; Target CPU: 6502
+; Total optimizations: 3
+
+; Two copies of the same counted loop, each calling the same helper. The
+; profile shows DrawName hot: its loop is unrolled and its call to
+; SetColor inlined. DrawTitle ran once, so it is optimized for size and
+; keeps both its loop and its call.
+* = $1000
+
+Main:
+    JSR DrawTitle
+    LDY #$00
+@frame:
+    JSR DrawName
+    DEY
+    BNE @frame
+    RTS
+
+DrawTitle:
+    LDA #$01
+    JSR SetColor
+    LDX #$07
+@copy:
+    LDA title,X
+    STA $0400,X
+    DEX
+    BPL @copy
+    RTS
+
+DrawName:
+    LDA #$02
+    STA $D020
+    STA $D021
+    STA $D022
+@copy:
+    LDA name+7
+    STA $042F
+    LDA name+6
+    STA $042E
+    LDA name+5
+    STA $042D
+    LDA name+4
+    STA $042C
+    LDA name+3
+    STA $042B
+    LDA name+2
+    STA $042A
+    LDA name+1
+    STA $0429
+    LDA name
+    STA $0428
+    LDX #$FF
+    RTS
+
+SetColor:
+    STA $D020
+    STA $D021
+    STA $D022
+    RTS
+
+title: .byte "OPT6502!"
+name:  .byte "PROFILED"
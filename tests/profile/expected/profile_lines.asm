@@ -0,0 +1,39 @@
+; Optimized for speed
+; Assembler: Generic
+; Target CPU: 6502
+; Total optimizations: 2
+
+; A profile keyed by source line. Only the BPL of Main, line 10, ran
+; hot, so that loop is unrolled; the RTS after it and Clear are cold
+; and optimized for size.
+Main:
+@copy:
+    LDA name+7
+    STA $0407
+    LDA name+6
+    STA $0406
+    LDA name+5
+    STA $0405
+    LDA name+4
+    STA $0404
+    LDA name+3
+    STA $0403
+    LDA name+2
+    STA $0402
+    LDA name+1
+    STA $0401
+    LDA name
+    STA $0400
+    LDX #$FF
+    RTS
+
+Clear:
+    LDA #$20
+    LDX #$07
+@clear:
+    STA $0428,X
+    DEX
+    BPL @clear
+    RTS
+
+name: .byte "PROFILED"
@@ -0,0 +1,45 @@
+; Two copies of the same counted loop, each calling the same helper. The
+; profile shows DrawName hot: its loop is unrolled and its call to
+; SetColor inlined. DrawTitle ran once, so it is optimized for size and
+; keeps both its loop and its call.
+* = $1000
+
+Main:
+    JSR DrawTitle
+    LDY #$00
+@frame:
+    JSR DrawName
+    DEY
+    BNE @frame
+    RTS
+
+DrawTitle:
+    LDA #$01
+    JSR SetColor
+    LDX #$07
+@copy:
+    LDA title,X
+    STA $0400,X
+    DEX
+    BPL @copy
+    RTS
+
+DrawName:
+    LDA #$02
+    JSR SetColor
+    LDX #$07
+@copy:
+    LDA name,X
+    STA $0428,X
+    DEX
+    BPL @copy
+    RTS
+
+SetColor:
+    STA $D020
+    STA $D021
+    STA $D022
+    RTS
+
+title: .byte "OPT6502!"
+name:  .byte "PROFILED"
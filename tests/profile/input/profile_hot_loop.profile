@@ -0,0 +1,27 @@
+# Execution counts of profile_hot_loop (py65)
+$1000 1
+$1003 1
+$1005 256
+$1008 256
+$1009 256
+$100B 1
+$100C 1
+$100E 1
+$1011 1
+$1013 8
+$1016 8
+$1019 8
+$101A 8
+$101C 1
+$101D 256
+$101F 256
+$1022 256
+$1024 2048
+$1027 2048
+$102A 2048
+$102B 2048
+$102D 256
+$102E 257
+$1031 257
+$1034 257
+$1037 257
@@ -0,0 +1,22 @@
+; A profile keyed by source line. Only the BPL of Main, line 10, ran
+; hot, so that loop is unrolled; the RTS after it and Clear are cold
+; and optimized for size.
+Main:
+    LDX #$07
+@copy:
+    LDA name,X
+    STA $0400,X
+    DEX
+    BPL @copy
+    RTS
+
+Clear:
+    LDA #$20
+    LDX #$07
+@clear:
+    STA $0428,X
+    DEX
+    BPL @clear
+    RTS
+
+name: .byte "PROFILED"
@@ -0,0 +1,3 @@
+# Execution counts of profile_lines, by source line
+10 4096
+11 1
@@ -13,6 +13,12 @@ Usage:
 
     If test_name is provided, runs only that test.
     Otherwise, runs all tests in input/ directory.
+
+    python3 run_semantic_tests.py --profile test_name profile.txt
+
+    Runs the original code of test_name and writes how often each
+    address executed, for opt6502 -profile. Code is loaded at $1000, so
+    the input should start with * = $1000 for the addresses to match.
 """
 
 import sys
@@ -206,8 +212,8 @@ def compare_states(state1, state2, test_name, memory_addrs=None):
         return True
 
 
-def run_code_on_mpu(mpu, binary_file, load_addr=0x1000, max_cycles=10000):
-    """Load and execute binary on MPU"""
+def run_code_on_mpu(mpu, binary_file, load_addr=0x1000, max_cycles=10000, counts=None):
+    """Load and execute binary on MPU, counting executions per address into counts"""
     # Load binary into memory
     with open(binary_file, 'rb') as f:
         code = f.read()
@@ -221,6 +227,8 @@ def run_code_on_mpu(mpu, binary_file, load_addr=0x1000, max_cycles=10000):
     cycle_count = 0
     for _ in range(max_cycles):
         opcode = mpu.memory[mpu.pc]
+        if counts is not None:
+            counts[mpu.pc] = counts.get(mpu.pc, 0) + 1
 
         # Check for RTS (0x60)
         if opcode == 0x60:
@@ -335,9 +343,40 @@ def run_semantic_test(test_name, test_dir, cpu='6502'):
     return result
 
 
+def write_profile(test_name, test_dir, profile_file, cpu='6502'):
+    """Run the original code of a test and write its execution counts"""
+    input_asm = test_dir / 'input' / f'{test_name}.asm'
+    output_dir = test_dir / 'output'
+    output_dir.mkdir(exist_ok=True)
+    original_bin = output_dir / f'{test_name}_original.bin'
+    if not input_asm.exists() or not assemble_file(input_asm, original_bin, cpu):
+        print(f"✗ {test_name} - Failed to assemble original")
+        return False
+
+    mpu = MPU()
+    init_mpu(mpu, load_state_file(test_dir / 'state' / f'{test_name}_init.txt'))
+    counts = {}
+    if run_code_on_mpu(mpu, original_bin, counts=counts) is None:
+        print(f"✗ {test_name} - Original code did not complete")
+        return False
+
+    with open(profile_file, 'w') as f:
+        f.write(f"# Execution counts of {test_name} (py65)\n")
+        for addr in sorted(counts):
+            f.write(f"${addr:04X} {counts[addr]}\n")
+    print(f"Wrote {len(counts)} counts to {profile_file}")
+    return True
+
+
 def main():
     test_dir = Path(__file__).parent.resolve()
 
+    if len(sys.argv) > 1 and sys.argv[1] == '--profile':
+        if len(sys.argv) != 4:
+            print("Usage: run_semantic_tests.py --profile test_name profile.txt")
+            sys.exit(1)
+        sys.exit(0 if write_profile(sys.argv[2], test_dir, sys.argv[3]) else 1)
+
     # Check if opt6502 exists
     opt6502_path = test_dir.parent.parent / 'opt6502'
     if not opt6502_path.exists():
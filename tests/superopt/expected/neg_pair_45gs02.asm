@@ -0,0 +1,34 @@
+; Optimized for speed
+; Assembler: Generic
+; Target CPU: 45GS02
+; Total optimizations: 8
+
+; Superoptimizer: a negation may not be assembled right after NEG
+Main:
+    LDY #$10
+    LDA $FB
+    NEG
+Loop:
+    EOR #$FF
+    INC A
+    STA $0400,Y
+    NEG
+    STA $0500,Y
+    DEY
+    NEG
+    STA $0400,Y
+    NEG
+    STA $0500,Y
+    DEY
+    NEG
+    STA $0400,Y
+    NEG
+    STA $0500,Y
+    DEY
+    NEG
+    STA $0400,Y
+    NEG
+    STA $0500,Y
+    DEY
+    BNE Loop
+    RTS
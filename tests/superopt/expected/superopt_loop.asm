@@ -0,0 +1,39 @@
+; Optimized for speed
+; Assembler: Generic
+; Target CPU: 6502
+; Total optimizations: 8
+
+; Superoptimizer: cheaper equivalents of short sequences in a loop
+Main:
+    LDY #$10
+Loop:
+    LDX $FB
+    LDA $FC
+    ASL A
+    STA $0400,Y
+    TXA
+    STA $0500,Y
+    DEY
+    LDX $FB
+    LDA $FC
+    ASL A
+    STA $0400,Y
+    TXA
+    STA $0500,Y
+    DEY
+    LDX $FB
+    LDA $FC
+    ASL A
+    STA $0400,Y
+    TXA
+    STA $0500,Y
+    DEY
+    LDX $FB
+    LDA $FC
+    ASL A
+    STA $0400,Y
+    TXA
+    STA $0500,Y
+    DEY
+    BNE Loop
+    RTS
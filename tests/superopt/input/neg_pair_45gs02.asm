@@ -0,0 +1,15 @@
+; Superoptimizer: a negation may not be assembled right after NEG
+Main:
+    LDY #$10
+    LDA $FB
+    NEG
+Loop:
+    EOR #$FF
+    INC A
+    STA $0400,Y
+    EOR #$FF
+    INC A
+    STA $0500,Y
+    DEY
+    BNE Loop
+    RTS
@@ -0,0 +1,15 @@
+; Superoptimizer: cheaper equivalents of short sequences in a loop
+Main:
+    LDY #$10
+Loop:
+    LDA $FB
+    TAX
+    LDA $FC
+    CLC
+    ROL A
+    STA $0400,Y
+    TXA
+    STA $0500,Y
+    DEY
+    BNE Loop
+    RTS
@@ -0,0 +1,14 @@
+; Optimized for speed
+; Assembler: Generic
+; Target CPU: 6502
+; Total optimizations: 1
+
+; Lines longer than the old 256-byte read buffer and fields longer than
+; the old 63-byte label/operand limits must survive intact.
+; ------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+copy_the_title_screen_bitmap_from_the_cartridge_bank_into_video_memory:
+    LDA #<(title_screen_bitmap_source_address_in_cartridge_bank_three + bitmap_row_offset)   ; long comment long comment long comment long comment long comment long comment long comment long comment long comment long comment long comment long comment long comment long comment long comment long comment long comment long comment long comment long comment long comment long comment long comment long comment long comment 
+    STA $FB
+    STA $FC
+    RTS
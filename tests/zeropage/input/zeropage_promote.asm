@@ -0,0 +1,32 @@
+; Zero page promotion into the free bytes $FB-$FE. ptr already uses $FD,
+; which leaves no room for total; table and what follows it are skipped
+; since its address is taken.
+ptr = $FD
+
+Main:
+    LDX #$00
+loop:
+    LDA counter
+    CLC
+    ADC #$01
+    STA counter
+    LDA total
+    ADC #$00
+    STA total+1
+    INX
+    CPX #$10
+    BNE loop
+    LDA flag
+    STA $D020
+    LDA #<table
+    STA ptr
+    LDA #>table
+    STA ptr+1
+    RTS
+
+counter: .res 1
+total:   .res 2
+flag:
+    .res 1
+table:   .res 8
+cold:    .res 1
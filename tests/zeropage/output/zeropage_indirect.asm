@@ -0,0 +1,34 @@
+; Optimized for speed
+; Assembler: Generic
+; Target CPU: 6502
+; Total optimizations: 1
+
+; Zero page promotion must not take $FB-$FC, which the program already
+; reads as the pointer of LDA ($FB),Y
+Main:
+    LDY #$00
+loop:
+    LDA ($FB),Y
+    STA buffer
+    LDA buffer
+    STA $0400,Y
+    INY
+    LDA ($FB),Y
+    STA buffer
+    LDA buffer
+    STA $0400,Y
+    INY
+    LDA ($FB),Y
+    STA buffer
+    LDA buffer
+    STA $0400,Y
+    INY
+    LDA ($FB),Y
+    STA buffer
+    LDA buffer
+    STA $0400,Y
+    INY
+    BNE loop
+    RTS
+
+buffer: .res 1
@@ -0,0 +1,36 @@
+; Optimized for speed
+; Assembler: Generic
+; Target CPU: 6502
+; Total optimizations: 2
+
+counter = $FB	; zero page: 2 references, 2 cycles saved
+flag = $FC	; zero page: 1 references, 1 cycles saved
+; Zero page promotion into the free bytes $FB-$FE. ptr already uses $FD,
+; which leaves no room for total; table and what follows it are skipped
+; since its address is taken.
+ptr = $FD
+
+Main:
+    LDX #$00
+loop:
+    LDA counter
+    CLC
+    ADC #$01
+    STA counter
+    LDA total
+    ADC #$00
+    STA total+1
+    INX
+    CPX #$10
+    BNE loop
+    LDA flag
+    STA $D020
+    LDA #<table
+    STA ptr
+    LDA #>table
+    STA ptr+1
+    RTS
+
+total:   .res 2
+table:   .res 8
+cold:    .res 1